@@ -0,0 +1,310 @@
+// arena.h - scratch arenas and block pools for the staging buffers of the generation
+//
+// to create the implementation,
+//     #define ARENA_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// Only needs the C library and pthreads, so every other module can use it.
+//
+//
+// Documentation:
+//
+// MemoryArena *GetScratchArena(void)
+//
+// Arena of the calling thread, for the buffers that only live during a call
+// like the noise rows of a band. Its blocks are kept across calls, so once a
+// first generation warmed them up the next ones do not reach malloc. The
+// threads of parallel.h free theirs when they exit, other threads must call
+// FreeScratchArena before they do.
+//
+// void *ArenaAlloc(MemoryArena *arena, size_t size)
+// ArenaMark GetArenaMark(const MemoryArena *arena)
+// void RewindArena(MemoryArena *arena, ArenaMark mark)
+//
+// Allocates 'size' bytes aligned to ARENA_ALIGNMENT, which stay valid until
+// the arena is rewound to a mark taken before them. Take a mark on entry and
+// rewind to it on exit: a job run by WaitJob in between finishes before the
+// wait returns, so the marks of nested calls stay a stack.
+//
+// void InitMemoryPool(MemoryPool *pool, size_t blockSize)
+// void *AllocPoolBlock(MemoryPool *pool)
+// void FreePoolBlock(MemoryPool *pool, void *block)
+// void UnloadMemoryPool(MemoryPool *pool)
+// size_t GetMemoryPoolSize(MemoryPool *pool)
+//
+// Blocks of a single size, for buffers that outlive a call but come and go
+// all the time, like the CPU copy of a tile waiting for its upload. Freed
+// blocks go to a locked free list, so any thread can take or return them.
+// UnloadMemoryPool frees the blocks in the list, not the ones still out.
+// GetMemoryPoolSize returns the bytes of every block taken from malloc.
+//
+// ArenaStats GetArenaStats(void)
+//
+// Blocks the arenas and pools of every thread took from malloc, and the
+// bytes they hold now and at most, to check that regenerations reuse them.
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Enough for the AVX2 kernels of noise.h
+#define ARENA_ALIGNMENT 32
+
+// Smallest block an arena takes from malloc, larger allocations get a block of their own
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct MemoryArena {
+    ArenaBlock *first;
+    ArenaBlock *current;    // NULL before the first allocation
+} MemoryArena;
+
+typedef struct ArenaMark {
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+typedef struct MemoryPool {
+    pthread_mutex_t mutex;
+    size_t blockSize;
+    void *freeBlocks;
+    int freeCount;
+    int blockCount;         // Taken from malloc, in the list or out
+} MemoryPool;
+
+typedef struct ArenaStats {
+    long systemAllocs;      // Blocks taken from malloc since the start
+    long heldBytes;
+    long peakBytes;
+} ArenaStats;
+
+MemoryArena *GetScratchArena(void);
+void FreeScratchArena(void);
+
+void *ArenaAlloc(MemoryArena *arena, size_t size);
+ArenaMark GetArenaMark(const MemoryArena *arena);
+void RewindArena(MemoryArena *arena, ArenaMark mark);
+void FreeArena(MemoryArena *arena);
+
+void InitMemoryPool(MemoryPool *pool, size_t blockSize);
+void *AllocPoolBlock(MemoryPool *pool);
+void FreePoolBlock(MemoryPool *pool, void *block);
+void UnloadMemoryPool(MemoryPool *pool);
+size_t GetMemoryPoolSize(MemoryPool *pool);
+
+ArenaStats GetArenaStats(void);
+
+#endif // ARENA_H
+
+#ifdef ARENA_IMPLEMENTATION
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    unsigned char *data;    // Aligned start of the bytes after the header
+};
+
+static _Thread_local MemoryArena scratchArena = { 0 };
+
+static atomic_long arenaSystemAllocs = 0;
+static atomic_long arenaHeldBytes = 0;
+static atomic_long arenaPeakBytes = 0;
+
+static void *AllocArenaMemory(size_t size)
+{
+    void *memory = malloc(size);
+    if (memory == NULL)
+        return NULL;
+
+    atomic_fetch_add(&arenaSystemAllocs, 1);
+    long held = atomic_fetch_add(&arenaHeldBytes, (long)size) + (long)size;
+    long peak = atomic_load(&arenaPeakBytes);
+
+    while (held > peak && !atomic_compare_exchange_weak(&arenaPeakBytes, &peak, held))
+        ;
+
+    return memory;
+}
+
+static void FreeArenaMemory(void *memory, size_t size)
+{
+    if (memory == NULL)
+        return;
+
+    atomic_fetch_sub(&arenaHeldBytes, (long)size);
+    free(memory);
+}
+
+static size_t AlignArenaSize(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+MemoryArena *GetScratchArena(void)
+{
+    return &scratchArena;
+}
+
+void FreeScratchArena(void)
+{
+    FreeArena(&scratchArena);
+}
+
+void *ArenaAlloc(MemoryArena *arena, size_t size)
+{
+    size = AlignArenaSize(size > 0 ? size : 1);
+
+    ArenaBlock *block = arena->current;
+    if (block == NULL && arena->first != NULL) {
+        block = arena->current = arena->first;
+        block->used = 0;
+    }
+
+    // Blocks past the current one are left over from deeper calls, reused from the start
+    while (block != NULL && block->used + size > block->size) {
+        if (block->next == NULL) {
+            block = NULL;
+            break;
+        }
+
+        block = arena->current = block->next;
+        block->used = 0;
+    }
+
+    if (block == NULL) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        size_t bytes = sizeof(ArenaBlock) + ARENA_ALIGNMENT + capacity;
+
+        block = AllocArenaMemory(bytes);
+        if (block == NULL)
+            return NULL;
+
+        block->next = NULL;
+        block->size = capacity;
+        block->used = 0;
+        block->data = (unsigned char *)AlignArenaSize((uintptr_t)(block + 1));
+
+        if (arena->current != NULL)
+            arena->current->next = block;
+        else
+            arena->first = block;
+
+        arena->current = block;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+
+    return memory;
+}
+
+ArenaMark GetArenaMark(const MemoryArena *arena)
+{
+    ArenaMark mark = { arena->current, arena->current != NULL ? arena->current->used : 0 };
+    return mark;
+}
+
+void RewindArena(MemoryArena *arena, ArenaMark mark)
+{
+    arena->current = mark.block;
+
+    if (mark.block != NULL)
+        mark.block->used = mark.used;
+}
+
+void FreeArena(MemoryArena *arena)
+{
+    ArenaBlock *block = arena->first;
+
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        FreeArenaMemory(block, sizeof(ArenaBlock) + ARENA_ALIGNMENT + block->size);
+        block = next;
+    }
+
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+void InitMemoryPool(MemoryPool *pool, size_t blockSize)
+{
+    pthread_mutex_init(&pool->mutex, NULL);
+    pool->blockSize = AlignArenaSize(blockSize > sizeof(void *) ? blockSize : sizeof(void *));
+    pool->freeBlocks = NULL;
+    pool->freeCount = 0;
+    pool->blockCount = 0;
+}
+
+void *AllocPoolBlock(MemoryPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    void *block = pool->freeBlocks;
+    if (block != NULL) {
+        pool->freeBlocks = *(void **)block;
+        pool->freeCount--;
+    }
+    else {
+        block = AllocArenaMemory(pool->blockSize);
+        pool->blockCount += block != NULL;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return block;
+}
+
+void FreePoolBlock(MemoryPool *pool, void *block)
+{
+    if (block == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    *(void **)block = pool->freeBlocks;
+    pool->freeBlocks = block;
+    pool->freeCount++;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void UnloadMemoryPool(MemoryPool *pool)
+{
+    while (pool->freeBlocks != NULL) {
+        void *block = pool->freeBlocks;
+        pool->freeBlocks = *(void **)block;
+        FreeArenaMemory(block, pool->blockSize);
+    }
+
+    pool->freeCount = 0;
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+size_t GetMemoryPoolSize(MemoryPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    size_t size = pool->blockCount * pool->blockSize;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return size;
+}
+
+ArenaStats GetArenaStats(void)
+{
+    ArenaStats stats = {
+        .systemAllocs = atomic_load(&arenaSystemAllocs),
+        .heldBytes = atomic_load(&arenaHeldBytes),
+        .peakBytes = atomic_load(&arenaPeakBytes),
+    };
+
+    return stats;
+}
+
+#endif // ARENA_IMPLEMENTATION
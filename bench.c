@@ -0,0 +1,1928 @@
+// terragen_bench - headless benchmarks of the planet generation
+//
+// Only needs the raylib headers, not the library or a GPU:
+//     cc -O2 bench.c -o terragen_bench -lm -lpthread
+//
+// Modes:
+//     sweep    generate planets for every slices/octaves pair, one process per
+//              pair so the peak memory is measured on its own (default)
+//     threads  time the vertex pass for 1, 2, 4, ... threads and check it
+//              against the serial output
+//     bake     pixels/sec baking the height, color and normal maps of
+//              export.h for 1, 2, 4, ... threads, checked against the serial
+//              maps
+//     erosion  droplets/sec and thermal passes/sec of erosion.h on 512, 1024
+//              and 2048 wide height fields for 1, 2, 4, ... threads, checked
+//              against the serial field
+//     jobs     jobs/sec and scheduling overhead of the job system of
+//              parallel.h against a pool with a single locked queue, for 1,
+//              2, 4, ... threads
+//     noise    points/sec of the scalar, SSE2 and AVX2 fBm kernels
+//     deriv    points/sec of the fBm value and gradient, from forward
+//              differences against the analytic derivative
+//     topology triangles the cube sphere and the icosphere need to match the
+//              geometric error of the UV sphere at each slice count
+//     cache    startup from scratch against loading a cache saved with
+//              SavePlanetCache, at each slice count
+//     layout   regeneration time over a sweep of octaves and scales at a
+//              fixed slice count, with the directions and indices built from
+//              scratch for each planet against taken from LoadSphereLayout
+//     shadow   refits of every shadow cascade of shadow.h over a full turn of
+//              the orbital camera, at a few distances from the planet
+//     backend  points/sec of the fBm of every backend of noise.h on every
+//              kernel, and the mean, deviation, range and isotropy of a
+//              single octave of each
+//     graph    points/sec of the fBm against the same fBm as a noise graph,
+//              which must match it, and against the graph of --graph
+//              (continents.graph by default)
+//     alloc    mallocs and peak memory of regenerating the planet with new
+//              noise parameters, and of streaming level of detail tiles
+//              through malloc against the MemoryPool of arena.h, each in its
+//              own process
+//
+// --graph also replaces the fBm of the planets in the other modes.
+//
+// --slices sets the longitude and latitude slices of the UV sphere, or the
+// subdivisions of the cube sphere and the icosphere picked with --topology.
+//
+// Results are printed as CSV, or JSON with --json.
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// Every RL_MALLOC of the modules goes through these, so that the alloc mode can count them
+static atomic_long benchAllocs = 0;
+
+static void *CountMalloc(size_t size)
+{
+    atomic_fetch_add(&benchAllocs, 1);
+    return malloc(size);
+}
+
+static void *CountCalloc(size_t count, size_t size)
+{
+    atomic_fetch_add(&benchAllocs, 1);
+    return calloc(count, size);
+}
+
+#define RL_MALLOC(size) CountMalloc(size)
+#define RL_CALLOC(count, size) CountCalloc(count, size)
+
+#include <raylib.h>
+#include <raymath.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define STB_PERLIN_IMPLEMENTATION
+#include "stb_perlin.h"
+
+#define NOISE_IMPLEMENTATION
+#include "noise.h"
+
+#define ARENA_IMPLEMENTATION
+#include "arena.h"
+
+#define NOISE_GRAPH_IMPLEMENTATION
+#include "noisegraph.h"
+
+#define PARALLEL_IMPLEMENTATION
+#include "parallel.h"
+
+#define EROSION_IMPLEMENTATION
+#include "erosion.h"
+
+#define PLANET_IMPLEMENTATION
+#include "planet.h"
+
+#define CACHE_IMPLEMENTATION
+#include "cache.h"
+
+#define EXPORT_IMPLEMENTATION
+#include "export.h"
+
+// Only the fitting of the cascades, the bench has no GL context
+#define SHADOW_IMPLEMENTATION
+#define SHADOW_FIT_ONLY
+#include "shadow.h"
+
+#define MAX_SWEEP 32
+
+typedef struct BenchOptions {
+    PlanetParams planet;
+    int threads;
+    int runs;
+    bool json;
+    const char *cachePath;
+    const char *graphPath;
+
+    int slices[MAX_SWEEP];
+    int sliceCount;
+    int octaves[MAX_SWEEP];
+    int octaveCount;
+} BenchOptions;
+
+typedef struct BenchResult {
+    int vertexCount;
+    int triangleCount;
+    int chunkCount;
+    double bestTime;
+    double meanTime;
+    double regenerateTime;
+    size_t meshBytes;
+} BenchResult;
+
+// How far the flat triangles of an undisplaced planet stray from the sphere
+typedef struct SphereError {
+    float maxSag;       // Largest gap between a triangle and the unit sphere
+    float maxEdge;      // Longest edge on the unit sphere, the noise sampling step
+} SphereError;
+
+static int ParseList(const char *text, int *values, int max)
+{
+    int count = 0;
+
+    while (*text != '\0' && count < max) {
+        char *end;
+        values[count++] = strtol(text, &end, 10);
+
+        if (*end != ',')
+            break;
+
+        text = end + 1;
+    }
+
+    return count;
+}
+
+static void SetPlanetSlices(PlanetParams *planet, int slices)
+{
+    planet->longitudeSlices = planet->latitudeSlices = slices;
+    planet->subdivisions = slices;
+}
+
+#define MAX_FIELDS 16
+
+// One row of results, printed as a CSV line or a JSON object
+typedef struct Record {
+    int count;
+    const char *keys[MAX_FIELDS];
+    char values[MAX_FIELDS][32];
+    bool quoted[MAX_FIELDS];
+} Record;
+
+static void AddField(Record *record, const char *key, bool quoted, const char *format, ...)
+{
+    if (record->count == MAX_FIELDS)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(record->values[record->count], sizeof(record->values[0]), format, args);
+    va_end(args);
+
+    record->keys[record->count] = key;
+    record->quoted[record->count] = quoted;
+    record->count++;
+}
+
+static void PrintRecord(const Record *record, bool json, bool first)
+{
+    if (json) {
+        printf("%s  {", first ? "" : ",\n");
+        for (int i = 0; i < record->count; i++) {
+            const char *quote = record->quoted[i] ? "\"" : "";
+            printf("%s\"%s\": %s%s%s", i > 0 ? ", " : "", record->keys[i], quote, record->values[i], quote);
+        }
+        printf("}");
+        return;
+    }
+
+    if (first) {
+        for (int i = 0; i < record->count; i++)
+            printf("%s%s", i > 0 ? "," : "", record->keys[i]);
+        printf("\n");
+    }
+
+    for (int i = 0; i < record->count; i++)
+        printf("%s%s", i > 0 ? "," : "", record->values[i]);
+    printf("\n");
+}
+
+static void BeginRecords(bool json)
+{
+    if (json)
+        printf("[\n");
+}
+
+static void EndRecords(bool json)
+{
+    if (json)
+        printf("\n]\n");
+
+    fflush(stdout);
+}
+
+static BenchResult RunGeneration(PlanetParams planet, int threads, int runs)
+{
+    BenchResult result = { 0 };
+    WorkerPool *pool = LoadWorkerPool(threads);
+
+    // From scratch every run, the layout mode measures what the cache of LoadSphereLayout saves
+    for (int run = 0; run < runs; run++) {
+        UnloadSphereLayoutCache();
+
+        double start = GetWallTime();
+        ChunkedMesh mesh = GeneratePlanetMesh(pool, planet);
+        double elapsed = GetWallTime() - start;
+
+        if (run == 0 || elapsed < result.bestTime)
+            result.bestTime = elapsed;
+        result.meanTime += elapsed / runs;
+
+        result.vertexCount = mesh.vertexCount;
+        result.triangleCount = mesh.triangleCount;
+        result.chunkCount = mesh.chunkCount;
+        result.meshBytes = GetChunkedMeshSize(mesh);
+
+        FreeChunkedMesh(mesh);
+    }
+
+    // Parameter edits reuse the layout and the buffers, like the viewer does
+    SphereLayout *layout = LoadSphereLayout(pool, planet);
+    ChunkedMesh mesh = AllocChunkedMesh(layout);
+
+    for (int run = 0; run < runs; run++) {
+        double start = GetWallTime();
+        GeneratePlanetVertices(pool, &layout->directions, &mesh, planet);
+        double elapsed = GetWallTime() - start;
+
+        if (run == 0 || elapsed < result.regenerateTime)
+            result.regenerateTime = elapsed;
+    }
+
+    FreeChunkedMesh(mesh);
+    UnloadSphereLayout(layout);
+    UnloadSphereLayoutCache();
+
+    UnloadWorkerPool(pool);
+    return result;
+}
+
+static void RunSweep(BenchOptions options)
+{
+    int threads = options.threads > 0 ? options.threads : GetHardwareThreads();
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int s = 0; s < options.sliceCount; s++) {
+        for (int o = 0; o < options.octaveCount; o++) {
+            PlanetParams planet = options.planet;
+            SetPlanetSlices(&planet, options.slices[s]);
+            planet.octaves = options.octaves[o];
+
+            int channel[2];
+            if (pipe(channel) != 0) {
+                perror("pipe");
+                exit(1);
+            }
+
+            // Each run in its own process, so ru_maxrss is the peak of this run alone
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(channel[0]);
+                BenchResult result = RunGeneration(planet, threads, options.runs);
+                write(channel[1], &result, sizeof(result));
+                _exit(0);
+            }
+
+            close(channel[1]);
+
+            BenchResult result = { 0 };
+            bool ok = read(channel[0], &result, sizeof(result)) == sizeof(result);
+            close(channel[0]);
+
+            int status;
+            struct rusage usage = { 0 };
+            wait4(pid, &status, 0, &usage);
+
+            if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "generation failed for %d slices, %d octaves\n", options.slices[s], options.octaves[o]);
+                continue;
+            }
+
+            Record record = { 0 };
+            AddField(&record, "topology", true, "%s", GetPlanetTopologyName(planet.topology));
+            AddField(&record, "slices", false, "%d", options.slices[s]);
+            AddField(&record, "octaves", false, "%d", options.octaves[o]);
+            AddField(&record, "threads", false, "%d", threads);
+            AddField(&record, "chunks", false, "%d", result.chunkCount);
+            AddField(&record, "vertices", false, "%d", result.vertexCount);
+            AddField(&record, "triangles", false, "%d", result.triangleCount);
+            AddField(&record, "best_ms", false, "%.3f", result.bestTime * 1000);
+            AddField(&record, "mean_ms", false, "%.3f", result.meanTime * 1000);
+            AddField(&record, "vertices_per_sec", false, "%.0f", result.vertexCount / result.bestTime);
+            AddField(&record, "regenerate_ms", false, "%.3f", result.regenerateTime * 1000);
+            AddField(&record, "mesh_bytes", false, "%zu", result.meshBytes);
+            AddField(&record, "peak_rss_kb", false, "%ld", usage.ru_maxrss);
+
+            PrintRecord(&record, options.json, first);
+            first = false;
+        }
+    }
+
+    EndRecords(options.json);
+}
+
+// Times the vertex pass for power of two thread counts up to the hardware
+// threads, checking that every run matches the serial output
+static void RunThreads(BenchOptions options)
+{
+    PlanetParams planet = options.planet;
+    int maxThreads = options.threads > 0 ? options.threads : GetHardwareThreads();
+
+    SphereLayout *layout = LoadSphereLayout(NULL, planet);
+    const SphereDirections *directions = &layout->directions;
+
+    ChunkedMesh reference = AllocChunkedMesh(layout);
+    ChunkedMesh mesh = AllocChunkedMesh(layout);
+
+    GeneratePlanetVertices(NULL, directions, &reference, planet);
+
+    double serial = 0;
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > maxThreads)
+            threads = maxThreads;
+
+        WorkerPool *pool = LoadWorkerPool(threads);
+
+        double best = 0;
+        for (int run = 0; run < options.runs; run++) {
+            double start = GetWallTime();
+            GeneratePlanetVertices(pool, directions, &mesh, planet);
+            double elapsed = GetWallTime() - start;
+
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        UnloadWorkerPool(pool);
+
+        if (threads == 1)
+            serial = best;
+
+        Record record = { 0 };
+        AddField(&record, "topology", true, "%s", GetPlanetTopologyName(planet.topology));
+        AddField(&record, "slices", false, "%d", planet.longitudeSlices);
+        AddField(&record, "octaves", false, "%d", planet.octaves);
+        AddField(&record, "vertices", false, "%d", mesh.vertexCount);
+        AddField(&record, "threads", false, "%d", threads);
+        AddField(&record, "best_ms", false, "%.3f", best * 1000);
+        AddField(&record, "speedup", false, "%.2f", serial / best);
+        AddField(&record, "identical", false, "%s", ChunkedMeshEquals(mesh, reference) ? "true" : "false");
+
+        PrintRecord(&record, options.json, first);
+        first = false;
+
+        if (threads == maxThreads)
+            break;
+    }
+
+    EndRecords(options.json);
+
+    FreeChunkedMesh(reference);
+    FreeChunkedMesh(mesh);
+    UnloadSphereLayout(layout);
+    UnloadSphereLayoutCache();
+}
+
+// Pixels/sec baking the 2048x1024 maps of export.h in 64 pixel tiles, for
+// 1, 2, 4, ... threads, checked against the serial maps
+static void RunBake(BenchOptions options)
+{
+    const int width = 2048;
+    const int height = 1024;
+    const int tileSize = 64;
+
+    PlanetParams planet = options.planet;
+    int maxThreads = options.threads > 0 ? options.threads : GetHardwareThreads();
+
+    PlanetMaps reference = AllocPlanetMaps(width, height);
+    PlanetMaps maps = AllocPlanetMaps(width, height);
+    BakePlanetMaps(NULL, planet, tileSize, &reference);
+
+    double serial = 0;
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > maxThreads)
+            threads = maxThreads;
+
+        WorkerPool *pool = LoadWorkerPool(threads);
+
+        double best = 0;
+        for (int run = 0; run < options.runs; run++) {
+            double start = GetWallTime();
+            BakePlanetMaps(pool, planet, tileSize, &maps);
+            double elapsed = GetWallTime() - start;
+
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        UnloadWorkerPool(pool);
+
+        if (threads == 1)
+            serial = best;
+
+        bool identical = memcmp(maps.heights, reference.heights, width * height * sizeof(float)) == 0
+            && memcmp(maps.colors, reference.colors, width * height * sizeof(Color)) == 0
+            && memcmp(maps.normals, reference.normals, width * height * 3) == 0;
+
+        Record record = { 0 };
+        AddField(&record, "width", false, "%d", width);
+        AddField(&record, "height", false, "%d", height);
+        AddField(&record, "tile", false, "%d", tileSize);
+        AddField(&record, "octaves", false, "%d", planet.octaves);
+        AddField(&record, "threads", false, "%d", threads);
+        AddField(&record, "best_ms", false, "%.3f", best * 1000);
+        AddField(&record, "pixels_per_sec", false, "%.0f", width * height / best);
+        AddField(&record, "speedup", false, "%.2f", serial / best);
+        AddField(&record, "efficiency", false, "%.2f", serial / best / threads);
+        AddField(&record, "identical", false, "%s", identical ? "true" : "false");
+
+        PrintRecord(&record, options.json, first);
+        first = false;
+
+        if (threads == maxThreads)
+            break;
+    }
+
+    EndRecords(options.json);
+
+    FreePlanetMaps(reference);
+    FreePlanetMaps(maps);
+}
+
+// Times the droplets and the thermal passes of erosion.h apart, on a copy of the same field
+static void TimeErosion(WorkerPool *pool, HeightField base, HeightField *field, ErosionSettings settings, int runs, double *hydraulic, double *thermal)
+{
+    ErosionSettings droplets = settings;
+    ErosionSettings slopes = settings;
+    droplets.thermalIterations = 0;
+    slopes.droplets = 0;
+
+    for (int run = 0; run < runs; run++) {
+        memcpy(field->heights, base.heights, base.width * base.height * sizeof(float));
+
+        double start = GetWallTime();
+        ErodeHeightField(pool, field, droplets);
+        double middle = GetWallTime();
+        ErodeHeightField(pool, field, slopes);
+        double end = GetWallTime();
+
+        if (run == 0 || middle - start < *hydraulic)
+            *hydraulic = middle - start;
+
+        if (run == 0 || end - middle < *thermal)
+            *thermal = end - middle;
+    }
+}
+
+// Droplets/sec and thermal passes/sec of the erosion at each field size for
+// 1, 2, 4, ... threads, checked against the serial field
+static void RunErosion(BenchOptions options)
+{
+    const int resolutions[] = { 512, 1024, 2048 };
+    const int thermalIterations = 50;
+
+    PlanetParams planet = options.planet;
+    int maxThreads = options.threads > 0 ? options.threads : GetHardwareThreads();
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int r = 0; r < (int)(sizeof(resolutions) / sizeof(resolutions[0])); r++) {
+        // One droplet for every 8 cells
+        ErosionSettings settings = GetDefaultErosionSettings();
+        settings.resolution = resolutions[r];
+        settings.droplets = resolutions[r] * resolutions[r] / 2 / 8;
+        settings.thermalIterations = thermalIterations;
+
+        HeightField base = BakePlanetHeightField(NULL, planet, settings.resolution);
+        HeightField reference = AllocHeightField(base.width, base.height, base.cellSize);
+        HeightField field = AllocHeightField(base.width, base.height, base.cellSize);
+
+        double serialHydraulic = 0;
+        double serialThermal = 0;
+        TimeErosion(NULL, base, &reference, settings, 1, &serialHydraulic, &serialThermal);
+
+        for (int threads = 1; ; threads *= 2) {
+            if (threads > maxThreads)
+                threads = maxThreads;
+
+            WorkerPool *pool = LoadWorkerPool(threads);
+
+            double hydraulic = 0;
+            double thermal = 0;
+            TimeErosion(pool, base, &field, settings, options.runs, &hydraulic, &thermal);
+
+            UnloadWorkerPool(pool);
+
+            if (threads == 1) {
+                serialHydraulic = hydraulic;
+                serialThermal = thermal;
+            }
+
+            bool identical = memcmp(field.heights, reference.heights, base.width * base.height * sizeof(float)) == 0;
+
+            Record record = { 0 };
+            AddField(&record, "width", false, "%d", base.width);
+            AddField(&record, "height", false, "%d", base.height);
+            AddField(&record, "droplets", false, "%d", settings.droplets);
+            AddField(&record, "thermal_iterations", false, "%d", settings.thermalIterations);
+            AddField(&record, "threads", false, "%d", threads);
+            AddField(&record, "droplets_ms", false, "%.3f", hydraulic * 1000);
+            AddField(&record, "thermal_ms", false, "%.3f", thermal * 1000);
+            AddField(&record, "droplets_per_sec", false, "%.0f", settings.droplets / hydraulic);
+            AddField(&record, "thermal_iterations_per_sec", false, "%.1f", settings.thermalIterations / thermal);
+            AddField(&record, "droplets_speedup", false, "%.2f", serialHydraulic / hydraulic);
+            AddField(&record, "thermal_speedup", false, "%.2f", serialThermal / thermal);
+            AddField(&record, "identical", false, "%s", identical ? "true" : "false");
+
+            PrintRecord(&record, options.json, first);
+            first = false;
+
+            if (threads == maxThreads)
+                break;
+        }
+
+        FreeHeightField(base);
+        FreeHeightField(reference);
+        FreeHeightField(field);
+    }
+
+    EndRecords(options.json);
+}
+
+// Baseline for the jobs mode: one locked queue that every worker takes from
+typedef struct NaivePool NaivePool;
+
+typedef struct NaiveTask {
+    void (*func)(NaivePool *pool, int arg);
+    int arg;
+} NaiveTask;
+
+struct NaivePool {
+    pthread_t *threads;
+    int threadCount;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    NaiveTask *tasks;
+    int taskCount;
+    int taskCapacity;
+    int pending;        // Queued or running
+    bool quit;
+};
+
+static void PushNaiveTask(NaivePool *pool, void (*func)(NaivePool *pool, int arg), int arg)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->taskCount == pool->taskCapacity) {
+        pool->taskCapacity = pool->taskCapacity > 0 ? pool->taskCapacity * 2 : 1024;
+        pool->tasks = realloc(pool->tasks, pool->taskCapacity * sizeof(NaiveTask));
+    }
+
+    pool->tasks[pool->taskCount++] = (NaiveTask){ func, arg };
+    pool->pending++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void *NaivePoolMain(void *arg)
+{
+    NaivePool *pool = arg;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (;;) {
+        while (!pool->quit && pool->taskCount == 0)
+            pthread_cond_wait(&pool->work, &pool->mutex);
+
+        if (pool->quit)
+            break;
+
+        NaiveTask task = pool->tasks[--pool->taskCount];
+        pthread_mutex_unlock(&pool->mutex);
+
+        task.func(pool, task.arg);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->done);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+static NaivePool *LoadNaivePool(int threads)
+{
+    NaivePool *pool = calloc(1, sizeof(NaivePool));
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    pool->threadCount = threads;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < threads; i++)
+        pthread_create(&pool->threads[i], NULL, NaivePoolMain, pool);
+
+    return pool;
+}
+
+static void WaitNaivePool(NaivePool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void UnloadNaivePool(NaivePool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->threadCount; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+
+    free(pool->tasks);
+    free(pool->threads);
+    free(pool);
+}
+
+// Work of a single job in the jobs mode, in steps of a few ns each
+static int jobWork = 0;
+static atomic_uint jobSink;
+
+static void DoJobWork(int seed)
+{
+    unsigned int x = seed;
+
+    for (int i = 0; i < jobWork; i++)
+        x = x * 1664525u + 1013904223u;
+
+    atomic_fetch_add_explicit(&jobSink, x, memory_order_relaxed);
+}
+
+// A job of 'count' spawns two children sharing count - 1 between them, so
+// the jobs fan out from a single one like the splits of WorkerPoolFor
+static void RunTreeJob(WorkerPool *pool, Job *job, void *data)
+{
+    int count = (int)(intptr_t)data;
+
+    if (count > 1)
+        RunJob(pool, CreateJob(pool, job, RunTreeJob, (void *)(intptr_t)(count / 2)));
+    if (count > 2)
+        RunJob(pool, CreateJob(pool, job, RunTreeJob, (void *)(intptr_t)(count - 1 - count / 2)));
+
+    DoJobWork(count);
+}
+
+static void RunNaiveTreeTask(NaivePool *pool, int count)
+{
+    if (count > 1)
+        PushNaiveTask(pool, RunNaiveTreeTask, count / 2);
+    if (count > 2)
+        PushNaiveTask(pool, RunNaiveTreeTask, count - 1 - count / 2);
+
+    DoJobWork(count);
+}
+
+// Children of an empty root, submitted one by one like the tasks of the naive pool
+static void RunFlatJob(WorkerPool *pool, Job *job, void *data)
+{
+    (void)pool;
+    (void)job;
+    DoJobWork((int)(intptr_t)data);
+}
+
+static void RunEmptyJob(WorkerPool *pool, Job *job, void *data)
+{
+    (void)pool;
+    (void)job;
+    (void)data;
+}
+
+static void RunNaiveFlatTask(NaivePool *pool, int index)
+{
+    (void)pool;
+    DoJobWork(index);
+}
+
+// Jobs/sec of the job system of parallel.h against a single locked queue,
+// for jobs spawning jobs (tree) and jobs the caller submits one by one (flat),
+// with empty jobs and with about a microsecond of work each. The overhead is
+// the thread time per job beyond its work
+static void RunJobs(BenchOptions options)
+{
+    const int count = 1 << 18;
+    const int works[] = { 0, 256 };
+    const char *workloads[] = { "tree", "flat" };
+
+    int maxThreads = options.threads > 0 ? options.threads : GetHardwareThreads();
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int w = 0; w < (int)(sizeof(works) / sizeof(works[0])); w++) {
+        jobWork = works[w];
+
+        double start = GetWallTime();
+        for (int i = 0; i < count; i++)
+            DoJobWork(i);
+        double work = (GetWallTime() - start) / count;
+
+        for (int workload = 0; workload < 2; workload++) {
+            for (int threads = 1; ; threads *= 2) {
+                if (threads > maxThreads)
+                    threads = maxThreads;
+
+                for (int naive = 0; naive < 2; naive++) {
+                    // The naive pool's caller only waits, so it gets all the threads as workers
+                    WorkerPool *pool = naive ? NULL : LoadWorkerPool(threads);
+                    NaivePool *naivePool = naive ? LoadNaivePool(threads) : NULL;
+
+                    double best = 0;
+                    for (int run = 0; run < options.runs; run++) {
+                        double begin = GetWallTime();
+
+                        if (naive && workload == 0)
+                            PushNaiveTask(naivePool, RunNaiveTreeTask, count);
+                        else if (naive) {
+                            for (int i = 0; i < count; i++)
+                                PushNaiveTask(naivePool, RunNaiveFlatTask, i);
+                        }
+                        else if (workload == 0) {
+                            Job *root = CreateJob(pool, NULL, RunTreeJob, (void *)(intptr_t)count);
+                            RunJob(pool, root);
+                            WaitJob(pool, root);
+                        }
+                        else {
+                            // Not WorkerPoolFor, which runs inline on a single thread pool
+                            Job *root = CreateJob(pool, NULL, RunEmptyJob, NULL);
+                            for (int i = 0; i < count; i++)
+                                RunJob(pool, CreateJob(pool, root, RunFlatJob, (void *)(intptr_t)i));
+                            RunJob(pool, root);
+                            WaitJob(pool, root);
+                        }
+
+                        if (naive)
+                            WaitNaivePool(naivePool);
+
+                        double elapsed = GetWallTime() - begin;
+                        if (run == 0 || elapsed < best)
+                            best = elapsed;
+                    }
+
+                    if (naive)
+                        UnloadNaivePool(naivePool);
+                    else
+                        UnloadWorkerPool(pool);
+
+                    double perJob = best / count;
+
+                    Record record = { 0 };
+                    AddField(&record, "scheduler", true, "%s", naive ? "mutex_queue" : "work_stealing");
+                    AddField(&record, "workload", true, "%s", workloads[workload]);
+                    AddField(&record, "work_ns", false, "%.1f", work * 1e9);
+                    AddField(&record, "threads", false, "%d", threads);
+                    AddField(&record, "jobs", false, "%d", count);
+                    AddField(&record, "best_ms", false, "%.3f", best * 1000);
+                    AddField(&record, "jobs_per_sec", false, "%.0f", 1 / perJob);
+                    AddField(&record, "overhead_ns", false, "%.1f", fmax(perJob * threads - work, 0) * 1e9);
+
+                    PrintRecord(&record, options.json, first);
+                    first = false;
+                }
+
+                if (threads == maxThreads)
+                    break;
+            }
+        }
+    }
+
+    EndRecords(options.json);
+}
+
+// Compares the batched fBm kernels against the scalar stb_perlin_fbm_noise3
+static void RunNoise(BenchOptions options)
+{
+    const char *names[] = { "scalar", "sse2", "avx2" };
+    const int count = 1 << 18;
+    const int octaves = options.planet.octaves;
+
+    float *points = (float *)RL_MALLOC(count * 5 * sizeof(float));
+    float *x = points;
+    float *y = points + count;
+    float *z = points + count * 2;
+    float *reference = points + count * 3;
+    float *out = points + count * 4;
+
+    // Points on a sphere like the ones the generator samples
+    for (int i = 0; i < count; i++) {
+        float theta = 2 * PI * i / count * 97;
+        float phi = PI * i / count;
+        x[i] = 2.5f * sinf(phi) * cosf(theta);
+        y[i] = 2.5f * sinf(phi) * sinf(theta);
+        z[i] = 2.5f * cosf(phi);
+        reference[i] = stb_perlin_fbm_noise3(x[i], y[i], z[i], 2, 0.5f, octaves);
+    }
+
+    bool first = true;
+    BeginRecords(options.json);
+
+    for (int simd = STB_PERLIN_SIMD_SCALAR; simd <= stb_perlin_simd_support(); simd++) {
+        double best = 0;
+        for (int run = 0; run < options.runs; run++) {
+            double start = GetWallTime();
+            stb_perlin_fbm_noise3_batch_simd(simd, x, y, z, out, count, 2, 0.5f, octaves);
+            double elapsed = GetWallTime() - start;
+
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        float error = 0;
+        for (int i = 0; i < count; i++)
+            error = fmaxf(error, fabsf(out[i] - reference[i]));
+
+        Record record = { 0 };
+        AddField(&record, "kernel", true, "%s", names[simd]);
+        AddField(&record, "octaves", false, "%d", octaves);
+        AddField(&record, "points_per_sec", false, "%.0f", count / best);
+        AddField(&record, "max_error", false, "%g", error);
+
+        PrintRecord(&record, options.json, first);
+        first = false;
+    }
+
+    EndRecords(options.json);
+
+    RL_FREE(points);
+}
+
+#define DIFFERENCE_STEP 1e-3f
+
+// Value and gradient of the fBm at every point, from three extra samples
+// offset by DIFFERENCE_STEP, or analytically when 'analytic' is set
+static void ComputeNoiseGradients(bool analytic, int simd, const float **points, float *out, float **gradient, float *shifted, float *sample, int count, int octaves)
+{
+    if (analytic) {
+        stb_perlin_fbm_noise3_deriv_batch_simd(simd, points[0], points[1], points[2], out, gradient[0], gradient[1], gradient[2], count, 2, 0.5f, octaves);
+        return;
+    }
+
+    stb_perlin_fbm_noise3_batch_simd(simd, points[0], points[1], points[2], out, count, 2, 0.5f, octaves);
+
+    for (int axis = 0; axis < 3; axis++) {
+        const float *offset[3] = { points[0], points[1], points[2] };
+        offset[axis] = shifted;
+
+        for (int i = 0; i < count; i++)
+            shifted[i] = points[axis][i] + DIFFERENCE_STEP;
+
+        stb_perlin_fbm_noise3_batch_simd(simd, offset[0], offset[1], offset[2], sample, count, 2, 0.5f, octaves);
+
+        for (int i = 0; i < count; i++)
+            gradient[axis][i] = (sample[i] - out[i]) / DIFFERENCE_STEP;
+    }
+}
+
+// Compares forward differences, which take 4 fBm evaluations per point,
+// with the analytic gradient, for the scalar and the best SIMD kernel
+static void RunDeriv(BenchOptions options)
+{
+    const char *names[] = { "scalar", "sse2", "avx2" };
+    const int count = 1 << 16;
+    const int octaves = options.planet.octaves;
+
+    float *buffer = (float *)RL_MALLOC(count * 12 * sizeof(float));
+    float *x = buffer;
+    float *y = buffer + count;
+    float *z = buffer + count * 2;
+    float *out = buffer + count * 3;
+    float *gradient[3] = { buffer + count * 4, buffer + count * 5, buffer + count * 6 };
+    float *reference[3] = { buffer + count * 7, buffer + count * 8, buffer + count * 9 };
+    float *shifted = buffer + count * 10;
+    float *sample = buffer + count * 11;
+    const float *points[3] = { x, y, z };
+
+    // Same points as the noise mode
+    for (int i = 0; i < count; i++) {
+        float theta = 2 * PI * i / count * 97;
+        float phi = PI * i / count;
+        x[i] = 2.5f * sinf(phi) * cosf(theta);
+        y[i] = 2.5f * sinf(phi) * sinf(theta);
+        z[i] = 2.5f * cosf(phi);
+    }
+
+    ComputeNoiseGradients(true, STB_PERLIN_SIMD_SCALAR, points, out, reference, shifted, sample, count, octaves);
+
+    int kernels[] = { STB_PERLIN_SIMD_SCALAR, stb_perlin_simd_support() };
+    double baseline = 0;
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int k = 0; k < 2; k++) {
+        if (k == 1 && kernels[1] == kernels[0])
+            break;
+
+        for (int analytic = 0; analytic < 2; analytic++) {
+            double best = 0;
+            for (int run = 0; run < options.runs; run++) {
+                double start = GetWallTime();
+                ComputeNoiseGradients(analytic, kernels[k], points, out, gradient, shifted, sample, count, octaves);
+                double elapsed = GetWallTime() - start;
+
+                if (run == 0 || elapsed < best)
+                    best = elapsed;
+            }
+
+            if (k == 0 && !analytic)
+                baseline = best;
+
+            // Against the analytic gradient, the forward differences only approximate it
+            float error = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                for (int i = 0; i < count; i++)
+                    error = fmaxf(error, fabsf(gradient[axis][i] - reference[axis][i]));
+            }
+
+            Record record = { 0 };
+            AddField(&record, "kernel", true, "%s", names[kernels[k]]);
+            AddField(&record, "method", true, "%s", analytic ? "analytic" : "forward_difference");
+            AddField(&record, "octaves", false, "%d", octaves);
+            AddField(&record, "points_per_sec", false, "%.0f", count / best);
+            AddField(&record, "speedup", false, "%.2f", baseline / best);
+            AddField(&record, "max_gradient_error", false, "%g", error);
+
+            PrintRecord(&record, options.json, first);
+            first = false;
+        }
+    }
+
+    EndRecords(options.json);
+
+    RL_FREE(buffer);
+}
+
+// Distribution of a single octave of the backend over random points: the
+// moments and range of the values, and how much steeper the noise is along
+// the axes than along the diagonal, 1 when it has no preferred direction
+typedef struct NoiseQuality {
+    double mean;
+    double deviation;
+    float low;
+    float high;
+    double isotropy;
+} NoiseQuality;
+
+static NoiseQuality MeasureNoiseQuality(NoiseBackend backend, const float *points[3], float *out, float *gradient[3], int count)
+{
+    NoiseQuality quality = { 0 };
+    FbmNoise3DerivBatchSimd(backend, STB_PERLIN_SIMD_SCALAR, points[0], points[1], points[2], out, gradient[0], gradient[1], gradient[2], count, 2, 0.5f, 1);
+
+    double sum = 0, squares = 0, axes = 0, diagonals = 0;
+    quality.low = quality.high = out[0];
+
+    for (int i = 0; i < count; i++) {
+        float gx = gradient[0][i], gy = gradient[1][i], gz = gradient[2][i];
+
+        sum += out[i];
+        squares += (double)out[i] * out[i];
+        quality.low = fminf(quality.low, out[i]);
+        quality.high = fmaxf(quality.high, out[i]);
+
+        // Squared slopes along the axes, averaged, and along the main
+        // diagonal, where lattice noise tends to line up
+        float diagonal = (gx + gy + gz) / sqrtf(3);
+        axes += (gx * gx + gy * gy + gz * gz) / 3.0;
+        diagonals += diagonal * diagonal;
+    }
+
+    quality.mean = sum / count;
+    quality.deviation = sqrt(squares / count - quality.mean * quality.mean);
+    quality.isotropy = sqrt(axes / diagonals);
+
+    return quality;
+}
+
+// Throughput of the fBm and quality of the noise of every backend of
+// noise.h, for every kernel, with the speedup over stb_perlin on the same one
+static void RunBackend(BenchOptions options)
+{
+    const char *names[] = { "scalar", "sse2", "avx2" };
+    const int count = 1 << 16;
+    const int octaves = options.planet.octaves;
+
+    float *buffer = (float *)RL_MALLOC(count * 14 * sizeof(float));
+    float *x = buffer;
+    float *y = buffer + count;
+    float *z = buffer + count * 2;
+    float *out = buffer + count * 3;
+    float *gradient[3] = { buffer + count * 4, buffer + count * 5, buffer + count * 6 };
+    float *scalar = buffer + count * 7;
+    float *scalarGradient[3] = { buffer + count * 8, buffer + count * 9, buffer + count * 10 };
+    float *random[3] = { buffer + count * 11, buffer + count * 12, buffer + count * 13 };
+    const float *samples[3] = { random[0], random[1], random[2] };
+
+    // Same points as the noise mode
+    for (int i = 0; i < count; i++) {
+        float theta = 2 * PI * i / count * 97;
+        float phi = PI * i / count;
+        x[i] = 2.5f * sinf(phi) * cosf(theta);
+        y[i] = 2.5f * sinf(phi) * sinf(theta);
+        z[i] = 2.5f * cosf(phi);
+    }
+
+    // The quality over random points spread across many cells
+    unsigned int state = 12345;
+    for (int i = 0; i < count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            state = state * 1664525u + 1013904223u;
+            random[axis][i] = (state >> 8) / (float)(1 << 24) * 64;
+        }
+    }
+
+    double stbTime[STB_PERLIN_SIMD_AVX2 + 1] = { 0 };
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int backend = 0; backend < NOISE_BACKEND_COUNT; backend++) {
+        NoiseQuality quality = MeasureNoiseQuality(backend, samples, out, gradient, count);
+
+        FbmNoise3DerivBatchSimd(backend, STB_PERLIN_SIMD_SCALAR, x, y, z, scalar, scalarGradient[0], scalarGradient[1], scalarGradient[2], count, 2, 0.5f, octaves);
+
+        for (int simd = STB_PERLIN_SIMD_SCALAR; simd <= stb_perlin_simd_support(); simd++) {
+            double best = 0;
+            for (int run = 0; run < options.runs; run++) {
+                double start = GetWallTime();
+                FbmNoise3DerivBatchSimd(backend, simd, x, y, z, out, gradient[0], gradient[1], gradient[2], count, 2, 0.5f, octaves);
+                double elapsed = GetWallTime() - start;
+
+                if (run == 0 || elapsed < best)
+                    best = elapsed;
+            }
+
+            if (backend == NOISE_BACKEND_STB)
+                stbTime[simd] = best;
+
+            bool identical = memcmp(out, scalar, count * sizeof(float)) == 0;
+            for (int axis = 0; axis < 3; axis++)
+                identical = identical && memcmp(gradient[axis], scalarGradient[axis], count * sizeof(float)) == 0;
+
+            Record record = { 0 };
+            AddField(&record, "backend", true, "%s", GetNoiseBackendName(backend));
+            AddField(&record, "kernel", true, "%s", names[simd]);
+            AddField(&record, "octaves", false, "%d", octaves);
+            AddField(&record, "points_per_sec", false, "%.0f", count / best);
+            AddField(&record, "speedup", false, "%.2f", stbTime[simd] / best);
+            AddField(&record, "matches_scalar", false, "%s", identical ? "true" : "false");
+            AddField(&record, "mean", false, "%.4f", quality.mean);
+            AddField(&record, "deviation", false, "%.4f", quality.deviation);
+            AddField(&record, "min", false, "%.4f", quality.low);
+            AddField(&record, "max", false, "%.4f", quality.high);
+            AddField(&record, "isotropy", false, "%.3f", quality.isotropy);
+
+            PrintRecord(&record, options.json, first);
+            first = false;
+        }
+    }
+
+    EndRecords(options.json);
+
+    RL_FREE(buffer);
+}
+
+// Best time over the runs of the fBm of 'graph', or of the plain batch without one
+static double TimeNoiseGraph(const NoiseGraph *graph, const float *points[3], float *out, float *gradient[3], int count, int octaves, int runs)
+{
+    double best = 0;
+
+    for (int run = 0; run < runs; run++) {
+        double start = GetWallTime();
+
+        if (graph != NULL)
+            EvaluateNoiseGraph(graph, points[0], points[1], points[2], out, gradient[0], gradient[1], gradient[2], count);
+        else
+            stb_perlin_fbm_noise3_deriv_batch(points[0], points[1], points[2], out, gradient[0], gradient[1], gradient[2], count, 2, 0.5f, octaves);
+
+        double elapsed = GetWallTime() - start;
+
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best;
+}
+
+// The cost of going through a graph: the plain fBm, the same fBm as a single
+// node, which must give the same values, and a layered graph
+static void RunGraph(BenchOptions options)
+{
+    const char *names[] = { "fbm", "graph_fbm", "graph" };
+    const int count = 1 << 16;
+    const int octaves = options.planet.octaves;
+
+    char source[64];
+    char error[256];
+    snprintf(source, sizeof(source), "height = fbm octaves=%d\n", octaves);
+
+    NoiseGraph *single = CompileNoiseGraph(source, error, sizeof(error));
+    NoiseGraph *layered = (NoiseGraph *)options.planet.graph;
+    const char *graphPath = options.graphPath != NULL ? options.graphPath : "continents.graph";
+
+    if (layered == NULL)
+        layered = LoadNoiseGraph(graphPath, error, sizeof(error));
+
+    if (single == NULL || layered == NULL) {
+        fprintf(stderr, "%s: %s\n", single == NULL ? "fbm graph" : graphPath, error);
+        exit(1);
+    }
+
+    float *buffer = (float *)RL_MALLOC(count * 11 * sizeof(float));
+    float *x = buffer;
+    float *y = buffer + count;
+    float *z = buffer + count * 2;
+    float *out = buffer + count * 3;
+    float *gradient[3] = { buffer + count * 4, buffer + count * 5, buffer + count * 6 };
+    float *reference = buffer + count * 7;
+    float *referenceGradient[3] = { buffer + count * 8, buffer + count * 9, buffer + count * 10 };
+    const float *points[3] = { x, y, z };
+
+    // Same points as the noise mode
+    for (int i = 0; i < count; i++) {
+        float theta = 2 * PI * i / count * 97;
+        float phi = PI * i / count;
+        x[i] = 2.5f * sinf(phi) * cosf(theta);
+        y[i] = 2.5f * sinf(phi) * sinf(theta);
+        z[i] = 2.5f * cosf(phi);
+    }
+
+    const NoiseGraph *graphs[] = { NULL, single, layered };
+    double baseline = 0;
+
+    BeginRecords(options.json);
+
+    for (int g = 0; g < 3; g++) {
+        float *values = g == 0 ? reference : out;
+        float **gradients = g == 0 ? referenceGradient : gradient;
+        double best = TimeNoiseGraph(graphs[g], points, values, gradients, count, octaves, options.runs);
+
+        if (g == 0)
+            baseline = best;
+
+        Record record = { 0 };
+        AddField(&record, "noise", true, "%s", names[g]);
+        AddField(&record, "nodes", false, "%d", graphs[g] != NULL ? graphs[g]->codeCount : 1);
+        AddField(&record, "points_per_sec", false, "%.0f", count / best);
+        AddField(&record, "relative", false, "%.2f", baseline / best);
+
+        // Only the single node has to, the layered graph is there for the time
+        bool identical = memcmp(values, reference, count * sizeof(float)) == 0;
+        for (int axis = 0; axis < 3; axis++)
+            identical = identical && memcmp(gradients[axis], referenceGradient[axis], count * sizeof(float)) == 0;
+        AddField(&record, "matches_fbm", false, "%s", identical ? "true" : "false");
+
+        PrintRecord(&record, options.json, g == 0);
+    }
+
+    EndRecords(options.json);
+
+    if (layered != options.planet.graph)
+        UnloadNoiseGraph(layered);
+    UnloadNoiseGraph(single);
+    RL_FREE(buffer);
+}
+
+// Measures the triangles of a planet generated without noise, on the unit sphere
+static SphereError MeasureSphereError(WorkerPool *pool, PlanetParams planet, int *triangleCount, int *vertexCount)
+{
+    planet.radius = 1;
+    planet.octaves = 0;
+
+    ChunkedMesh mesh = GeneratePlanetMesh(pool, planet);
+    SphereError error = { 0 };
+
+    for (int c = 0; c < mesh.chunkCount; c++) {
+        const Mesh *chunk = &mesh.chunks[c];
+
+        for (int t = 0; t < chunk->triangleCount; t++) {
+            Vector3 corners[3];
+            for (int k = 0; k < 3; k++) {
+                const float *vertex = &chunk->vertices[chunk->indices[t * 3 + k] * 3];
+                corners[k] = (Vector3){ vertex[0], vertex[1], vertex[2] };
+            }
+
+            // Longest edge, and whether the triangle is acute
+            int longest = 0;
+            float lengths[3];
+            for (int k = 0; k < 3; k++) {
+                lengths[k] = Vector3Distance(corners[k], corners[(k + 1) % 3]);
+                if (lengths[k] > lengths[longest])
+                    longest = k;
+            }
+
+            float a = lengths[(longest + 1) % 3];
+            float b = lengths[(longest + 2) % 3];
+            float c = lengths[longest];
+
+            // The corners are on the sphere, so the point of the triangle
+            // closest to the center is its circumcenter when that lies
+            // inside, otherwise the middle of the longest edge
+            float closest;
+            if (a * a + b * b > c * c) {
+                Vector3 normal = Vector3CrossProduct(Vector3Subtract(corners[1], corners[0]), Vector3Subtract(corners[2], corners[0]));
+                closest = fabsf(Vector3DotProduct(Vector3Normalize(normal), corners[0]));
+            }
+            else
+                closest = Vector3Length(Vector3Lerp(corners[longest], corners[(longest + 1) % 3], 0.5f));
+
+            error.maxSag = fmaxf(error.maxSag, 1 - closest);
+            error.maxEdge = fmaxf(error.maxEdge, c);
+        }
+    }
+
+    *triangleCount = mesh.triangleCount;
+    *vertexCount = mesh.vertexCount;
+
+    FreeChunkedMesh(mesh);
+    return error;
+}
+
+static float GetSphereErrorValue(SphereError error, bool edge)
+{
+    return edge ? error.maxEdge : error.maxSag;
+}
+
+static void AddSphereErrorRecord(BenchOptions options, bool *first, int slices, const char *criterion, PlanetParams planet, SphereError error, int triangles, int vertices, int reference)
+{
+    Record record = { 0 };
+    AddField(&record, "uv_slices", false, "%d", slices);
+    AddField(&record, "criterion", true, "%s", criterion);
+    AddField(&record, "topology", true, "%s", GetPlanetTopologyName(planet.topology));
+    AddField(&record, "subdivisions", false, "%d", planet.topology == PLANET_UV_SPHERE ? slices : planet.subdivisions);
+    AddField(&record, "triangles", false, "%d", triangles);
+    AddField(&record, "vertices", false, "%d", vertices);
+    AddField(&record, "max_sag", false, "%g", error.maxSag);
+    AddField(&record, "max_edge", false, "%g", error.maxEdge);
+    AddField(&record, "triangle_ratio", false, "%.3f", (double)triangles / reference);
+
+    PrintRecord(&record, options.json, *first);
+    *first = false;
+}
+
+// For every UV slice count, finds the fewest subdivisions of the other
+// topologies whose error is no worse, both for the gap to the sphere (what
+// the silhouette and the shading show) and for the longest edge (how finely
+// the noise is sampled)
+static void RunTopology(BenchOptions options)
+{
+    WorkerPool *pool = LoadWorkerPool(options.threads);
+    const char *criteria[] = { "sag", "edge" };
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int s = 0; s < options.sliceCount; s++) {
+        PlanetParams uv = options.planet;
+        uv.topology = PLANET_UV_SPHERE;
+        SetPlanetSlices(&uv, options.slices[s]);
+
+        int uvTriangles, uvVertices;
+        SphereError uvError = MeasureSphereError(pool, uv, &uvTriangles, &uvVertices);
+
+        for (int c = 0; c < 2; c++) {
+            bool edge = c == 1;
+            AddSphereErrorRecord(options, &first, options.slices[s], criteria[c], uv, uvError, uvTriangles, uvVertices, uvTriangles);
+
+            for (int topology = PLANET_CUBE_SPHERE; topology < PLANET_TOPOLOGY_COUNT; topology++) {
+                PlanetParams planet = options.planet;
+                planet.topology = topology;
+
+                // The error shrinks with the subdivisions, so bisect for the smallest match
+                int low = 1;
+                int high = options.slices[s];
+                while (low < high) {
+                    planet.subdivisions = (low + high) / 2;
+
+                    int triangles, vertices;
+                    SphereError error = MeasureSphereError(pool, planet, &triangles, &vertices);
+
+                    if (GetSphereErrorValue(error, edge) <= GetSphereErrorValue(uvError, edge))
+                        high = planet.subdivisions;
+                    else
+                        low = planet.subdivisions + 1;
+                }
+
+                planet.subdivisions = low;
+
+                int triangles, vertices;
+                SphereError error = MeasureSphereError(pool, planet, &triangles, &vertices);
+                AddSphereErrorRecord(options, &first, options.slices[s], criteria[c], planet, error, triangles, vertices, uvTriangles);
+            }
+        }
+    }
+
+    EndRecords(options.json);
+
+    UnloadWorkerPool(pool);
+}
+
+// Compares a cold start, which generates the planet, with a warm one that
+// maps the cache. The cache was just written, so it comes from the page cache
+static void RunCache(BenchOptions options)
+{
+    WorkerPool *pool = LoadWorkerPool(options.threads);
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int s = 0; s < options.sliceCount; s++) {
+        PlanetParams planet = options.planet;
+        SetPlanetSlices(&planet, options.slices[s]);
+
+        double generate = 0;
+        ChunkedMesh generated = { 0 };
+
+        // Startup from scratch, without a layout cached by the previous run
+        for (int run = 0; run < options.runs; run++) {
+            FreeChunkedMesh(generated);
+            UnloadSphereLayoutCache();
+
+            double start = GetWallTime();
+            generated = GeneratePlanetMesh(pool, planet);
+            double elapsed = GetWallTime() - start;
+
+            if (run == 0 || elapsed < generate)
+                generate = elapsed;
+        }
+
+        double start = GetWallTime();
+        bool saved = SavePlanetCache(options.cachePath, generated, planet);
+        double save = GetWallTime() - start;
+
+        if (!saved) {
+            fprintf(stderr, "could not save %s\n", options.cachePath);
+            FreeChunkedMesh(generated);
+            break;
+        }
+
+        double load = 0;
+        bool identical = true;
+
+        for (int run = 0; run < options.runs; run++) {
+            ChunkedMesh loaded = { 0 };
+            PlanetCache cache = { 0 };
+
+            double start = GetWallTime();
+            bool ok = LoadPlanetCache(options.cachePath, planet, &loaded, &cache);
+            double elapsed = GetWallTime() - start;
+
+            identical = identical && ok && ChunkedMeshEquals(loaded, generated);
+
+            if (run == 0 || elapsed < load)
+                load = elapsed;
+
+            if (ok) {
+                RL_FREE(loaded.chunks);
+                UnloadPlanetCache(cache);
+            }
+        }
+
+        struct stat info = { 0 };
+        stat(options.cachePath, &info);
+
+        Record record = { 0 };
+        AddField(&record, "topology", true, "%s", GetPlanetTopologyName(planet.topology));
+        AddField(&record, "slices", false, "%d", options.slices[s]);
+        AddField(&record, "octaves", false, "%d", planet.octaves);
+        AddField(&record, "vertices", false, "%d", generated.vertexCount);
+        AddField(&record, "generate_ms", false, "%.3f", generate * 1000);
+        AddField(&record, "save_ms", false, "%.3f", save * 1000);
+        AddField(&record, "load_ms", false, "%.3f", load * 1000);
+        AddField(&record, "speedup", false, "%.1f", generate / load);
+        AddField(&record, "file_bytes", false, "%lld", (long long)info.st_size);
+        AddField(&record, "identical", false, "%s", identical ? "true" : "false");
+
+        PrintRecord(&record, options.json, first);
+        first = false;
+
+        FreeChunkedMesh(generated);
+    }
+
+    EndRecords(options.json);
+
+    remove(options.cachePath);
+    UnloadSphereLayoutCache();
+    UnloadWorkerPool(pool);
+}
+
+// Regenerates the planet at its --slices for every octaves of --octaves
+// and a few scales, building its layout from scratch against taking it from
+// the cache of LoadSphereLayout, checked to give the same mesh
+static void RunLayout(BenchOptions options)
+{
+    const float scales[] = { 2, 4, 8 };
+    const int scaleCount = sizeof(scales) / sizeof(scales[0]);
+
+    int threads = options.threads > 0 ? options.threads : GetHardwareThreads();
+    WorkerPool *pool = LoadWorkerPool(threads);
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int o = 0; o < options.octaveCount; o++) {
+        for (int k = 0; k < scaleCount; k++) {
+            PlanetParams planet = options.planet;
+            planet.octaves = options.octaves[o];
+            planet.scale = scales[k];
+
+            UnloadSphereLayoutCache();
+            ChunkedMesh reference = GeneratePlanetMesh(pool, planet);
+
+            double cold = 0;
+            double layoutTime = 0;
+            bool identical = true;
+
+            for (int run = 0; run < options.runs; run++) {
+                UnloadSphereLayoutCache();
+
+                double start = GetWallTime();
+                SphereLayout *layout = LoadSphereLayout(pool, planet);
+                double elapsed = GetWallTime() - start;
+                UnloadSphereLayout(layout);
+                UnloadSphereLayoutCache();
+
+                if (run == 0 || elapsed < layoutTime)
+                    layoutTime = elapsed;
+
+                start = GetWallTime();
+                ChunkedMesh mesh = GeneratePlanetMesh(pool, planet);
+                elapsed = GetWallTime() - start;
+
+                identical = identical && ChunkedMeshEquals(mesh, reference);
+
+                if (run == 0 || elapsed < cold)
+                    cold = elapsed;
+
+                FreeChunkedMesh(mesh);
+            }
+
+            // The last cold run left the layout cached
+            double cached = 0;
+
+            for (int run = 0; run < options.runs; run++) {
+                double start = GetWallTime();
+                ChunkedMesh mesh = GeneratePlanetMesh(pool, planet);
+                double elapsed = GetWallTime() - start;
+
+                identical = identical && ChunkedMeshEquals(mesh, reference);
+
+                if (run == 0 || elapsed < cached)
+                    cached = elapsed;
+
+                FreeChunkedMesh(mesh);
+            }
+
+            Record record = { 0 };
+            AddField(&record, "topology", true, "%s", GetPlanetTopologyName(planet.topology));
+            AddField(&record, "slices", false, "%d", planet.longitudeSlices);
+            AddField(&record, "octaves", false, "%d", planet.octaves);
+            AddField(&record, "scale", false, "%.1f", planet.scale);
+            AddField(&record, "threads", false, "%d", threads);
+            AddField(&record, "vertices", false, "%d", reference.vertexCount);
+            AddField(&record, "layout_ms", false, "%.3f", layoutTime * 1000);
+            AddField(&record, "cold_ms", false, "%.3f", cold * 1000);
+            AddField(&record, "cached_ms", false, "%.3f", cached * 1000);
+            AddField(&record, "speedup", false, "%.2f", cold / cached);
+            AddField(&record, "identical", false, "%s", identical ? "true" : "false");
+
+            PrintRecord(&record, options.json, first);
+            first = false;
+
+            FreeChunkedMesh(reference);
+        }
+    }
+
+    EndRecords(options.json);
+
+    UnloadSphereLayoutCache();
+    UnloadWorkerPool(pool);
+}
+
+// Orbits the camera around the planet like the orbital camera of the viewer,
+// at 60 frames per second for a full turn at a few distances, and counts the
+// refits of every cascade: past the first frame only the inner ones, which
+// follow the camera closely, should ever need one
+static void RunShadow(BenchOptions options)
+{
+    const float distances[] = { 86.6f, 43.3f, 21.6f };
+    const int distanceCount = sizeof(distances) / sizeof(distances[0]);
+
+    // CAMERA_ORBITAL turns 0.5 radians a second
+    const float step = 0.5f / 60;
+    const int frames = 2 * PI / step;
+
+    PlanetParams planet = options.planet;
+    float noiseBound = GetPlanetNoiseBound(planet);
+    Vector3 lightDir = Vector3Normalize((Vector3){ 0.35f, -1.0f, -0.35f });
+    bool first = true;
+
+    BeginRecords(options.json);
+
+    for (int d = 0; d < distanceCount; d++) {
+        ShadowMap shadow = LoadShadowMap(3, 1024);
+
+        // Starts along (1, 1, 1) like the viewer, then turns around the up axis
+        float height = distances[d] / sqrtf(3);
+        float around = height * sqrtf(2);
+
+        Camera camera = { 0 };
+        camera.up = (Vector3){ 0, 1, 0 };
+        camera.fovy = 45;
+        camera.projection = CAMERA_PERSPECTIVE;
+
+        int redraws = 0;
+
+        for (int frame = 0; frame < frames; frame++) {
+            float angle = PI / 4 + frame * step;
+            camera.position = (Vector3){ around * cosf(angle), height, around * sinf(angle) };
+
+            if (UpdateShadowMap(&shadow, camera, 16.0f / 9, lightDir, planet.radius - noiseBound, planet.radius + noiseBound))
+                redraws++;
+        }
+
+        for (int i = 0; i < shadow.cascadeCount; i++) {
+            Record record = { 0 };
+            AddField(&record, "distance", false, "%.1f", distances[d]);
+            AddField(&record, "cascade", false, "%d", i);
+            AddField(&record, "frames", false, "%d", frames);
+            AddField(&record, "refits", false, "%d", shadow.cascades[i].refits);
+            AddField(&record, "redraws", false, "%d", redraws);
+            AddField(&record, "radius", false, "%.3f", shadow.cascades[i].radius);
+            // Only the first fit on the outer cascades, the inner one follows the camera
+            const char *check = i == 0 ? "inner" : shadow.cascades[i].refits <= 1 ? "clean" : "refit";
+            AddField(&record, "check", true, "%s", check);
+
+            PrintRecord(&record, options.json, first);
+            first = false;
+        }
+
+        UnloadShadowMap(shadow);
+    }
+
+    EndRecords(options.json);
+}
+
+typedef enum AllocScenario {
+    ALLOC_REGENERATE = 0,   // The viewer editing the noise: same directions and buffers, new vertices
+    ALLOC_TILES_HEAP,       // Tiles from malloc, kept on the CPU while drawn, as lod.h did
+    ALLOC_TILES_POOL,       // Tiles from a MemoryPool, returned once uploaded, as lod.h does
+    ALLOC_SCENARIO_COUNT
+} AllocScenario;
+
+static const char *allocScenarioNames[ALLOC_SCENARIO_COUNT] = { "regenerate", "tiles_heap", "tiles_pool" };
+
+// Tiles streamed, generated in batches like the jobs of lod.h
+#define ALLOC_TILES 2048
+#define ALLOC_TILE_BATCH 64
+#define ALLOC_TILE_SLICES 32
+#define ALLOC_RESIDENT_TILES 384
+
+typedef struct AllocResult {
+    int items;
+    long firstAllocs;       // Mallocs of the first regeneration or batch, which warms up the arenas
+    long steadyAllocs;      // Mallocs of all the others
+    long arenaPeakBytes;
+    double time;
+} AllocResult;
+
+typedef struct AllocTile {
+    PlanetTile tile;
+    PlanetParams params;
+    MemoryPool *pool;       // NULL to allocate from the heap
+    void *buffer;
+    Mesh mesh;
+} AllocTile;
+
+static long GetBenchAllocs(void)
+{
+    return atomic_load(&benchAllocs) + GetArenaStats().systemAllocs;
+}
+
+static void GenerateAllocTiles(void *data, int begin, int end)
+{
+    AllocTile *tiles = data;
+
+    for (int i = begin; i < end; i++) {
+        AllocTile *tile = &tiles[i];
+
+        if (tile->pool != NULL) {
+            tile->buffer = AllocPoolBlock(tile->pool);
+            tile->mesh = InitPlanetTileMesh(tile->buffer, ALLOC_TILE_SLICES);
+        }
+        else
+            tile->mesh = AllocPlanetTileMesh(ALLOC_TILE_SLICES);
+
+        GeneratePlanetTile(&tile->mesh, tile->tile, ALLOC_TILE_SLICES, tile->params);
+    }
+}
+
+static AllocResult MeasureAllocs(AllocScenario scenario, PlanetParams planet, int threads, int runs)
+{
+    AllocResult result = { 0 };
+    WorkerPool *pool = LoadWorkerPool(threads);
+
+    if (scenario == ALLOC_REGENERATE) {
+        SphereLayout *layout = LoadSphereLayout(pool, planet);
+        ChunkedMesh mesh = AllocChunkedMesh(layout);
+        result.items = runs + 1;
+
+        for (int run = 0; run < result.items; run++) {
+            PlanetParams params = planet;
+            params.octaves = 1 + run % 8;
+
+            long before = GetBenchAllocs();
+            double start = GetWallTime();
+            GeneratePlanetVertices(pool, &layout->directions, &mesh, params);
+            result.time += GetWallTime() - start;
+
+            if (run == 0)
+                result.firstAllocs = GetBenchAllocs() - before;
+            else
+                result.steadyAllocs += GetBenchAllocs() - before;
+        }
+
+        FreeChunkedMesh(mesh);
+        UnloadSphereLayout(layout);
+        UnloadSphereLayoutCache();
+    }
+    else {
+        // Level 5 tiles face after face, as a camera flying around would ask for them
+        AllocTile *batch = RL_CALLOC(ALLOC_TILE_BATCH, sizeof(AllocTile));
+        Mesh *resident = RL_CALLOC(ALLOC_RESIDENT_TILES, sizeof(Mesh));
+        MemoryPool tileBuffers;
+        InitMemoryPool(&tileBuffers, GetPlanetTileMeshSize(ALLOC_TILE_SLICES));
+        result.items = ALLOC_TILES;
+
+        for (int first = 0; first < ALLOC_TILES; first += ALLOC_TILE_BATCH) {
+            for (int i = 0; i < ALLOC_TILE_BATCH; i++) {
+                int t = first + i;
+                batch[i] = (AllocTile){ .tile = { t / 1024, 5, t % 32, t / 32 % 32 }, .params = planet };
+                batch[i].pool = scenario == ALLOC_TILES_POOL ? &tileBuffers : NULL;
+            }
+
+            long before = GetBenchAllocs();
+            double start = GetWallTime();
+            WorkerPoolFor(pool, ALLOC_TILE_BATCH, 1, GenerateAllocTiles, batch);
+
+            // In place of the upload: the heap tiles stay until evicted, the pool ones go back
+            for (int i = 0; i < ALLOC_TILE_BATCH; i++) {
+                if (scenario == ALLOC_TILES_POOL) {
+                    FreePoolBlock(&tileBuffers, batch[i].buffer);
+                    continue;
+                }
+
+                Mesh *slot = &resident[(first + i) % ALLOC_RESIDENT_TILES];
+                FreePlanetTileMesh(*slot);
+                *slot = batch[i].mesh;
+            }
+
+            result.time += GetWallTime() - start;
+
+            if (first == 0)
+                result.firstAllocs = GetBenchAllocs() - before;
+            else
+                result.steadyAllocs += GetBenchAllocs() - before;
+        }
+
+        for (int i = 0; i < ALLOC_RESIDENT_TILES; i++)
+            FreePlanetTileMesh(resident[i]);
+
+        UnloadMemoryPool(&tileBuffers);
+        RL_FREE(resident);
+        RL_FREE(batch);
+    }
+
+    result.arenaPeakBytes = GetArenaStats().peakBytes;
+    UnloadWorkerPool(pool);
+
+    return result;
+}
+
+// Mallocs and peak memory of each scenario, in its own process for ru_maxrss like sweep
+static void RunAlloc(BenchOptions options)
+{
+    int threads = options.threads > 0 ? options.threads : GetHardwareThreads();
+
+    BeginRecords(options.json);
+
+    for (int scenario = 0; scenario < ALLOC_SCENARIO_COUNT; scenario++) {
+        int channel[2];
+        if (pipe(channel) != 0) {
+            perror("pipe");
+            exit(1);
+        }
+
+        // The children must not print the header again
+        fflush(stdout);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(channel[0]);
+            AllocResult result = MeasureAllocs(scenario, options.planet, threads, options.runs);
+            write(channel[1], &result, sizeof(result));
+            _exit(0);
+        }
+
+        close(channel[1]);
+
+        AllocResult result = { 0 };
+        bool ok = read(channel[0], &result, sizeof(result)) == sizeof(result);
+        close(channel[0]);
+
+        int status;
+        struct rusage usage = { 0 };
+        wait4(pid, &status, 0, &usage);
+
+        if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s failed\n", allocScenarioNames[scenario]);
+            continue;
+        }
+
+        bool tiles = scenario != ALLOC_REGENERATE;
+        int steadyItems = tiles ? result.items - ALLOC_TILE_BATCH : result.items - 1;
+
+        Record record = { 0 };
+        AddField(&record, "scenario", true, "%s", allocScenarioNames[scenario]);
+        AddField(&record, "topology", true, "%s", GetPlanetTopologyName(options.planet.topology));
+        AddField(&record, "slices", false, "%d", tiles ? ALLOC_TILE_SLICES : options.planet.longitudeSlices);
+        AddField(&record, "threads", false, "%d", threads);
+        AddField(&record, "items", false, "%d", result.items);
+        AddField(&record, "first_allocs", false, "%ld", result.firstAllocs);
+        AddField(&record, "allocs_per_item", false, "%.2f", (double)result.steadyAllocs / steadyItems);
+        AddField(&record, "ms_per_item", false, "%.3f", result.time * 1000 / result.items);
+        AddField(&record, "arena_peak_kb", false, "%ld", result.arenaPeakBytes / 1024);
+        AddField(&record, "peak_rss_kb", false, "%ld", usage.ru_maxrss);
+
+        PrintRecord(&record, options.json, scenario == 0);
+    }
+
+    EndRecords(options.json);
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options = {
+        .planet = {
+            .topology = PLANET_UV_SPHERE,
+            .longitudeSlices = 200,
+            .latitudeSlices = 200,
+            .subdivisions = 200,
+            .chunkSlices = 128,
+            .radius = 10,
+            .scale = 4,
+            .lacunarity = 2,
+            .gain = 0.5,
+            .octaves = 6,
+        },
+        .runs = 3,
+        .cachePath = "terragen_bench.cache",
+        .slices = { 100, 200, 400, 800, 1600 },
+        .sliceCount = 5,
+        .octaves = { 1, 2, 4, 6, 8 },
+        .octaveCount = 5,
+    };
+
+    const char *mode = "sweep";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            options.runs = Clamp(atoi(argv[++i]), 1, 1000);
+        else if (strcmp(argv[i], "--slices") == 0 && i + 1 < argc) {
+            options.sliceCount = ParseList(argv[++i], options.slices, MAX_SWEEP);
+            SetPlanetSlices(&options.planet, options.slices[0]);
+        }
+        else if (strcmp(argv[i], "--octaves") == 0 && i + 1 < argc) {
+            options.octaveCount = ParseList(argv[++i], options.octaves, MAX_SWEEP);
+            options.planet.octaves = options.octaves[0];
+        }
+        else if (strcmp(argv[i], "--chunk-slices") == 0 && i + 1 < argc)
+            options.planet.chunkSlices = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--topology") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            options.planet.topology = PLANET_TOPOLOGY_COUNT;
+
+            for (int t = 0; t < PLANET_TOPOLOGY_COUNT; t++) {
+                if (strcmp(name, GetPlanetTopologyName(t)) == 0)
+                    options.planet.topology = t;
+            }
+
+            if (options.planet.topology == PLANET_TOPOLOGY_COUNT) {
+                fprintf(stderr, "unknown topology: %s\n", name);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            options.cachePath = argv[++i];
+        else if (strcmp(argv[i], "--graph") == 0 && i + 1 < argc)
+            options.graphPath = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0)
+            options.json = true;
+        else if (argv[i][0] != '-')
+            mode = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [sweep|threads|bake|erosion|jobs|noise|deriv|topology|cache|layout|shadow|backend|graph|alloc] [--threads N] [--runs N] [--slices N,...] [--octaves N,...] [--chunk-slices N] [--topology uv|cube|ico] [--cache PATH] [--graph PATH] [--json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    NoiseGraph *graph = NULL;
+
+    if (options.graphPath != NULL) {
+        char error[256];
+        graph = LoadNoiseGraph(options.graphPath, error, sizeof(error));
+
+        if (graph == NULL) {
+            fprintf(stderr, "%s: %s\n", options.graphPath, error);
+            return 1;
+        }
+
+        options.planet.graph = graph;
+    }
+
+    if (strcmp(mode, "sweep") == 0)
+        RunSweep(options);
+    else if (strcmp(mode, "threads") == 0)
+        RunThreads(options);
+    else if (strcmp(mode, "noise") == 0)
+        RunNoise(options);
+    else if (strcmp(mode, "deriv") == 0)
+        RunDeriv(options);
+    else if (strcmp(mode, "topology") == 0)
+        RunTopology(options);
+    else if (strcmp(mode, "cache") == 0)
+        RunCache(options);
+    else if (strcmp(mode, "layout") == 0)
+        RunLayout(options);
+    else if (strcmp(mode, "shadow") == 0)
+        RunShadow(options);
+    else if (strcmp(mode, "jobs") == 0)
+        RunJobs(options);
+    else if (strcmp(mode, "erosion") == 0)
+        RunErosion(options);
+    else if (strcmp(mode, "bake") == 0)
+        RunBake(options);
+    else if (strcmp(mode, "backend") == 0)
+        RunBackend(options);
+    else if (strcmp(mode, "graph") == 0)
+        RunGraph(options);
+    else if (strcmp(mode, "alloc") == 0)
+        RunAlloc(options);
+    else {
+        fprintf(stderr, "unknown mode: %s\n", mode);
+        return 1;
+    }
+
+    UnloadNoiseGraph(graph);
+
+    return 0;
+}
@@ -0,0 +1,370 @@
+// cache.h - binary cache of generated planets
+//
+// to create the implementation,
+//     #define CACHE_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// planet.h must be included before this file. Like planet.h only the raylib
+// headers are used; files are mapped with mmap, so this is POSIX only.
+//
+//
+// Documentation:
+//
+// bool SavePlanetCache(const char *fileName, ChunkedMesh chunked, PlanetParams params)
+//
+// Writes the chunks as they are in memory, after a header holding the
+// layout, a hash of every parameter that changes the output, the cache
+// format version and PLANET_GENERATOR_VERSION. The file is written next to
+// 'fileName' and renamed over it, so a reader never sees half a cache.
+//
+// bool LoadPlanetCache(const char *fileName, PlanetParams params, ChunkedMesh *chunked, PlanetCache *cache)
+// void UnloadPlanetCache(PlanetCache cache)
+//
+// Maps the file and, if it was saved for the same parameters by the same
+// generator, fills a new ChunkedMesh whose arrays point straight into the
+// mapping, so they can be uploaded without a copy. The chunk array is the
+// caller's, the vertex and index arrays are read only and stay valid until
+// UnloadPlanetCache unmaps the file: take them off the chunks before
+// UnloadMesh sees them. Returns false, leaving 'chunked' untouched, on any
+// mismatch.
+//
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stddef.h>
+
+// A cache file mapped in memory
+typedef struct PlanetCache {
+    void *data;
+    size_t size;
+} PlanetCache;
+
+uint64_t GetPlanetParamsHash(PlanetParams params);
+
+bool SavePlanetCache(const char *fileName, ChunkedMesh chunked, PlanetParams params);
+bool LoadPlanetCache(const char *fileName, PlanetParams params, ChunkedMesh *chunked, PlanetCache *cache);
+void UnloadPlanetCache(PlanetCache cache);
+
+#endif // CACHE_H
+
+#ifdef CACHE_IMPLEMENTATION
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PLANET_CACHE_MAGIC "TGPLANET"
+#define PLANET_CACHE_VERSION 1
+
+// Arrays start on this boundary inside the file
+#define PLANET_CACHE_ALIGN 16
+
+typedef struct PlanetCacheHeader {
+    char magic[8];
+    uint32_t cacheVersion;
+    uint32_t generatorVersion;
+    uint32_t byteOrder;     // 0x01020304 as written, to reject foreign files
+    uint32_t chunkCount;
+    uint64_t paramsHash;
+    uint64_t fileSize;
+
+    int32_t topology;
+    int32_t faceCount;
+    int32_t faceColumns;
+    int32_t faceRows;
+    int32_t chunkColumns;
+    int32_t chunkRows;
+    int32_t chunkSlices;
+    int32_t vertexCount;
+    int32_t triangleCount;
+    int32_t reserved;
+} PlanetCacheHeader;
+
+// The chunk table follows the header without padding
+_Static_assert(sizeof(PlanetCacheHeader) % PLANET_CACHE_ALIGN == 0, "cache header must keep the arrays aligned");
+
+// Followed by the vertices, normals, colors and indices of the chunk
+typedef struct PlanetCacheChunk {
+    int32_t vertexCount;
+    int32_t triangleCount;
+    uint64_t offset;
+} PlanetCacheChunk;
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+
+    // FNV-1a
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// Hash of the parameters that change the generated mesh, field by field so padding is left out
+uint64_t GetPlanetParamsHash(PlanetParams params)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    int32_t layout[] = {
+        params.topology,
+        params.topology == PLANET_UV_SPHERE ? params.longitudeSlices : 0,
+        params.topology == PLANET_UV_SPHERE ? params.latitudeSlices : 0,
+        params.topology != PLANET_UV_SPHERE ? params.subdivisions : 0,
+        params.chunkSlices,
+        params.octaves,
+    };
+    float noise[] = { params.radius, params.scale, params.lacunarity, params.gain };
+
+    hash = HashBytes(hash, layout, sizeof(layout));
+    hash = HashBytes(hash, noise, sizeof(noise));
+
+    // Planets of the default backend keep the hashes they had before there were others
+    if (PLANET_NOISE_BACKEND != NOISE_BACKEND_STB) {
+        int32_t backend = PLANET_NOISE_BACKEND;
+        hash = HashBytes(hash, &backend, sizeof(backend));
+    }
+
+    // The graph hashes its own instructions
+    if (params.graph != NULL)
+        hash = HashBytes(hash, &params.graph->hash, sizeof(params.graph->hash));
+
+    // Uneroded planets keep their hashes too, whatever the unused settings
+    if (IsErosionEnabled(params.erosion)) {
+        const ErosionSettings *e = &params.erosion;
+        int32_t budget[] = { e->resolution, (int32_t)e->seed, e->droplets, e->thermalIterations, e->lifetime, e->radius };
+        float rates[] = {
+            e->inertia, e->capacity, e->minCapacity, e->erosion, e->deposition,
+            e->evaporation, e->gravity, e->talus, e->thermalRate,
+        };
+
+        hash = HashBytes(hash, budget, sizeof(budget));
+        hash = HashBytes(hash, rates, sizeof(rates));
+    }
+
+    return hash;
+}
+
+static size_t AlignCacheOffset(size_t offset)
+{
+    return (offset + PLANET_CACHE_ALIGN - 1) & ~(size_t)(PLANET_CACHE_ALIGN - 1);
+}
+
+static size_t GetCacheChunkSize(int vertexCount, int triangleCount)
+{
+    size_t size = AlignCacheOffset((size_t)vertexCount * 3 * sizeof(float));
+    size += AlignCacheOffset((size_t)vertexCount * 3 * sizeof(float));
+    size += AlignCacheOffset((size_t)vertexCount * 4 * sizeof(unsigned char));
+    size += AlignCacheOffset((size_t)triangleCount * 3 * sizeof(unsigned short));
+
+    return size;
+}
+
+static bool WriteCacheArray(FILE *file, const void *data, size_t size)
+{
+    static const char padding[PLANET_CACHE_ALIGN] = { 0 };
+
+    return fwrite(data, 1, size, file) == size
+        && fwrite(padding, 1, AlignCacheOffset(size) - size, file) == AlignCacheOffset(size) - size;
+}
+
+bool SavePlanetCache(const char *fileName, ChunkedMesh chunked, PlanetParams params)
+{
+    PlanetCacheHeader header = { 0 };
+    memcpy(header.magic, PLANET_CACHE_MAGIC, sizeof(header.magic));
+    header.cacheVersion = PLANET_CACHE_VERSION;
+    header.generatorVersion = PLANET_GENERATOR_VERSION;
+    header.byteOrder = 0x01020304;
+    header.chunkCount = chunked.chunkCount;
+    header.paramsHash = GetPlanetParamsHash(params);
+
+    header.topology = chunked.topology;
+    header.faceCount = chunked.faceCount;
+    header.faceColumns = chunked.faceColumns;
+    header.faceRows = chunked.faceRows;
+    header.chunkColumns = chunked.chunkColumns;
+    header.chunkRows = chunked.chunkRows;
+    header.chunkSlices = chunked.chunkSlices;
+    header.vertexCount = chunked.vertexCount;
+    header.triangleCount = chunked.triangleCount;
+
+    PlanetCacheChunk *table = RL_CALLOC(chunked.chunkCount, sizeof(PlanetCacheChunk));
+    size_t offset = AlignCacheOffset(sizeof(header) + chunked.chunkCount * sizeof(PlanetCacheChunk));
+
+    for (int i = 0; i < chunked.chunkCount; i++) {
+        table[i].vertexCount = chunked.chunks[i].vertexCount;
+        table[i].triangleCount = chunked.chunks[i].triangleCount;
+        table[i].offset = offset;
+        offset += GetCacheChunkSize(table[i].vertexCount, table[i].triangleCount);
+    }
+
+    header.fileSize = offset;
+
+    char tempName[4096];
+    snprintf(tempName, sizeof(tempName), "%s.tmp", fileName);
+
+    FILE *file = fopen(tempName, "wb");
+    if (file == NULL) {
+        RL_FREE(table);
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && WriteCacheArray(file, table, chunked.chunkCount * sizeof(PlanetCacheChunk));
+
+    for (int i = 0; ok && i < chunked.chunkCount; i++) {
+        const Mesh *chunk = &chunked.chunks[i];
+
+        ok = WriteCacheArray(file, chunk->vertices, chunk->vertexCount * 3 * sizeof(float))
+            && WriteCacheArray(file, chunk->normals, chunk->vertexCount * 3 * sizeof(float))
+            && WriteCacheArray(file, chunk->colors, chunk->vertexCount * 4 * sizeof(unsigned char))
+            && WriteCacheArray(file, chunk->indices, chunk->triangleCount * 3 * sizeof(unsigned short));
+    }
+
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tempName, fileName) == 0;
+
+    if (!ok)
+        remove(tempName);
+
+    RL_FREE(table);
+    return ok;
+}
+
+// Checks the header and the chunk table against the size of the mapping,
+// and every index against the vertices of its chunk
+static bool IsPlanetCacheValid(const unsigned char *data, size_t size, PlanetParams params)
+{
+    if (size < sizeof(PlanetCacheHeader))
+        return false;
+
+    const PlanetCacheHeader *header = (const PlanetCacheHeader *)data;
+
+    if (memcmp(header->magic, PLANET_CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->cacheVersion != PLANET_CACHE_VERSION
+        || header->generatorVersion != PLANET_GENERATOR_VERSION
+        || header->byteOrder != 0x01020304
+        || header->paramsHash != GetPlanetParamsHash(params)
+        || header->fileSize != size)
+        return false;
+
+    size_t tableEnd = sizeof(PlanetCacheHeader) + (size_t)header->chunkCount * sizeof(PlanetCacheChunk);
+    if (tableEnd > size)
+        return false;
+
+    const PlanetCacheChunk *table = (const PlanetCacheChunk *)(data + sizeof(PlanetCacheHeader));
+
+    for (uint32_t i = 0; i < header->chunkCount; i++) {
+        if (table[i].vertexCount < 0 || table[i].vertexCount > 65536 || table[i].triangleCount < 0)
+            return false;
+
+        // Compared without adding to the offset, which a damaged file could make wrap
+        size_t chunkSize = GetCacheChunkSize(table[i].vertexCount, table[i].triangleCount);
+        if (table[i].offset < tableEnd || table[i].offset % PLANET_CACHE_ALIGN != 0
+            || table[i].offset > size || chunkSize > size - table[i].offset)
+            return false;
+
+        // Indices past the chunk would reach outside its buffers on the GPU
+        size_t indexOffset = chunkSize - AlignCacheOffset((size_t)table[i].triangleCount * 3 * sizeof(unsigned short));
+        const unsigned short *indices = (const unsigned short *)(data + table[i].offset + indexOffset);
+
+        for (size_t k = 0; k < (size_t)table[i].triangleCount * 3; k++) {
+            if (indices[k] >= table[i].vertexCount)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool LoadPlanetCache(const char *fileName, PlanetParams params, ChunkedMesh *chunked, PlanetCache *cache)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    // The whole file is read right away, the validation and the upload touch every page
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+
+    size_t size = info.st_size;
+    unsigned char *data = mmap(NULL, size, PROT_READ, flags, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, size, MADV_WILLNEED);
+
+    if (!IsPlanetCacheValid(data, size, params)) {
+        munmap(data, size);
+        return false;
+    }
+
+    const PlanetCacheHeader *header = (const PlanetCacheHeader *)data;
+    const PlanetCacheChunk *table = (const PlanetCacheChunk *)(data + sizeof(PlanetCacheHeader));
+
+    ChunkedMesh loaded = { 0 };
+    loaded.topology = header->topology;
+    loaded.faceCount = header->faceCount;
+    loaded.faceColumns = header->faceColumns;
+    loaded.faceRows = header->faceRows;
+    loaded.chunkColumns = header->chunkColumns;
+    loaded.chunkRows = header->chunkRows;
+    loaded.chunkSlices = header->chunkSlices;
+    loaded.vertexCount = header->vertexCount;
+    loaded.triangleCount = header->triangleCount;
+    loaded.chunkCount = header->chunkCount;
+    loaded.chunks = (Mesh *)RL_CALLOC(loaded.chunkCount, sizeof(Mesh));
+
+    for (int i = 0; i < loaded.chunkCount; i++) {
+        Mesh *chunk = &loaded.chunks[i];
+        chunk->vertexCount = table[i].vertexCount;
+        chunk->triangleCount = table[i].triangleCount;
+
+        size_t vertexBytes = chunk->vertexCount * 3 * sizeof(float);
+        size_t colorBytes = chunk->vertexCount * 4 * sizeof(unsigned char);
+
+        // Aligned by the writer, the mapping itself is page aligned
+        unsigned char *source = data + table[i].offset;
+
+        chunk->vertices = (float *)source;
+        source += AlignCacheOffset(vertexBytes);
+        chunk->normals = (float *)source;
+        source += AlignCacheOffset(vertexBytes);
+        chunk->colors = source;
+        source += AlignCacheOffset(colorBytes);
+        chunk->indices = (unsigned short *)source;
+    }
+
+    cache->data = data;
+    cache->size = size;
+
+    *chunked = loaded;
+    return true;
+}
+
+void UnloadPlanetCache(PlanetCache cache)
+{
+    if (cache.data != NULL)
+        munmap(cache.data, cache.size);
+}
+
+#endif // CACHE_IMPLEMENTATION
@@ -0,0 +1,222 @@
+// cull.h - frustum and horizon culling of planet chunks
+//
+// to create the implementation,
+//     #define CULL_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// Only the raylib and raymath headers are used. Everything is in the model
+// space of the planet, centered on the origin.
+//
+//
+// Documentation:
+//
+// ChunkBounds GetChunkBounds(Mesh chunk, float padding)
+//
+// Bounding sphere of the CPU vertices of 'chunk', and the cone of their
+// directions from the planet center with the farthest of their distances.
+// 'padding' grows both, for vertices that move by up to that much later,
+// like the ones displaced in the vertex shader.
+//
+// float GetOccluderRadius(const ChunkBounds *bounds, int count)
+//
+// Radius of the largest sphere around the planet center that no triangle
+// of the chunks enters, which then hides whatever is behind it.
+//
+// ChunkCuller GetChunkCuller(Matrix viewProjection, Vector3 eye, float occluderRadius)
+//
+// Culls against the frustum of 'viewProjection', the model, view and
+// projection matrices multiplied together. Unless 'occluderRadius' is 0,
+// also culls the chunks hidden from 'eye' behind a sphere of that radius,
+// which must lie entirely inside the planet.
+//
+// ChunkVisibility GetChunkVisibility(const ChunkCuller *culler, ChunkBounds bounds)
+//
+// Whether the chunk may be visible, or why it is not.
+//
+// void CountChunkVisibility(CullStats *stats, ChunkVisibility visibility)
+//
+// Adds the chunk to the counter of its visibility.
+//
+
+#ifndef CULL_H
+#define CULL_H
+
+#include <stdbool.h>
+
+typedef struct ChunkBounds {
+    Vector3 center;         // Bounding sphere
+    float radius;
+    Vector3 axis;           // Cone of the directions from the planet center
+    float angle;
+    float farthest;         // Largest distance from the planet center
+    float nearest;          // Smallest distance of the triangles from it
+} ChunkBounds;
+
+typedef struct ChunkCuller {
+    Vector4 planes[6];      // Normal and offset, positive inside
+    bool horizon;
+    Vector3 eye;
+    float occluderRadius;
+} ChunkCuller;
+
+typedef enum {
+    CHUNK_VISIBLE = 0,
+    CHUNK_OUTSIDE_FRUSTUM,
+    CHUNK_BELOW_HORIZON,
+} ChunkVisibility;
+
+// Chunks counted by GetChunkVisibility through a draw
+typedef struct CullStats {
+    int drawn;
+    int outsideFrustum;
+    int belowHorizon;
+} CullStats;
+
+ChunkBounds GetChunkBounds(Mesh chunk, float padding);
+float GetOccluderRadius(const ChunkBounds *bounds, int count);
+ChunkCuller GetChunkCuller(Matrix viewProjection, Vector3 eye, float occluderRadius);
+ChunkVisibility GetChunkVisibility(const ChunkCuller *culler, ChunkBounds bounds);
+void CountChunkVisibility(CullStats *stats, ChunkVisibility visibility);
+
+#endif // CULL_H
+
+#ifdef CULL_IMPLEMENTATION
+
+ChunkBounds GetChunkBounds(Mesh chunk, float padding)
+{
+    ChunkBounds bounds = { 0 };
+
+    if (chunk.vertexCount == 0)
+        return bounds;
+
+    Vector3 low = { chunk.vertices[0], chunk.vertices[1], chunk.vertices[2] };
+    Vector3 high = low;
+    Vector3 axis = Vector3Zero();
+
+    for (int i = 0; i < chunk.vertexCount; i++) {
+        Vector3 vertex = { chunk.vertices[i * 3], chunk.vertices[i * 3 + 1], chunk.vertices[i * 3 + 2] };
+        low = Vector3Min(low, vertex);
+        high = Vector3Max(high, vertex);
+        axis = Vector3Add(axis, Vector3Normalize(vertex));
+    }
+
+    bounds.center = Vector3Scale(Vector3Add(low, high), 0.5f);
+    bounds.axis = Vector3Normalize(axis);
+
+    float cosAngle = 1;
+
+    for (int i = 0; i < chunk.vertexCount; i++) {
+        Vector3 vertex = { chunk.vertices[i * 3], chunk.vertices[i * 3 + 1], chunk.vertices[i * 3 + 2] };
+        float distance = Vector3Length(vertex);
+
+        bounds.radius = fmaxf(bounds.radius, Vector3Distance(vertex, bounds.center));
+        bounds.farthest = fmaxf(bounds.farthest, distance);
+        cosAngle = fminf(cosAngle, Vector3DotProduct(vertex, bounds.axis) / distance);
+    }
+
+    bounds.angle = acosf(Clamp(cosAngle, -1, 1));
+
+    // A triangle is no closer than its nearest vertex projected on the
+    // direction of another, when they are all within 90 degrees
+    bounds.nearest = bounds.farthest;
+
+    for (int i = 0; i < chunk.triangleCount; i++) {
+        Vector3 corners[3];
+        float nearest = bounds.farthest;
+        float cosSpread = 1;
+
+        for (int k = 0; k < 3; k++) {
+            int v = chunk.indices[i * 3 + k];
+            corners[k] = (Vector3){ chunk.vertices[v * 3], chunk.vertices[v * 3 + 1], chunk.vertices[v * 3 + 2] };
+            nearest = fminf(nearest, Vector3Length(corners[k]));
+        }
+
+        for (int k = 0; k < 3; k++)
+            cosSpread = fminf(cosSpread, Vector3DotProduct(Vector3Normalize(corners[k]), Vector3Normalize(corners[(k + 1) % 3])));
+
+        bounds.nearest = fminf(bounds.nearest, nearest * fmaxf(cosSpread, 0));
+    }
+
+    bounds.radius += padding;
+    bounds.farthest += padding;
+    bounds.nearest = fmaxf(bounds.nearest - padding, 0);
+
+    return bounds;
+}
+
+float GetOccluderRadius(const ChunkBounds *bounds, int count)
+{
+    float radius = count > 0 ? bounds[0].nearest : 0;
+
+    for (int i = 1; i < count; i++)
+        radius = fminf(radius, bounds[i].nearest);
+
+    return radius;
+}
+
+ChunkCuller GetChunkCuller(Matrix viewProjection, Vector3 eye, float occluderRadius)
+{
+    ChunkCuller culler = { 0 };
+    const Matrix m = viewProjection;
+
+    // Rows of the clip matrix, the planes are sums and differences with the last one
+    Vector4 rows[4] = {
+        { m.m0, m.m4, m.m8, m.m12 },
+        { m.m1, m.m5, m.m9, m.m13 },
+        { m.m2, m.m6, m.m10, m.m14 },
+        { m.m3, m.m7, m.m11, m.m15 },
+    };
+
+    for (int i = 0; i < 6; i++) {
+        float sign = i % 2 == 0 ? 1 : -1;
+        Vector4 row = rows[i / 2];
+        Vector4 plane = { rows[3].x + row.x * sign, rows[3].y + row.y * sign, rows[3].z + row.z * sign, rows[3].w + row.w * sign };
+        float length = Vector3Length((Vector3){ plane.x, plane.y, plane.z });
+
+        culler.planes[i] = (Vector4){ plane.x / length, plane.y / length, plane.z / length, plane.w / length };
+    }
+
+    culler.eye = eye;
+    culler.occluderRadius = occluderRadius;
+    culler.horizon = occluderRadius > 0 && Vector3Length(eye) > occluderRadius;
+
+    return culler;
+}
+
+ChunkVisibility GetChunkVisibility(const ChunkCuller *culler, ChunkBounds bounds)
+{
+    for (int i = 0; i < 6; i++) {
+        Vector4 plane = culler->planes[i];
+
+        if (plane.x * bounds.center.x + plane.y * bounds.center.y + plane.z * bounds.center.z + plane.w < -bounds.radius)
+            return CHUNK_OUTSIDE_FRUSTUM;
+    }
+
+    if (culler->horizon && bounds.angle < PI / 2) {
+        // A point at distance r from the center clears a sphere of radius R
+        // seen from distance d when its angle from the eye, around the
+        // center, is below acos(R / d) + acos(R / r). The whole cone is
+        // hidden when its nearest edge is past that for its farthest point.
+        // Only holds for a convex cone, which contains the triangles too
+        float distance = Vector3Length(culler->eye);
+        float R = culler->occluderRadius;
+        float limit = acosf(R / distance) + acosf(fminf(R / bounds.farthest, 1));
+        float angle = acosf(Clamp(Vector3DotProduct(culler->eye, bounds.axis) / distance, -1, 1));
+
+        if (angle - bounds.angle > limit)
+            return CHUNK_BELOW_HORIZON;
+    }
+
+    return CHUNK_VISIBLE;
+}
+
+void CountChunkVisibility(CullStats *stats, ChunkVisibility visibility)
+{
+    switch (visibility) {
+        case CHUNK_VISIBLE: stats->drawn++; break;
+        case CHUNK_OUTSIDE_FRUSTUM: stats->outsideFrustum++; break;
+        case CHUNK_BELOW_HORIZON: stats->belowHorizon++; break;
+    }
+}
+
+#endif // CULL_IMPLEMENTATION
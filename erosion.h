@@ -0,0 +1,517 @@
+// erosion.h - hydraulic and thermal erosion of a spherical height field
+//
+// to create the implementation,
+//     #define EROSION_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// parallel.h must be included before this file. Only the raylib and raymath
+// headers are used, like planet.h, which erodes its planets with it.
+//
+//
+// Documentation:
+//
+// HeightField AllocHeightField(int width, int height, float cellSize)
+// void FreeHeightField(HeightField field)
+//
+// Equirectangular grid of heights, sampled at the cell centers, rows from the
+// north pole down and columns east from longitude 0. 'cellSize' is the length
+// of a cell along the equator, in the units of the heights, so that slopes
+// come out right; the cells narrow towards the poles, which the erosion takes
+// into account.
+//
+// void ErodeHeightField(WorkerPool *pool, HeightField *field, ErosionSettings settings)
+//
+// Runs settings.droplets water droplets, each carving and filling along its
+// way downhill, then settings.thermalIterations passes moving material down
+// the slopes steeper than settings.talus.
+//
+// The droplets are split among tiles of the field, colored in a 2 x 2 pattern
+// so that the tiles of a color are a whole tile apart. All the tiles of a
+// color run at once, each its droplets in order, and a droplet dies rather
+// than leave the half tile around its own, so no two threads ever touch the
+// same cell. The thermal passes read one copy of the field and write another.
+// Either way the result only depends on the settings and settings.seed, not
+// on the thread count.
+//
+// float SampleHeightField(const HeightField *field, Vector3 direction, Vector3 *gradient)
+//
+// Bilinear height along the unit 'direction'. Unless 'gradient' is NULL, also
+// returns the gradient of the height on the unit sphere, tangent to it.
+//
+
+#ifndef EROSION_H
+#define EROSION_H
+
+#include <stdbool.h>
+
+// Droplet parameters are in cells, with the heights measured in cells too
+typedef struct ErosionSettings {
+    int resolution;         // Cells around the equator, half as many from pole to pole
+    unsigned int seed;
+    int droplets;           // Hydraulic budget, 0 for none
+    int thermalIterations;  // Thermal budget, 0 for none
+
+    int lifetime;           // Steps before a droplet dries up
+    int radius;             // Cells eroded around a droplet
+    float inertia;          // How much a droplet keeps its direction, in [0, 1]
+    float capacity;         // Sediment carried per unit of speed, water and drop
+    float minCapacity;
+    float erosion;          // Fraction of the free capacity taken in a step
+    float deposition;       // Fraction of the excess sediment dropped in a step
+    float evaporation;      // Fraction of the water lost in a step
+    float gravity;
+
+    float talus;            // Steepest slope that holds without sliding
+    float thermalRate;      // Fraction of the excess moved in a pass
+} ErosionSettings;
+
+typedef struct HeightField {
+    int width;
+    int height;
+    float cellSize;
+    float *heights;
+} HeightField;
+
+ErosionSettings GetDefaultErosionSettings(void);
+bool IsErosionEnabled(ErosionSettings settings);
+
+HeightField AllocHeightField(int width, int height, float cellSize);
+void FreeHeightField(HeightField field);
+
+void ErodeHeightField(WorkerPool *pool, HeightField *field, ErosionSettings settings);
+float SampleHeightField(const HeightField *field, Vector3 direction, Vector3 *gradient);
+
+#endif // EROSION_H
+
+#ifdef EROSION_IMPLEMENTATION
+
+#include <stdint.h>
+#include <string.h>
+
+// Droplets a tile runs before the next color gets its turn
+#define EROSION_TILE_BATCH 64
+
+// Cells are never counted narrower than this, the ones at the poles are
+#define EROSION_MIN_COS 0.05f
+
+ErosionSettings GetDefaultErosionSettings(void)
+{
+    ErosionSettings settings = {
+        .resolution = 1024,
+        .seed = 0,
+        .droplets = 0,
+        .thermalIterations = 0,
+        .lifetime = 30,
+        .radius = 3,
+        .inertia = 0.05f,
+        .capacity = 4,
+        .minCapacity = 0.01f,
+        .erosion = 0.3f,
+        .deposition = 0.3f,
+        .evaporation = 0.01f,
+        .gravity = 4,
+        .talus = 0.6f,
+        .thermalRate = 0.5f,
+    };
+
+    return settings;
+}
+
+bool IsErosionEnabled(ErosionSettings settings)
+{
+    return settings.droplets > 0 || settings.thermalIterations > 0;
+}
+
+HeightField AllocHeightField(int width, int height, float cellSize)
+{
+    HeightField field = { width, height, cellSize, NULL };
+    field.heights = (float *)RL_MALLOC(width * height * sizeof(float));
+
+    return field;
+}
+
+void FreeHeightField(HeightField field)
+{
+    RL_FREE(field.heights);
+}
+
+// Width of the cells of a row relative to the ones on the equator
+static float GetRowCos(int height, float row)
+{
+    return fmaxf(cosf(((row + 0.5f) / height - 0.5f) * PI), EROSION_MIN_COS);
+}
+
+// splitmix64, for random numbers that only depend on where they are used
+static uint64_t HashErosion(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static float RandomErosionFloat(uint64_t *state)
+{
+    *state = HashErosion(*state);
+    return (*state >> 40) / (float)(1 << 24);
+}
+
+typedef struct DropletJob {
+    HeightField *field;
+    const ErosionSettings *settings;
+    int tileColumns;
+    int tileRows;
+    int color;
+    int pass;
+    int droplets;           // Left to run, spread over the tiles
+
+    // Cells of the brush around a droplet and their weights, summing to 1
+    int brushSize;
+    int *brushX;
+    int *brushY;
+    float *brushWeights;
+} DropletJob;
+
+// Height and slope in heights per cell at a point of the field in cells,
+// wrapping around in longitude
+static float GetFieldSlope(const HeightField *field, float x, float y, float *slopeX, float *slopeY)
+{
+    int column = (int)floorf(x);
+    int row = (int)floorf(y);
+    float u = x - column;
+    float v = y - row;
+
+    int c0 = ((column % field->width) + field->width) % field->width;
+    int c1 = (c0 + 1) % field->width;
+    const float *top = field->heights + row * field->width;
+    const float *bottom = top + field->width;
+
+    float h00 = top[c0], h10 = top[c1], h01 = bottom[c0], h11 = bottom[c1];
+
+    *slopeX = (h10 - h00) * (1 - v) + (h11 - h01) * v;
+    *slopeY = (h01 - h00) * (1 - u) + (h11 - h10) * u;
+
+    return h00 * (1 - u) * (1 - v) + h10 * u * (1 - v) + h01 * (1 - u) * v + h11 * u * v;
+}
+
+// Runs the droplets of one tile, never leaving the half tile around it
+static void RunTileDroplets(const DropletJob *job, int tile)
+{
+    HeightField *field = job->field;
+    const ErosionSettings *s = job->settings;
+    const int width = field->width;
+    const float scale = 1 / field->cellSize;
+
+    int tx = tile % job->tileColumns;
+    int ty = tile / job->tileColumns;
+
+    // Cells of the tile, and of the area its droplets stay in
+    int x0 = tx * width / job->tileColumns;
+    int x1 = (tx + 1) * width / job->tileColumns;
+    int y0 = ty * field->height / job->tileRows;
+    int y1 = (ty + 1) * field->height / job->tileRows;
+    int marginX = (x1 - x0) / 2 - 1;
+    int marginY = job->tileRows > 1 ? (y1 - y0) / 2 - 1 : field->height;
+
+    float left = x0 - marginX + s->radius + 1;
+    float right = x1 + marginX - s->radius - 2;
+    float top = fmaxf(y0 - marginY, 0) + s->radius + 1;
+    float bottom = fminf(y1 + marginY, field->height) - s->radius - 2;
+
+    int tileCount = job->tileColumns * job->tileRows;
+    int count = job->droplets / tileCount + (tile < job->droplets % tileCount);
+
+    // Sines of the latitudes of the tile, to start the droplets evenly over its area
+    float z0 = sinf((0.5f - (float)y0 / field->height) * PI);
+    float z1 = sinf((0.5f - (float)y1 / field->height) * PI);
+
+    for (int d = 0; d < count; d++) {
+        uint64_t droplet = ((uint64_t)job->pass * tileCount + tile) * EROSION_TILE_BATCH + d;
+        uint64_t state = HashErosion(((uint64_t)s->seed << 32) ^ droplet);
+
+        float x = x0 + RandomErosionFloat(&state) * (x1 - x0);
+        float latitude = asinf(Lerp(z0, z1, RandomErosionFloat(&state)));
+        float y = (0.5f - latitude / PI) * field->height - 0.5f;
+
+        float directionX = 0;
+        float directionY = 0;
+        float speed = 1;
+        float water = 1;
+        float sediment = 0;
+
+        for (int step = 0; step < s->lifetime; step++) {
+            if (x < left || x > right || y < top || y > bottom)
+                break;
+
+            int column = (int)floorf(x);
+            int row = (int)floorf(y);
+            float u = x - column;
+            float v = y - row;
+            float rowCos = GetRowCos(field->height, y);
+
+            float slopeX, slopeY;
+            float height = GetFieldSlope(field, x, y, &slopeX, &slopeY) * scale;
+
+            // Downhill on the sphere, where a cell is narrower than it looks
+            slopeX *= scale / rowCos;
+            slopeY *= scale;
+            directionX = directionX * s->inertia - slopeX * (1 - s->inertia);
+            directionY = directionY * s->inertia - slopeY * (1 - s->inertia);
+
+            float length = sqrtf(directionX * directionX + directionY * directionY);
+            if (length == 0)
+                break;
+
+            directionX /= length;
+            directionY /= length;
+
+            float nextX = x + directionX / rowCos;
+            float nextY = y + directionY;
+
+            if (nextX < left || nextX > right || nextY < top || nextY > bottom)
+                break;
+
+            float unused;
+            float drop = GetFieldSlope(field, nextX, nextY, &unused, &unused) * scale - height;
+            float capacity = fmaxf(-drop * speed * water * s->capacity, s->minCapacity);
+
+            int c0 = ((column % width) + width) % width;
+            int c1 = (c0 + 1) % width;
+
+            if (sediment > capacity || drop > 0) {
+                // Fills the pit it climbs out of, or drops what it cannot carry
+                float amount = drop > 0 ? fminf(drop, sediment) : (sediment - capacity) * s->deposition;
+                sediment -= amount;
+                amount *= field->cellSize;
+
+                field->heights[row * width + c0] += amount * (1 - u) * (1 - v);
+                field->heights[row * width + c1] += amount * u * (1 - v);
+                field->heights[(row + 1) * width + c0] += amount * (1 - u) * v;
+                field->heights[(row + 1) * width + c1] += amount * u * v;
+            }
+            else {
+                // Never digs deeper than the drop, which would leave a pit behind
+                float amount = fminf((capacity - sediment) * s->erosion, -drop);
+                float taken = 0;
+
+                for (int b = 0; b < job->brushSize; b++) {
+                    int bx = ((column + job->brushX[b]) % width + width) % width;
+                    float *cell = &field->heights[(row + job->brushY[b]) * width + bx];
+                    float share = fminf(amount * job->brushWeights[b], *cell * scale - (height - amount));
+
+                    share = fmaxf(share, 0);
+                    *cell -= share * field->cellSize;
+                    taken += share;
+                }
+
+                sediment += taken;
+            }
+
+            speed = sqrtf(fmaxf(speed * speed - drop * s->gravity, 0));
+            water *= 1 - s->evaporation;
+            x = nextX;
+            y = nextY;
+        }
+    }
+}
+
+static void RunDropletTiles(void *data, int begin, int end)
+{
+    const DropletJob *job = data;
+
+    // Every other tile across and down, starting from the one of the color
+    int columns = job->tileColumns / 2;
+
+    for (int i = begin; i < end; i++) {
+        int tx = (i % columns) * 2 + job->color % 2;
+        int ty = (i / columns) * 2 + job->color / 2;
+
+        if (ty < job->tileRows)
+            RunTileDroplets(job, ty * job->tileColumns + tx);
+    }
+}
+
+typedef struct ThermalJob {
+    const HeightField *source;
+    HeightField *target;
+    float *flows;           // Outflow of every cell to east, west, north and south
+    float talus;
+    float rate;
+} ThermalJob;
+
+static const int thermalNeighbors[4][2] = { { 1, 0 }, { -1, 0 }, { 0, -1 }, { 0, 1 } };
+
+// Outflow of each cell to its lower neighbors, shared by how far each is past the talus
+static void ComputeThermalFlows(void *data, int begin, int end)
+{
+    const ThermalJob *job = data;
+    const HeightField *field = job->source;
+    const int width = field->width;
+
+    for (int row = begin; row < end; row++) {
+        // Distances to the neighbors, in units of the heights
+        float across = field->cellSize * GetRowCos(field->height, row);
+        float along = field->cellSize;
+
+        for (int column = 0; column < width; column++) {
+            float h = field->heights[row * width + column];
+            float excess[4] = { 0 };
+            float total = 0;
+            float largest = 0;
+
+            for (int k = 0; k < 4; k++) {
+                int r = row + thermalNeighbors[k][1];
+                if (r < 0 || r >= field->height)
+                    continue;
+
+                int c = (column + thermalNeighbors[k][0] + width) % width;
+                float distance = k < 2 ? across : along;
+                float e = h - field->heights[r * width + c] - job->talus * distance;
+
+                if (e > 0) {
+                    excess[k] = e;
+                    total += e;
+                    largest = fmaxf(largest, e);
+                }
+            }
+
+            // Half the largest excess levels the steepest pair
+            float moved = total > 0 ? job->rate * largest / 2 : 0;
+
+            for (int k = 0; k < 4; k++)
+                job->flows[(row * width + column) * 4 + k] = total > 0 ? moved * excess[k] / total : 0;
+        }
+    }
+}
+
+static void ApplyThermalFlows(void *data, int begin, int end)
+{
+    const ThermalJob *job = data;
+    const HeightField *field = job->source;
+    const int width = field->width;
+
+    for (int row = begin; row < end; row++) {
+        for (int column = 0; column < width; column++) {
+            int i = row * width + column;
+            float h = field->heights[i];
+
+            for (int k = 0; k < 4; k++) {
+                h -= job->flows[i * 4 + k];
+
+                // What the neighbor sends back the other way
+                int r = row + thermalNeighbors[k][1];
+                if (r < 0 || r >= field->height)
+                    continue;
+
+                int c = (column + thermalNeighbors[k][0] + width) % width;
+                h += job->flows[(r * width + c) * 4 + (k ^ 1)];
+            }
+
+            job->target->heights[i] = h;
+        }
+    }
+}
+
+void ErodeHeightField(WorkerPool *pool, HeightField *field, ErosionSettings settings)
+{
+    if (settings.droplets > 0) {
+        DropletJob job = { 0 };
+        job.field = field;
+        job.settings = &settings;
+
+        // Tiles a bit wider than a droplet can travel, an even number of
+        // them around so that the colors alternate across the seam too
+        int tileSize = Clamp(settings.lifetime * 2, settings.radius * 4 + 8, field->width / 2);
+        job.tileColumns = (int)fmaxf(field->width / tileSize / 2, 1) * 2;
+        job.tileRows = (int)fmaxf(field->height / tileSize, 1);
+
+        int r = settings.radius;
+        job.brushX = (int *)RL_MALLOC((2 * r + 1) * (2 * r + 1) * sizeof(int));
+        job.brushY = (int *)RL_MALLOC((2 * r + 1) * (2 * r + 1) * sizeof(int));
+        job.brushWeights = (float *)RL_MALLOC((2 * r + 1) * (2 * r + 1) * sizeof(float));
+
+        float weightSum = 0;
+        for (int y = -r; y <= r; y++) {
+            for (int x = -r; x <= r; x++) {
+                float weight = r - sqrtf(x * x + y * y) + 1;
+
+                if (weight > 0) {
+                    job.brushX[job.brushSize] = x;
+                    job.brushY[job.brushSize] = y;
+                    job.brushWeights[job.brushSize++] = weight;
+                    weightSum += weight;
+                }
+            }
+        }
+
+        for (int b = 0; b < job.brushSize; b++)
+            job.brushWeights[b] /= weightSum;
+
+        int tileCount = job.tileColumns * job.tileRows;
+        int perPass = tileCount * EROSION_TILE_BATCH;
+        int tilesPerColor = job.tileColumns / 2 * ((job.tileRows + 1) / 2);
+
+        for (int left = settings.droplets; left > 0; left -= perPass, job.pass++) {
+            job.droplets = (int)fminf(left, perPass);
+
+            for (job.color = 0; job.color < 4; job.color++)
+                WorkerPoolFor(pool, tilesPerColor, 1, RunDropletTiles, &job);
+        }
+
+        RL_FREE(job.brushX);
+        RL_FREE(job.brushY);
+        RL_FREE(job.brushWeights);
+    }
+
+    if (settings.thermalIterations > 0) {
+        HeightField copy = AllocHeightField(field->width, field->height, field->cellSize);
+        float *flows = (float *)RL_MALLOC(field->width * field->height * 4 * sizeof(float));
+
+        ThermalJob job = { field, &copy, flows, settings.talus, settings.thermalRate };
+
+        for (int i = 0; i < settings.thermalIterations; i++) {
+            WorkerPoolFor(pool, field->height, 8, ComputeThermalFlows, &job);
+            WorkerPoolFor(pool, field->height, 8, ApplyThermalFlows, &job);
+
+            // The target becomes the source of the next pass
+            float *heights = field->heights;
+            field->heights = copy.heights;
+            copy.heights = heights;
+        }
+
+        RL_FREE(flows);
+        FreeHeightField(copy);
+    }
+}
+
+float SampleHeightField(const HeightField *field, Vector3 direction, Vector3 *gradient)
+{
+    float longitude = atan2f(direction.y, direction.x);
+    float latitude = asinf(Clamp(direction.z, -1, 1));
+
+    if (longitude < 0)
+        longitude += 2 * PI;
+
+    // Cell centers are at half cells, the rows clamp at the poles
+    float x = longitude / (2 * PI) * field->width - 0.5f;
+    float y = Clamp((0.5f - latitude / PI) * field->height - 0.5f, 0, field->height - 1.001f);
+
+    float slopeX, slopeY;
+    float height = GetFieldSlope(field, x, y, &slopeX, &slopeY);
+
+    if (gradient != NULL) {
+        // Per radian of longitude and of latitude, then per unit of length on the sphere
+        float latitudeCos = cosf(latitude);
+        float east = slopeX * field->width / (2 * PI) / fmaxf(latitudeCos, EROSION_MIN_COS);
+        float north = -slopeY * field->height / PI;
+
+        Vector3 eastAxis = { -sinf(longitude), cosf(longitude), 0 };
+        Vector3 northAxis = { -direction.z * cosf(longitude), -direction.z * sinf(longitude), latitudeCos };
+
+        *gradient = Vector3Add(Vector3Scale(eastAxis, east), Vector3Scale(northAxis, north));
+    }
+
+    return height;
+}
+
+#endif // EROSION_IMPLEMENTATION
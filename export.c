@@ -0,0 +1,160 @@
+// terragen_export - streams the planet surface to disk, without the viewer
+//
+// Only needs the raylib headers, not the library or a GPU:
+//     cc -O2 export.c -o terragen_export -lm -lpthread
+//
+// The format follows the extension of the output file:
+//     .r32     equirectangular heightmap of little endian floats
+//     .r16     equirectangular heightmap of little endian unsigned shorts
+//              over [-bound, bound] of the noise, printed once done
+//     .glb     binary glTF of the UV sphere
+//
+// With --maps, the output is a base name for the height, color and normal
+// maps of ExportPlanetMaps, baked in tiles of --tile pixels (64 by default).
+//
+// --size sets the pixels of a map, or the quads of the glb mesh (4096x2048 by
+// default). Rows are generated in bands and written while the next band is
+// generated, so 16384x8192 heightmaps only need a few MB.
+//
+// Prints the size of the file, the throughput in MB/s and the peak resident
+// memory of the process.
+
+#include <raylib.h>
+#include <raymath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define STB_PERLIN_IMPLEMENTATION
+#include "stb_perlin.h"
+
+#define NOISE_IMPLEMENTATION
+#include "noise.h"
+
+#define ARENA_IMPLEMENTATION
+#include "arena.h"
+
+#define NOISE_GRAPH_IMPLEMENTATION
+#include "noisegraph.h"
+
+#define PARALLEL_IMPLEMENTATION
+#include "parallel.h"
+
+#define EROSION_IMPLEMENTATION
+#include "erosion.h"
+
+#define PLANET_IMPLEMENTATION
+#include "planet.h"
+
+#define EXPORT_IMPLEMENTATION
+#include "export.h"
+
+static bool HasExtension(const char *fileName, const char *extension)
+{
+    const char *dot = strrchr(fileName, '.');
+    return dot != NULL && strcmp(dot, extension) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    // Same planet as the viewer
+    PlanetParams planet = {
+        .topology = PLANET_UV_SPHERE,
+        .radius = 10,
+        .scale = 4,
+        .lacunarity = 2,
+        .gain = 0.5,
+        .octaves = 6,
+    };
+
+    const char *output = NULL;
+    const char *graphPath = NULL;
+    int threads = 0;
+    int width = 4096;
+    int height = 2048;
+    int tileSize = 64;
+    bool maps = false;
+    bool badArgument = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--octaves") == 0 && i + 1 < argc)
+            planet.octaves = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--graph") == 0 && i + 1 < argc)
+            graphPath = argv[++i];
+        else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc)
+            tileSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--maps") == 0)
+            maps = true;
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 1 || height < 1) {
+                fprintf(stderr, "bad size: %s, expected WIDTHxHEIGHT\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argv[i][0] != '-' && output == NULL)
+            output = argv[i];
+        else
+            badArgument = true;
+    }
+
+    bool glb = output != NULL && HasExtension(output, ".glb");
+    bool r16 = output != NULL && HasExtension(output, ".r16");
+    bool r32 = output != NULL && HasExtension(output, ".r32");
+
+    if (badArgument || output == NULL || (!maps && !glb && !r16 && !r32)) {
+        fprintf(stderr, "usage: %s OUTPUT.r32|OUTPUT.r16|OUTPUT.glb|--maps BASENAME [--tile N] [--size WxH] [--threads N] [--octaves N] [--graph PATH]\n", argv[0]);
+        return 1;
+    }
+
+    NoiseGraph *graph = NULL;
+
+    if (graphPath != NULL) {
+        char error[256];
+        graph = LoadNoiseGraph(graphPath, error, sizeof(error));
+
+        if (graph == NULL) {
+            fprintf(stderr, "%s: %s\n", graphPath, error);
+            return 1;
+        }
+
+        planet.graph = graph;
+    }
+
+    WorkerPool *pool = LoadWorkerPool(threads);
+    ExportStats stats = { 0 };
+    bool ok;
+
+    if (maps)
+        ok = ExportPlanetMaps(pool, planet, width, height, tileSize, output, &stats);
+    else if (glb)
+        ok = ExportPlanetGlb(pool, planet, width, height, output, &stats);
+    else
+        ok = ExportPlanetHeightmap(pool, planet, width, height, r16 ? HEIGHTMAP_R16 : HEIGHTMAP_R32, output, &stats);
+
+    UnloadWorkerPool(pool);
+    UnloadNoiseGraph(graph);
+
+    if (!ok) {
+        fprintf(stderr, "could not export %s\n", output);
+        return 1;
+    }
+
+    struct rusage resources;
+    getrusage(RUSAGE_SELF, &resources);
+
+    double megabytes = stats.bytes / (1024.0 * 1024.0);
+
+    printf("%s: %dx%d, %.1f MB in %.2f s, %.1f MB/s, %d rows per %s, peak RSS %.1f MB\n",
+        output, width, height, megabytes, stats.time, megabytes / stats.time, stats.bandRows, maps ? "strip" : "band", resources.ru_maxrss / 1024.0);
+    printf("heights [%.4f, %.4f]", stats.low, stats.high);
+
+    if (r16 && !maps)
+        printf(", 0 and 65535 are -%.4f and %.4f", GetPlanetNoiseBound(planet), GetPlanetNoiseBound(planet));
+
+    printf("\n");
+
+    return 0;
+}
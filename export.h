@@ -0,0 +1,741 @@
+// export.h - streaming export of the planet surface for offline pipelines
+//
+// to create the implementation,
+//     #define EXPORT_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// planet.h must be included before this file. Like planet.h only the raylib
+// headers are used, so exports run without a window or a GPU.
+//
+// The surface is generated in bands of rows across the worker pool, and each
+// band is written on its own thread while the next one is generated. Only two
+// bands are ever held in memory, whatever the size of the output.
+//
+//
+// Documentation:
+//
+// bool ExportPlanetHeightmap(WorkerPool *pool, PlanetParams params, int width, int height, HeightmapFormat format, const char *fileName, ExportStats *stats)
+//
+// Writes the heights above the radius as an equirectangular map of 'width'
+// by 'height' pixels, sampled at the pixel centers. Rows go from the north
+// pole down and columns east from longitude 0, like the UV sphere. There is
+// no header: HEIGHTMAP_R32 writes little endian floats, and HEIGHTMAP_R16
+// writes little endian unsigned shorts mapping [-bound, bound] of
+// GetPlanetNoiseBound to [0, 65535].
+//
+// bool ExportPlanetGlb(WorkerPool *pool, PlanetParams params, int columns, int rows, const char *fileName, ExportStats *stats)
+//
+// Writes the UV sphere of 'columns' by 'rows' quads as binary glTF, Y up,
+// with positions, normals and colors, and 32 bit indices that skip the
+// collapsed triangles at the poles. The JSON chunk holds the bounds of the
+// positions, so it is reserved up front and filled in once they are known.
+// Fails if the file would pass the 4 GB limit of the format.
+//
+// PlanetMaps AllocPlanetMaps(int width, int height)
+// void FreePlanetMaps(PlanetMaps maps)
+//
+// Equirectangular height, color and normal maps, laid out like the
+// heightmaps. The colors are the heightToColor of the heights, and the
+// normals are in the tangent space of the sphere, east, north and up mapped
+// from [-1, 1] to [0, 255] like a normal map texture.
+//
+// void BakePlanetMaps(WorkerPool *pool, PlanetParams params, int tileSize, PlanetMaps *maps)
+//
+// Fills the maps in square tiles of 'tileSize' pixels spread across the pool.
+// Each tile goes to the batched noise at once, and every pixel only depends on
+// its own coordinates, so the maps are the same for any thread count.
+//
+// bool ExportPlanetMaps(WorkerPool *pool, PlanetParams params, int width, int height, int tileSize, const char *baseName, ExportStats *stats)
+//
+// Bakes the maps in strips of tiles and streams them to baseName_height.r32,
+// little endian floats, baseName_color.rgba and baseName_normal.rgb, 8 bits
+// per channel, all without a header.
+//
+// The exports write next to the target files and rename over them, like
+// SavePlanetCache, so a reader never sees half a file. 'stats' may be NULL.
+//
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum HeightmapFormat {
+    HEIGHTMAP_R32 = 0,
+    HEIGHTMAP_R16,
+} HeightmapFormat;
+
+typedef struct ExportStats {
+    size_t bytes;       // Size of the file
+    double time;        // Generating and writing, in seconds
+    int bandRows;       // Rows generated at once
+    float low;          // Range of the heights written
+    float high;
+} ExportStats;
+
+// Equirectangular maps of the surface, rows from the north pole down
+typedef struct PlanetMaps {
+    int width;
+    int height;
+    float *heights;             // Above the radius
+    Color *colors;
+    unsigned char *normals;     // Tangent space, 3 per pixel
+} PlanetMaps;
+
+bool ExportPlanetHeightmap(WorkerPool *pool, PlanetParams params, int width, int height, HeightmapFormat format, const char *fileName, ExportStats *stats);
+bool ExportPlanetGlb(WorkerPool *pool, PlanetParams params, int columns, int rows, const char *fileName, ExportStats *stats);
+
+PlanetMaps AllocPlanetMaps(int width, int height);
+void FreePlanetMaps(PlanetMaps maps);
+void BakePlanetMaps(WorkerPool *pool, PlanetParams params, int tileSize, PlanetMaps *maps);
+bool ExportPlanetMaps(WorkerPool *pool, PlanetParams params, int width, int height, int tileSize, const char *baseName, ExportStats *stats);
+
+#endif // EXPORT_H
+
+#ifdef EXPORT_IMPLEMENTATION
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Target size of a band, raised to a few rows per thread on narrow outputs
+#define EXPORT_BAND_BYTES (8 << 20)
+
+// Room left for the JSON chunk of a glb, padded with spaces
+#define EXPORT_GLB_JSON_SIZE 2048
+
+// Files written at once, the three maps of ExportPlanetMaps
+#define EXPORT_MAX_FILES 3
+
+// Interleaved position, normal and color of a glb vertex
+#define EXPORT_GLB_STRIDE 28
+
+// Height range and position bounds of one row
+typedef struct ExportRange {
+    float low;
+    float high;
+    Vector3 min;
+    Vector3 max;
+} ExportRange;
+
+typedef struct ExportJob ExportJob;
+
+// Fills row 'row' of the output into 'out'
+typedef void (*ExportRowFunc)(const ExportJob *job, int row, unsigned char *out, ExportRange *range);
+
+struct ExportJob {
+    PlanetParams params;
+    int columns;            // Samples per row
+    int rows;               // Rows of the output
+    size_t rowBytes;
+    HeightmapFormat format;
+    ExportRowFunc func;
+
+    // Band being generated
+    unsigned char *data;
+    ExportRange *ranges;
+    int first;
+};
+
+// Band handed to the writer thread, one buffer per file
+typedef struct ExportWrite {
+    int count;
+    FILE *files[EXPORT_MAX_FILES];
+    const unsigned char *data[EXPORT_MAX_FILES];
+    size_t sizes[EXPORT_MAX_FILES];
+    bool ok;
+} ExportWrite;
+
+typedef struct ExportWriter {
+    ExportWrite write;
+    pthread_t thread;
+    bool running;
+} ExportWriter;
+
+static void *WriteExportBand(void *arg)
+{
+    ExportWrite *write = arg;
+
+    for (int i = 0; write->ok && i < write->count; i++)
+        write->ok = write->sizes[i] == 0 || fwrite(write->data[i], write->sizes[i], 1, write->files[i]) == 1;
+
+    return NULL;
+}
+
+// Waits for the band being written, false if it or an earlier one failed
+static bool FinishExportWrite(ExportWriter *writer)
+{
+    if (writer->running)
+        pthread_join(writer->thread, NULL);
+
+    writer->running = false;
+    return writer->write.ok;
+}
+
+// Writes the band set in writer->write on the writer thread
+static bool StartExportWrite(ExportWriter *writer)
+{
+    writer->running = pthread_create(&writer->thread, NULL, WriteExportBand, &writer->write) == 0;
+    return writer->running;
+}
+
+static void GenerateExportRows(void *data, int begin, int end)
+{
+    const ExportJob *job = data;
+
+    for (int r = begin; r < end; r++)
+        job->func(job, job->first + r, job->data + r * job->rowBytes, &job->ranges[r]);
+}
+
+// Generates the rows of 'job' band by band and writes each one while the next
+// is generated, merging the ranges of every row into 'range'
+static bool StreamExportRows(WorkerPool *pool, ExportJob *job, FILE *file, ExportRange *range, int *bandRows)
+{
+    const int threads = GetWorkerPoolThreads(pool);
+
+    int rowsPerBand = EXPORT_BAND_BYTES / job->rowBytes;
+    rowsPerBand = Clamp(rowsPerBand, threads * 4, job->rows);
+    *bandRows = rowsPerBand;
+
+    unsigned char *buffers[2];
+    buffers[0] = (unsigned char *)RL_MALLOC(rowsPerBand * job->rowBytes * 2);
+    buffers[1] = buffers[0] + rowsPerBand * job->rowBytes;
+    job->ranges = (ExportRange *)RL_MALLOC(rowsPerBand * sizeof(ExportRange));
+
+    ExportWriter writer = { 0 };
+    writer.write.count = 1;
+    writer.write.files[0] = file;
+    writer.write.ok = true;
+    bool ok = true;
+
+    for (int first = 0, band = 0; ok && first < job->rows; first += rowsPerBand, band++) {
+        int count = (int)fminf(rowsPerBand, job->rows - first);
+
+        // The other buffer may still be on its way to the disk
+        job->data = buffers[band % 2];
+        job->first = first;
+        WorkerPoolFor(pool, count, 1, GenerateExportRows, job);
+
+        for (int r = 0; r < count; r++) {
+            ExportRange row = job->ranges[r];
+
+            if (first == 0 && r == 0)
+                *range = row;
+
+            range->low = fminf(range->low, row.low);
+            range->high = fmaxf(range->high, row.high);
+            range->min = Vector3Min(range->min, row.min);
+            range->max = Vector3Max(range->max, row.max);
+        }
+
+        ok = FinishExportWrite(&writer);
+
+        writer.write.data[0] = job->data;
+        writer.write.sizes[0] = count * job->rowBytes;
+        ok = ok && StartExportWrite(&writer);
+    }
+
+    ok = FinishExportWrite(&writer) && ok;
+
+    RL_FREE(job->ranges);
+    RL_FREE(buffers[0]);
+
+    return ok;
+}
+
+// Unit directions along a latitude, at 'columns' longitudes from 0, shifted by 'offset' steps
+static void GetLatitudeDirections(float latitude, int columns, float offset, int count, float *x, float *y, float *z)
+{
+    const float longitudeStep = 2 * PI / columns;
+    float latitudeCos = cosf(latitude);
+    float latitudeSin = sinf(latitude);
+
+    for (int j = 0; j < count; j++) {
+        float longitude = (j + offset) * longitudeStep;
+
+        x[j] = latitudeCos * cosf(longitude);
+        y[j] = latitudeCos * sinf(longitude);
+        z[j] = latitudeSin;
+    }
+}
+
+static void GenerateHeightmapRow(const ExportJob *job, int row, unsigned char *out, ExportRange *range)
+{
+    const int width = job->columns;
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *buffer = (float *)ArenaAlloc(arena, width * 4 * sizeof(float));
+    float *x = buffer;
+    float *y = buffer + width;
+    float *z = buffer + width * 2;
+    float *heights = buffer + width * 3;
+
+    // Pixel centers
+    GetLatitudeDirections(PI / 2 - (row + 0.5f) * PI / job->rows, width, 0.5f, width, x, y, z);
+    GetPlanetSurface(job->params, x, y, z, heights, NULL, width);
+
+    range->low = range->high = heights[0];
+
+    for (int j = 0; j < width; j++) {
+        range->low = fminf(range->low, heights[j]);
+        range->high = fmaxf(range->high, heights[j]);
+    }
+
+    if (job->format == HEIGHTMAP_R32) {
+        for (int j = 0; j < width; j++) {
+            uint32_t bits;
+            memcpy(&bits, &heights[j], sizeof(bits));
+
+            out[j * 4 + 0] = bits & 0xff;
+            out[j * 4 + 1] = (bits >> 8) & 0xff;
+            out[j * 4 + 2] = (bits >> 16) & 0xff;
+            out[j * 4 + 3] = bits >> 24;
+        }
+    }
+    else {
+        const float bound = GetPlanetNoiseBound(job->params);
+
+        for (int j = 0; j < width; j++) {
+            float t = Clamp((heights[j] + bound) / (2 * bound), 0, 1);
+            unsigned short value = (unsigned short)(t * 65535 + 0.5f);
+
+            out[j * 2 + 0] = value & 0xff;
+            out[j * 2 + 1] = value >> 8;
+        }
+    }
+
+    RewindArena(arena, mark);
+}
+
+// Same grid as the UV sphere of planet.h, turned so that its pole is the Y axis of glTF
+static void GenerateGlbRow(const ExportJob *job, int row, unsigned char *out, ExportRange *range)
+{
+    const int count = job->columns + 1;
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *buffer = (float *)ArenaAlloc(arena, count * 4 * sizeof(float));
+    Vector3 *normals = (Vector3 *)ArenaAlloc(arena, count * sizeof(Vector3));
+    float *x = buffer;
+    float *y = buffer + count;
+    float *z = buffer + count * 2;
+    float *heights = buffer + count * 3;
+
+    // One more row of vertices than of quads
+    GetLatitudeDirections(PI / 2 - row * PI / (job->rows - 1), job->columns, 0, count, x, y, z);
+    GetPlanetSurface(job->params, x, y, z, heights, normals, count);
+
+    for (int j = 0; j < count; j++) {
+        float distance = job->params.radius + heights[j];
+        Vector3 position = { x[j] * distance, z[j] * distance, -y[j] * distance };
+        Vector3 normal = { normals[j].x, normals[j].z, -normals[j].y };
+        Color color = heightToColor(heights[j]);
+
+        if (j == 0) {
+            range->low = range->high = heights[j];
+            range->min = range->max = position;
+        }
+
+        range->low = fminf(range->low, heights[j]);
+        range->high = fmaxf(range->high, heights[j]);
+        range->min = Vector3Min(range->min, position);
+        range->max = Vector3Max(range->max, position);
+
+        unsigned char *vertex = out + j * EXPORT_GLB_STRIDE;
+        memcpy(vertex, &position, sizeof(Vector3));
+        memcpy(vertex + 12, &normal, sizeof(Vector3));
+        memcpy(vertex + 24, &color, sizeof(Color));
+    }
+
+    RewindArena(arena, mark);
+}
+
+// Opens the file written in place of 'fileName'
+static FILE *OpenExportFile(const char *fileName, char *tempName, int tempSize)
+{
+    snprintf(tempName, tempSize, "%s.tmp", fileName);
+    return fopen(tempName, "wb");
+}
+
+static bool CloseExportFile(FILE *file, bool ok, const char *fileName, const char *tempName)
+{
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tempName, fileName) == 0;
+
+    if (!ok)
+        remove(tempName);
+
+    return ok;
+}
+
+bool ExportPlanetHeightmap(WorkerPool *pool, PlanetParams params, int width, int height, HeightmapFormat format, const char *fileName, ExportStats *stats)
+{
+    if (width < 1 || height < 1)
+        return false;
+
+    double start = GetWallTime();
+
+    ExportJob job = { 0 };
+    job.params = params;
+    job.columns = width;
+    job.rows = height;
+    job.rowBytes = width * (format == HEIGHTMAP_R32 ? sizeof(float) : sizeof(unsigned short));
+    job.format = format;
+    job.func = GenerateHeightmapRow;
+
+    char tempName[4096];
+    FILE *file = OpenExportFile(fileName, tempName, sizeof(tempName));
+    if (file == NULL)
+        return false;
+
+    ExportRange range = { 0 };
+    int bandRows = 0;
+    bool ok = StreamExportRows(pool, &job, file, &range, &bandRows);
+    ok = CloseExportFile(file, ok, fileName, tempName);
+
+    if (ok && stats != NULL) {
+        stats->bytes = job.rowBytes * height;
+        stats->time = GetWallTime() - start;
+        stats->bandRows = bandRows;
+        stats->low = range.low;
+        stats->high = range.high;
+    }
+
+    return ok;
+}
+
+static bool WriteGlbUint32(FILE *file, uint32_t value)
+{
+    unsigned char bytes[4] = { value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24 };
+    return fwrite(bytes, sizeof(bytes), 1, file) == 1;
+}
+
+// Indices of the quad rows, one row at a time, in the winding of AllocChunkedMesh
+static bool WriteGlbIndices(FILE *file, int columns, int rows)
+{
+    uint32_t *indices = (uint32_t *)RL_MALLOC(columns * 6 * sizeof(uint32_t));
+    bool ok = true;
+
+    for (int i = 0; ok && i < rows; i++) {
+        int v = 0;
+
+        for (int j = 0; j < columns; j++) {
+            uint32_t k1 = (uint32_t)i * (columns + 1) + j;
+            uint32_t k2 = k1 + columns + 1;
+
+            if (i != 0) {
+                indices[v++] = k1;
+                indices[v++] = k2;
+                indices[v++] = k1 + 1;
+            }
+
+            if (i != rows - 1) {
+                indices[v++] = k1 + 1;
+                indices[v++] = k2;
+                indices[v++] = k2 + 1;
+            }
+        }
+
+        ok = fwrite(indices, v * sizeof(uint32_t), 1, file) == 1;
+    }
+
+    RL_FREE(indices);
+    return ok;
+}
+
+bool ExportPlanetGlb(WorkerPool *pool, PlanetParams params, int columns, int rows, const char *fileName, ExportStats *stats)
+{
+    if (columns < 3 || rows < 2)
+        return false;
+
+    const uint64_t vertexCount = (uint64_t)(columns + 1) * (rows + 1);
+    const uint64_t indexCount = (uint64_t)columns * (rows - 1) * 6;
+    const uint64_t vertexBytes = vertexCount * EXPORT_GLB_STRIDE;
+    const uint64_t indexBytes = indexCount * sizeof(uint32_t);
+    const uint64_t fileSize = 12 + 8 + EXPORT_GLB_JSON_SIZE + 8 + vertexBytes + indexBytes;
+
+    if (fileSize > UINT32_MAX)
+        return false;
+
+    double start = GetWallTime();
+
+    char tempName[4096];
+    FILE *file = OpenExportFile(fileName, tempName, sizeof(tempName));
+    if (file == NULL)
+        return false;
+
+    // Header, then the JSON chunk left blank until the bounds are known
+    char json[EXPORT_GLB_JSON_SIZE + 1];
+    memset(json, ' ', EXPORT_GLB_JSON_SIZE);
+
+    bool ok = fwrite("glTF", 4, 1, file) == 1
+        && WriteGlbUint32(file, 2)
+        && WriteGlbUint32(file, (uint32_t)fileSize)
+        && WriteGlbUint32(file, EXPORT_GLB_JSON_SIZE)
+        && fwrite("JSON", 4, 1, file) == 1
+        && fwrite(json, EXPORT_GLB_JSON_SIZE, 1, file) == 1
+        && WriteGlbUint32(file, (uint32_t)(vertexBytes + indexBytes))
+        && fwrite("BIN\0", 4, 1, file) == 1;
+
+    ExportJob job = { 0 };
+    job.params = params;
+    job.columns = columns;
+    job.rows = rows + 1;
+    job.rowBytes = (columns + 1) * EXPORT_GLB_STRIDE;
+    job.func = GenerateGlbRow;
+
+    ExportRange range = { 0 };
+    int bandRows = 0;
+    ok = ok && StreamExportRows(pool, &job, file, &range, &bandRows);
+    ok = ok && WriteGlbIndices(file, columns, rows);
+
+    int length = snprintf(json, sizeof(json),
+        "{\"asset\":{\"version\":\"2.0\",\"generator\":\"terragen\"},"
+        "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"COLOR_0\":2},\"indices\":3}]}],"
+        "\"buffers\":[{\"byteLength\":%llu}],"
+        "\"bufferViews\":["
+        "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%llu,\"byteStride\":%d,\"target\":34962},"
+        "{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu,\"target\":34963}],"
+        "\"accessors\":["
+        "{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\","
+        "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+        "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"},"
+        "{\"bufferView\":0,\"byteOffset\":24,\"componentType\":5121,\"normalized\":true,\"count\":%llu,\"type\":\"VEC4\"},"
+        "{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":%llu,\"type\":\"SCALAR\"}]}",
+        (unsigned long long)(vertexBytes + indexBytes),
+        (unsigned long long)vertexBytes, EXPORT_GLB_STRIDE,
+        (unsigned long long)vertexBytes, (unsigned long long)indexBytes,
+        (unsigned long long)vertexCount,
+        range.min.x, range.min.y, range.min.z, range.max.x, range.max.y, range.max.z,
+        (unsigned long long)vertexCount, (unsigned long long)vertexCount, (unsigned long long)indexCount);
+
+    ok = ok && length < EXPORT_GLB_JSON_SIZE;
+
+    if (ok) {
+        json[length] = ' ';
+        ok = fseek(file, 20, SEEK_SET) == 0 && fwrite(json, EXPORT_GLB_JSON_SIZE, 1, file) == 1;
+    }
+
+    ok = CloseExportFile(file, ok, fileName, tempName);
+
+    if (ok && stats != NULL) {
+        stats->bytes = fileSize;
+        stats->time = GetWallTime() - start;
+        stats->bandRows = bandRows;
+        stats->low = range.low;
+        stats->high = range.high;
+    }
+
+    return ok;
+}
+
+PlanetMaps AllocPlanetMaps(int width, int height)
+{
+    PlanetMaps maps = { 0 };
+    maps.width = width;
+    maps.height = height;
+    maps.heights = (float *)RL_MALLOC(width * height * sizeof(float));
+    maps.colors = (Color *)RL_MALLOC(width * height * sizeof(Color));
+    maps.normals = (unsigned char *)RL_MALLOC(width * height * 3);
+
+    return maps;
+}
+
+void FreePlanetMaps(PlanetMaps maps)
+{
+    RL_FREE(maps.heights);
+    RL_FREE(maps.colors);
+    RL_FREE(maps.normals);
+}
+
+typedef struct MapTilesJob {
+    PlanetParams params;
+    PlanetMaps *maps;       // Rows [firstRow, firstRow + maps->height) of the map
+    int mapHeight;
+    int firstRow;
+    int tileSize;
+    int tileColumns;
+} MapTilesJob;
+
+static void BakeMapTiles(void *data, int begin, int end)
+{
+    const MapTilesJob *job = data;
+    PlanetMaps *maps = job->maps;
+
+    const int tileSize = job->tileSize;
+    const int tilePixels = tileSize * tileSize;
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *buffer = (float *)ArenaAlloc(arena, tilePixels * 4 * sizeof(float));
+    Vector3 *normals = (Vector3 *)ArenaAlloc(arena, tilePixels * sizeof(Vector3));
+    float *x = buffer;
+    float *y = buffer + tilePixels;
+    float *z = buffer + tilePixels * 2;
+    float *heights = buffer + tilePixels * 3;
+
+    for (int t = begin; t < end; t++) {
+        int x0 = (t % job->tileColumns) * tileSize;
+        int y0 = (t / job->tileColumns) * tileSize;
+        int width = (int)fminf(tileSize, maps->width - x0);
+        int height = (int)fminf(tileSize, maps->height - y0);
+
+        // Pixel centers of the whole tile, then a single noise batch
+        for (int i = 0; i < height; i++) {
+            float latitude = PI / 2 - (job->firstRow + y0 + i + 0.5f) * PI / job->mapHeight;
+            int k = i * width;
+            GetLatitudeDirections(latitude, maps->width, x0 + 0.5f, width, x + k, y + k, z + k);
+        }
+
+        GetPlanetSurface(job->params, x, y, z, heights, normals, width * height);
+
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                int k = i * width + j;
+                int p = (y0 + i) * maps->width + x0 + j;
+
+                // Pixel centers never fall on the poles, where east is undefined
+                Vector3 up = { x[k], y[k], z[k] };
+                Vector3 east = Vector3Normalize((Vector3){ -y[k], x[k], 0 });
+                Vector3 north = Vector3CrossProduct(up, east);
+                Vector3 tangent = {
+                    Vector3DotProduct(normals[k], east),
+                    Vector3DotProduct(normals[k], north),
+                    Vector3DotProduct(normals[k], up),
+                };
+
+                maps->heights[p] = heights[k];
+                maps->colors[p] = heightToColor(heights[k]);
+                maps->normals[p * 3 + 0] = (unsigned char)Clamp(tangent.x * 127.5f + 128, 0, 255);
+                maps->normals[p * 3 + 1] = (unsigned char)Clamp(tangent.y * 127.5f + 128, 0, 255);
+                maps->normals[p * 3 + 2] = (unsigned char)Clamp(tangent.z * 127.5f + 128, 0, 255);
+            }
+        }
+    }
+
+    RewindArena(arena, mark);
+}
+
+// Bakes the rows of 'maps' as rows [firstRow, firstRow + maps->height) of a map 'mapHeight' tall
+static void BakePlanetMapRows(WorkerPool *pool, PlanetParams params, int tileSize, int mapHeight, int firstRow, PlanetMaps *maps)
+{
+    MapTilesJob job = { params, maps, mapHeight, firstRow, tileSize, 0 };
+    job.tileColumns = (maps->width + tileSize - 1) / tileSize;
+    int tileRows = (maps->height + tileSize - 1) / tileSize;
+
+    WorkerPoolFor(pool, job.tileColumns * tileRows, 1, BakeMapTiles, &job);
+}
+
+void BakePlanetMaps(WorkerPool *pool, PlanetParams params, int tileSize, PlanetMaps *maps)
+{
+    BakePlanetMapRows(pool, params, Clamp(tileSize, 1, 1024), maps->height, 0, maps);
+}
+
+// Puts floats in little endian order in place, a no-op on little endian hosts
+static void SetLittleEndianFloats(float *values, int count)
+{
+    const uint32_t one = 1;
+    if (*(const unsigned char *)&one == 1)
+        return;
+
+    for (int i = 0; i < count; i++) {
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+        memcpy(&values[i], &bits, sizeof(bits));
+    }
+}
+
+bool ExportPlanetMaps(WorkerPool *pool, PlanetParams params, int width, int height, int tileSize, const char *baseName, ExportStats *stats)
+{
+    if (width < 1 || height < 1)
+        return false;
+
+    tileSize = Clamp(tileSize, 1, 1024);
+    double start = GetWallTime();
+
+    // Strips of whole tile rows, enough of them to keep every thread busy
+    const size_t pixelBytes = sizeof(float) + sizeof(Color) + 3;
+    const int tileColumns = (width + tileSize - 1) / tileSize;
+    const int threads = GetWorkerPoolThreads(pool);
+
+    int stripTiles = EXPORT_BAND_BYTES / (pixelBytes * width * tileSize);
+    stripTiles = Clamp(stripTiles, (threads * 4 + tileColumns - 1) / tileColumns, (height + tileSize - 1) / tileSize);
+    const int stripRows = stripTiles * tileSize;
+
+    const char *suffixes[3] = { "_height.r32", "_color.rgba", "_normal.rgb" };
+    char fileNames[3][4096];
+    char tempNames[3][4096];
+    FILE *files[3] = { 0 };
+    bool ok = true;
+
+    for (int i = 0; i < 3; i++) {
+        snprintf(fileNames[i], sizeof(fileNames[i]), "%s%s", baseName, suffixes[i]);
+        files[i] = ok ? OpenExportFile(fileNames[i], tempNames[i], sizeof(tempNames[i])) : NULL;
+        ok = ok && files[i] != NULL;
+    }
+
+    PlanetMaps strips[2] = { AllocPlanetMaps(width, stripRows), AllocPlanetMaps(width, stripRows) };
+
+    ExportWriter writer = { 0 };
+    writer.write.count = 3;
+    writer.write.ok = true;
+
+    float low = 0;
+    float high = 0;
+
+    for (int first = 0, band = 0; ok && first < height; first += stripRows, band++) {
+        // The other strip may still be on its way to the disk
+        PlanetMaps *strip = &strips[band % 2];
+        strip->height = (int)fminf(stripRows, height - first);
+        BakePlanetMapRows(pool, params, tileSize, height, first, strip);
+
+        int pixels = width * strip->height;
+
+        for (int i = 0; i < pixels; i++) {
+            if (first == 0 && i == 0)
+                low = high = strip->heights[i];
+
+            low = fminf(low, strip->heights[i]);
+            high = fmaxf(high, strip->heights[i]);
+        }
+
+        SetLittleEndianFloats(strip->heights, pixels);
+
+        ok = FinishExportWrite(&writer);
+
+        const void *data[3] = { strip->heights, strip->colors, strip->normals };
+        const size_t sizes[3] = { pixels * sizeof(float), pixels * sizeof(Color), pixels * 3 };
+
+        for (int i = 0; i < 3; i++) {
+            writer.write.files[i] = files[i];
+            writer.write.data[i] = data[i];
+            writer.write.sizes[i] = sizes[i];
+        }
+
+        ok = ok && StartExportWrite(&writer);
+    }
+
+    ok = FinishExportWrite(&writer) && ok;
+
+    for (int i = 0; i < 3; i++) {
+        if (files[i] != NULL)
+            ok = CloseExportFile(files[i], ok, fileNames[i], tempNames[i]);
+    }
+
+    FreePlanetMaps(strips[0]);
+    FreePlanetMaps(strips[1]);
+
+    if (ok && stats != NULL) {
+        stats->bytes = (size_t)width * height * pixelBytes;
+        stats->time = GetWallTime() - start;
+        stats->bandRows = stripRows;
+        stats->low = low;
+        stats->high = high;
+    }
+
+    return ok;
+}
+
+#endif // EXPORT_IMPLEMENTATION
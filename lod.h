@@ -0,0 +1,506 @@
+// lod.h - quadtree level of detail for cube sphere planets
+//
+// to create the implementation,
+//     #define LOD_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// stb_perlin.h, arena.h, parallel.h and planet.h must be included before this file.
+// Unlike planet.h this needs the raylib library: tiles are uploaded and drawn
+// from the thread calling UpdatePlanetLod, which must own the GL context.
+//
+//
+// Documentation:
+//
+// PlanetLod *LoadPlanetLod(WorkerPool *pool, PlanetParams params, PlanetLodSettings settings)
+//
+// Every cube face is the root of a quadtree of PlanetTile. Tiles split when
+// the camera gets closer than 'splitDistance' times their size and merge
+// back when it moves away, as long as at most 'maxTiles' tiles are drawn.
+// Every tile is generated by its own job on 'pool', which hands it back with
+// RunOnMainThread, so RunMainThreadJobs must run before UpdatePlanetLod for
+// it to be uploaded. A tile is only replaced by its children once all four
+// are uploaded, so the surface never has holes.
+//
+// Tiles are generated into blocks of a MemoryPool, one per tile, which go
+// back to the pool once uploaded: only the tiles in flight have a CPU copy,
+// and after the first splits the generation no longer allocates.
+//
+// bool UpdatePlanetLod(PlanetLod *lod, Vector3 camera)
+//
+// Uploads up to 'uploadsPerFrame' finished tiles, then picks the tiles to
+// draw for 'camera' (in model space) and queues the ones still missing.
+// Returns true when DrawPlanetLod draws something different than before,
+// either other tiles or tiles regenerated with new noise parameters.
+//
+
+#ifndef LOD_H
+#define LOD_H
+
+typedef struct PlanetLodSettings {
+    int tileSlices;         // Quads along a tile side
+    int maxLevel;           // Deepest split, at most MAX_TILE_LEVEL
+    int maxTiles;           // Tiles drawn at most, bounds the triangles
+    float splitDistance;    // Split when closer than this many tile sizes
+    int uploadsPerFrame;
+} PlanetLodSettings;
+
+typedef struct PlanetLodStats {
+    int drawnTiles;
+    int drawnTriangles;
+    int deepestLevel;
+    int nodes;
+    int queued;             // Tiles waiting for or being generated
+    int stagingBlocks;      // Tile buffers the pool took from malloc
+    size_t stagingBytes;
+} PlanetLodStats;
+
+typedef struct PlanetLod PlanetLod;
+
+PlanetLodSettings GetDefaultPlanetLodSettings(void);
+
+PlanetLod *LoadPlanetLod(WorkerPool *pool, PlanetParams params, PlanetLodSettings settings);
+void UnloadPlanetLod(PlanetLod *lod);
+void SetPlanetLodParams(PlanetLod *lod, PlanetParams params);
+bool UpdatePlanetLod(PlanetLod *lod, Vector3 camera);
+void DrawPlanetLod(PlanetLod *lod, Material material, Matrix transform);
+PlanetLodStats GetPlanetLodStats(PlanetLod *lod);
+
+#endif // LOD_H
+
+#ifdef LOD_IMPLEMENTATION
+
+// Tiles queued at most, so that a moving camera does not pile up stale work
+#define LOD_MAX_JOBS 64
+
+typedef struct LodNode {
+    PlanetTile tile;
+    Vector3 center;         // Middle of the tile on the undisplaced sphere
+    float size;             // Side of the tile along the sphere
+    int children[4];        // Child nodes, or -1 for a leaf
+    bool used;
+    float priority;         // Size over distance to the camera, this frame
+
+    Mesh mesh;              // Uploaded once 'ready'
+    bool ready;
+    bool queued;
+    unsigned request;       // Latest generation asked for this node
+    unsigned version;       // Noise parameters the mesh was generated with
+} LodNode;
+
+typedef struct LodJob {
+    PlanetLod *lod;
+    int node;
+    unsigned request;
+    unsigned version;
+    PlanetTile tile;
+    int tileSlices;
+    PlanetParams params;
+    MemoryPool *buffers;
+    void *buffer;           // Block of 'buffers' holding the mesh arrays
+    Mesh mesh;
+} LodJob;
+
+struct PlanetLod {
+    WorkerPool *pool;
+    PlanetLodSettings settings;
+    PlanetParams params;
+    unsigned version;
+    unsigned requests;
+
+    LodNode *nodes;
+    int nodeCapacity;
+    int nodeCount;
+
+    int *visit;             // Traversal heap, largest priority on top
+    int visitCount;
+    int *drawn;
+    int drawnCount;
+    int *lastDrawn;         // Tiles drawn the frame before, to tell when they change
+    int lastDrawnCount;
+    int queued;             // Tiles generating or waiting for their upload
+    MemoryPool tileBuffers;
+
+    Job *jobs;              // Parent of the tile jobs, only run to unload
+
+    // Handed over by the tile jobs, only touched from the main thread
+    LodJob *done[LOD_MAX_JOBS];
+    int doneCount;
+};
+
+PlanetLodSettings GetDefaultPlanetLodSettings(void)
+{
+    PlanetLodSettings settings = {
+        .tileSlices = 32,
+        .maxLevel = 12,
+        .maxTiles = 384,
+        .splitDistance = 3.0f,
+        .uploadsPerFrame = 16,
+    };
+
+    return settings;
+}
+
+// Runs on the main thread, the upload waits for UpdatePlanetLod and its budget
+static void PublishLodTile(void *data)
+{
+    LodJob *job = data;
+    PlanetLod *lod = job->lod;
+
+    lod->done[lod->doneCount++] = job;
+}
+
+static void GenerateLodTileJob(WorkerPool *pool, Job *job, void *data)
+{
+    (void)job;
+
+    LodJob *tile = data;
+    tile->buffer = AllocPoolBlock(tile->buffers);
+    tile->mesh = InitPlanetTileMesh(tile->buffer, tile->tileSlices);
+    GeneratePlanetTile(&tile->mesh, tile->tile, tile->tileSlices, tile->params);
+
+    RunOnMainThread(pool, PublishLodTile, tile);
+}
+
+static void RunLodRootJob(WorkerPool *pool, Job *job, void *data)
+{
+    (void)pool;
+    (void)job;
+    (void)data;
+}
+
+static int AllocLodNode(PlanetLod *lod, PlanetTile tile)
+{
+    for (int i = 0; i < lod->nodeCapacity; i++) {
+        LodNode *node = &lod->nodes[i];
+        if (node->used)
+            continue;
+
+        memset(node, 0, sizeof(LodNode));
+        node->used = true;
+        node->tile = tile;
+        node->children[0] = node->children[1] = node->children[2] = node->children[3] = -1;
+
+        int slices = 2 << tile.level;
+        Vector3 direction = GetCubeSphereDirection(tile.face, tile.x * 2 + 1, tile.y * 2 + 1, slices);
+        node->center = Vector3Scale(direction, lod->params.radius);
+        node->size = lod->params.radius * PI / 2 / (1 << tile.level);
+
+        lod->nodeCount++;
+        return i;
+    }
+
+    return -1;
+}
+
+// Frees the children of a node and everything below them; jobs still in
+// flight for them are thrown away when they come back
+static void FreeLodChildren(PlanetLod *lod, LodNode *node)
+{
+    for (int c = 0; c < 4; c++) {
+        if (node->children[c] < 0)
+            continue;
+
+        LodNode *child = &lod->nodes[node->children[c]];
+        FreeLodChildren(lod, child);
+
+        if (child->ready)
+            UnloadMesh(child->mesh);
+
+        child->used = false;
+        node->children[c] = -1;
+        lod->nodeCount--;
+    }
+}
+
+static void QueueLodNode(PlanetLod *lod, int index)
+{
+    LodNode *node = &lod->nodes[index];
+
+    if (node->queued || (node->ready && node->version == lod->version) || lod->queued == LOD_MAX_JOBS)
+        return;
+
+    LodJob *job = RL_CALLOC(1, sizeof(LodJob));
+    job->lod = lod;
+    job->node = index;
+    job->request = node->request = ++lod->requests;
+    job->version = lod->version;
+    job->tile = node->tile;
+    job->tileSlices = lod->settings.tileSlices;
+    job->params = lod->params;
+    job->buffers = &lod->tileBuffers;
+
+    node->queued = true;
+    lod->queued++;
+
+    RunJob(lod->pool, CreateJob(lod->pool, lod->jobs, GenerateLodTileJob, job));
+}
+
+static void PushLodVisit(PlanetLod *lod, int index, Vector3 camera)
+{
+    LodNode *node = &lod->nodes[index];
+
+    // Distance to the nearest point of the tile, roughly
+    float distance = Vector3Distance(camera, node->center) - node->size * 0.75f;
+    node->priority = node->size / fmaxf(distance, 1e-6f);
+
+    int i = lod->visitCount++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (lod->nodes[lod->visit[parent]].priority >= node->priority)
+            break;
+
+        lod->visit[i] = lod->visit[parent];
+        i = parent;
+    }
+
+    lod->visit[i] = index;
+}
+
+static int PopLodVisit(PlanetLod *lod)
+{
+    int top = lod->visit[0];
+    int last = lod->visit[--lod->visitCount];
+    float priority = lod->nodes[last].priority;
+
+    int i = 0;
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= lod->visitCount)
+            break;
+
+        if (child + 1 < lod->visitCount && lod->nodes[lod->visit[child + 1]].priority > lod->nodes[lod->visit[child]].priority)
+            child++;
+
+        if (priority >= lod->nodes[lod->visit[child]].priority)
+            break;
+
+        lod->visit[i] = lod->visit[child];
+        i = child;
+    }
+
+    lod->visit[i] = last;
+    return top;
+}
+
+// Takes finished tiles and uploads them, or refreshes the GPU buffers of
+// tiles regenerated with new noise parameters. Returns true if a refresh happened
+static bool UploadLodTiles(PlanetLod *lod)
+{
+    bool refreshed = false;
+
+    int count = lod->doneCount < lod->settings.uploadsPerFrame ? lod->doneCount : lod->settings.uploadsPerFrame;
+
+    for (int i = 0; i < count; i++) {
+        LodJob *job = lod->done[i];
+        LodNode *node = &lod->nodes[job->node];
+        lod->queued--;
+
+        // Merged away, or asked again since
+        if (!node->used || node->request != job->request) {
+            FreePoolBlock(&lod->tileBuffers, job->buffer);
+            RL_FREE(job);
+            continue;
+        }
+
+        node->queued = false;
+        node->version = job->version;
+
+        if (!node->ready) {
+            node->mesh = job->mesh;
+            UploadMesh(&node->mesh, false);
+            node->ready = true;
+
+            // The GPU has its copy, the arrays go back to the pool and UnloadMesh only frees the buffers
+            node->mesh.vertices = node->mesh.normals = NULL;
+            node->mesh.colors = NULL;
+            node->mesh.indices = NULL;
+        }
+        else {
+            // Same layout, so only the vertex data changes
+            // raylib buffer slots: 0 positions, 2 normals, 3 colors
+            UpdateMeshBuffer(node->mesh, 0, job->mesh.vertices, job->mesh.vertexCount * 3 * sizeof(float), 0);
+            UpdateMeshBuffer(node->mesh, 2, job->mesh.normals, job->mesh.vertexCount * 3 * sizeof(float), 0);
+            UpdateMeshBuffer(node->mesh, 3, job->mesh.colors, job->mesh.vertexCount * 4 * sizeof(unsigned char), 0);
+            refreshed = true;
+        }
+
+        FreePoolBlock(&lod->tileBuffers, job->buffer);
+        RL_FREE(job);
+    }
+
+    memmove(lod->done, lod->done + count, (lod->doneCount - count) * sizeof(LodJob *));
+    lod->doneCount -= count;
+
+    return refreshed;
+}
+
+PlanetLod *LoadPlanetLod(WorkerPool *pool, PlanetParams params, PlanetLodSettings settings)
+{
+    PlanetLod *lod = RL_CALLOC(1, sizeof(PlanetLod));
+    lod->pool = pool;
+    lod->params = params;
+
+    settings.tileSlices = Clamp(settings.tileSlices, 1, MAX_TILE_SLICES);
+    settings.maxLevel = Clamp(settings.maxLevel, 0, MAX_TILE_LEVEL);
+    settings.maxTiles = settings.maxTiles > 6 ? settings.maxTiles : 6;
+    settings.uploadsPerFrame = Clamp(settings.uploadsPerFrame, 1, LOD_MAX_JOBS);
+    lod->settings = settings;
+
+    // Drawn tiles, plus the parents kept while they are drawn and the
+    // children being generated before they replace them
+    lod->nodeCapacity = settings.maxTiles * 2 + 6;
+    lod->nodes = RL_CALLOC(lod->nodeCapacity, sizeof(LodNode));
+    lod->visit = RL_MALLOC(lod->nodeCapacity * sizeof(int));
+    lod->drawn = RL_MALLOC(lod->nodeCapacity * sizeof(int));
+    lod->lastDrawn = RL_MALLOC(lod->nodeCapacity * sizeof(int));
+    InitMemoryPool(&lod->tileBuffers, GetPlanetTileMeshSize(settings.tileSlices));
+
+    for (int face = 0; face < 6; face++)
+        AllocLodNode(lod, (PlanetTile){ face, 0, 0, 0 });
+
+    // Children keep it unfinished until it is run
+    lod->jobs = CreateJob(pool, NULL, RunLodRootJob, NULL);
+
+    return lod;
+}
+
+void UnloadPlanetLod(PlanetLod *lod)
+{
+    if (lod == NULL)
+        return;
+
+    // Once the tile jobs are done, their hand overs are all queued
+    RunJob(lod->pool, lod->jobs);
+    WaitJob(lod->pool, lod->jobs);
+
+    while (lod->doneCount < lod->queued)
+        RunMainThreadJobs(lod->pool);
+
+    for (int i = 0; i < lod->doneCount; i++) {
+        FreePoolBlock(&lod->tileBuffers, lod->done[i]->buffer);
+        RL_FREE(lod->done[i]);
+    }
+
+    for (int i = 0; i < lod->nodeCapacity; i++) {
+        if (lod->nodes[i].used && lod->nodes[i].ready)
+            UnloadMesh(lod->nodes[i].mesh);
+    }
+
+    UnloadMemoryPool(&lod->tileBuffers);
+
+    RL_FREE(lod->lastDrawn);
+    RL_FREE(lod->drawn);
+    RL_FREE(lod->visit);
+    RL_FREE(lod->nodes);
+    RL_FREE(lod);
+}
+
+// Regenerates every tile with new noise parameters; the old tiles stay drawn until then
+void SetPlanetLodParams(PlanetLod *lod, PlanetParams params)
+{
+    params.radius = lod->params.radius;
+    lod->params = params;
+    lod->version++;
+}
+
+bool UpdatePlanetLod(PlanetLod *lod, Vector3 camera)
+{
+    bool refreshed = UploadLodTiles(lod);
+
+    const PlanetLodSettings *settings = &lod->settings;
+
+    // Keep last frame's selection to compare with
+    int *lastDrawn = lod->lastDrawn;
+    lod->lastDrawn = lod->drawn;
+    lod->lastDrawnCount = lod->drawnCount;
+    lod->drawn = lastDrawn;
+
+    int tiles = 6;
+    lod->drawnCount = 0;
+    lod->visitCount = 0;
+
+    // Roots are the first six nodes. The tiles that look largest from the
+    // camera are split first, so the budget goes where it shows the most
+    for (int face = 0; face < 6; face++)
+        PushLodVisit(lod, face, camera);
+
+    while (lod->visitCount > 0) {
+        int index = PopLodVisit(lod);
+        LodNode *node = &lod->nodes[index];
+
+        QueueLodNode(lod, index);
+
+        // Some slack before merging, so a camera on the boundary does not thrash
+        bool split = node->children[0] >= 0;
+        float threshold = (split ? 0.8f : 1.0f) / settings->splitDistance;
+
+        bool wantSplit = node->tile.level < settings->maxLevel && node->priority > threshold && tiles + 3 <= settings->maxTiles;
+
+        if (wantSplit && !split) {
+            PlanetTile tile = node->tile;
+
+            for (int c = 0; c < 4; c++) {
+                PlanetTile child = { tile.face, tile.level + 1, tile.x * 2 + (c & 1), tile.y * 2 + (c >> 1) };
+                node->children[c] = AllocLodNode(lod, child);
+            }
+
+            // Out of nodes, stay coarse
+            if (node->children[0] < 0 || node->children[1] < 0 || node->children[2] < 0 || node->children[3] < 0) {
+                FreeLodChildren(lod, node);
+                wantSplit = false;
+            }
+        }
+
+        if (!wantSplit) {
+            FreeLodChildren(lod, node);
+
+            if (node->ready)
+                lod->drawn[lod->drawnCount++] = index;
+            continue;
+        }
+
+        bool childrenReady = true;
+        for (int c = 0; c < 4; c++) {
+            QueueLodNode(lod, node->children[c]);
+            childrenReady = childrenReady && lod->nodes[node->children[c]].ready;
+        }
+
+        if (childrenReady) {
+            tiles += 3;
+            for (int c = 0; c < 4; c++)
+                PushLodVisit(lod, node->children[c], camera);
+        }
+        else if (node->ready)
+            lod->drawn[lod->drawnCount++] = index;
+    }
+
+    // A reused node is not ready before a later frame, so the same drawn indices mean the same tiles
+    return refreshed || lod->drawnCount != lod->lastDrawnCount
+        || memcmp(lod->drawn, lod->lastDrawn, lod->drawnCount * sizeof(int)) != 0;
+}
+
+void DrawPlanetLod(PlanetLod *lod, Material material, Matrix transform)
+{
+    for (int i = 0; i < lod->drawnCount; i++)
+        DrawMesh(lod->nodes[lod->drawn[i]].mesh, material, transform);
+}
+
+PlanetLodStats GetPlanetLodStats(PlanetLod *lod)
+{
+    PlanetLodStats stats = { 0 };
+    stats.drawnTiles = lod->drawnCount;
+    stats.nodes = lod->nodeCount;
+    stats.queued = lod->queued;
+    stats.stagingBytes = GetMemoryPoolSize(&lod->tileBuffers);
+    stats.stagingBlocks = stats.stagingBytes / lod->tileBuffers.blockSize;
+
+    for (int i = 0; i < lod->drawnCount; i++) {
+        const LodNode *node = &lod->nodes[lod->drawn[i]];
+        stats.drawnTriangles += node->mesh.triangleCount;
+        stats.deepestLevel = node->tile.level > stats.deepestLevel ? node->tile.level : stats.deepestLevel;
+    }
+
+    return stats;
+}
+
+#endif // LOD_IMPLEMENTATION
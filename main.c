@@ -1,5 +1,6 @@
 #include <raylib.h>
 #include <raymath.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <rlgl.h>
@@ -7,142 +8,158 @@
 #define STB_PERLIN_IMPLEMENTATION
 #include "stb_perlin.h"
 
-static Color heightToColor(float noise)
-{
-    if (noise > 0.5)
-        return DARKGRAY;
-
-    if (noise > 0.3)
-        return DARKBROWN;
+#define NOISE_IMPLEMENTATION
+#include "noise.h"
 
-    if (noise > 0.15)
-        return BROWN;
+#define ARENA_IMPLEMENTATION
+#include "arena.h"
 
-    if (noise > 0)
-        return DARKGREEN;
+#define NOISE_GRAPH_IMPLEMENTATION
+#include "noisegraph.h"
 
-    if (noise > -0.2)
-        return SKYBLUE;
-
-    return DARKBLUE;
-}
+#define PARALLEL_IMPLEMENTATION
+#include "parallel.h"
 
-static Mesh GenerateMesh(int longitudeSlices, int latitudeSlices, float radius, float scale, float lacunarity, float gain, int octaves)
-{
-    Mesh mesh = { 0 };
-    mesh.triangleCount = longitudeSlices * (latitudeSlices - 1) * 2;
-    mesh.vertexCount = (longitudeSlices + 1) * (latitudeSlices + 1);
+#define EROSION_IMPLEMENTATION
+#include "erosion.h"
 
-    mesh.vertices = (float *)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
-    mesh.colors = (unsigned char *)MemAlloc(mesh.vertexCount * 4 * sizeof(unsigned char));
-    mesh.indices = (unsigned short *)MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short));
-    mesh.normals = (float *)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+#define PLANET_IMPLEMENTATION
+#include "planet.h"
 
-    // TODO
-    mesh.texcoords = (float*)MemAlloc(mesh.vertexCount * 2 * sizeof(float));
-    memset(mesh.texcoords, 0, mesh.vertexCount * 2 * sizeof(float));
+#define LOD_IMPLEMENTATION
+#include "lod.h"
 
-    const float lengthInv = 1.0f / radius;
-    const float longitudeStep = 2 * PI / longitudeSlices;
-    const float latitudeStep = PI / latitudeSlices;
+#define CACHE_IMPLEMENTATION
+#include "cache.h"
 
-    for (int i = 0, v = 0; i <= latitudeSlices; i++) {
+#define SHADOW_IMPLEMENTATION
+#include "shadow.h"
 
-        float latitudeAngle = PI / 2 - i * latitudeStep;
-        float latitudeCos = cosf(latitudeAngle);
-        float latitudeSin = sinf(latitudeAngle);
-        float z = radius * latitudeSin;
+#define TERRAIN_IMPLEMENTATION
+#include "terrain.h"
 
-        for (int j = 0; j <= longitudeSlices; j++, v++) {
+#define PACKED_IMPLEMENTATION
+#include "packed.h"
 
-            float longitudeAngle = j * longitudeStep;
-            float longitudeCos = cosf(longitudeAngle);
-            float longitudeSin = sinf(longitudeAngle);
+#define CULL_IMPLEMENTATION
+#include "cull.h"
 
-            float x = radius * latitudeCos * longitudeCos;
-            float y = radius * latitudeCos * longitudeSin;
+#define SCENE_IMPLEMENTATION
+#include "scene.h"
 
-            float noise = stb_perlin_fbm_noise3(x / scale, y / scale, z / scale, lacunarity, gain, octaves);
+#define PROFILER_IMPLEMENTATION
+#include "profiler.h"
 
-            float offsetX = noise * latitudeCos * longitudeCos;
-            float offsetY = noise * latitudeCos * longitudeSin;
-            float offsetZ = noise * latitudeSin;
+// Uploads the chunks in the packed layout of packed.h, or as the float arrays of UploadMesh
+static void UploadChunkedMesh(ChunkedMesh *chunked, PlanetParams params, bool packed, bool dynamic)
+{
+    for (int i = 0; i < chunked->chunkCount; i++) {
+        if (packed)
+            UploadPackedMesh(&chunked->chunks[i], params, dynamic);
+        else
+            UploadMesh(&chunked->chunks[i], dynamic);
+    }
+}
 
-            mesh.vertices[v * 3 + 0] = x + offsetX;
-            mesh.vertices[v * 3 + 1] = y + offsetY;
-            mesh.vertices[v * 3 + 2] = z + offsetZ;
+// Drops the CPU arrays of uploaded chunks, freeing them unless another mesh owns them
+static void ReleaseChunkedMeshArrays(ChunkedMesh *chunked, bool owned)
+{
+    for (int i = 0; i < chunked->chunkCount; i++) {
+        Mesh *chunk = &chunked->chunks[i];
+
+        if (owned) {
+            RL_FREE(chunk->vertices);
+            RL_FREE(chunk->normals);
+            RL_FREE(chunk->colors);
+            RL_FREE(chunk->indices);
+        }
 
-            mesh.normals[v * 3 + 0] = mesh.vertices[v * 3 + 0] * lengthInv;
-            mesh.normals[v * 3 + 1] = mesh.vertices[v * 3 + 1] * lengthInv;
-            mesh.normals[v * 3 + 2] = mesh.vertices[v * 3 + 2] * lengthInv;
+        chunk->vertices = chunk->normals = NULL;
+        chunk->colors = NULL;
+        chunk->indices = NULL;
+    }
+}
 
-            Color color = heightToColor(noise);
+// Draws the chunks kept by 'culler', or all of them without one
+static void DrawChunkedMesh(ChunkedMesh chunked, const ChunkBounds *bounds, const ChunkCuller *culler, Material material, Matrix transform, CullStats *stats)
+{
+    for (int i = 0; i < chunked.chunkCount; i++) {
+        ChunkVisibility visibility = culler != NULL ? GetChunkVisibility(culler, bounds[i]) : CHUNK_VISIBLE;
+        CountChunkVisibility(stats, visibility);
 
-            mesh.colors[v * 4 + 0] = color.r;
-            mesh.colors[v * 4 + 1] = color.g;
-            mesh.colors[v * 4 + 2] = color.b;
-            mesh.colors[v * 4 + 3] = color.a;
-        }
+        if (visibility == CHUNK_VISIBLE)
+            DrawMesh(chunked.chunks[i], material, transform);
     }
+}
 
-    for (int i = 0, v = 0; i < latitudeSlices; i++) {
-
-        int k1 = i * (longitudeSlices + 1);
-        int k2 = k1 + longitudeSlices + 1;
+// Bounds of the chunks for culling, 'padding' covers the displacement done in the shader
+static ChunkBounds *UpdateChunkBounds(ChunkBounds *bounds, ChunkedMesh chunked, float padding)
+{
+    bounds = (ChunkBounds *)RL_REALLOC(bounds, chunked.chunkCount * sizeof(ChunkBounds));
 
-        for (int j = 0; j < longitudeSlices; j++, k1++, k2++) {
+    for (int i = 0; i < chunked.chunkCount; i++)
+        bounds[i] = GetChunkBounds(chunked.chunks[i], padding);
 
-            // k1 => k2 => k1+1
-            if (i != 0) {
-                mesh.indices[v++] = k1;
-                mesh.indices[v++] = k2;
-                mesh.indices[v++] = k1 + 1;
-            }
+    return bounds;
+}
 
-            // k1+1 => k2 => k2+1
-            if (i != latitudeSlices - 1) {
-                mesh.indices[v++] = k1 + 1;
-                mesh.indices[v++] = k2;
-                mesh.indices[v++] = k2 + 1;
-            }
-        }
+static void UnloadChunkedMesh(ChunkedMesh chunked, bool packed)
+{
+    for (int i = 0; i < chunked.chunkCount; i++) {
+        if (packed)
+            UnloadPackedMesh(chunked.chunks[i]);
+        else
+            UnloadMesh(chunked.chunks[i]);
     }
 
-    //ExportMesh(mesh, "mesh.obj");
+    MemFree(chunked.chunks);
+}
+
+static size_t GetChunkedMeshVideoMemory(ChunkedMesh chunked, bool packed)
+{
+    size_t size = 0;
 
-    UploadMesh(&mesh, false);
+    for (int i = 0; i < chunked.chunkCount; i++)
+        size += GetMeshVideoMemory(chunked.chunks[i], packed);
 
-    return mesh;
+    return size;
 }
 
-static RenderTexture2D LoadShadowmapTexture(int width, int height)
+// Uploads freshly generated vertices, reusing the GPU buffers when the layout matches
+// The CPU arrays stay with the generator for its next run, the mesh keeps none
+static void UpdateChunkedMesh(ChunkedMesh *mesh, const ChunkedMesh *staging, PlanetParams params, bool packed)
 {
-    RenderTexture2D target = { 0 };
+    bool sameLayout = mesh->chunkCount == staging->chunkCount;
+    for (int i = 0; sameLayout && i < mesh->chunkCount; i++)
+        sameLayout = mesh->chunks[i].vertexCount == staging->chunks[i].vertexCount;
 
-    target.id = rlLoadFramebuffer(width, height);
-    target.texture.width = width;
-    target.texture.height = height;
+    if (!sameLayout) {
+        UnloadChunkedMesh(*mesh, packed);
 
-    if (target.id > 0) {
-        rlEnableFramebuffer(target.id);
+        *mesh = *staging;
+        mesh->chunks = (Mesh *)RL_MALLOC(staging->chunkCount * sizeof(Mesh));
+        memcpy(mesh->chunks, staging->chunks, staging->chunkCount * sizeof(Mesh));
 
-        target.depth.id = rlLoadTextureDepth(width, height, false);
-        target.depth.width = width;
-        target.depth.height = height;
-        target.depth.format = 24;
-        target.depth.mipmaps = 1;
+        UploadChunkedMesh(mesh, params, packed, true);
+        ReleaseChunkedMeshArrays(mesh, false);
+        return;
+    }
 
-        rlFramebufferAttach(target.id, target.depth.id, RL_ATTACHMENT_DEPTH, RL_ATTACHMENT_TEXTURE2D, 0);
+    for (int i = 0; i < mesh->chunkCount; i++) {
+        Mesh *chunk = &mesh->chunks[i];
+        Mesh source = staging->chunks[i];
 
-        if (rlFramebufferComplete(target.id))
-            TRACELOG(LOG_INFO, "FBO: [ID %i] Framebuffer object created successfully", target.id);
+        if (packed) {
+            source.vboId = chunk->vboId;
+            UpdatePackedMesh(source, params);
+            continue;
+        }
 
-        rlDisableFramebuffer();
+        // raylib buffer slots: 0 positions, 2 normals, 3 colors
+        UpdateMeshBuffer(*chunk, 0, source.vertices, chunk->vertexCount * 3 * sizeof(float), 0);
+        UpdateMeshBuffer(*chunk, 2, source.normals, chunk->vertexCount * 3 * sizeof(float), 0);
+        UpdateMeshBuffer(*chunk, 3, source.colors, chunk->vertexCount * 4 * sizeof(unsigned char), 0);
     }
-    else
-        TRACELOG(LOG_WARNING, "FBO: Framebuffer object can not be created");
-
-    return target;
 }
 
 int main(int argc, char **argv)
@@ -150,6 +167,164 @@ int main(int argc, char **argv)
     int screenWidth = 1000;
     int screenHeight = 800;
 
+    // 44 subdivisions match the geometric error of a 200 slice UV sphere
+    // with less than half the triangles, see terragen_bench topology.
+    // Chunks of 16 slices are small enough for the culling to skip most of
+    // the far side, 90 of them for the icosphere
+    PlanetParams planet = {
+        .topology = PLANET_ICOSPHERE,
+        .longitudeSlices = 200,
+        .latitudeSlices = 200,
+        .subdivisions = 44,
+        .chunkSlices = 16,
+        .radius = 10,
+        .scale = 4,
+        .lacunarity = 2,
+        .gain = 0.5,
+        .octaves = 6,
+        .erosion = GetDefaultErosionSettings(),
+    };
+
+    // Defaults to the hardware threads
+    int threads = 0;
+
+    // Planet saved from the last launch, NULL to always generate
+    const char *cachePath = "planet.cache";
+
+    // Quadtree of cube sphere tiles instead of a single fixed mesh
+    bool useLod = false;
+    PlanetLodSettings lodSettings = GetDefaultPlanetLodSettings();
+
+    // Shadow map cascades, sharing the memory of a single 1024 map
+    int cascades = 3;
+
+    // Bare sphere displaced in the vertex shader instead of a generated mesh
+    bool gpuDisplace = false;
+
+    // Vertices in 12 bytes instead of 36, see packed.h
+    bool packedVertices = false;
+
+    // Skips the chunks outside the view or behind the planet
+    bool cullChunks = true;
+
+    // Frame rate cap, 0 to measure the frame time without one
+    int targetFps = 60;
+
+    // Layered noise in place of the fBm, see noisegraph.h
+    const char *graphPath = NULL;
+
+    // Bodies of a solar system drawn with instancing instead of the planet, see scene.h
+    int sceneBodies = 0;
+
+    // Frame timers shown from the start, toggled with F3, and their CSV trace
+    bool showProfiler = false;
+    const char *tracePath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--slices") == 0 && i + 1 < argc)
+            planet.longitudeSlices = planet.latitudeSlices = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--subdivisions") == 0 && i + 1 < argc)
+            planet.subdivisions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--chunk-slices") == 0 && i + 1 < argc)
+            planet.chunkSlices = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cachePath = argv[++i];
+        else if (strcmp(argv[i], "--no-cache") == 0)
+            cachePath = NULL;
+        else if (strcmp(argv[i], "--lod") == 0)
+            useLod = true;
+        else if (strcmp(argv[i], "--max-tiles") == 0 && i + 1 < argc)
+            lodSettings.maxTiles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cascades") == 0 && i + 1 < argc)
+            cascades = Clamp(atoi(argv[++i]), 2, MAX_SHADOW_CASCADES);
+        else if (strcmp(argv[i], "--gpu-displace") == 0)
+            gpuDisplace = true;
+        else if (strcmp(argv[i], "--packed") == 0)
+            packedVertices = true;
+        else if (strcmp(argv[i], "--no-cull") == 0)
+            cullChunks = false;
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+            targetFps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--graph") == 0 && i + 1 < argc)
+            graphPath = argv[++i];
+        else if (strcmp(argv[i], "--erosion") == 0 && i + 1 < argc)
+            planet.erosion.droplets = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--thermal") == 0 && i + 1 < argc)
+            planet.erosion.thermalIterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--erosion-seed") == 0 && i + 1 < argc)
+            planet.erosion.seed = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            sceneBodies = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--profile") == 0)
+            showProfiler = true;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "--topology") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            planet.topology = PLANET_TOPOLOGY_COUNT;
+
+            for (int t = 0; t < PLANET_TOPOLOGY_COUNT; t++) {
+                if (strcmp(name, GetPlanetTopologyName(t)) == 0)
+                    planet.topology = t;
+            }
+
+            if (planet.topology == PLANET_TOPOLOGY_COUNT) {
+                fprintf(stderr, "unknown topology: %s\n", name);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "usage: %s [--threads N] [--topology uv|cube|ico] [--slices N] [--subdivisions N] [--chunk-slices N] [--cache PATH] [--no-cache] [--lod] [--max-tiles N] [--cascades 2-4] [--gpu-displace] [--packed] [--no-cull] [--fps N] [--graph PATH] [--erosion DROPLETS] [--thermal N] [--erosion-seed N] [--scene N] [--profile] [--trace PATH]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (useLod && (gpuDisplace || packedVertices)) {
+        fprintf(stderr, "--gpu-displace and --packed do not work with --lod\n");
+        return 1;
+    }
+
+    // The vertex shader only has the fBm of stb_perlin
+    if (graphPath != NULL && gpuDisplace) {
+        fprintf(stderr, "--graph does not work with --gpu-displace\n");
+        return 1;
+    }
+
+    // The erosion runs on the whole planet before meshing it, tiles and shaders only have the noise
+    if (IsErosionEnabled(planet.erosion) && (useLod || gpuDisplace)) {
+        fprintf(stderr, "--erosion and --thermal do not work with --lod or --gpu-displace\n");
+        return 1;
+    }
+
+    if (PLANET_NOISE_BACKEND != NOISE_BACKEND_STB && gpuDisplace) {
+        fprintf(stderr, "--gpu-displace needs the stb noise backend, this build has %s\n", GetNoiseBackendName(PLANET_NOISE_BACKEND));
+        return 1;
+    }
+
+    // The bodies are displaced in the vertex shader, so only the fBm of the planet applies to them
+    if (sceneBodies > 0 && (useLod || gpuDisplace || packedVertices || graphPath != NULL || IsErosionEnabled(planet.erosion))) {
+        fprintf(stderr, "--scene does not work with --lod, --gpu-displace, --packed, --graph or --erosion\n");
+        return 1;
+    }
+
+    NoiseGraph *graph = NULL;
+
+    if (graphPath != NULL) {
+        char error[256];
+        graph = LoadNoiseGraph(graphPath, error, sizeof(error));
+
+        if (graph == NULL) {
+            fprintf(stderr, "%s: %s\n", graphPath, error);
+            return 1;
+        }
+
+        planet.graph = graph;
+    }
+
+    WorkerPool *pool = LoadWorkerPool(threads);
+
     SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT);
     InitWindow(screenWidth, screenHeight, "terragen");
 
@@ -160,18 +335,9 @@ int main(int argc, char **argv)
     camera.fovy = 45.0f;
     camera.projection = CAMERA_PERSPECTIVE;
 
-    SetTargetFPS(60);
+    SetTargetFPS(targetFps);
     SetExitKey(KEY_NULL);
 
-    int longitudeSlices = 200;
-    int latitudeSlices = 200;
-
-    float radius = 10;
-    float scale = 4;
-    float lacunarity = 2;
-    float gain = 0.5;
-    int octaves = 6;
-
     Shader shadowShader = LoadShader("shadowmap.vs", "shadowmap.fs");
     shadowShader.locs[SHADER_LOC_VECTOR_VIEW] = GetShaderLocation(shadowShader, "viewPos");
 
@@ -189,29 +355,108 @@ int main(int argc, char **argv)
     SetShaderValue(shadowShader, ambientLoc, ambient, SHADER_UNIFORM_VEC4);
 
     int shadowMapResolution = 1024;
-    SetShaderValue(shadowShader, GetShaderLocation(shadowShader, "shadowMapResolution"), &shadowMapResolution, SHADER_UNIFORM_INT);
-
-    int lightVPLoc = GetShaderLocation(shadowShader, "lightVP");
     int shadowMapLoc = GetShaderLocation(shadowShader, "shadowMap");
 
-    // TODO: Use fibonacci/cube sphere instead of UV
-    Mesh mesh = GenerateMesh(longitudeSlices, latitudeSlices, radius, scale, lacunarity, gain, octaves);
+    Texture2D noiseTable = LoadNoiseTableTexture();
+    int noiseTableLoc = GetShaderLocation(shadowShader, "noiseTable");
+    SetTerrainShaderParams(shadowShader, gpuDisplace || sceneBodies > 0, planet);
+    SetPackedVertexUniforms(shadowShader, packedVertices, planet);
+
+    // The planet is generated in the background and swapped in once ready
+    PlanetGenerator *generator = NULL;
+    PlanetLod *lod = NULL;
+    Scene *scene = NULL;
+    float sceneRadius = 0;
+
+    if (useLod) {
+        planet.topology = PLANET_CUBE_SPHERE;
+        lod = LoadPlanetLod(pool, planet, lodSettings);
+    }
+
+    ChunkedMesh mesh = { 0 };
+    double generationTime = 0;
+
+    // Culling state of the mesh: no triangle goes below occluderRadius, taken
+    // from the chunk bounds of CPU meshes and from the noise bound when the
+    // shader displaces the vertices
+    ChunkBounds *chunkBounds = NULL;
+    float occluderRadius = 0;
+    CullStats viewCull = { 0 };
+    CullStats shadowCull = { 0 };
+
+    // Saved once the first generation is done, if the cache did not have it
+    bool saveCache = false;
+
+    if (sceneBodies > 0) {
+        scene = LoadScene(pool, shadowShader);
+        AddSceneSystem(scene, planet, sceneBodies, 1);
+        sceneRadius = GetSceneRadius(scene);
+
+        // Far enough out to see most of the system, within the far plane
+        camera.position = (Vector3){ sceneRadius * 0.6f, sceneRadius * 0.4f, sceneRadius * 0.6f };
+        TRACELOG(LOG_INFO, "SCENE: %d bodies within a radius of %.1f", sceneBodies, sceneRadius);
+    }
+    else if (gpuDisplace) {
+        double start = GetWallTime();
+
+        mesh = GenerateBaseSphereMesh(pool, planet);
+        UploadChunkedMesh(&mesh, planet, packedVertices, false);
+        chunkBounds = UpdateChunkBounds(chunkBounds, mesh, GetPlanetNoiseBound(planet));
+        occluderRadius = planet.radius - GetPlanetNoiseBound(planet);
+        TRACELOG(LOG_INFO, "TERRAIN: Base sphere generated in %.1f ms", (GetWallTime() - start) * 1000);
+    }
+    else if (!useLod) {
+        generator = LoadPlanetGenerator(pool, planet);
+
+        double start = GetWallTime();
+
+        PlanetCache cache = { 0 };
+
+        if (cachePath != NULL && LoadPlanetCache(cachePath, planet, &mesh, &cache)) {
+            // Uploaded straight from the mapping, which goes away with the arrays
+            UploadChunkedMesh(&mesh, planet, packedVertices, true);
+            chunkBounds = UpdateChunkBounds(chunkBounds, mesh, 0);
+            ReleaseChunkedMeshArrays(&mesh, false);
+            UnloadPlanetCache(cache);
+            occluderRadius = GetOccluderRadius(chunkBounds, mesh.chunkCount);
+            TRACELOG(LOG_INFO, "CACHE: [%s] Planet loaded in %.1f ms", cachePath, (GetWallTime() - start) * 1000);
+        }
+        else {
+            RequestPlanetGeneration(generator, planet);
+            saveCache = cachePath != NULL;
+        }
+    }
+
     Matrix meshTransform = MatrixIdentity();
     Material material = LoadMaterialDefault();
     material.shader = shadowShader;
 
-    RenderTexture2D shadowMap = LoadShadowmapTexture(shadowMapResolution, shadowMapResolution);
+    ShadowMap shadow = LoadShadowMap(cascades, shadowMapResolution);
 
-    Camera3D lightCam = { 0 };
-    lightCam.position = Vector3Scale(lightDir, -15.0f);
-    lightCam.target = Vector3Zero();
-    lightCam.projection = CAMERA_ORTHOGRAPHIC;
-    lightCam.up = (Vector3){ 0.0f, 1.0f, 0.0f };
-    lightCam.fovy = 20.0f;
+    // The shadow map only depends on the light, the planet transform, the
+    // mesh and the cascades, so it is kept until one of them changes instead
+    // of redrawn every frame
+    bool shadowDirty = true;
+    Vector3 shadowLightDir = lightDir;
+    Matrix shadowTransform = meshTransform;
+    int shadowRenders = 0;
+
+    // CPU and GPU time of every pass, see profiler.h
+    Profiler *profiler = LoadProfiler(tracePath);
+    int frames = 0;
+
+    // Whole frame including the GPU, which only shows once EndDrawing swaps
+    // the buffers; run with --fps 0 to compare the displacement modes
+    double totalFrameTime = 0;
+    long totalDrawCalls = 0;
 
     bool menu = false;
+    int selected = 0;
 
     while (!WindowShouldClose()) {
+        BeginProfileFrame(profiler);
+        BeginProfileTimer(profiler, PROFILE_UPDATE);
+
         screenWidth = GetScreenWidth();
         screenHeight = GetScreenHeight();
 
@@ -224,45 +469,172 @@ int main(int argc, char **argv)
         if (IsKeyPressed(KEY_ESCAPE))
             menu = !menu;
 
+        if (IsKeyPressed(KEY_F3))
+            showProfiler = !showProfiler;
+
+        if (menu) {
+            if (IsKeyPressed(KEY_DOWN))
+                selected = (selected + 1) % 4;
+
+            if (IsKeyPressed(KEY_UP))
+                selected = (selected + 3) % 4;
+
+            int step = (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT)) - (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT));
+
+            // The bodies of the scene keep the noise they were added with
+            if (step != 0 && scene == NULL) {
+                switch (selected) {
+                    case 0: planet.scale = fmaxf(planet.scale + step * 0.25f, 0.25f); break;
+                    case 1: planet.lacunarity = Clamp(planet.lacunarity + step * 0.1f, 1, 4); break;
+                    case 2: planet.gain = Clamp(planet.gain + step * 0.05f, 0, 1); break;
+                    case 3: planet.octaves = Clamp(planet.octaves + step, 1, 12); break;
+                }
+
+                if (lod != NULL)
+                    SetPlanetLodParams(lod, planet);
+                else if (gpuDisplace) {
+                    SetTerrainShaderParams(shadowShader, true, planet);
+                    chunkBounds = UpdateChunkBounds(chunkBounds, mesh, GetPlanetNoiseBound(planet));
+                    occluderRadius = planet.radius - GetPlanetNoiseBound(planet);
+                    shadowDirty = true;
+                }
+                else
+                    RequestPlanetGeneration(generator, planet);
+            }
+        }
+
+        // Update mesh, jobs hand their results over here
+        RunMainThreadJobs(pool);
+
+        if (scene != NULL) {
+            // Everything moves, the shadow map is redrawn every frame
+            UpdateScene(scene, GetTime(), camera, screenHeight);
+            shadowDirty = true;
+        }
+        else if (lod != NULL) {
+            if (UpdatePlanetLod(lod, camera.position))
+                shadowDirty = true;
+        }
+        else if (generator != NULL) {
+            PlanetParams generatedParams;
+            ChunkedMesh *generated = PollGeneratedPlanet(generator, &generatedParams, &generationTime);
+            if (generated != NULL) {
+                AddProfileSample(profiler, PROFILE_GENERATION, generationTime);
+                UpdateChunkedMesh(&mesh, generated, generatedParams, packedVertices);
+                SetPackedVertexUniforms(shadowShader, packedVertices, generatedParams);
+                chunkBounds = UpdateChunkBounds(chunkBounds, *generated, 0);
+                occluderRadius = GetOccluderRadius(chunkBounds, generated->chunkCount);
+                shadowDirty = true;
+
+                // Saved from the generator, the mesh has no CPU copy
+                if (saveCache) {
+                    TRACELOG(LOG_INFO, "CACHE: Planet generated in %.1f ms", generationTime * 1000);
+
+                    if (SavePlanetCache(cachePath, *generated, generatedParams))
+                        TRACELOG(LOG_INFO, "CACHE: [%s] Planet saved", cachePath);
+                    else
+                        TRACELOG(LOG_WARNING, "CACHE: [%s] Failed to save planet", cachePath);
+
+                    saveCache = false;
+                }
+
+                ReleaseGeneratedPlanet(generator);
+            }
+        }
+
         // Update light
         lightDir = Vector3Normalize(lightDir);
-        lightCam.position = Vector3Scale(lightDir, -15.0f);
         SetShaderValue(shadowShader, lightDirLoc, &lightDir, SHADER_UNIFORM_VEC3);
 
+        if (memcmp(&lightDir, &shadowLightDir, sizeof(Vector3)) != 0 || memcmp(&meshTransform, &shadowTransform, sizeof(Matrix)) != 0) {
+            shadowLightDir = lightDir;
+            shadowTransform = meshTransform;
+            shadowDirty = true;
+        }
+
+        // The terrain stays within the noise bound of the surface
+        float noiseBound = GetPlanetNoiseBound(planet);
+        float aspect = (float)screenWidth / screenHeight;
+        float innerRadius = scene != NULL ? 0 : planet.radius - noiseBound;
+        float outerRadius = scene != NULL ? sceneRadius : planet.radius + noiseBound;
+        if (UpdateShadowMap(&shadow, camera, aspect, lightDir, innerRadius, outerRadius))
+            shadowDirty = true;
+
+        EndProfileTimer(profiler, PROFILE_UPDATE);
+
         BeginDrawing();
 
-            Matrix lightView;
-            Matrix lightProj;
+            if (shadowDirty) {
+                BeginProfileTimer(profiler, PROFILE_SHADOW);
+                BeginProfileTimer(profiler, PROFILE_GPU_SHADOW);
+                shadowCull = (CullStats){ 0 };
 
-            BeginTextureMode(shadowMap);
-                ClearBackground(WHITE);
+                BeginTextureMode(shadow.target);
+                    ClearBackground(WHITE);
 
-                BeginMode3D(lightCam);
+                    for (int i = 0; i < shadow.cascadeCount; i++) {
+                        BeginShadowCascade(&shadow, i);
 
-                    lightView = rlGetMatrixModelview();
-                    lightProj = rlGetMatrixProjection();
-                    DrawMesh(mesh, material, meshTransform);
+                        // Only the light frustum, the planet does not hide its own casters from the light
+                        Matrix lightViewProj = MatrixMultiply(shadow.cascades[i].view, shadow.cascades[i].projection);
+                        ChunkCuller culler = GetChunkCuller(MatrixMultiply(meshTransform, lightViewProj), Vector3Zero(), 0);
 
-                EndMode3D();
-            EndTextureMode();
+                        if (scene != NULL)
+                            DrawScene(scene, material, cullChunks ? &culler : NULL);
+                        else if (lod != NULL)
+                            DrawPlanetLod(lod, material, meshTransform);
+                        else
+                            DrawChunkedMesh(mesh, chunkBounds, cullChunks ? &culler : NULL, material, meshTransform, &shadowCull);
+                    }
 
-            Matrix lightViewProj = MatrixMultiply(lightView, lightProj);
-            SetShaderValueMatrix(shadowShader, lightVPLoc, lightViewProj);
+                    EndShadowCascades();
+                EndTextureMode();
+
+                EndProfileTimer(profiler, PROFILE_GPU_SHADOW);
+                SetShadowMapUniforms(&shadow, shadowShader);
+
+                shadowDirty = false;
+                shadowRenders++;
+                EndProfileTimer(profiler, PROFILE_SHADOW);
+            }
+
+            BeginProfileTimer(profiler, PROFILE_MAIN);
+            BeginProfileTimer(profiler, PROFILE_GPU_MAIN);
 
             rlEnableShader(shadowShader.id);
             int slot = 10;
             rlActiveTextureSlot(slot);
-            rlEnableTexture(shadowMap.depth.id);
+            rlEnableTexture(shadow.target.depth.id);
             rlSetUniform(shadowMapLoc, &slot, SHADER_UNIFORM_INT, 1);
 
+            slot = 11;
+            rlActiveTextureSlot(slot);
+            rlEnableTexture(noiseTable.id);
+            rlSetUniform(noiseTableLoc, &slot, SHADER_UNIFORM_INT, 1);
+
             ClearBackground(RAYWHITE);
 
             BeginMode3D(camera);
 
-                DrawMesh(mesh, material, meshTransform);
+                // In the model space of the planet, which must stay a rigid transform
+                Matrix viewProj = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+                Vector3 eye = Vector3Transform(camera.position, MatrixInvert(meshTransform));
+                ChunkCuller culler = GetChunkCuller(MatrixMultiply(meshTransform, viewProj), eye, occluderRadius);
+                viewCull = (CullStats){ 0 };
+
+                if (scene != NULL)
+                    DrawScene(scene, material, cullChunks ? &culler : NULL);
+                else if (lod != NULL)
+                    DrawPlanetLod(lod, material, meshTransform);
+                else
+                    DrawChunkedMesh(mesh, chunkBounds, cullChunks ? &culler : NULL, material, meshTransform, &viewCull);
 
             EndMode3D();
 
+            EndProfileTimer(profiler, PROFILE_GPU_MAIN);
+            EndProfileTimer(profiler, PROFILE_MAIN);
+            BeginProfileTimer(profiler, PROFILE_UI);
+
             if (menu) {
                 Color infoColor = Fade(LIGHTGRAY, 0.6f);
 
@@ -273,19 +645,35 @@ int main(int argc, char **argv)
 
                 float fontSize = Clamp(screenHeight / 100.0 * 3.2, 16, 40);
 
-                DrawText("perlin noise", paddingX * 2, paddingY * 2, fontSize * 1.2, BLACK);
+                // The graph nodes have their own settings, only the scale applies to them
+                if (graph != NULL)
+                    DrawText(TextFormat("noise graph: %s (%d nodes)", GetFileName(graphPath), graph->codeCount), paddingX * 2, paddingY * 2, fontSize * 1.2, BLACK);
+                else
+                    DrawText("perlin noise", paddingX * 2, paddingY * 2, fontSize * 1.2, BLACK);
                 int spacing = fontSize * 2;
 
-                DrawText(TextFormat("scale: %f", scale), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                DrawText(TextFormat("%sscale: %f", selected == 0 ? "> " : "", planet.scale), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
                 spacing += fontSize;
 
-                DrawText(TextFormat("lacunarity: %f", lacunarity), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                DrawText(TextFormat("%slacunarity: %f", selected == 1 ? "> " : "", planet.lacunarity), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
                 spacing += fontSize;
 
-                DrawText(TextFormat("gain: %f", gain), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                DrawText(TextFormat("%sgain: %f", selected == 2 ? "> " : "", planet.gain), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
                 spacing += fontSize;
 
-                DrawText(TextFormat("octaves: %d", octaves), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                DrawText(TextFormat("%soctaves: %d", selected == 3 ? "> " : "", planet.octaves), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                spacing += fontSize;
+
+                if (scene != NULL)
+                    DrawText("solar system, the bodies keep their noise", paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                else if (lod != NULL)
+                    DrawText(TextFormat("tiles queued: %d (up/down/left/right to edit)", GetPlanetLodStats(lod).queued), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                else if (gpuDisplace)
+                    DrawText("displaced on the GPU (up/down/left/right to edit)", paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                else if (IsPlanetGenerating(generator))
+                    DrawText("generating...", paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                else
+                    DrawText(TextFormat("generated in %.1f ms (up/down/left/right to edit)", generationTime * 1000), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
                 spacing += fontSize * 2;
 
                 DrawText("window", paddingX * 2, paddingY * 2 + spacing, fontSize * 1.2, BLACK);
@@ -297,33 +685,131 @@ int main(int argc, char **argv)
                 DrawText(TextFormat("height: %d", screenHeight), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
                 spacing += fontSize;
 
-                DrawText(TextFormat("shadowmap resolution: %d", shadowMapResolution), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                DrawText(TextFormat("shadowmap cascades: %d x %d^2 (refit %d times)", shadow.cascadeCount, shadow.resolution, shadow.refits), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                spacing += fontSize;
+
+                DrawText(TextFormat("shadowmap redrawn: %d of %d frames", shadowRenders, frames), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                spacing += fontSize;
+
+                ProfileStats mainStats = GetProfileStats(profiler, PROFILE_MAIN);
+                ProfileStats gpuStats = GetProfileStats(profiler, PROFILE_GPU_MAIN);
+                DrawText(TextFormat("main pass: %.3f ms CPU, %.3f ms GPU (median, F3 for the profiler)", mainStats.p50 * 1000, gpuStats.p50 * 1000), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                spacing += fontSize;
+
+                DrawText(TextFormat("frame time: %.3f ms", GetProfileStats(profiler, PROFILE_FRAME).p50 * 1000), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
                 spacing += fontSize * 2;
 
                 DrawText("mesh", paddingX * 2, paddingY * 2 + spacing, fontSize * 1.2, BLACK);
                 spacing += fontSize * 2;
 
-                DrawText(TextFormat("triangles: %d", mesh.triangleCount), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
-                spacing += fontSize;
+                if (scene != NULL) {
+                    SceneStats stats = GetSceneStats(scene);
 
-                DrawText(TextFormat("vertices: %d", mesh.vertexCount), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
-                spacing += fontSize;
+                    DrawText(TextFormat("bodies: %d (%d drawn over the cascades and the view)", stats.bodies, stats.drawnBodies), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
 
-                DrawText(TextFormat("longitude slices: %d", longitudeSlices), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
-                spacing += fontSize;
+                    DrawText(TextFormat("draw calls: %d (one per level of detail and pass)", stats.drawCalls), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("triangles: %d", stats.triangles), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("levels of detail: %d / %d / %d bodies", stats.lodBodies[0], stats.lodBodies[1], stats.lodBodies[2]), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+                }
+                else if (lod != NULL) {
+                    PlanetLodStats stats = GetPlanetLodStats(lod);
+
+                    DrawText(TextFormat("triangles: %d (%d tiles of %d)", stats.drawnTriangles, stats.drawnTiles, lodSettings.maxTiles), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("deepest level: %d of %d", stats.deepestLevel, lodSettings.maxLevel), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("tree nodes: %d", stats.nodes), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
 
-                DrawText(TextFormat("latitude slices: %d", latitudeSlices), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    DrawText(TextFormat("tile staging: %d buffers in %.1f MB", stats.stagingBlocks, stats.stagingBytes / 1e6), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+                }
+                else {
+                    DrawText(TextFormat("triangles: %d", mesh.triangleCount), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("vertices: %d", mesh.vertexCount), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("video memory: %.1f MB (%s vertices)", GetChunkedMeshVideoMemory(mesh, packedVertices) / 1e6, packedVertices ? "packed" : "float"), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("topology: %s", GetPlanetTopologyName(planet.topology)), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    if (planet.topology == PLANET_UV_SPHERE) {
+                        DrawText(TextFormat("longitude slices: %d", planet.longitudeSlices), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                        spacing += fontSize;
+
+                        DrawText(TextFormat("latitude slices: %d", planet.latitudeSlices), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                        spacing += fontSize;
+                    }
+                    else {
+                        DrawText(TextFormat("subdivisions: %d", planet.subdivisions), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                        spacing += fontSize;
+                    }
+
+                    DrawText(TextFormat("chunks: %d (%d slices)", mesh.chunkCount, mesh.chunkSlices), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("chunks drawn: %d (culled %d outside the view, %d behind the horizon)", viewCull.drawn, viewCull.outsideFrustum, viewCull.belowHorizon), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+
+                    DrawText(TextFormat("shadow chunks drawn: %d of %d (culled %d outside the cascades)", shadowCull.drawn, mesh.chunkCount * shadow.cascadeCount, shadowCull.outsideFrustum), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
+                    spacing += fontSize;
+                }
+
+                DrawText(TextFormat("threads: %d", GetWorkerPoolThreads(pool)), paddingX * 2, paddingY * 2 + spacing, fontSize, BLACK);
                 spacing += fontSize;
             }
 
+            if (showProfiler) {
+                int fontSize = Clamp(screenHeight / 60, 10, 20);
+                DrawProfiler(profiler, 10, 10, Clamp(screenWidth / 3, fontSize * 28, screenWidth - 20), fontSize);
+            }
+
+            // Measured before EndDrawing, which waits for the next frame
+            EndProfileTimer(profiler, PROFILE_UI);
+            frames++;
+
         EndDrawing();
+
+        AddProfileSample(profiler, PROFILE_FRAME, GetFrameTime());
+        EndProfileFrame(profiler);
+        totalFrameTime += GetFrameTime();
+
+        if (scene != NULL)
+            totalDrawCalls += GetSceneStats(scene).drawCalls;
     }
 
-    if (shadowMap.id > 0)
-        rlUnloadFramebuffer(shadowMap.id);
+    if (frames > 0 && scene != NULL)
+        TRACELOG(LOG_INFO, "RENDER: %d frames, %.3f ms on average (%d bodies in %.1f draw calls per frame)", frames, totalFrameTime / frames * 1000,
+            sceneBodies, (double)totalDrawCalls / frames);
+    else if (frames > 0)
+        TRACELOG(LOG_INFO, "RENDER: %d frames, %.3f ms on average (%s displacement, %s vertices in %.1f MB)", frames, totalFrameTime / frames * 1000,
+            gpuDisplace ? "GPU" : "CPU", packedVertices ? "packed" : "float", GetChunkedMeshVideoMemory(mesh, packedVertices) / 1e6);
+
+    UnloadProfiler(profiler);
+    UnloadShadowMap(shadow);
+    UnloadTexture(noiseTable);
 
-    UnloadMesh(mesh);
+    UnloadChunkedMesh(mesh, packedVertices);
+    RL_FREE(chunkBounds);
     UnloadMaterial(material);
+    UnloadPlanetGenerator(generator);
+    UnloadSphereLayoutCache();
+    UnloadPlanetLod(lod);
+    UnloadScene(scene);
+    UnloadWorkerPool(pool);
+    UnloadNoiseGraph(graph);
 
     CloseWindow();
 
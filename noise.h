@@ -0,0 +1,851 @@
+// noise.h - lattice noise backends for the planet fBm
+//
+// to create the implementation,
+//     #define NOISE_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// stb_perlin.h must be included before this file, for the default backend
+// and its STB_PERLIN_SIMD_* levels.
+//
+// The planet picks its backend at build time, stb_perlin unless
+//     -DPLANET_NOISE_BACKEND=NOISE_BACKEND_HASHED
+//     -DPLANET_NOISE_BACKEND=NOISE_BACKEND_SIMPLEX
+// Only stb_perlin is reproduced by the displacement in shadowmap.vs.
+//
+//
+// Documentation:
+//
+// float HashedNoise3Deriv(float x, float y, float z, int seed, float *dx, float *dy, float *dz)
+//
+// Perlin noise like stb_perlin_noise3_deriv, over a lattice hashed with
+// arithmetic instead of the chain of permutation table lookups: every
+// lattice coordinate is multiplied by a 16-bit constant, the three are
+// combined and mixed with two more 16-bit multiplies, and the top 4 bits
+// pick one of 16 gradients from a 256 byte table, Perlin's 12 edge
+// directions with 4 of them twice. The 16-bit multiplies are a single
+// instruction in SSE2, and the table stays in a few cache lines, or in
+// registers with AVX2. It repeats every 65536 cells instead of 256.
+//
+// float SimplexNoise3Deriv(float x, float y, float z, int seed, float *dx, float *dy, float *dz)
+//
+// Simplex noise over the same hash and gradients: 4 corners per point
+// instead of 8, each falling off within a radius of sqrt(1/2), so the noise
+// and its gradient are continuous. Scaled to about [-1, 1] like noise3.
+//
+// void FbmNoise3DerivBatch(NoiseBackend backend, const float *x, const float *y, const float *z,
+//                          float *out, float *dx, float *dy, float *dz,
+//                          int count, float lacunarity, float gain, int octaves)
+//
+// stb_perlin_fbm_noise3_deriv_batch over the given backend: the same octave
+// sum, each octave seeded with its index, 8 points at a time with AVX2 or 4
+// with SSE2. The SIMD paths match the scalar functions bit for bit.
+// FbmNoise3DerivBatchSimd(backend, simd, ...) caps the SIMD level, like
+// stb_perlin_fbm_noise3_deriv_batch_simd.
+//
+// const char *GetNoiseBackendName(NoiseBackend backend)
+//
+
+#ifndef NOISE_H
+#define NOISE_H
+
+typedef enum NoiseBackend {
+    NOISE_BACKEND_STB = 0,  // stb_perlin, permutation tables
+    NOISE_BACKEND_HASHED,   // Perlin noise, arithmetic hash and gradient table
+    NOISE_BACKEND_SIMPLEX,  // Simplex noise, same hash
+    NOISE_BACKEND_COUNT
+} NoiseBackend;
+
+// Backend of the planet noise
+#ifndef PLANET_NOISE_BACKEND
+#define PLANET_NOISE_BACKEND NOISE_BACKEND_STB
+#endif
+
+const char *GetNoiseBackendName(NoiseBackend backend);
+float HashedNoise3Deriv(float x, float y, float z, int seed, float *dx, float *dy, float *dz);
+float SimplexNoise3Deriv(float x, float y, float z, int seed, float *dx, float *dy, float *dz);
+void FbmNoise3DerivBatch(NoiseBackend backend, const float *x, const float *y, const float *z,
+                         float *out, float *dx, float *dy, float *dz,
+                         int count, float lacunarity, float gain, int octaves);
+void FbmNoise3DerivBatchSimd(NoiseBackend backend, int simd, const float *x, const float *y, const float *z,
+                             float *out, float *dx, float *dy, float *dz,
+                             int count, float lacunarity, float gain, int octaves);
+
+#endif // NOISE_H
+
+#ifdef NOISE_IMPLEMENTATION
+
+#if !defined(STB_PERLIN_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(NOISE_SSE2) && defined(__GNUC__)
+#define NOISE_AVX2
+#define NOISE_AVX2_FUNC __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+// Multipliers of the lattice coordinates and of the seed
+#define NOISE_HASH_X 0x9e37u
+#define NOISE_HASH_Y 0x6b43u
+#define NOISE_HASH_Z 0x2f1du
+#define NOISE_HASH_SEED 0x3c6fu
+
+// Simplex skew and unskew factors, and the falloff radius squared
+#define NOISE_SIMPLEX_SKEW (1.0f / 3.0f)
+#define NOISE_SIMPLEX_UNSKEW (1.0f / 6.0f)
+#define NOISE_SIMPLEX_RADIUS 0.5f
+
+// Brings the largest simplex value, about 1 / 76.9, within [-1, 1]
+#define NOISE_SIMPLEX_SCALE 76.0f
+
+// Perlin's 12 edge gradients, the first 4 again to fill 16 entries, padded to 16 bytes
+static const float noiseGradients[16][4] = {
+    {  1, 1, 0 }, { -1, 1, 0 }, {  1,-1, 0 }, { -1,-1, 0 },
+    {  1, 0, 1 }, { -1, 0, 1 }, {  1, 0,-1 }, { -1, 0,-1 },
+    {  0, 1, 1 }, {  0,-1, 1 }, {  0, 1,-1 }, {  0,-1,-1 },
+    {  1, 1, 0 }, { -1, 1, 0 }, {  0,-1, 1 }, {  0,-1,-1 },
+};
+
+const char *GetNoiseBackendName(NoiseBackend backend)
+{
+    switch (backend) {
+        case NOISE_BACKEND_STB: return "stb";
+        case NOISE_BACKEND_HASHED: return "hashed";
+        case NOISE_BACKEND_SIMPLEX: return "simplex";
+        default: return "unknown";
+    }
+}
+
+static int NoiseFloor(float a)
+{
+    int ai = (int)a;
+    return a < ai ? ai - 1 : ai;
+}
+
+static float NoiseLerp(float a, float b, float t)
+{
+    return a + (b - a) * t;
+}
+
+#define NoiseEase(a) (((a * 6 - 15) * a + 10) * a * a * a)
+#define NoiseEaseDeriv(a) (((a - 1) * a) * ((a - 1) * a) * 30)
+
+// Mixes a 16-bit value, every step stays within 16 bits
+static unsigned int NoiseMix16(unsigned int h)
+{
+    h ^= h >> 8;
+    h = (h * 0x88b5u) & 0xffff;
+    h ^= h >> 7;
+    h = (h * 0xdb2du) & 0xffff;
+    h ^= h >> 9;
+    return h;
+}
+
+// Hashed coordinates of the cells at 'p' and 'p + 1' along one axis
+static void NoiseHashAxis(int p, unsigned int multiplier, unsigned int offset, unsigned int *hash)
+{
+    hash[0] = ((unsigned int)p * multiplier + offset) & 0xffff;
+    hash[1] = ((unsigned int)(p + 1) * multiplier + offset) & 0xffff;
+}
+
+static const float *NoiseGradient(unsigned int hx, unsigned int hy, unsigned int hz)
+{
+    return noiseGradients[NoiseMix16(hx ^ hy ^ hz) >> 12];
+}
+
+float HashedNoise3Deriv(float x, float y, float z, int seed, float *dx, float *dy, float *dz)
+{
+    int px = NoiseFloor(x);
+    int py = NoiseFloor(y);
+    int pz = NoiseFloor(z);
+    unsigned int hx[2], hy[2], hz[2];
+
+    NoiseHashAxis(px, NOISE_HASH_X, (unsigned int)seed * NOISE_HASH_SEED, hx);
+    NoiseHashAxis(py, NOISE_HASH_Y, 0, hy);
+    NoiseHashAxis(pz, NOISE_HASH_Z, 0, hz);
+
+    const float *g[8];
+
+    for (int c = 0; c < 8; c++)
+        g[c] = NoiseGradient(hx[c >> 2], hy[(c >> 1) & 1], hz[c & 1]);
+
+    x -= px; float u = NoiseEase(x); float du = NoiseEaseDeriv(x);
+    y -= py; float v = NoiseEase(y); float dv = NoiseEaseDeriv(y);
+    z -= pz; float w = NoiseEase(z); float dw = NoiseEaseDeriv(z);
+
+    // As stb_perlin_noise3_deriv_internal from here
+    float n000 = g[0][0] * x       + g[0][1] * y       + g[0][2] * z;
+    float n001 = g[1][0] * x       + g[1][1] * y       + g[1][2] * (z - 1);
+    float n010 = g[2][0] * x       + g[2][1] * (y - 1) + g[2][2] * z;
+    float n011 = g[3][0] * x       + g[3][1] * (y - 1) + g[3][2] * (z - 1);
+    float n100 = g[4][0] * (x - 1) + g[4][1] * y       + g[4][2] * z;
+    float n101 = g[5][0] * (x - 1) + g[5][1] * y       + g[5][2] * (z - 1);
+    float n110 = g[6][0] * (x - 1) + g[6][1] * (y - 1) + g[6][2] * z;
+    float n111 = g[7][0] * (x - 1) + g[7][1] * (y - 1) + g[7][2] * (z - 1);
+
+    float n00 = NoiseLerp(n000, n001, w);
+    float n01 = NoiseLerp(n010, n011, w);
+    float n10 = NoiseLerp(n100, n101, w);
+    float n11 = NoiseLerp(n110, n111, w);
+
+    float n0 = NoiseLerp(n00, n01, v);
+    float n1 = NoiseLerp(n10, n11, v);
+
+    float d[3];
+
+    for (int c = 0; c < 3; c++) {
+        float d0 = NoiseLerp(NoiseLerp(g[0][c], g[1][c], w), NoiseLerp(g[2][c], g[3][c], w), v);
+        float d1 = NoiseLerp(NoiseLerp(g[4][c], g[5][c], w), NoiseLerp(g[6][c], g[7][c], w), v);
+        d[c] = NoiseLerp(d0, d1, u);
+    }
+
+    *dx = d[0] + (n1 - n0) * du;
+    *dy = d[1] + NoiseLerp(n01 - n00, n11 - n10, u) * dv;
+    *dz = d[2] + NoiseLerp(NoiseLerp(n001 - n000, n011 - n010, v), NoiseLerp(n101 - n100, n111 - n110, v), u) * dw;
+
+    return NoiseLerp(n0, n1, u);
+}
+
+float SimplexNoise3Deriv(float x, float y, float z, int seed, float *dx, float *dy, float *dz)
+{
+    // Cell of the skewed lattice, then the point from its first corner
+    float s = (x + y + z) * NOISE_SIMPLEX_SKEW;
+    int i = NoiseFloor(x + s);
+    int j = NoiseFloor(y + s);
+    int k = NoiseFloor(z + s);
+    float t = (float)(i + j + k) * NOISE_SIMPLEX_UNSKEW;
+    float x0 = x - ((float)i - t);
+    float y0 = y - ((float)j - t);
+    float z0 = z - ((float)k - t);
+
+    // The second and third corners step along the largest coordinates first
+    int i1 = (x0 >= y0) & (x0 >= z0);
+    int j1 = (y0 > x0) & (y0 >= z0);
+    int k1 = (z0 > x0) & (z0 > y0);
+    int i2 = (x0 >= y0) | (x0 >= z0);
+    int j2 = (y0 > x0) | (y0 >= z0);
+    int k2 = (z0 > x0) | (z0 > y0);
+
+    unsigned int hx[2], hy[2], hz[2];
+    NoiseHashAxis(i, NOISE_HASH_X, (unsigned int)seed * NOISE_HASH_SEED, hx);
+    NoiseHashAxis(j, NOISE_HASH_Y, 0, hy);
+    NoiseHashAxis(k, NOISE_HASH_Z, 0, hz);
+
+    const float *g[4] = {
+        NoiseGradient(hx[0], hy[0], hz[0]),
+        NoiseGradient(hx[i1], hy[j1], hz[k1]),
+        NoiseGradient(hx[i2], hy[j2], hz[k2]),
+        NoiseGradient(hx[1], hy[1], hz[1]),
+    };
+    float cx[4] = { x0, x0 - i1 + NOISE_SIMPLEX_UNSKEW, x0 - i2 + 2 * NOISE_SIMPLEX_UNSKEW, x0 - 1 + 3 * NOISE_SIMPLEX_UNSKEW };
+    float cy[4] = { y0, y0 - j1 + NOISE_SIMPLEX_UNSKEW, y0 - j2 + 2 * NOISE_SIMPLEX_UNSKEW, y0 - 1 + 3 * NOISE_SIMPLEX_UNSKEW };
+    float cz[4] = { z0, z0 - k1 + NOISE_SIMPLEX_UNSKEW, z0 - k2 + 2 * NOISE_SIMPLEX_UNSKEW, z0 - 1 + 3 * NOISE_SIMPLEX_UNSKEW };
+
+    // Every corner adds (r^2 - |d|^2)^4 (g . d), whose gradient is
+    // (r^2 - |d|^2)^4 g - 8 (r^2 - |d|^2)^3 (g . d) d
+    float n = 0, gx = 0, gy = 0, gz = 0;
+
+    for (int c = 0; c < 4; c++) {
+        float falloff = NOISE_SIMPLEX_RADIUS - cx[c] * cx[c] - cy[c] * cy[c] - cz[c] * cz[c];
+        falloff = falloff > 0 ? falloff : 0;
+
+        float dot = g[c][0] * cx[c] + g[c][1] * cy[c] + g[c][2] * cz[c];
+        float f2 = falloff * falloff;
+        float f4 = f2 * f2;
+        float slope = 8 * f2 * falloff * dot;
+
+        n += f4 * dot;
+        gx += f4 * g[c][0] - slope * cx[c];
+        gy += f4 * g[c][1] - slope * cy[c];
+        gz += f4 * g[c][2] - slope * cz[c];
+    }
+
+    *dx = gx * NOISE_SIMPLEX_SCALE;
+    *dy = gy * NOISE_SIMPLEX_SCALE;
+    *dz = gz * NOISE_SIMPLEX_SCALE;
+
+    return n * NOISE_SIMPLEX_SCALE;
+}
+
+typedef float (*NoiseFunction)(float x, float y, float z, int seed, float *dx, float *dy, float *dz);
+
+// The octave sum of stb_perlin_fbm_noise3_deriv
+static float FbmNoise3Deriv(NoiseFunction noise, float x, float y, float z, float lacunarity, float gain, int octaves, float *dx, float *dy, float *dz)
+{
+    float frequency = 1;
+    float amplitude = 1;
+    float sum = 0;
+
+    *dx = *dy = *dz = 0;
+
+    for (int i = 0; i < octaves; i++) {
+        float nx, ny, nz;
+        sum += noise(x * frequency, y * frequency, z * frequency, i, &nx, &ny, &nz) * amplitude;
+        *dx += nx * (amplitude * frequency);
+        *dy += ny * (amplitude * frequency);
+        *dz += nz * (amplitude * frequency);
+        frequency *= lacunarity;
+        amplitude *= gain;
+    }
+
+    return sum;
+}
+
+#ifdef NOISE_SSE2
+
+static __m128i NoiseFloorSse2(__m128 a)
+{
+    __m128i ai = _mm_cvttps_epi32(a);
+    return _mm_add_epi32(ai, _mm_castps_si128(_mm_cmplt_ps(a, _mm_cvtepi32_ps(ai))));
+}
+
+static __m128 NoiseLerpSse2(__m128 a, __m128 b, __m128 t)
+{
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+static __m128 NoiseEaseSse2(__m128 a)
+{
+    __m128 e = _mm_sub_ps(_mm_mul_ps(a, _mm_set1_ps(6)), _mm_set1_ps(15));
+    e = _mm_add_ps(_mm_mul_ps(e, a), _mm_set1_ps(10));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(e, a), a), a);
+}
+
+static __m128 NoiseEaseDerivSse2(__m128 a)
+{
+    __m128 e = _mm_mul_ps(_mm_sub_ps(a, _mm_set1_ps(1)), a);
+    return _mm_mul_ps(_mm_mul_ps(e, e), _mm_set1_ps(30));
+}
+
+// The lanes hold 16-bit values with the upper half clear, so the 16-bit
+// multiplies leave that half clear too and match NoiseMix16
+static __m128i NoiseMix16Sse2(__m128i h)
+{
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 8));
+    h = _mm_mullo_epi16(h, _mm_set1_epi32(0x88b5));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 7));
+    h = _mm_mullo_epi16(h, _mm_set1_epi32(0xdb2d));
+    return _mm_xor_si128(h, _mm_srli_epi32(h, 9));
+}
+
+static void NoiseHashAxisSse2(__m128i p, unsigned int multiplier, unsigned int offset, __m128i *hash)
+{
+    __m128i mask = _mm_set1_epi32(0xffff);
+    __m128i m = _mm_set1_epi32(multiplier);
+    __m128i o = _mm_set1_epi32(offset & 0xffff);
+
+    hash[0] = _mm_and_si128(_mm_add_epi32(_mm_mullo_epi16(_mm_and_si128(p, mask), m), o), mask);
+    hash[1] = _mm_and_si128(_mm_add_epi32(_mm_mullo_epi16(_mm_and_si128(_mm_add_epi32(p, _mm_set1_epi32(1)), mask), m), o), mask);
+}
+
+// No gathers in SSE2: the 4 table rows are loaded and transposed
+static void NoiseGradientSse2(__m128i hx, __m128i hy, __m128i hz, __m128 *g)
+{
+    int index[4];
+    _mm_storeu_si128((__m128i *)index, _mm_srli_epi32(NoiseMix16Sse2(_mm_xor_si128(_mm_xor_si128(hx, hy), hz)), 12));
+
+    __m128 r0 = _mm_loadu_ps(noiseGradients[index[0]]);
+    __m128 r1 = _mm_loadu_ps(noiseGradients[index[1]]);
+    __m128 r2 = _mm_loadu_ps(noiseGradients[index[2]]);
+    __m128 r3 = _mm_loadu_ps(noiseGradients[index[3]]);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    g[0] = r0;
+    g[1] = r1;
+    g[2] = r2;
+}
+
+static __m128 NoiseDotSse2(const __m128 *g, __m128 x, __m128 y, __m128 z)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(g[0], x), _mm_mul_ps(g[1], y)), _mm_mul_ps(g[2], z));
+}
+
+// HashedNoise3Deriv, 4 points at a time
+static __m128 HashedNoise3DerivSse2(__m128 x, __m128 y, __m128 z, int seed, __m128 *grad)
+{
+    __m128 one = _mm_set1_ps(1);
+    __m128i px = NoiseFloorSse2(x);
+    __m128i py = NoiseFloorSse2(y);
+    __m128i pz = NoiseFloorSse2(z);
+    __m128i hx[2], hy[2], hz[2];
+
+    NoiseHashAxisSse2(px, NOISE_HASH_X, (unsigned int)seed * NOISE_HASH_SEED, hx);
+    NoiseHashAxisSse2(py, NOISE_HASH_Y, 0, hy);
+    NoiseHashAxisSse2(pz, NOISE_HASH_Z, 0, hz);
+
+    __m128 g[8][3];
+
+    for (int c = 0; c < 8; c++)
+        NoiseGradientSse2(hx[c >> 2], hy[(c >> 1) & 1], hz[c & 1], g[c]);
+
+    x = _mm_sub_ps(x, _mm_cvtepi32_ps(px)); __m128 u = NoiseEaseSse2(x);
+    y = _mm_sub_ps(y, _mm_cvtepi32_ps(py)); __m128 v = NoiseEaseSse2(y);
+    z = _mm_sub_ps(z, _mm_cvtepi32_ps(pz)); __m128 w = NoiseEaseSse2(z);
+    __m128 x1 = _mm_sub_ps(x, one);
+    __m128 y1 = _mm_sub_ps(y, one);
+    __m128 z1 = _mm_sub_ps(z, one);
+
+    __m128 n000 = NoiseDotSse2(g[0], x , y , z );
+    __m128 n001 = NoiseDotSse2(g[1], x , y , z1);
+    __m128 n010 = NoiseDotSse2(g[2], x , y1, z );
+    __m128 n011 = NoiseDotSse2(g[3], x , y1, z1);
+    __m128 n100 = NoiseDotSse2(g[4], x1, y , z );
+    __m128 n101 = NoiseDotSse2(g[5], x1, y , z1);
+    __m128 n110 = NoiseDotSse2(g[6], x1, y1, z );
+    __m128 n111 = NoiseDotSse2(g[7], x1, y1, z1);
+
+    __m128 n00 = NoiseLerpSse2(n000, n001, w);
+    __m128 n01 = NoiseLerpSse2(n010, n011, w);
+    __m128 n10 = NoiseLerpSse2(n100, n101, w);
+    __m128 n11 = NoiseLerpSse2(n110, n111, w);
+
+    __m128 n0 = NoiseLerpSse2(n00, n01, v);
+    __m128 n1 = NoiseLerpSse2(n10, n11, v);
+
+    for (int c = 0; c < 3; c++) {
+        __m128 d0 = NoiseLerpSse2(NoiseLerpSse2(g[0][c], g[1][c], w), NoiseLerpSse2(g[2][c], g[3][c], w), v);
+        __m128 d1 = NoiseLerpSse2(NoiseLerpSse2(g[4][c], g[5][c], w), NoiseLerpSse2(g[6][c], g[7][c], w), v);
+        grad[c] = NoiseLerpSse2(d0, d1, u);
+    }
+
+    grad[0] = _mm_add_ps(grad[0], _mm_mul_ps(_mm_sub_ps(n1, n0), NoiseEaseDerivSse2(x)));
+    grad[1] = _mm_add_ps(grad[1], _mm_mul_ps(NoiseLerpSse2(_mm_sub_ps(n01, n00), _mm_sub_ps(n11, n10), u), NoiseEaseDerivSse2(y)));
+    grad[2] = _mm_add_ps(grad[2], _mm_mul_ps(NoiseLerpSse2(
+        NoiseLerpSse2(_mm_sub_ps(n001, n000), _mm_sub_ps(n011, n010), v),
+        NoiseLerpSse2(_mm_sub_ps(n101, n100), _mm_sub_ps(n111, n110), v), u), NoiseEaseDerivSse2(z)));
+
+    return NoiseLerpSse2(n0, n1, u);
+}
+
+static __m128i NoiseSelectSse2(__m128 mask, __m128i a, __m128i b)
+{
+    __m128i m = _mm_castps_si128(mask);
+    return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+}
+
+// SimplexNoise3Deriv, 4 points at a time
+static __m128 SimplexNoise3DerivSse2(__m128 x, __m128 y, __m128 z, int seed, __m128 *grad)
+{
+    __m128 one = _mm_set1_ps(1);
+    __m128 unskew = _mm_set1_ps(NOISE_SIMPLEX_UNSKEW);
+
+    __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), z), _mm_set1_ps(NOISE_SIMPLEX_SKEW));
+    __m128i i = NoiseFloorSse2(_mm_add_ps(x, s));
+    __m128i j = NoiseFloorSse2(_mm_add_ps(y, s));
+    __m128i k = NoiseFloorSse2(_mm_add_ps(z, s));
+    __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)), unskew);
+    __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+    __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+    __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+
+    __m128 xy = _mm_cmpge_ps(x0, y0);
+    __m128 xz = _mm_cmpge_ps(x0, z0);
+    __m128 yx = _mm_cmpgt_ps(y0, x0);
+    __m128 yz = _mm_cmpge_ps(y0, z0);
+    __m128 zx = _mm_cmpgt_ps(z0, x0);
+    __m128 zy = _mm_cmpgt_ps(z0, y0);
+    __m128 step1[3] = { _mm_and_ps(xy, xz), _mm_and_ps(yx, yz), _mm_and_ps(zx, zy) };
+    __m128 step2[3] = { _mm_or_ps(xy, xz), _mm_or_ps(yx, yz), _mm_or_ps(zx, zy) };
+
+    __m128i hx[2], hy[2], hz[2];
+    NoiseHashAxisSse2(i, NOISE_HASH_X, (unsigned int)seed * NOISE_HASH_SEED, hx);
+    NoiseHashAxisSse2(j, NOISE_HASH_Y, 0, hy);
+    NoiseHashAxisSse2(k, NOISE_HASH_Z, 0, hz);
+
+    __m128 g[4][3];
+    NoiseGradientSse2(hx[0], hy[0], hz[0], g[0]);
+    NoiseGradientSse2(NoiseSelectSse2(step1[0], hx[0], hx[1]), NoiseSelectSse2(step1[1], hy[0], hy[1]), NoiseSelectSse2(step1[2], hz[0], hz[1]), g[1]);
+    NoiseGradientSse2(NoiseSelectSse2(step2[0], hx[0], hx[1]), NoiseSelectSse2(step2[1], hy[0], hy[1]), NoiseSelectSse2(step2[2], hz[0], hz[1]), g[2]);
+    NoiseGradientSse2(hx[1], hy[1], hz[1], g[3]);
+
+    __m128 cx[4] = {
+        x0,
+        _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(step1[0], one)), unskew),
+        _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(step2[0], one)), _mm_set1_ps(2 * NOISE_SIMPLEX_UNSKEW)),
+        _mm_add_ps(_mm_sub_ps(x0, one), _mm_set1_ps(3 * NOISE_SIMPLEX_UNSKEW)),
+    };
+    __m128 cy[4] = {
+        y0,
+        _mm_add_ps(_mm_sub_ps(y0, _mm_and_ps(step1[1], one)), unskew),
+        _mm_add_ps(_mm_sub_ps(y0, _mm_and_ps(step2[1], one)), _mm_set1_ps(2 * NOISE_SIMPLEX_UNSKEW)),
+        _mm_add_ps(_mm_sub_ps(y0, one), _mm_set1_ps(3 * NOISE_SIMPLEX_UNSKEW)),
+    };
+    __m128 cz[4] = {
+        z0,
+        _mm_add_ps(_mm_sub_ps(z0, _mm_and_ps(step1[2], one)), unskew),
+        _mm_add_ps(_mm_sub_ps(z0, _mm_and_ps(step2[2], one)), _mm_set1_ps(2 * NOISE_SIMPLEX_UNSKEW)),
+        _mm_add_ps(_mm_sub_ps(z0, one), _mm_set1_ps(3 * NOISE_SIMPLEX_UNSKEW)),
+    };
+
+    __m128 n = _mm_setzero_ps();
+    grad[0] = grad[1] = grad[2] = _mm_setzero_ps();
+
+    for (int c = 0; c < 4; c++) {
+        __m128 falloff = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(NOISE_SIMPLEX_RADIUS),
+            _mm_mul_ps(cx[c], cx[c])), _mm_mul_ps(cy[c], cy[c])), _mm_mul_ps(cz[c], cz[c]));
+        falloff = _mm_max_ps(falloff, _mm_setzero_ps());
+
+        __m128 dot = NoiseDotSse2(g[c], cx[c], cy[c], cz[c]);
+        __m128 f2 = _mm_mul_ps(falloff, falloff);
+        __m128 f4 = _mm_mul_ps(f2, f2);
+        __m128 slope = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(8), f2), falloff), dot);
+
+        n = _mm_add_ps(n, _mm_mul_ps(f4, dot));
+        grad[0] = _mm_add_ps(grad[0], _mm_sub_ps(_mm_mul_ps(f4, g[c][0]), _mm_mul_ps(slope, cx[c])));
+        grad[1] = _mm_add_ps(grad[1], _mm_sub_ps(_mm_mul_ps(f4, g[c][1]), _mm_mul_ps(slope, cy[c])));
+        grad[2] = _mm_add_ps(grad[2], _mm_sub_ps(_mm_mul_ps(f4, g[c][2]), _mm_mul_ps(slope, cz[c])));
+    }
+
+    __m128 scale = _mm_set1_ps(NOISE_SIMPLEX_SCALE);
+    grad[0] = _mm_mul_ps(grad[0], scale);
+    grad[1] = _mm_mul_ps(grad[1], scale);
+    grad[2] = _mm_mul_ps(grad[2], scale);
+
+    return _mm_mul_ps(n, scale);
+}
+
+// Returns how many points were processed, a multiple of 4
+static int FbmNoise3DerivSse2(NoiseBackend backend, const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz,
+                              int count, float lacunarity, float gain, int octaves)
+{
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 sum = _mm_setzero_ps();
+        __m128 dsum[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        float frequency = 1;
+        float amplitude = 1;
+
+        for (int o = 0; o < octaves; o++) {
+            __m128 f = _mm_set1_ps(frequency);
+            __m128 d[3];
+            __m128 n = backend == NOISE_BACKEND_SIMPLEX
+                ? SimplexNoise3DerivSse2(_mm_mul_ps(px, f), _mm_mul_ps(py, f), _mm_mul_ps(pz, f), o, d)
+                : HashedNoise3DerivSse2(_mm_mul_ps(px, f), _mm_mul_ps(py, f), _mm_mul_ps(pz, f), o, d);
+            __m128 a = _mm_set1_ps(amplitude * frequency);
+
+            sum = _mm_add_ps(sum, _mm_mul_ps(n, _mm_set1_ps(amplitude)));
+            dsum[0] = _mm_add_ps(dsum[0], _mm_mul_ps(d[0], a));
+            dsum[1] = _mm_add_ps(dsum[1], _mm_mul_ps(d[1], a));
+            dsum[2] = _mm_add_ps(dsum[2], _mm_mul_ps(d[2], a));
+            frequency *= lacunarity;
+            amplitude *= gain;
+        }
+
+        _mm_storeu_ps(out + i, sum);
+        _mm_storeu_ps(dx + i, dsum[0]);
+        _mm_storeu_ps(dy + i, dsum[1]);
+        _mm_storeu_ps(dz + i, dsum[2]);
+    }
+
+    return i;
+}
+
+#endif // NOISE_SSE2
+
+#ifdef NOISE_AVX2
+
+// The gradient table as columns, each split in two registers of 8 entries
+typedef struct NoiseGradientsAvx2 {
+    __m256 low[3];
+    __m256 high[3];
+} NoiseGradientsAvx2;
+
+NOISE_AVX2_FUNC static NoiseGradientsAvx2 LoadNoiseGradientsAvx2(void)
+{
+    NoiseGradientsAvx2 table;
+
+    for (int c = 0; c < 3; c++) {
+        float column[16];
+        for (int i = 0; i < 16; i++)
+            column[i] = noiseGradients[i][c];
+
+        table.low[c] = _mm256_loadu_ps(column);
+        table.high[c] = _mm256_loadu_ps(column + 8);
+    }
+
+    return table;
+}
+
+NOISE_AVX2_FUNC static __m256i NoiseFloorAvx2(__m256 a)
+{
+    __m256i ai = _mm256_cvttps_epi32(a);
+    return _mm256_add_epi32(ai, _mm256_castps_si256(_mm256_cmp_ps(a, _mm256_cvtepi32_ps(ai), _CMP_LT_OQ)));
+}
+
+NOISE_AVX2_FUNC static __m256 NoiseLerpAvx2(__m256 a, __m256 b, __m256 t)
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+NOISE_AVX2_FUNC static __m256 NoiseEaseAvx2(__m256 a)
+{
+    __m256 e = _mm256_sub_ps(_mm256_mul_ps(a, _mm256_set1_ps(6)), _mm256_set1_ps(15));
+    e = _mm256_add_ps(_mm256_mul_ps(e, a), _mm256_set1_ps(10));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(e, a), a), a);
+}
+
+NOISE_AVX2_FUNC static __m256 NoiseEaseDerivAvx2(__m256 a)
+{
+    __m256 e = _mm256_mul_ps(_mm256_sub_ps(a, _mm256_set1_ps(1)), a);
+    return _mm256_mul_ps(_mm256_mul_ps(e, e), _mm256_set1_ps(30));
+}
+
+// See NoiseMix16Sse2
+NOISE_AVX2_FUNC static __m256i NoiseMix16Avx2(__m256i h)
+{
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 8));
+    h = _mm256_mullo_epi16(h, _mm256_set1_epi32(0x88b5));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 7));
+    h = _mm256_mullo_epi16(h, _mm256_set1_epi32(0xdb2d));
+    return _mm256_xor_si256(h, _mm256_srli_epi32(h, 9));
+}
+
+NOISE_AVX2_FUNC static void NoiseHashAxisAvx2(__m256i p, unsigned int multiplier, unsigned int offset, __m256i *hash)
+{
+    __m256i mask = _mm256_set1_epi32(0xffff);
+    __m256i m = _mm256_set1_epi32(multiplier);
+    __m256i o = _mm256_set1_epi32(offset & 0xffff);
+
+    hash[0] = _mm256_and_si256(_mm256_add_epi32(_mm256_mullo_epi16(_mm256_and_si256(p, mask), m), o), mask);
+    hash[1] = _mm256_and_si256(_mm256_add_epi32(_mm256_mullo_epi16(_mm256_and_si256(_mm256_add_epi32(p, _mm256_set1_epi32(1)), mask), m), o), mask);
+}
+
+// The table lookup stays in registers: a permute of each half, picked by bit 3
+NOISE_AVX2_FUNC static void NoiseGradientAvx2(const NoiseGradientsAvx2 *table, __m256i hx, __m256i hy, __m256i hz, __m256 *g)
+{
+    __m256i index = _mm256_srli_epi32(NoiseMix16Avx2(_mm256_xor_si256(_mm256_xor_si256(hx, hy), hz)), 12);
+    __m256 high = _mm256_castsi256_ps(_mm256_slli_epi32(index, 28));
+
+    for (int c = 0; c < 3; c++)
+        g[c] = _mm256_blendv_ps(_mm256_permutevar8x32_ps(table->low[c], index), _mm256_permutevar8x32_ps(table->high[c], index), high);
+}
+
+NOISE_AVX2_FUNC static __m256 NoiseDotAvx2(const __m256 *g, __m256 x, __m256 y, __m256 z)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(g[0], x), _mm256_mul_ps(g[1], y)), _mm256_mul_ps(g[2], z));
+}
+
+// See HashedNoise3DerivSse2
+NOISE_AVX2_FUNC static __m256 HashedNoise3DerivAvx2(const NoiseGradientsAvx2 *table, __m256 x, __m256 y, __m256 z, int seed, __m256 *grad)
+{
+    __m256 one = _mm256_set1_ps(1);
+    __m256i px = NoiseFloorAvx2(x);
+    __m256i py = NoiseFloorAvx2(y);
+    __m256i pz = NoiseFloorAvx2(z);
+    __m256i hx[2], hy[2], hz[2];
+
+    NoiseHashAxisAvx2(px, NOISE_HASH_X, (unsigned int)seed * NOISE_HASH_SEED, hx);
+    NoiseHashAxisAvx2(py, NOISE_HASH_Y, 0, hy);
+    NoiseHashAxisAvx2(pz, NOISE_HASH_Z, 0, hz);
+
+    __m256 g[8][3];
+
+    for (int c = 0; c < 8; c++)
+        NoiseGradientAvx2(table, hx[c >> 2], hy[(c >> 1) & 1], hz[c & 1], g[c]);
+
+    x = _mm256_sub_ps(x, _mm256_cvtepi32_ps(px)); __m256 u = NoiseEaseAvx2(x);
+    y = _mm256_sub_ps(y, _mm256_cvtepi32_ps(py)); __m256 v = NoiseEaseAvx2(y);
+    z = _mm256_sub_ps(z, _mm256_cvtepi32_ps(pz)); __m256 w = NoiseEaseAvx2(z);
+    __m256 x1 = _mm256_sub_ps(x, one);
+    __m256 y1 = _mm256_sub_ps(y, one);
+    __m256 z1 = _mm256_sub_ps(z, one);
+
+    __m256 n000 = NoiseDotAvx2(g[0], x , y , z );
+    __m256 n001 = NoiseDotAvx2(g[1], x , y , z1);
+    __m256 n010 = NoiseDotAvx2(g[2], x , y1, z );
+    __m256 n011 = NoiseDotAvx2(g[3], x , y1, z1);
+    __m256 n100 = NoiseDotAvx2(g[4], x1, y , z );
+    __m256 n101 = NoiseDotAvx2(g[5], x1, y , z1);
+    __m256 n110 = NoiseDotAvx2(g[6], x1, y1, z );
+    __m256 n111 = NoiseDotAvx2(g[7], x1, y1, z1);
+
+    __m256 n00 = NoiseLerpAvx2(n000, n001, w);
+    __m256 n01 = NoiseLerpAvx2(n010, n011, w);
+    __m256 n10 = NoiseLerpAvx2(n100, n101, w);
+    __m256 n11 = NoiseLerpAvx2(n110, n111, w);
+
+    __m256 n0 = NoiseLerpAvx2(n00, n01, v);
+    __m256 n1 = NoiseLerpAvx2(n10, n11, v);
+
+    for (int c = 0; c < 3; c++) {
+        __m256 d0 = NoiseLerpAvx2(NoiseLerpAvx2(g[0][c], g[1][c], w), NoiseLerpAvx2(g[2][c], g[3][c], w), v);
+        __m256 d1 = NoiseLerpAvx2(NoiseLerpAvx2(g[4][c], g[5][c], w), NoiseLerpAvx2(g[6][c], g[7][c], w), v);
+        grad[c] = NoiseLerpAvx2(d0, d1, u);
+    }
+
+    grad[0] = _mm256_add_ps(grad[0], _mm256_mul_ps(_mm256_sub_ps(n1, n0), NoiseEaseDerivAvx2(x)));
+    grad[1] = _mm256_add_ps(grad[1], _mm256_mul_ps(NoiseLerpAvx2(_mm256_sub_ps(n01, n00), _mm256_sub_ps(n11, n10), u), NoiseEaseDerivAvx2(y)));
+    grad[2] = _mm256_add_ps(grad[2], _mm256_mul_ps(NoiseLerpAvx2(
+        NoiseLerpAvx2(_mm256_sub_ps(n001, n000), _mm256_sub_ps(n011, n010), v),
+        NoiseLerpAvx2(_mm256_sub_ps(n101, n100), _mm256_sub_ps(n111, n110), v), u), NoiseEaseDerivAvx2(z)));
+
+    return NoiseLerpAvx2(n0, n1, u);
+}
+
+// See SimplexNoise3DerivSse2
+NOISE_AVX2_FUNC static __m256 SimplexNoise3DerivAvx2(const NoiseGradientsAvx2 *table, __m256 x, __m256 y, __m256 z, int seed, __m256 *grad)
+{
+    __m256 one = _mm256_set1_ps(1);
+    __m256 unskew = _mm256_set1_ps(NOISE_SIMPLEX_UNSKEW);
+
+    __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(x, y), z), _mm256_set1_ps(NOISE_SIMPLEX_SKEW));
+    __m256i i = NoiseFloorAvx2(_mm256_add_ps(x, s));
+    __m256i j = NoiseFloorAvx2(_mm256_add_ps(y, s));
+    __m256i k = NoiseFloorAvx2(_mm256_add_ps(z, s));
+    __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(i, j), k)), unskew);
+    __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+    __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+    __m256 z0 = _mm256_sub_ps(z, _mm256_sub_ps(_mm256_cvtepi32_ps(k), t));
+
+    __m256 xy = _mm256_cmp_ps(x0, y0, _CMP_GE_OQ);
+    __m256 xz = _mm256_cmp_ps(x0, z0, _CMP_GE_OQ);
+    __m256 yx = _mm256_cmp_ps(y0, x0, _CMP_GT_OQ);
+    __m256 yz = _mm256_cmp_ps(y0, z0, _CMP_GE_OQ);
+    __m256 zx = _mm256_cmp_ps(z0, x0, _CMP_GT_OQ);
+    __m256 zy = _mm256_cmp_ps(z0, y0, _CMP_GT_OQ);
+    __m256 step1[3] = { _mm256_and_ps(xy, xz), _mm256_and_ps(yx, yz), _mm256_and_ps(zx, zy) };
+    __m256 step2[3] = { _mm256_or_ps(xy, xz), _mm256_or_ps(yx, yz), _mm256_or_ps(zx, zy) };
+
+    __m256i hx[2], hy[2], hz[2];
+    NoiseHashAxisAvx2(i, NOISE_HASH_X, (unsigned int)seed * NOISE_HASH_SEED, hx);
+    NoiseHashAxisAvx2(j, NOISE_HASH_Y, 0, hy);
+    NoiseHashAxisAvx2(k, NOISE_HASH_Z, 0, hz);
+
+    __m256i h1[3], h2[3];
+    __m256i *axes[3] = { hx, hy, hz };
+
+    for (int c = 0; c < 3; c++) {
+        h1[c] = _mm256_blendv_epi8(axes[c][0], axes[c][1], _mm256_castps_si256(step1[c]));
+        h2[c] = _mm256_blendv_epi8(axes[c][0], axes[c][1], _mm256_castps_si256(step2[c]));
+    }
+
+    __m256 g[4][3];
+    NoiseGradientAvx2(table, hx[0], hy[0], hz[0], g[0]);
+    NoiseGradientAvx2(table, h1[0], h1[1], h1[2], g[1]);
+    NoiseGradientAvx2(table, h2[0], h2[1], h2[2], g[2]);
+    NoiseGradientAvx2(table, hx[1], hy[1], hz[1], g[3]);
+
+    __m256 corners[3][4];
+    __m256 origin[3] = { x0, y0, z0 };
+
+    for (int c = 0; c < 3; c++) {
+        corners[c][0] = origin[c];
+        corners[c][1] = _mm256_add_ps(_mm256_sub_ps(origin[c], _mm256_and_ps(step1[c], one)), unskew);
+        corners[c][2] = _mm256_add_ps(_mm256_sub_ps(origin[c], _mm256_and_ps(step2[c], one)), _mm256_set1_ps(2 * NOISE_SIMPLEX_UNSKEW));
+        corners[c][3] = _mm256_add_ps(_mm256_sub_ps(origin[c], one), _mm256_set1_ps(3 * NOISE_SIMPLEX_UNSKEW));
+    }
+
+    __m256 n = _mm256_setzero_ps();
+    grad[0] = grad[1] = grad[2] = _mm256_setzero_ps();
+
+    for (int c = 0; c < 4; c++) {
+        __m256 cx = corners[0][c], cy = corners[1][c], cz = corners[2][c];
+        __m256 falloff = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(NOISE_SIMPLEX_RADIUS),
+            _mm256_mul_ps(cx, cx)), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz));
+        falloff = _mm256_max_ps(falloff, _mm256_setzero_ps());
+
+        __m256 dot = NoiseDotAvx2(g[c], cx, cy, cz);
+        __m256 f2 = _mm256_mul_ps(falloff, falloff);
+        __m256 f4 = _mm256_mul_ps(f2, f2);
+        __m256 slope = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(8), f2), falloff), dot);
+
+        n = _mm256_add_ps(n, _mm256_mul_ps(f4, dot));
+        grad[0] = _mm256_add_ps(grad[0], _mm256_sub_ps(_mm256_mul_ps(f4, g[c][0]), _mm256_mul_ps(slope, cx)));
+        grad[1] = _mm256_add_ps(grad[1], _mm256_sub_ps(_mm256_mul_ps(f4, g[c][1]), _mm256_mul_ps(slope, cy)));
+        grad[2] = _mm256_add_ps(grad[2], _mm256_sub_ps(_mm256_mul_ps(f4, g[c][2]), _mm256_mul_ps(slope, cz)));
+    }
+
+    __m256 scale = _mm256_set1_ps(NOISE_SIMPLEX_SCALE);
+    grad[0] = _mm256_mul_ps(grad[0], scale);
+    grad[1] = _mm256_mul_ps(grad[1], scale);
+    grad[2] = _mm256_mul_ps(grad[2], scale);
+
+    return _mm256_mul_ps(n, scale);
+}
+
+// Returns how many points were processed, a multiple of 8
+NOISE_AVX2_FUNC static int FbmNoise3DerivAvx2(NoiseBackend backend, const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz,
+                                              int count, float lacunarity, float gain, int octaves)
+{
+    const NoiseGradientsAvx2 table = LoadNoiseGradientsAvx2();
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+        __m256 sum = _mm256_setzero_ps();
+        __m256 dsum[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+        float frequency = 1;
+        float amplitude = 1;
+
+        for (int o = 0; o < octaves; o++) {
+            __m256 f = _mm256_set1_ps(frequency);
+            __m256 d[3];
+            __m256 n = backend == NOISE_BACKEND_SIMPLEX
+                ? SimplexNoise3DerivAvx2(&table, _mm256_mul_ps(px, f), _mm256_mul_ps(py, f), _mm256_mul_ps(pz, f), o, d)
+                : HashedNoise3DerivAvx2(&table, _mm256_mul_ps(px, f), _mm256_mul_ps(py, f), _mm256_mul_ps(pz, f), o, d);
+            __m256 a = _mm256_set1_ps(amplitude * frequency);
+
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(n, _mm256_set1_ps(amplitude)));
+            dsum[0] = _mm256_add_ps(dsum[0], _mm256_mul_ps(d[0], a));
+            dsum[1] = _mm256_add_ps(dsum[1], _mm256_mul_ps(d[1], a));
+            dsum[2] = _mm256_add_ps(dsum[2], _mm256_mul_ps(d[2], a));
+            frequency *= lacunarity;
+            amplitude *= gain;
+        }
+
+        _mm256_storeu_ps(out + i, sum);
+        _mm256_storeu_ps(dx + i, dsum[0]);
+        _mm256_storeu_ps(dy + i, dsum[1]);
+        _mm256_storeu_ps(dz + i, dsum[2]);
+    }
+
+    return i;
+}
+
+#endif // NOISE_AVX2
+
+void FbmNoise3DerivBatchSimd(NoiseBackend backend, int simd, const float *x, const float *y, const float *z,
+                             float *out, float *dx, float *dy, float *dz,
+                             int count, float lacunarity, float gain, int octaves)
+{
+    if (backend == NOISE_BACKEND_STB) {
+        stb_perlin_fbm_noise3_deriv_batch_simd(simd, x, y, z, out, dx, dy, dz, count, lacunarity, gain, octaves);
+        return;
+    }
+
+    int i = 0;
+    int support = stb_perlin_simd_support();
+
+    if (simd > support)
+        simd = support;
+
+#ifdef NOISE_AVX2
+    if (simd >= STB_PERLIN_SIMD_AVX2)
+        i += FbmNoise3DerivAvx2(backend, x + i, y + i, z + i, out + i, dx + i, dy + i, dz + i, count - i, lacunarity, gain, octaves);
+#endif
+#ifdef NOISE_SSE2
+    if (simd >= STB_PERLIN_SIMD_SSE2)
+        i += FbmNoise3DerivSse2(backend, x + i, y + i, z + i, out + i, dx + i, dy + i, dz + i, count - i, lacunarity, gain, octaves);
+#endif
+
+    NoiseFunction noise = backend == NOISE_BACKEND_SIMPLEX ? SimplexNoise3Deriv : HashedNoise3Deriv;
+
+    for (; i < count; i++)
+        out[i] = FbmNoise3Deriv(noise, x[i], y[i], z[i], lacunarity, gain, octaves, &dx[i], &dy[i], &dz[i]);
+}
+
+void FbmNoise3DerivBatch(NoiseBackend backend, const float *x, const float *y, const float *z,
+                         float *out, float *dx, float *dy, float *dz,
+                         int count, float lacunarity, float gain, int octaves)
+{
+    FbmNoise3DerivBatchSimd(backend, STB_PERLIN_SIMD_AVX2, x, y, z, out, dx, dy, dz, count, lacunarity, gain, octaves);
+}
+
+#endif // NOISE_IMPLEMENTATION
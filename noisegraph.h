@@ -0,0 +1,855 @@
+// noisegraph.h - layered terrain noise compiled to a flat list of batched instructions
+//
+// to create the implementation,
+//     #define NOISE_GRAPH_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// stb_perlin.h, noise.h and arena.h must be included before this file. Only
+// the raylib headers are used, for RL_MALLOC and RL_FREE.
+//
+//
+// Documentation:
+//
+// NoiseGraph *CompileNoiseGraph(const char *source, char *error, int errorSize)
+//
+// Compiles the text of a graph, one node per line:
+//
+//     # continents, with mountains on the land only
+//     bend = fbm frequency=0.5 octaves=2 seed=7
+//     warped = warp bend bend bend amount=0.4
+//     land = fbm domain=warped frequency=0.4 octaves=4 seed=1
+//     peaks = ridge frequency=2 octaves=5 seed=2
+//     mountains = scale peaks scale=0.6
+//     height = select land mountains land threshold=0.05 falloff=0.1
+//
+// Every node names a value, made by one of:
+//
+//     fbm          stb_perlin_fbm_noise3, or PLANET_NOISE_BACKEND of noise.h
+//     ridge        stb_perlin_ridge_noise3, with offset= (1)
+//     turbulence   stb_perlin_turbulence_noise3
+//         sources, taking frequency= (1), octaves= (6), lacunarity= (2),
+//         gain= (0.5), seed= (0) and domain= (the point itself)
+//     constant V   V everywhere
+//     add A B      A + B
+//     mul A B      A * B
+//     scale A      A * scale= (1) + bias= (0)
+//     clamp A      A within min= (-1) and max= (1)
+//     select A B C A where C is below threshold= (0), B above it, blended
+//                  over falloff= (0) on each side
+//     warp X Y Z   the point of domain= moved by amount= (1) times (X, Y, Z),
+//                  a domain for the sources rather than a value
+//
+// The last value is the output. The seed moves a source to another part of
+// the lattice of stb_perlin, so two sources with different seeds do not
+// follow each other. Returns NULL and fills 'error' when the text is wrong.
+//
+// NoiseGraph *LoadNoiseGraph(const char *fileName, char *error, int errorSize)
+//
+// Reads and compiles a graph file.
+//
+// void UnloadNoiseGraph(NoiseGraph *graph)
+//
+// void EvaluateNoiseGraph(const NoiseGraph *graph, const float *x, const float *y, const float *z,
+//                         float *out, float *dx, float *dy, float *dz, int count)
+//
+// Like stb_perlin_fbm_noise3_deriv_batch: the output at 'count' points and
+// its gradient with respect to them, through the warps too. The points are
+// run through the instructions in blocks, every instruction over a whole
+// block before the next; the fbm sources go through the SIMD batch. A graph
+// of a single fbm node gives the exact results of that batch.
+//
+// float GetNoiseGraphBound(const NoiseGraph *graph)
+//
+// Largest magnitude the output can take, from the range of every node.
+//
+
+#ifndef NOISE_GRAPH_H
+#define NOISE_GRAPH_H
+
+#include <stdint.h>
+
+typedef enum NoiseOp {
+    NOISE_OP_FBM = 0,
+    NOISE_OP_RIDGE,
+    NOISE_OP_TURBULENCE,
+    NOISE_OP_CONSTANT,
+    NOISE_OP_ADD,
+    NOISE_OP_MUL,
+    NOISE_OP_SCALE,
+    NOISE_OP_CLAMP,
+    NOISE_OP_SELECT,
+    NOISE_OP_WARP,
+} NoiseOp;
+
+typedef struct NoiseInstruction {
+    NoiseOp op;
+    int target;             // Register written, or domain for a warp
+    int inputs[3];          // Registers read
+    int domain;             // Domain read by a source or a warp, 0 is the point itself
+    int octaves;
+    int seed;
+    float frequency;
+    float lacunarity;
+    float gain;
+    float values[2];        // Constant, offset, scale and bias, min and max, threshold and falloff, amount
+} NoiseInstruction;
+
+typedef struct NoiseGraph {
+    NoiseInstruction *code;
+    int codeCount;
+    int registerCount;
+    int domainCount;
+    int output;             // Register of the output
+    float low;              // Range of the output
+    float high;
+    uint64_t hash;          // Of the compiled instructions, for the planet cache
+} NoiseGraph;
+
+NoiseGraph *CompileNoiseGraph(const char *source, char *error, int errorSize);
+NoiseGraph *LoadNoiseGraph(const char *fileName, char *error, int errorSize);
+void UnloadNoiseGraph(NoiseGraph *graph);
+void EvaluateNoiseGraph(const NoiseGraph *graph, const float *x, const float *y, const float *z,
+                        float *out, float *dx, float *dy, float *dz, int count);
+float GetNoiseGraphBound(const NoiseGraph *graph);
+
+#endif // NOISE_GRAPH_H
+
+#ifdef NOISE_GRAPH_IMPLEMENTATION
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Points run through the instructions together
+#define NOISE_GRAPH_BLOCK 256
+
+#define NOISE_GRAPH_MAX_NODES 64
+#define NOISE_GRAPH_MAX_NAME 32
+#define NOISE_GRAPH_MAX_TOKENS 16
+
+typedef struct NoiseGraphSymbol {
+    char name[NOISE_GRAPH_MAX_NAME];
+    bool domain;
+    int index;
+    float low;
+    float high;
+} NoiseGraphSymbol;
+
+typedef struct NoiseGraphCompiler {
+    NoiseGraphSymbol symbols[NOISE_GRAPH_MAX_NODES];
+    int symbolCount;
+    NoiseInstruction code[NOISE_GRAPH_MAX_NODES];
+    int codeCount;
+    int registerCount;
+    int domainCount;
+    int line;
+    char *error;
+    int errorSize;
+} NoiseGraphCompiler;
+
+static bool NoiseGraphError(NoiseGraphCompiler *compiler, const char *format, ...)
+{
+    if (compiler->error != NULL && compiler->errorSize > 0) {
+        int length = snprintf(compiler->error, compiler->errorSize, "line %d: ", compiler->line);
+        va_list args;
+        va_start(args, format);
+        if (length < compiler->errorSize)
+            vsnprintf(compiler->error + length, compiler->errorSize - length, format, args);
+        va_end(args);
+    }
+
+    return false;
+}
+
+static NoiseGraphSymbol *FindNoiseGraphSymbol(NoiseGraphCompiler *compiler, const char *name)
+{
+    for (int i = compiler->symbolCount - 1; i >= 0; i--) {
+        if (strcmp(compiler->symbols[i].name, name) == 0)
+            return &compiler->symbols[i];
+    }
+
+    return NULL;
+}
+
+static bool ReadNoiseGraphInput(NoiseGraphCompiler *compiler, const char *name, bool domain, NoiseGraphSymbol **symbol)
+{
+    *symbol = FindNoiseGraphSymbol(compiler, name);
+
+    if (*symbol == NULL)
+        return NoiseGraphError(compiler, "unknown node '%s'", name);
+    if ((*symbol)->domain != domain)
+        return NoiseGraphError(compiler, "'%s' is %s", name, domain ? "not a domain" : "a domain");
+
+    return true;
+}
+
+static bool ReadNoiseGraphNumber(NoiseGraphCompiler *compiler, const char *text, float *value)
+{
+    char *end;
+    *value = strtof(text, &end);
+
+    if (end == text || *end != '\0' || !isfinite(*value))
+        return NoiseGraphError(compiler, "'%s' is not a number", text);
+
+    return true;
+}
+
+// Largest magnitude of a sum of octaves that stay within [-1, 1]
+static float GetOctavesBound(int octaves, float gain)
+{
+    float bound = 0;
+    float amplitude = 1;
+
+    for (int i = 0; i < octaves; i++) {
+        bound += fabsf(amplitude);
+        amplitude *= gain;
+    }
+
+    return bound;
+}
+
+// Range of a node from the ranges of its inputs
+static void GetNoiseInstructionRange(const NoiseInstruction *instruction, const NoiseGraphSymbol **inputs, float *low, float *high)
+{
+    switch (instruction->op) {
+        case NOISE_OP_FBM: {
+            *high = GetOctavesBound(instruction->octaves, instruction->gain);
+            *low = -*high;
+        } break;
+
+        case NOISE_OP_RIDGE: {
+            // Every octave squares offset - |n| and weighs it by the one before,
+            // starting at half the amplitude
+            float offset = instruction->values[0];
+            float square = fmaxf(offset * offset, (offset - 1) * (offset - 1));
+            float amplitude = 0.5f;
+            float weight = 1;
+            *low = 0;
+            *high = 0;
+
+            for (int i = 0; i < instruction->octaves; i++) {
+                *high += square * fabsf(amplitude) * weight;
+                weight = square;
+                amplitude *= instruction->gain;
+            }
+        } break;
+
+        case NOISE_OP_TURBULENCE: {
+            *low = 0;
+            *high = GetOctavesBound(instruction->octaves, instruction->gain);
+        } break;
+
+        case NOISE_OP_CONSTANT: {
+            *low = *high = instruction->values[0];
+        } break;
+
+        case NOISE_OP_ADD: {
+            *low = inputs[0]->low + inputs[1]->low;
+            *high = inputs[0]->high + inputs[1]->high;
+        } break;
+
+        case NOISE_OP_MUL: {
+            float products[4] = {
+                inputs[0]->low * inputs[1]->low, inputs[0]->low * inputs[1]->high,
+                inputs[0]->high * inputs[1]->low, inputs[0]->high * inputs[1]->high,
+            };
+            *low = *high = products[0];
+
+            for (int i = 1; i < 4; i++) {
+                *low = fminf(*low, products[i]);
+                *high = fmaxf(*high, products[i]);
+            }
+        } break;
+
+        case NOISE_OP_SCALE: {
+            float a = inputs[0]->low * instruction->values[0] + instruction->values[1];
+            float b = inputs[0]->high * instruction->values[0] + instruction->values[1];
+            *low = fminf(a, b);
+            *high = fmaxf(a, b);
+        } break;
+
+        case NOISE_OP_CLAMP: {
+            *low = fminf(fmaxf(inputs[0]->low, instruction->values[0]), instruction->values[1]);
+            *high = fminf(fmaxf(inputs[0]->high, instruction->values[0]), instruction->values[1]);
+        } break;
+
+        case NOISE_OP_SELECT: {
+            *low = fminf(inputs[0]->low, inputs[1]->low);
+            *high = fmaxf(inputs[0]->high, inputs[1]->high);
+        } break;
+
+        case NOISE_OP_WARP: {
+            *low = *high = 0;
+        } break;
+    }
+}
+
+static bool CompileNoiseGraphLine(NoiseGraphCompiler *compiler, char **tokens, int count)
+{
+    static const struct { const char *name; NoiseOp op; int inputs; } ops[] = {
+        { "fbm", NOISE_OP_FBM, 0 },
+        { "ridge", NOISE_OP_RIDGE, 0 },
+        { "turbulence", NOISE_OP_TURBULENCE, 0 },
+        { "constant", NOISE_OP_CONSTANT, 1 },
+        { "add", NOISE_OP_ADD, 2 },
+        { "mul", NOISE_OP_MUL, 2 },
+        { "scale", NOISE_OP_SCALE, 1 },
+        { "clamp", NOISE_OP_CLAMP, 1 },
+        { "select", NOISE_OP_SELECT, 3 },
+        { "warp", NOISE_OP_WARP, 3 },
+    };
+
+    if (count < 3 || strcmp(tokens[1], "=") != 0)
+        return NoiseGraphError(compiler, "expected 'name = op ...'");
+    if (strlen(tokens[0]) >= NOISE_GRAPH_MAX_NAME)
+        return NoiseGraphError(compiler, "name '%s' is too long", tokens[0]);
+    if (compiler->codeCount == NOISE_GRAPH_MAX_NODES)
+        return NoiseGraphError(compiler, "more than %d nodes", NOISE_GRAPH_MAX_NODES);
+
+    int opIndex = -1;
+
+    for (int i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+        if (strcmp(tokens[2], ops[i].name) == 0)
+            opIndex = i;
+    }
+
+    if (opIndex < 0)
+        return NoiseGraphError(compiler, "unknown op '%s'", tokens[2]);
+
+    NoiseInstruction instruction = {
+        .op = ops[opIndex].op,
+        .octaves = 6,
+        .frequency = 1,
+        .lacunarity = 2,
+        .gain = 0.5f,
+    };
+
+    switch (instruction.op) {
+        case NOISE_OP_RIDGE: instruction.values[0] = 1; break;
+        case NOISE_OP_SCALE: instruction.values[0] = 1; break;
+        case NOISE_OP_CLAMP: instruction.values[0] = -1; instruction.values[1] = 1; break;
+        case NOISE_OP_WARP: instruction.values[0] = 1; break;
+        default: break;
+    }
+
+    // Positional inputs, then key=value settings
+    const NoiseGraphSymbol *inputs[3] = { 0 };
+    int positional = 0;
+
+    for (int i = 3; i < count; i++) {
+        char *equals = strchr(tokens[i], '=');
+
+        if (equals == NULL) {
+            if (positional == ops[opIndex].inputs)
+                return NoiseGraphError(compiler, "'%s' takes %d inputs", tokens[2], ops[opIndex].inputs);
+
+            if (instruction.op == NOISE_OP_CONSTANT) {
+                if (!ReadNoiseGraphNumber(compiler, tokens[i], &instruction.values[0]))
+                    return false;
+            } else {
+                NoiseGraphSymbol *symbol;
+                if (!ReadNoiseGraphInput(compiler, tokens[i], false, &symbol))
+                    return false;
+                inputs[positional] = symbol;
+                instruction.inputs[positional] = symbol->index;
+            }
+
+            positional++;
+            continue;
+        }
+
+        *equals = '\0';
+        const char *key = tokens[i];
+        const char *text = equals + 1;
+        bool source = instruction.op <= NOISE_OP_TURBULENCE;
+        float value = 0;
+
+        if (strcmp(key, "domain") == 0 && (source || instruction.op == NOISE_OP_WARP)) {
+            NoiseGraphSymbol *symbol;
+            if (!ReadNoiseGraphInput(compiler, text, true, &symbol))
+                return false;
+            instruction.domain = symbol->index;
+            continue;
+        }
+
+        if (!ReadNoiseGraphNumber(compiler, text, &value))
+            return false;
+
+        if (source && strcmp(key, "frequency") == 0)
+            instruction.frequency = value;
+        else if (source && strcmp(key, "octaves") == 0) {
+            if (value < 0 || value > 16)
+                return NoiseGraphError(compiler, "octaves must be within 0 and 16");
+            instruction.octaves = (int)value;
+        }
+        else if (source && strcmp(key, "lacunarity") == 0)
+            instruction.lacunarity = value;
+        else if (source && strcmp(key, "gain") == 0)
+            instruction.gain = value;
+        else if (source && strcmp(key, "seed") == 0)
+            instruction.seed = (int)value;
+        else if (instruction.op == NOISE_OP_RIDGE && strcmp(key, "offset") == 0)
+            instruction.values[0] = value;
+        else if (instruction.op == NOISE_OP_SCALE && strcmp(key, "scale") == 0)
+            instruction.values[0] = value;
+        else if (instruction.op == NOISE_OP_SCALE && strcmp(key, "bias") == 0)
+            instruction.values[1] = value;
+        else if (instruction.op == NOISE_OP_CLAMP && strcmp(key, "min") == 0)
+            instruction.values[0] = value;
+        else if (instruction.op == NOISE_OP_CLAMP && strcmp(key, "max") == 0)
+            instruction.values[1] = value;
+        else if (instruction.op == NOISE_OP_SELECT && strcmp(key, "threshold") == 0)
+            instruction.values[0] = value;
+        else if (instruction.op == NOISE_OP_SELECT && strcmp(key, "falloff") == 0)
+            instruction.values[1] = fmaxf(value, 0);
+        else if (instruction.op == NOISE_OP_WARP && strcmp(key, "amount") == 0)
+            instruction.values[0] = value;
+        else
+            return NoiseGraphError(compiler, "'%s=%s' does not apply to '%s'", key, text, tokens[2]);
+    }
+
+    if (positional < ops[opIndex].inputs)
+        return NoiseGraphError(compiler, "'%s' takes %d inputs", tokens[2], ops[opIndex].inputs);
+
+    NoiseGraphSymbol symbol = { .domain = instruction.op == NOISE_OP_WARP };
+    strcpy(symbol.name, tokens[0]);
+    GetNoiseInstructionRange(&instruction, inputs, &symbol.low, &symbol.high);
+
+    // Every node gets its own register, the graphs are small
+    symbol.index = symbol.domain ? compiler->domainCount++ : compiler->registerCount++;
+    instruction.target = symbol.index;
+
+    compiler->symbols[compiler->symbolCount++] = symbol;
+    compiler->code[compiler->codeCount++] = instruction;
+
+    return true;
+}
+
+static uint64_t HashNoiseGraphValue(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// Field by field, leaving out the padding of the struct
+static uint64_t HashNoiseGraph(const NoiseGraph *graph)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (int i = 0; i < graph->codeCount; i++) {
+        const NoiseInstruction *instruction = &graph->code[i];
+        int fields[] = {
+            instruction->op, instruction->target, instruction->inputs[0], instruction->inputs[1],
+            instruction->inputs[2], instruction->domain, instruction->octaves, instruction->seed,
+        };
+        float values[] = {
+            instruction->frequency, instruction->lacunarity, instruction->gain,
+            instruction->values[0], instruction->values[1],
+        };
+
+        hash = HashNoiseGraphValue(hash, fields, sizeof(fields));
+        hash = HashNoiseGraphValue(hash, values, sizeof(values));
+    }
+
+    return HashNoiseGraphValue(hash, &graph->output, sizeof(graph->output));
+}
+
+NoiseGraph *CompileNoiseGraph(const char *source, char *error, int errorSize)
+{
+    NoiseGraphCompiler *compiler = (NoiseGraphCompiler *)RL_CALLOC(1, sizeof(NoiseGraphCompiler));
+    compiler->domainCount = 1;
+    compiler->error = error;
+    compiler->errorSize = errorSize;
+
+    bool ok = true;
+    const char *cursor = source;
+
+    while (ok && *cursor != '\0') {
+        const char *end = strchr(cursor, '\n');
+        size_t length = end != NULL ? (size_t)(end - cursor) : strlen(cursor);
+        char line[256];
+        compiler->line++;
+
+        if (length >= sizeof(line)) {
+            ok = NoiseGraphError(compiler, "line is too long");
+            break;
+        }
+
+        memcpy(line, cursor, length);
+        line[length] = '\0';
+        cursor += end != NULL ? length + 1 : length;
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char *tokens[NOISE_GRAPH_MAX_TOKENS];
+        int count = 0;
+
+        for (char *token = strtok(line, " \t\r"); token != NULL; token = strtok(NULL, " \t\r")) {
+            if (count == NOISE_GRAPH_MAX_TOKENS) {
+                ok = NoiseGraphError(compiler, "too many settings");
+                break;
+            }
+            tokens[count++] = token;
+        }
+
+        if (ok && count > 0)
+            ok = CompileNoiseGraphLine(compiler, tokens, count);
+    }
+
+    int output = -1;
+
+    for (int i = compiler->symbolCount - 1; ok && i >= 0 && output < 0; i--) {
+        if (!compiler->symbols[i].domain)
+            output = i;
+    }
+
+    if (ok && output < 0)
+        ok = NoiseGraphError(compiler, "no value to output");
+
+    NoiseGraph *graph = NULL;
+
+    if (ok) {
+        graph = (NoiseGraph *)RL_CALLOC(1, sizeof(NoiseGraph));
+        graph->code = (NoiseInstruction *)RL_MALLOC(compiler->codeCount * sizeof(NoiseInstruction));
+        memcpy(graph->code, compiler->code, compiler->codeCount * sizeof(NoiseInstruction));
+        graph->codeCount = compiler->codeCount;
+        graph->registerCount = compiler->registerCount;
+        graph->domainCount = compiler->domainCount;
+        graph->output = compiler->symbols[output].index;
+        graph->low = compiler->symbols[output].low;
+        graph->high = compiler->symbols[output].high;
+        graph->hash = HashNoiseGraph(graph);
+    }
+
+    RL_FREE(compiler);
+
+    return graph;
+}
+
+NoiseGraph *LoadNoiseGraph(const char *fileName, char *error, int errorSize)
+{
+    FILE *file = fopen(fileName, "rb");
+
+    if (file == NULL) {
+        snprintf(error, errorSize, "cannot open %s", fileName);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *source = (char *)RL_MALLOC(size + 1);
+    size_t read = fread(source, 1, size, file);
+    source[read] = '\0';
+    fclose(file);
+
+    NoiseGraph *graph = CompileNoiseGraph(source, error, errorSize);
+    RL_FREE(source);
+
+    return graph;
+}
+
+void UnloadNoiseGraph(NoiseGraph *graph)
+{
+    if (graph == NULL)
+        return;
+
+    RL_FREE(graph->code);
+    RL_FREE(graph);
+}
+
+float GetNoiseGraphBound(const NoiseGraph *graph)
+{
+    return fmaxf(fabsf(graph->low), fabsf(graph->high));
+}
+
+// Value of a register over a block, with its gradient
+typedef struct NoiseRegister {
+    float *value;
+    float *dx;
+    float *dy;
+    float *dz;
+} NoiseRegister;
+
+// Point of a domain over a block, with its 3 x 3 jacobian row by row
+// The first domain is the point itself, whose jacobian is the identity
+typedef struct NoiseDomain {
+    const float *x;
+    const float *y;
+    const float *z;
+    float *jacobian[9];
+} NoiseDomain;
+
+// A seed moves the source by a fraction of the 256 cells the lattice repeats over
+static void GetNoiseSeedOffset(int seed, float offset[3])
+{
+    uint32_t hash = (uint32_t)seed * 0x9e3779b9u;
+
+    for (int i = 0; i < 3; i++) {
+        hash ^= hash >> 15;
+        hash *= 0x2c1b3c6du;
+        hash ^= hash >> 12;
+        offset[i] = seed != 0 ? (float)(hash & 0xffff) / 65536.0f * 256.0f : 0;
+    }
+}
+
+static void EvaluateNoiseSource(const NoiseInstruction *instruction, const NoiseDomain *domain, NoiseRegister target, float *sample[3], int count)
+{
+    const float frequency = instruction->frequency;
+    const float *x = domain->x;
+    const float *y = domain->y;
+    const float *z = domain->z;
+
+    // The point itself goes straight to the batch, so a single fbm node
+    // reproduces the plain fBm bit for bit
+    if (frequency != 1 || instruction->seed != 0) {
+        float offset[3];
+        GetNoiseSeedOffset(instruction->seed, offset);
+
+        for (int i = 0; i < count; i++) {
+            sample[0][i] = x[i] * frequency + offset[0];
+            sample[1][i] = y[i] * frequency + offset[1];
+            sample[2][i] = z[i] * frequency + offset[2];
+        }
+
+        x = sample[0];
+        y = sample[1];
+        z = sample[2];
+    }
+
+    switch (instruction->op) {
+        case NOISE_OP_FBM:
+            FbmNoise3DerivBatch(PLANET_NOISE_BACKEND, x, y, z, target.value, target.dx, target.dy, target.dz, count,
+                                instruction->lacunarity, instruction->gain, instruction->octaves);
+            break;
+
+        case NOISE_OP_RIDGE:
+            for (int i = 0; i < count; i++)
+                target.value[i] = stb_perlin_ridge_noise3_deriv(x[i], y[i], z[i], instruction->lacunarity, instruction->gain,
+                                                                instruction->values[0], instruction->octaves,
+                                                                &target.dx[i], &target.dy[i], &target.dz[i]);
+            break;
+
+        default:
+            for (int i = 0; i < count; i++)
+                target.value[i] = stb_perlin_turbulence_noise3_deriv(x[i], y[i], z[i], instruction->lacunarity, instruction->gain,
+                                                                     instruction->octaves, &target.dx[i], &target.dy[i], &target.dz[i]);
+            break;
+    }
+
+    // Back to the gradient with respect to the point: the frequency, then the
+    // jacobian of the warps, whose columns are the moves along x, y and z
+    if (frequency != 1) {
+        for (int i = 0; i < count; i++) {
+            target.dx[i] *= frequency;
+            target.dy[i] *= frequency;
+            target.dz[i] *= frequency;
+        }
+    }
+
+    if (domain->jacobian[0] != NULL) {
+        float *const *J = domain->jacobian;
+
+        for (int i = 0; i < count; i++) {
+            float gx = target.dx[i], gy = target.dy[i], gz = target.dz[i];
+            target.dx[i] = gx * J[0][i] + gy * J[3][i] + gz * J[6][i];
+            target.dy[i] = gx * J[1][i] + gy * J[4][i] + gz * J[7][i];
+            target.dz[i] = gx * J[2][i] + gy * J[5][i] + gz * J[8][i];
+        }
+    }
+}
+
+static void EvaluateNoiseWarp(const NoiseInstruction *instruction, const NoiseDomain *base, NoiseDomain *target,
+                              const NoiseRegister *registers, int count)
+{
+    const float amount = instruction->values[0];
+    const NoiseRegister *moves[3] = {
+        &registers[instruction->inputs[0]], &registers[instruction->inputs[1]], &registers[instruction->inputs[2]],
+    };
+    float *coordinates[3] = { (float *)target->x, (float *)target->y, (float *)target->z };
+    const float *baseCoordinates[3] = { base->x, base->y, base->z };
+
+    for (int c = 0; c < 3; c++) {
+        const NoiseRegister *move = moves[c];
+        float *rows[3] = { target->jacobian[c * 3], target->jacobian[c * 3 + 1], target->jacobian[c * 3 + 2] };
+
+        for (int i = 0; i < count; i++) {
+            coordinates[c][i] = baseCoordinates[c][i] + amount * move->value[i];
+            rows[0][i] = amount * move->dx[i];
+            rows[1][i] = amount * move->dy[i];
+            rows[2][i] = amount * move->dz[i];
+        }
+
+        if (base->jacobian[0] != NULL) {
+            for (int k = 0; k < 3; k++) {
+                for (int i = 0; i < count; i++)
+                    rows[k][i] += base->jacobian[c * 3 + k][i];
+            }
+        } else {
+            for (int i = 0; i < count; i++)
+                rows[c][i] += 1;
+        }
+    }
+}
+
+static void EvaluateNoiseInstruction(const NoiseInstruction *instruction, NoiseRegister *registers, NoiseDomain *domains,
+                                     float *sample[3], int count)
+{
+    NoiseRegister target = registers[instruction->target];
+    const NoiseRegister a = registers[instruction->inputs[0]];
+    const NoiseRegister b = registers[instruction->inputs[1]];
+    const NoiseRegister c = registers[instruction->inputs[2]];
+    const float *values = instruction->values;
+
+    switch (instruction->op) {
+        case NOISE_OP_FBM:
+        case NOISE_OP_RIDGE:
+        case NOISE_OP_TURBULENCE:
+            EvaluateNoiseSource(instruction, &domains[instruction->domain], target, sample, count);
+            break;
+
+        case NOISE_OP_CONSTANT:
+            for (int i = 0; i < count; i++) {
+                target.value[i] = values[0];
+                target.dx[i] = target.dy[i] = target.dz[i] = 0;
+            }
+            break;
+
+        case NOISE_OP_ADD:
+            for (int i = 0; i < count; i++) {
+                target.value[i] = a.value[i] + b.value[i];
+                target.dx[i] = a.dx[i] + b.dx[i];
+                target.dy[i] = a.dy[i] + b.dy[i];
+                target.dz[i] = a.dz[i] + b.dz[i];
+            }
+            break;
+
+        case NOISE_OP_MUL:
+            for (int i = 0; i < count; i++) {
+                float va = a.value[i], vb = b.value[i];
+                target.value[i] = va * vb;
+                target.dx[i] = a.dx[i] * vb + b.dx[i] * va;
+                target.dy[i] = a.dy[i] * vb + b.dy[i] * va;
+                target.dz[i] = a.dz[i] * vb + b.dz[i] * va;
+            }
+            break;
+
+        case NOISE_OP_SCALE:
+            for (int i = 0; i < count; i++) {
+                target.value[i] = a.value[i] * values[0] + values[1];
+                target.dx[i] = a.dx[i] * values[0];
+                target.dy[i] = a.dy[i] * values[0];
+                target.dz[i] = a.dz[i] * values[0];
+            }
+            break;
+
+        case NOISE_OP_CLAMP:
+            for (int i = 0; i < count; i++) {
+                float v = a.value[i];
+                bool inside = v > values[0] && v < values[1];
+                target.value[i] = fminf(fmaxf(v, values[0]), values[1]);
+                target.dx[i] = inside ? a.dx[i] : 0;
+                target.dy[i] = inside ? a.dy[i] : 0;
+                target.dz[i] = inside ? a.dz[i] : 0;
+            }
+            break;
+
+        case NOISE_OP_SELECT:
+            for (int i = 0; i < count; i++) {
+                // Smoothstep of the control across the threshold, or a step without falloff
+                float t, slope = 0;
+
+                if (values[1] > 0) {
+                    float u = fminf(fmaxf((c.value[i] - values[0] + values[1]) / (2 * values[1]), 0), 1);
+                    t = u * u * (3 - 2 * u);
+                    slope = u > 0 && u < 1 ? 6 * u * (1 - u) / (2 * values[1]) : 0;
+                } else {
+                    t = c.value[i] > values[0] ? 1 : 0;
+                }
+
+                float difference = b.value[i] - a.value[i];
+                target.value[i] = a.value[i] + difference * t;
+                target.dx[i] = a.dx[i] + (b.dx[i] - a.dx[i]) * t + difference * slope * c.dx[i];
+                target.dy[i] = a.dy[i] + (b.dy[i] - a.dy[i]) * t + difference * slope * c.dy[i];
+                target.dz[i] = a.dz[i] + (b.dz[i] - a.dz[i]) * t + difference * slope * c.dz[i];
+            }
+            break;
+
+        case NOISE_OP_WARP:
+            EvaluateNoiseWarp(instruction, &domains[instruction->domain], &domains[instruction->target], registers, count);
+            break;
+    }
+}
+
+void EvaluateNoiseGraph(const NoiseGraph *graph, const float *x, const float *y, const float *z,
+                        float *out, float *dx, float *dy, float *dz, int count)
+{
+    // Registers, then the warped domains, then the sample points of the sources
+    // Called for every row, so the buffers come from the scratch arena
+    const int registerFloats = graph->registerCount * 4;
+    const int domainFloats = (graph->domainCount - 1) * 12;
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *scratch = (float *)ArenaAlloc(arena, (registerFloats + domainFloats + 3) * NOISE_GRAPH_BLOCK * sizeof(float));
+
+    NoiseRegister *registers = (NoiseRegister *)ArenaAlloc(arena, graph->registerCount * sizeof(NoiseRegister));
+    NoiseDomain *domains = (NoiseDomain *)ArenaAlloc(arena, graph->domainCount * sizeof(NoiseDomain));
+    memset(domains, 0, graph->domainCount * sizeof(NoiseDomain));
+    float *cursor = scratch;
+
+    for (int i = 0; i < graph->registerCount; i++) {
+        registers[i].value = cursor;
+        registers[i].dx = cursor + NOISE_GRAPH_BLOCK;
+        registers[i].dy = cursor + NOISE_GRAPH_BLOCK * 2;
+        registers[i].dz = cursor + NOISE_GRAPH_BLOCK * 3;
+        cursor += NOISE_GRAPH_BLOCK * 4;
+    }
+
+    for (int i = 1; i < graph->domainCount; i++) {
+        domains[i].x = cursor;
+        domains[i].y = cursor + NOISE_GRAPH_BLOCK;
+        domains[i].z = cursor + NOISE_GRAPH_BLOCK * 2;
+        cursor += NOISE_GRAPH_BLOCK * 3;
+
+        for (int k = 0; k < 9; k++) {
+            domains[i].jacobian[k] = cursor;
+            cursor += NOISE_GRAPH_BLOCK;
+        }
+    }
+
+    float *sample[3] = { cursor, cursor + NOISE_GRAPH_BLOCK, cursor + NOISE_GRAPH_BLOCK * 2 };
+    const NoiseRegister output = registers[graph->output];
+
+    for (int start = 0; start < count; start += NOISE_GRAPH_BLOCK) {
+        int length = count - start < NOISE_GRAPH_BLOCK ? count - start : NOISE_GRAPH_BLOCK;
+
+        domains[0].x = x + start;
+        domains[0].y = y + start;
+        domains[0].z = z + start;
+
+        for (int i = 0; i < graph->codeCount; i++)
+            EvaluateNoiseInstruction(&graph->code[i], registers, domains, sample, length);
+
+        memcpy(out + start, output.value, length * sizeof(float));
+        memcpy(dx + start, output.dx, length * sizeof(float));
+        memcpy(dy + start, output.dy, length * sizeof(float));
+        memcpy(dz + start, output.dz, length * sizeof(float));
+    }
+
+    RewindArena(arena, mark);
+}
+
+#endif // NOISE_GRAPH_IMPLEMENTATION
@@ -0,0 +1,198 @@
+// packed.h - compact vertex layout for the planet chunks
+//
+// to create the implementation,
+//     #define PACKED_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// planet.h must be included before this file. Needs the raylib library and
+// rlgl, the calls must come from the thread that owns the GL context.
+//
+//
+// Documentation:
+//
+// void UploadPackedMesh(Mesh *mesh, PlanetParams params, bool dynamic)
+//
+// Uploads a planet chunk in 12 bytes per vertex instead of the 36 of
+// UploadMesh. Every vertex of the planet sits along its sphere direction,
+// so the position is stored as that direction, octahedral encoded, and the
+// height above params.radius, 16 bits each. The normal is octahedral
+// encoded in 2 x 16 bits. There are no texture coordinates, and no colors
+// either: shadowmap.vs picks them from the height, like heightToColor.
+// The CPU arrays are kept, as with UploadMesh.
+//
+// The mesh draws with DrawMesh, which binds its vertex array as it is, in
+// a shader whose packedVertices uniform is set, see SetPackedVertexUniforms.
+//
+// void UpdatePackedMesh(Mesh mesh, PlanetParams params)
+//
+// Packs and uploads the CPU arrays again, once the vertices changed.
+//
+// void UnloadPackedMesh(Mesh mesh)
+//
+// Like UnloadMesh, releases the GPU buffers and the CPU arrays.
+//
+// size_t GetMeshVideoMemory(Mesh mesh, bool packed)
+//
+// Bytes of GPU buffers held by a chunk uploaded either way.
+//
+// void SetPackedVertexUniforms(Shader shader, bool packed, PlanetParams params)
+//
+// Turns the decoding in the shader on or off, for meshes packed with 'params'.
+//
+
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Direction, height and padding, then the normal
+#define PACKED_VERTEX_SIZE (4 * sizeof(unsigned short) + 2 * sizeof(unsigned short))
+
+void UploadPackedMesh(Mesh *mesh, PlanetParams params, bool dynamic);
+void UpdatePackedMesh(Mesh mesh, PlanetParams params);
+void UnloadPackedMesh(Mesh mesh);
+size_t GetMeshVideoMemory(Mesh mesh, bool packed);
+void SetPackedVertexUniforms(Shader shader, bool packed, PlanetParams params);
+
+#endif // PACKED_H
+
+#ifdef PACKED_IMPLEMENTATION
+
+#include <rlgl.h>
+
+#ifndef RL_UNSIGNED_SHORT
+#define RL_UNSIGNED_SHORT 0x1403 // GL_UNSIGNED_SHORT
+#endif
+
+// Buffers of a packed mesh, in mesh.vboId
+#define PACKED_BUFFER_POSITIONS 0
+#define PACKED_BUFFER_NORMALS 1
+#define PACKED_BUFFER_INDICES 2
+#define PACKED_BUFFER_COUNT 3
+
+// Shader locations raylib binds vertexPosition and vertexNormal to
+#define PACKED_LOCATION_POSITION 0
+#define PACKED_LOCATION_NORMAL 2
+
+static unsigned short QuantizeUnit(float value)
+{
+    return (unsigned short)roundf(Clamp(value * 0.5f + 0.5f, 0, 1) * 65535);
+}
+
+// Octahedral encoding, folded the same way as the decoding in shadowmap.vs
+static void EncodeOctahedral(Vector3 v, unsigned short *out)
+{
+    float sum = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+    float x = v.x / sum;
+    float y = v.y / sum;
+
+    if (v.z < 0) {
+        float foldedX = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+        float foldedY = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    out[0] = QuantizeUnit(x);
+    out[1] = QuantizeUnit(y);
+}
+
+// Fills 'positions' with 4 and 'normals' with 2 values per vertex
+static void PackMeshVertices(Mesh mesh, PlanetParams params, unsigned short *positions, unsigned short *normals)
+{
+    float heightRange = GetPlanetNoiseBound(params);
+
+    for (int i = 0; i < mesh.vertexCount; i++) {
+        Vector3 position = { mesh.vertices[i * 3], mesh.vertices[i * 3 + 1], mesh.vertices[i * 3 + 2] };
+        Vector3 normal = { mesh.normals[i * 3], mesh.normals[i * 3 + 1], mesh.normals[i * 3 + 2] };
+        float length = Vector3Length(position);
+
+        EncodeOctahedral(position, &positions[i * 4]);
+        positions[i * 4 + 2] = QuantizeUnit(heightRange > 0 ? (length - params.radius) / heightRange : 0);
+        positions[i * 4 + 3] = 0;
+
+        EncodeOctahedral(normal, &normals[i * 2]);
+    }
+}
+
+void UploadPackedMesh(Mesh *mesh, PlanetParams params, bool dynamic)
+{
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    unsigned short *positions = (unsigned short *)ArenaAlloc(arena, mesh->vertexCount * PACKED_VERTEX_SIZE);
+    unsigned short *normals = positions + mesh->vertexCount * 4;
+    PackMeshVertices(*mesh, params, positions, normals);
+
+    mesh->vboId = (unsigned int *)RL_CALLOC(PACKED_BUFFER_COUNT, sizeof(unsigned int));
+    mesh->vaoId = rlLoadVertexArray();
+    rlEnableVertexArray(mesh->vaoId);
+
+    // Normalized, so the shader reads them as floats in [0, 1]
+    mesh->vboId[PACKED_BUFFER_POSITIONS] = rlLoadVertexBuffer(positions, mesh->vertexCount * 4 * sizeof(unsigned short), dynamic);
+    rlSetVertexAttribute(PACKED_LOCATION_POSITION, 4, RL_UNSIGNED_SHORT, true, 0, 0);
+    rlEnableVertexAttribute(PACKED_LOCATION_POSITION);
+
+    mesh->vboId[PACKED_BUFFER_NORMALS] = rlLoadVertexBuffer(normals, mesh->vertexCount * 2 * sizeof(unsigned short), dynamic);
+    rlSetVertexAttribute(PACKED_LOCATION_NORMAL, 2, RL_UNSIGNED_SHORT, true, 0, 0);
+    rlEnableVertexAttribute(PACKED_LOCATION_NORMAL);
+
+    mesh->vboId[PACKED_BUFFER_INDICES] = rlLoadVertexBufferElement(mesh->indices, mesh->triangleCount * 3 * sizeof(unsigned short), dynamic);
+
+    rlDisableVertexArray();
+
+    RewindArena(arena, mark);
+}
+
+void UpdatePackedMesh(Mesh mesh, PlanetParams params)
+{
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    unsigned short *positions = (unsigned short *)ArenaAlloc(arena, mesh.vertexCount * PACKED_VERTEX_SIZE);
+    unsigned short *normals = positions + mesh.vertexCount * 4;
+    PackMeshVertices(mesh, params, positions, normals);
+
+    rlUpdateVertexBuffer(mesh.vboId[PACKED_BUFFER_POSITIONS], positions, mesh.vertexCount * 4 * sizeof(unsigned short), 0);
+    rlUpdateVertexBuffer(mesh.vboId[PACKED_BUFFER_NORMALS], normals, mesh.vertexCount * 2 * sizeof(unsigned short), 0);
+
+    RewindArena(arena, mark);
+}
+
+void UnloadPackedMesh(Mesh mesh)
+{
+    rlUnloadVertexArray(mesh.vaoId);
+
+    if (mesh.vboId != NULL) {
+        for (int i = 0; i < PACKED_BUFFER_COUNT; i++)
+            rlUnloadVertexBuffer(mesh.vboId[i]);
+    }
+
+    RL_FREE(mesh.vboId);
+    RL_FREE(mesh.vertices);
+    RL_FREE(mesh.normals);
+    RL_FREE(mesh.colors);
+    RL_FREE(mesh.indices);
+}
+
+size_t GetMeshVideoMemory(Mesh mesh, bool packed)
+{
+    size_t indices = (size_t)mesh.triangleCount * 3 * sizeof(unsigned short);
+
+    if (packed)
+        return (size_t)mesh.vertexCount * PACKED_VERTEX_SIZE + indices;
+
+    // UploadMesh: positions, texture coordinates, normals and colors
+    return (size_t)mesh.vertexCount * ((3 + 2 + 3) * sizeof(float) + 4 * sizeof(unsigned char)) + indices;
+}
+
+void SetPackedVertexUniforms(Shader shader, bool packed, PlanetParams params)
+{
+    int enabled = packed;
+    float heightRange = GetPlanetNoiseBound(params);
+
+    SetShaderValue(shader, GetShaderLocation(shader, "packedVertices"), &enabled, SHADER_UNIFORM_INT);
+    SetShaderValue(shader, GetShaderLocation(shader, "planetRadius"), &params.radius, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, GetShaderLocation(shader, "heightRange"), &heightRange, SHADER_UNIFORM_FLOAT);
+}
+
+#endif // PACKED_IMPLEMENTATION
@@ -0,0 +1,630 @@
+// parallel.h - work stealing job system and worker pool for splitting loops into bands
+//
+// to create the implementation,
+//     #define PARALLEL_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// arena.h must be included before this file.
+//
+//
+// Documentation:
+//
+// WorkerPool *LoadWorkerPool(int threads)
+//
+// Creates a pool that runs jobs on 'threads' threads in total; the thread
+// waiting on a job helps running them, so 'threads - 1' workers are spawned,
+// but at least one so that jobs run in the background of a single thread
+// pool too. Pass 0 to use GetHardwareThreads().
+//
+// The workers free their scratch arena of arena.h when they exit, and
+// UnloadWorkerPool frees the one of the calling thread.
+//
+// Every worker has its own deque: it pushes and pops jobs at the bottom
+// without locking, while idle threads steal from the top of the others.
+// The thread that loaded the pool has a deque too, any other thread submits
+// through a locked queue.
+//
+// Job *CreateJob(WorkerPool *pool, Job *parent, JobFunc func, void *data)
+// void RunJob(WorkerPool *pool, Job *job)
+// void WaitJob(WorkerPool *pool, Job *job)
+//
+// A job calls func(pool, job, data) once run. It only counts as finished
+// when its children, jobs created with it as 'parent' before it finished,
+// are finished too, so a job can split its work in children and return.
+// Jobs without a parent must be waited on exactly once with WaitJob, which
+// runs other jobs meanwhile and frees the job; children are freed on their
+// own. Jobs can be created, run and waited on from any thread, including
+// from inside other jobs.
+//
+// bool IsJobFinished(Job *job)
+//
+// Whether the job and its children are finished, without running anything,
+// for a thread that must not pick up other jobs. A job without a parent
+// still has to be waited on, which then returns right away.
+//
+// void WorkerPoolFor(WorkerPool *pool, int count, int grain, WorkerFunc func, void *data)
+//
+// Calls func(data, begin, end) over [0, count) in bands of 'grain' items and
+// blocks until every band is done. The bands are split in halves down to
+// 'grain' as jobs, so 'func' must not depend on which thread runs which band.
+// Pools of a single thread run the loop on the calling thread.
+//
+// void RunOnMainThread(WorkerPool *pool, MainThreadFunc func, void *data)
+// int RunMainThreadJobs(WorkerPool *pool)
+//
+// Queues func(data) for the main thread, for the work that must stay there
+// like the OpenGL calls. The queue is behind a mutex, held only to append or
+// to take the whole queue, so what 'data' hands over needs no lock of its
+// own. The main thread runs the queue with RunMainThreadJobs, usually once a
+// frame, which returns how many functions it ran.
+//
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+
+typedef struct WorkerPool WorkerPool;
+typedef struct Job Job;
+
+typedef void (*WorkerFunc)(void *data, int begin, int end);
+typedef void (*JobFunc)(WorkerPool *pool, Job *job, void *data);
+typedef void (*MainThreadFunc)(void *data);
+
+int GetHardwareThreads(void);
+double GetWallTime(void);
+
+WorkerPool *LoadWorkerPool(int threads);
+void UnloadWorkerPool(WorkerPool *pool);
+int GetWorkerPoolThreads(const WorkerPool *pool);
+
+Job *CreateJob(WorkerPool *pool, Job *parent, JobFunc func, void *data);
+void RunJob(WorkerPool *pool, Job *job);
+void WaitJob(WorkerPool *pool, Job *job);
+bool IsJobFinished(Job *job);
+
+void WorkerPoolFor(WorkerPool *pool, int count, int grain, WorkerFunc func, void *data);
+
+void RunOnMainThread(WorkerPool *pool, MainThreadFunc func, void *data);
+int RunMainThreadJobs(WorkerPool *pool);
+
+#endif // PARALLEL_H
+
+#ifdef PARALLEL_IMPLEMENTATION
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Jobs a deque holds, a job pushed to a full deque runs right away instead
+#define JOB_DEQUE_SIZE 4096
+
+// Finished jobs every thread keeps for reuse instead of freeing them
+#define JOB_FREE_LIST_SIZE 256
+
+// Rounds of stealing an idle worker tries before going to sleep
+#define JOB_IDLE_SPINS 64
+
+struct Job {
+    JobFunc func;
+    void *data;
+    Job *parent;
+    atomic_int unfinished;  // The job itself and its unfinished children
+    atomic_int references;  // The scheduler and, without a parent, the waiter
+
+    // Bands of WorkerPoolFor
+    WorkerFunc loop;
+    void *loopData;
+    int begin;
+    int end;
+    int grain;
+
+    Job *nextFree;
+};
+
+// Chase-Lev deque: the owner pushes and pops at the bottom, thieves take from the top
+typedef struct JobDeque {
+    atomic_long top;
+    atomic_long bottom;
+    _Atomic(Job *) slots[JOB_DEQUE_SIZE];
+} JobDeque;
+
+typedef struct WorkerThread {
+    WorkerPool *pool;
+    int index;
+    pthread_t thread;
+    bool running;
+    unsigned int random;    // Picks the deque to steal from
+    JobDeque deque;
+} WorkerThread;
+
+typedef struct MainThreadCall {
+    MainThreadFunc func;
+    void *data;
+} MainThreadCall;
+
+struct WorkerPool {
+    int threadCount;
+    int workerCount;
+    WorkerThread *workers;  // The thread that loaded the pool, then the workers
+
+    // Jobs from threads without a deque
+    pthread_mutex_t queueMutex;
+    Job **queue;
+    int queueCount;
+    int queueCapacity;
+    atomic_int queued;
+
+    // Idle workers sleep until a job is pushed
+    pthread_mutex_t sleepMutex;
+    pthread_cond_t wake;
+    atomic_int sleeping;
+    atomic_bool quit;
+
+    pthread_mutex_t mainMutex;
+    MainThreadCall *mainCalls;
+    int mainCount;
+    int mainCapacity;
+};
+
+static _Thread_local WorkerThread *currentWorker = NULL;
+static _Thread_local Job *freeJobs = NULL;
+static _Thread_local int freeJobCount = 0;
+
+int GetHardwareThreads(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+double GetWallTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool PushJobDeque(JobDeque *deque, Job *job)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long top = atomic_load(&deque->top);
+
+    if (bottom - top >= JOB_DEQUE_SIZE)
+        return false;
+
+    atomic_store_explicit(&deque->slots[bottom % JOB_DEQUE_SIZE], job, memory_order_relaxed);
+    atomic_store(&deque->bottom, bottom + 1);
+
+    return true;
+}
+
+static Job *PopJobDeque(JobDeque *deque)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store(&deque->bottom, bottom);
+    long top = atomic_load(&deque->top);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    Job *job = atomic_load_explicit(&deque->slots[bottom % JOB_DEQUE_SIZE], memory_order_relaxed);
+
+    // The last job, a thief may be taking it too
+    if (top == bottom) {
+        if (!atomic_compare_exchange_strong(&deque->top, &top, top + 1))
+            job = NULL;
+
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+static Job *StealJobDeque(JobDeque *deque)
+{
+    long top = atomic_load(&deque->top);
+    long bottom = atomic_load(&deque->bottom);
+
+    if (top >= bottom)
+        return NULL;
+
+    Job *job = atomic_load_explicit(&deque->slots[top % JOB_DEQUE_SIZE], memory_order_relaxed);
+
+    // Lost to the owner or another thief
+    if (!atomic_compare_exchange_strong(&deque->top, &top, top + 1))
+        return NULL;
+
+    return job;
+}
+
+static bool HasQueuedJobs(WorkerPool *pool)
+{
+    if (atomic_load(&pool->queued) > 0)
+        return true;
+
+    for (int i = 0; i < pool->workerCount + 1; i++) {
+        JobDeque *deque = &pool->workers[i].deque;
+        if (atomic_load(&deque->top) < atomic_load(&deque->bottom))
+            return true;
+    }
+
+    return false;
+}
+
+static void WakeWorkers(WorkerPool *pool)
+{
+    if (atomic_load(&pool->sleeping) == 0)
+        return;
+
+    pthread_mutex_lock(&pool->sleepMutex);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->sleepMutex);
+}
+
+static WorkerThread *GetCurrentWorker(WorkerPool *pool)
+{
+    return currentWorker != NULL && currentWorker->pool == pool ? currentWorker : NULL;
+}
+
+// Next job for the current thread: its own newest, then the oldest of another
+static Job *GetNextJob(WorkerPool *pool)
+{
+    WorkerThread *self = GetCurrentWorker(pool);
+    Job *job = NULL;
+
+    if (self != NULL && (job = PopJobDeque(&self->deque)) != NULL)
+        return job;
+
+    if (atomic_load(&pool->queued) > 0) {
+        pthread_mutex_lock(&pool->queueMutex);
+        if (pool->queueCount > 0) {
+            job = pool->queue[--pool->queueCount];
+            atomic_fetch_sub(&pool->queued, 1);
+        }
+        pthread_mutex_unlock(&pool->queueMutex);
+
+        if (job != NULL)
+            return job;
+    }
+
+    int count = pool->workerCount + 1;
+    int start = 0;
+
+    if (self != NULL) {
+        self->random = self->random * 1664525u + 1013904223u;
+        start = (self->random >> 16) % count;
+    }
+
+    for (int i = 0; i < count; i++) {
+        WorkerThread *victim = &pool->workers[(start + i) % count];
+
+        if (victim != self && (job = StealJobDeque(&victim->deque)) != NULL)
+            return job;
+    }
+
+    return NULL;
+}
+
+static Job *AllocJob(void)
+{
+    Job *job = freeJobs;
+
+    if (job != NULL) {
+        freeJobs = job->nextFree;
+        freeJobCount--;
+    }
+    else
+        job = malloc(sizeof(Job));
+
+    return job;
+}
+
+static void ReleaseJob(Job *job)
+{
+    if (atomic_fetch_sub(&job->references, 1) != 1)
+        return;
+
+    // Kept by whichever thread lets go of it last
+    if (freeJobCount < JOB_FREE_LIST_SIZE) {
+        job->nextFree = freeJobs;
+        freeJobs = job;
+        freeJobCount++;
+    }
+    else
+        free(job);
+}
+
+static void FinishJob(Job *job)
+{
+    while (job != NULL && atomic_fetch_sub(&job->unfinished, 1) == 1) {
+        Job *parent = job->parent;
+        ReleaseJob(job);
+        job = parent;
+    }
+}
+
+static void ExecuteJob(WorkerPool *pool, Job *job)
+{
+    job->func(pool, job, job->data);
+    FinishJob(job);
+}
+
+static void *WorkerPoolMain(void *arg)
+{
+    WorkerThread *self = arg;
+    WorkerPool *pool = self->pool;
+    currentWorker = self;
+
+    int idle = 0;
+
+    while (!atomic_load(&pool->quit)) {
+        Job *job = GetNextJob(pool);
+
+        if (job != NULL) {
+            ExecuteJob(pool, job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < JOB_IDLE_SPINS) {
+            sched_yield();
+            continue;
+        }
+
+        // Looks again once counted as sleeping, so a job pushed meanwhile either
+        // shows up here or its pusher sees this thread sleeping and wakes it
+        pthread_mutex_lock(&pool->sleepMutex);
+        atomic_fetch_add(&pool->sleeping, 1);
+
+        if (!atomic_load(&pool->quit) && !HasQueuedJobs(pool))
+            pthread_cond_wait(&pool->wake, &pool->sleepMutex);
+
+        atomic_fetch_sub(&pool->sleeping, 1);
+        pthread_mutex_unlock(&pool->sleepMutex);
+        idle = 0;
+    }
+
+    while (freeJobs != NULL) {
+        Job *job = freeJobs;
+        freeJobs = job->nextFree;
+        free(job);
+    }
+
+    freeJobCount = 0;
+    FreeScratchArena();
+
+    return NULL;
+}
+
+WorkerPool *LoadWorkerPool(int threads)
+{
+    if (threads <= 0)
+        threads = GetHardwareThreads();
+
+    WorkerPool *pool = calloc(1, sizeof(WorkerPool));
+    pool->threadCount = threads;
+    pool->workers = calloc(threads > 1 ? threads : 2, sizeof(WorkerThread));
+
+    pthread_mutex_init(&pool->queueMutex, NULL);
+    pthread_mutex_init(&pool->sleepMutex, NULL);
+    pthread_mutex_init(&pool->mainMutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    // The calling thread pushes to the first deque
+    pool->workers[0].pool = pool;
+    currentWorker = &pool->workers[0];
+
+    pool->workerCount = threads > 1 ? threads - 1 : 1;
+    int running = 0;
+
+    for (int i = 1; i <= pool->workerCount; i++) {
+        WorkerThread *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->random = i * 2654435761u;
+        worker->running = pthread_create(&worker->thread, NULL, WorkerPoolMain, worker) == 0;
+        running += worker->running;
+    }
+
+    // Run loops with the workers we managed to spawn, the deques of the others stay empty
+    if (pool->threadCount > running + 1)
+        pool->threadCount = running + 1;
+
+    return pool;
+}
+
+void UnloadWorkerPool(WorkerPool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->sleepMutex);
+    atomic_store(&pool->quit, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleepMutex);
+
+    for (int i = 1; i <= pool->workerCount; i++) {
+        if (pool->workers[i].running)
+            pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    if (currentWorker == &pool->workers[0])
+        currentWorker = NULL;
+
+    FreeScratchArena();
+
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->mainMutex);
+    pthread_mutex_destroy(&pool->sleepMutex);
+    pthread_mutex_destroy(&pool->queueMutex);
+
+    free(pool->mainCalls);
+    free(pool->queue);
+    free(pool->workers);
+    free(pool);
+}
+
+int GetWorkerPoolThreads(const WorkerPool *pool)
+{
+    return pool != NULL ? pool->threadCount : 1;
+}
+
+Job *CreateJob(WorkerPool *pool, Job *parent, JobFunc func, void *data)
+{
+    (void)pool;
+
+    Job *job = AllocJob();
+    job->func = func;
+    job->data = data;
+    job->parent = parent;
+    job->loop = NULL;
+    atomic_init(&job->unfinished, 1);
+    atomic_init(&job->references, parent != NULL ? 1 : 2);
+
+    if (parent != NULL)
+        atomic_fetch_add(&parent->unfinished, 1);
+
+    return job;
+}
+
+void RunJob(WorkerPool *pool, Job *job)
+{
+    WorkerThread *self = GetCurrentWorker(pool);
+
+    if (self != NULL) {
+        if (!PushJobDeque(&self->deque, job)) {
+            ExecuteJob(pool, job);
+            return;
+        }
+    }
+    else {
+        pthread_mutex_lock(&pool->queueMutex);
+
+        if (pool->queueCount == pool->queueCapacity) {
+            pool->queueCapacity = pool->queueCapacity > 0 ? pool->queueCapacity * 2 : 16;
+            pool->queue = realloc(pool->queue, pool->queueCapacity * sizeof(Job *));
+        }
+
+        pool->queue[pool->queueCount++] = job;
+        atomic_fetch_add(&pool->queued, 1);
+        pthread_mutex_unlock(&pool->queueMutex);
+    }
+
+    WakeWorkers(pool);
+}
+
+void WaitJob(WorkerPool *pool, Job *job)
+{
+    while (atomic_load(&job->unfinished) > 0) {
+        Job *next = GetNextJob(pool);
+
+        if (next != NULL)
+            ExecuteJob(pool, next);
+        else
+            sched_yield();
+    }
+
+    ReleaseJob(job);
+}
+
+bool IsJobFinished(Job *job)
+{
+    return atomic_load(&job->unfinished) == 0;
+}
+
+// Hands the upper half of the bands to a child until a single band is left
+static void RunLoopJob(WorkerPool *pool, Job *job, void *data)
+{
+    (void)data;
+
+    int begin = job->begin;
+    int end = job->end;
+
+    while (end - begin > job->grain) {
+        int bands = (end - begin + job->grain - 1) / job->grain;
+        int middle = begin + bands / 2 * job->grain;
+
+        Job *child = CreateJob(pool, job, RunLoopJob, NULL);
+        child->loop = job->loop;
+        child->loopData = job->loopData;
+        child->begin = middle;
+        child->end = end;
+        child->grain = job->grain;
+        RunJob(pool, child);
+
+        end = middle;
+    }
+
+    job->loop(job->loopData, begin, end);
+}
+
+void WorkerPoolFor(WorkerPool *pool, int count, int grain, WorkerFunc func, void *data)
+{
+    if (count <= 0)
+        return;
+
+    if (grain < 1)
+        grain = 1;
+
+    // Not worth waking anyone up
+    if (pool == NULL || pool->threadCount == 1 || count <= grain) {
+        func(data, 0, count);
+        return;
+    }
+
+    Job *job = CreateJob(pool, NULL, RunLoopJob, NULL);
+    job->loop = func;
+    job->loopData = data;
+    job->begin = 0;
+    job->end = count;
+    job->grain = grain;
+
+    RunJob(pool, job);
+    WaitJob(pool, job);
+}
+
+void RunOnMainThread(WorkerPool *pool, MainThreadFunc func, void *data)
+{
+    pthread_mutex_lock(&pool->mainMutex);
+
+    if (pool->mainCount == pool->mainCapacity) {
+        pool->mainCapacity = pool->mainCapacity > 0 ? pool->mainCapacity * 2 : 16;
+        pool->mainCalls = realloc(pool->mainCalls, pool->mainCapacity * sizeof(MainThreadCall));
+    }
+
+    pool->mainCalls[pool->mainCount++] = (MainThreadCall){ func, data };
+    pthread_mutex_unlock(&pool->mainMutex);
+}
+
+int RunMainThreadJobs(WorkerPool *pool)
+{
+    int ran = 0;
+
+    // Calls queued by the ones running now wait for the next time
+    pthread_mutex_lock(&pool->mainMutex);
+    int count = pool->mainCount;
+    MainThreadCall *calls = NULL;
+
+    if (count > 0) {
+        calls = malloc(count * sizeof(MainThreadCall));
+        for (int i = 0; i < count; i++)
+            calls[i] = pool->mainCalls[i];
+        pool->mainCount = 0;
+    }
+
+    pthread_mutex_unlock(&pool->mainMutex);
+
+    for (; ran < count; ran++)
+        calls[ran].func(calls[ran].data);
+
+    free(calls);
+
+    return ran;
+}
+
+#endif // PARALLEL_IMPLEMENTATION
@@ -0,0 +1,1404 @@
+// planet.h - CPU side generation of the planet mesh
+//
+// to create the implementation,
+//     #define PLANET_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// stb_perlin.h, noise.h, arena.h, noisegraph.h, parallel.h and erosion.h must
+// be included before this file. Only the raylib and raymath headers are used, not the raylib
+// library, so the generator can run without a window or a GPU; uploading is
+// up to the caller.
+//
+
+#ifndef PLANET_H
+#define PLANET_H
+
+#include <raylib.h>
+#include <raymath.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum PlanetTopology {
+    PLANET_UV_SPHERE = 0,   // Longitude/latitude grid, crowded at the poles
+    PLANET_CUBE_SPHERE,     // Six equal-angle cube faces
+    PLANET_ICOSPHERE,       // Subdivided icosahedron, as ten diamonds of two triangles
+    PLANET_TOPOLOGY_COUNT
+} PlanetTopology;
+
+typedef struct PlanetParams {
+    PlanetTopology topology;
+    int longitudeSlices;    // UV sphere only
+    int latitudeSlices;     // UV sphere only
+    int subdivisions;       // Quads along a cube or icosahedron diamond side
+    int chunkSlices;
+    float radius;
+    float scale;
+    float lacunarity;
+    float gain;
+    int octaves;
+    const NoiseGraph *graph; // Replaces the fBm of the three above when set, see noisegraph.h
+    ErosionSettings erosion; // Applied to the whole mesh when enabled, see erosion.h
+} PlanetParams;
+
+// Sphere made of grid faces, each split in chunks under the 16 bit index limit of a raylib mesh
+// The UV sphere is a single face of longitude by latitude slices
+typedef struct ChunkedMesh {
+    Mesh *chunks;
+    int chunkCount;
+    PlanetTopology topology;
+    int faceCount;
+    int faceColumns;    // Quads along a face
+    int faceRows;       // Quads across a face
+    int chunkColumns;   // Chunks along a face
+    int chunkRows;      // Chunks across a face
+    int chunkSlices;    // Slices per chunk side
+    int vertexCount;
+    int triangleCount;
+} ChunkedMesh;
+
+// Bump whenever a change to the generator changes its output, so that cached planets are rebuilt
+#define PLANET_GENERATOR_VERSION 3
+
+// Largest chunk side whose (slices + 1)^2 vertices fit unsigned short indices
+#define MAX_CHUNK_SLICES 255
+
+// Unit sphere direction of every grid vertex, face by face and row by row,
+// so that changing the noise parameters does not redo the trigonometry
+typedef struct SphereDirections {
+    PlanetTopology topology;
+    int faceCount;
+    int faceColumns;
+    int faceRows;
+    float *x;
+    float *y;
+    float *z;
+} SphereDirections;
+
+// Everything of a planet that only depends on its layout (topology, slices and
+// chunks) rather than on its noise: the directions and the index buffers of
+// the chunks. Shared by every planet of the same layout, see LoadSphereLayout
+typedef struct SphereLayout {
+    PlanetTopology topology;
+    int faceCount;
+    int faceColumns;
+    int faceRows;
+    int chunkSlices;
+    SphereDirections directions;
+    ChunkedMesh indices;    // Chunk counts and index buffers, without vertex arrays
+    int references;         // Holders from LoadSphereLayout
+    bool cached;
+    unsigned long lastUse;
+} SphereLayout;
+
+// Layouts LoadSphereLayout keeps once nobody holds them, for the next planet of the same layout
+#define MAX_SPHERE_LAYOUTS 4
+
+// Square patch of a cube sphere face for level of detail: the face is split
+// in 2^level x 2^level tiles and this is the one at column x and row y
+typedef struct PlanetTile {
+    int face;
+    int level;
+    int x;
+    int y;
+} PlanetTile;
+
+// Finest tile level, the face grid of 2^level tiles must stay exact in a float
+#define MAX_TILE_LEVEL 16
+
+// Largest tile side whose grid and skirt vertices fit unsigned short indices
+#define MAX_TILE_SLICES 128
+
+// Regenerates the planet as jobs on the worker pool, see RequestPlanetGeneration
+typedef struct PlanetGenerator PlanetGenerator;
+
+// Terrain colors from the highest band down, a height takes the first band it is above
+// The last band takes every height left, its height is not used
+typedef struct PlanetColorBand {
+    float height;
+    Color color;
+} PlanetColorBand;
+
+#define PLANET_COLOR_BANDS 6
+
+PlanetColorBand GetPlanetColorBand(int band);
+Color heightToColor(float noise);
+
+const char *GetPlanetTopologyName(PlanetTopology topology);
+void GetPlanetFaceGrid(PlanetParams params, int *faceCount, int *faceColumns, int *faceRows);
+float GetPlanetNoiseBound(PlanetParams params);
+void GetPlanetSurface(PlanetParams params, const float *x, const float *y, const float *z, float *heights, Vector3 *normals, int count);
+HeightField BakePlanetHeightField(WorkerPool *pool, PlanetParams params, int width);
+
+ChunkedMesh AllocChunkedMesh(const SphereLayout *layout);
+void FreeChunkedMesh(ChunkedMesh chunked);
+size_t GetChunkedMeshSize(ChunkedMesh chunked);
+bool ChunkedMeshEquals(ChunkedMesh a, ChunkedMesh b);
+
+void SwapChunkedMeshVertices(ChunkedMesh *a, ChunkedMesh *b);
+
+SphereDirections LoadSphereDirections(WorkerPool *pool, PlanetParams params);
+void UnloadSphereDirections(SphereDirections directions);
+
+SphereLayout *LoadSphereLayout(WorkerPool *pool, PlanetParams params);
+void UnloadSphereLayout(SphereLayout *layout);
+void UnloadSphereLayoutCache(void);
+
+void GeneratePlanetVertices(WorkerPool *pool, const SphereDirections *directions, ChunkedMesh *chunked, PlanetParams params);
+ChunkedMesh GeneratePlanetMesh(WorkerPool *pool, PlanetParams params);
+
+Vector3 GetCubeSphereDirection(int face, int column, int row, int slices);
+Mesh AllocPlanetTileMesh(int tileSlices);
+void FreePlanetTileMesh(Mesh mesh);
+size_t GetPlanetTileMeshSize(int tileSlices);
+Mesh InitPlanetTileMesh(void *buffer, int tileSlices);
+void GeneratePlanetTile(Mesh *mesh, PlanetTile tile, int tileSlices, PlanetParams params);
+
+PlanetGenerator *LoadPlanetGenerator(WorkerPool *pool, PlanetParams params);
+void UnloadPlanetGenerator(PlanetGenerator *generator);
+void RequestPlanetGeneration(PlanetGenerator *generator, PlanetParams params);
+ChunkedMesh *PollGeneratedPlanet(PlanetGenerator *generator, PlanetParams *params, double *time);
+void ReleaseGeneratedPlanet(PlanetGenerator *generator);
+bool IsPlanetGenerating(PlanetGenerator *generator);
+
+#endif // PLANET_H
+
+#ifdef PLANET_IMPLEMENTATION
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+// Also handed to the displacement in shadowmap.vs, see terrain.h
+PlanetColorBand GetPlanetColorBand(int band)
+{
+    switch (band) {
+        case 0: return (PlanetColorBand){ 0.5f, DARKGRAY };
+        case 1: return (PlanetColorBand){ 0.3f, DARKBROWN };
+        case 2: return (PlanetColorBand){ 0.15f, BROWN };
+        case 3: return (PlanetColorBand){ 0.0f, DARKGREEN };
+        case 4: return (PlanetColorBand){ -0.2f, SKYBLUE };
+        default: return (PlanetColorBand){ 0.0f, DARKBLUE };
+    }
+}
+
+Color heightToColor(float noise)
+{
+    for (int i = 0; i < PLANET_COLOR_BANDS - 1; i++) {
+        PlanetColorBand band = GetPlanetColorBand(i);
+
+        if (noise > band.height)
+            return band.color;
+    }
+
+    return GetPlanetColorBand(PLANET_COLOR_BANDS - 1).color;
+}
+
+const char *GetPlanetTopologyName(PlanetTopology topology)
+{
+    switch (topology) {
+        case PLANET_UV_SPHERE: return "uv";
+        case PLANET_CUBE_SPHERE: return "cube";
+        case PLANET_ICOSPHERE: return "ico";
+        default: return "unknown";
+    }
+}
+
+// Number of grid faces of the topology and the quads along each of them
+void GetPlanetFaceGrid(PlanetParams params, int *faceCount, int *faceColumns, int *faceRows)
+{
+    int subdivisions = params.subdivisions > 0 ? params.subdivisions : 1;
+
+    switch (params.topology) {
+        case PLANET_CUBE_SPHERE:
+            *faceCount = 6;
+            *faceColumns = *faceRows = subdivisions;
+            break;
+
+        case PLANET_ICOSPHERE:
+            *faceCount = 10;
+            *faceColumns = *faceRows = subdivisions;
+            break;
+
+        default:
+            *faceCount = 1;
+            *faceColumns = params.longitudeSlices;
+            *faceRows = params.latitudeSlices;
+            break;
+    }
+}
+
+// Largest height the noise can displace a vertex by, up or down: the fBm sums
+// octaves of noise3, which stays within [-1, 1], scaled by the gain
+float GetPlanetNoiseBound(PlanetParams params)
+{
+    if (params.graph != NULL)
+        return GetNoiseGraphBound(params.graph);
+
+    float bound = 0;
+    float amplitude = 1;
+
+    for (int i = 0; i < params.octaves; i++) {
+        bound += amplitude;
+        amplitude *= params.gain;
+    }
+
+    return bound;
+}
+
+// Normal of the surface displaced to radius + noise(radius * direction / scale),
+// from the gradient of the noise at the vertex: only the part of the gradient
+// along the sphere tilts the normal, more so where the surface is closer in
+static Vector3 GetDisplacedNormal(Vector3 direction, float noise, Vector3 gradient, PlanetParams params)
+{
+    Vector3 tangent = Vector3Subtract(gradient, Vector3Scale(direction, Vector3DotProduct(gradient, direction)));
+    float slope = params.radius / (params.scale * (params.radius + noise));
+
+    return Vector3Normalize(Vector3Subtract(direction, Vector3Scale(tangent, slope)));
+}
+
+// Noise and gradient at the points radius * direction / scale
+static void GetPlanetNoise(PlanetParams params, const float *x, const float *y, const float *z,
+                           float *noise, float *gradientX, float *gradientY, float *gradientZ, int count)
+{
+    if (params.graph != NULL)
+        EvaluateNoiseGraph(params.graph, x, y, z, noise, gradientX, gradientY, gradientZ, count);
+    else
+        FbmNoise3DerivBatch(PLANET_NOISE_BACKEND, x, y, z, noise, gradientX, gradientY, gradientZ, count, params.lacunarity, params.gain, params.octaves);
+}
+
+// Height above the radius and normal of the surface along 'count' unit
+// directions, for sampling the planet outside of a mesh. 'normals' may be NULL
+void GetPlanetSurface(PlanetParams params, const float *x, const float *y, const float *z, float *heights, Vector3 *normals, int count)
+{
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *buffer = (float *)ArenaAlloc(arena, count * 6 * sizeof(float));
+    float *noiseX = buffer;
+    float *noiseY = buffer + count;
+    float *noiseZ = buffer + count * 2;
+    float *gradientX = buffer + count * 3;
+    float *gradientY = buffer + count * 4;
+    float *gradientZ = buffer + count * 5;
+
+    for (int i = 0; i < count; i++) {
+        noiseX[i] = params.radius * x[i] / params.scale;
+        noiseY[i] = params.radius * y[i] / params.scale;
+        noiseZ[i] = params.radius * z[i] / params.scale;
+    }
+
+    GetPlanetNoise(params, noiseX, noiseY, noiseZ, heights, gradientX, gradientY, gradientZ, count);
+
+    for (int i = 0; normals != NULL && i < count; i++) {
+        Vector3 direction = { x[i], y[i], z[i] };
+        Vector3 gradient = { gradientX[i], gradientY[i], gradientZ[i] };
+        normals[i] = GetDisplacedNormal(direction, heights[i], gradient, params);
+    }
+
+    RewindArena(arena, mark);
+}
+
+typedef struct HeightFieldJob {
+    HeightField *field;
+    PlanetParams params;
+    const float *longitudeCos;  // Of every column, the same on every row
+    const float *longitudeSin;
+} HeightFieldJob;
+
+static void BakeHeightFieldRows(void *data, int begin, int end)
+{
+    const HeightFieldJob *job = data;
+    HeightField *field = job->field;
+
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *buffer = (float *)ArenaAlloc(arena, field->width * 3 * sizeof(float));
+    float *x = buffer;
+    float *y = buffer + field->width;
+    float *z = buffer + field->width * 2;
+
+    for (int row = begin; row < end; row++) {
+        float latitude = (0.5f - (row + 0.5f) / field->height) * PI;
+        float latitudeCos = cosf(latitude);
+        float latitudeSin = sinf(latitude);
+
+        for (int column = 0; column < field->width; column++) {
+            x[column] = latitudeCos * job->longitudeCos[column];
+            y[column] = latitudeCos * job->longitudeSin[column];
+            z[column] = latitudeSin;
+        }
+
+        GetPlanetSurface(job->params, x, y, z, field->heights + row * field->width, NULL, field->width);
+    }
+
+    RewindArena(arena, mark);
+}
+
+// Heights of the planet at the cell centers of a 'width' x width / 2 field
+// for the erosion, see erosion.h
+HeightField BakePlanetHeightField(WorkerPool *pool, PlanetParams params, int width)
+{
+    HeightField field = AllocHeightField(width, width / 2, 2 * PI * params.radius / width);
+    HeightFieldJob job = { &field, params, NULL, NULL };
+
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *longitudeCos = (float *)ArenaAlloc(arena, field.width * 2 * sizeof(float));
+    float *longitudeSin = longitudeCos + field.width;
+
+    for (int column = 0; column < field.width; column++) {
+        float longitude = (column + 0.5f) / field.width * 2 * PI;
+        longitudeCos[column] = cosf(longitude);
+        longitudeSin[column] = sinf(longitude);
+    }
+
+    job.longitudeCos = longitudeCos;
+    job.longitudeSin = longitudeSin;
+
+    WorkerPoolFor(pool, field.height, 4, BakeHeightFieldRows, &job);
+
+    RewindArena(arena, mark);
+
+    return field;
+}
+
+// Change of the heights made by the erosion, which the mesh samples on top of the noise
+static HeightField GetPlanetErosion(WorkerPool *pool, PlanetParams params)
+{
+    HeightField base = BakePlanetHeightField(pool, params, params.erosion.resolution);
+    HeightField eroded = AllocHeightField(base.width, base.height, base.cellSize);
+
+    memcpy(eroded.heights, base.heights, base.width * base.height * sizeof(float));
+    ErodeHeightField(pool, &eroded, params.erosion);
+
+    for (int i = 0; i < base.width * base.height; i++)
+        eroded.heights[i] -= base.heights[i];
+
+    FreeHeightField(base);
+
+    return eroded;
+}
+
+typedef struct MeshRowsJob {
+    const SphereDirections *directions;
+    ChunkedMesh *chunked;
+    PlanetParams params;
+    const HeightField *erosion;     // NULL unless the planet is eroded
+} MeshRowsJob;
+
+// Writes a vertex in the chunk at the given chunk row and column, if it contains it
+static void SetChunkVertex(ChunkedMesh *chunked, int face, int row, int column, int i, int j, Vector3 position, Vector3 normal, Color color)
+{
+    if (row < 0 || row >= chunked->chunkRows || column < 0 || column >= chunked->chunkColumns)
+        return;
+
+    Mesh *chunk = &chunked->chunks[(face * chunked->chunkRows + row) * chunked->chunkColumns + column];
+
+    int j0 = column * chunked->chunkSlices;
+    int width = fminf(chunked->chunkSlices, chunked->faceColumns - j0);
+    int v = (i - row * chunked->chunkSlices) * (width + 1) + (j - j0);
+
+    chunk->vertices[v * 3 + 0] = position.x;
+    chunk->vertices[v * 3 + 1] = position.y;
+    chunk->vertices[v * 3 + 2] = position.z;
+
+    chunk->normals[v * 3 + 0] = normal.x;
+    chunk->normals[v * 3 + 1] = normal.y;
+    chunk->normals[v * 3 + 2] = normal.z;
+
+    chunk->colors[v * 4 + 0] = color.r;
+    chunk->colors[v * 4 + 1] = color.g;
+    chunk->colors[v * 4 + 2] = color.b;
+    chunk->colors[v * 4 + 3] = color.a;
+}
+
+// Face normal, then the axes along the columns and along the rows, so that
+// cross(rows, columns) points out of the cube like the UV grid winding
+static const signed char cubeFaceAxes[6][3][3] = {
+    { {  1,  0,  0 }, {  0,  1,  0 }, {  0,  0, -1 } },
+    { { -1,  0,  0 }, {  0, -1,  0 }, {  0,  0, -1 } },
+    { {  0,  1,  0 }, { -1,  0,  0 }, {  0,  0, -1 } },
+    { {  0, -1,  0 }, {  1,  0,  0 }, {  0,  0, -1 } },
+    { {  0,  0,  1 }, {  0,  1,  0 }, {  1,  0,  0 } },
+    { {  0,  0, -1 }, {  0,  1,  0 }, { -1,  0,  0 } },
+};
+
+// Equal-angle coordinate of grid line k out of n, in [-1, 1]
+// The edges are exact and the tangent is odd, so the faces meet without cracks
+static float CubeFaceCoordinate(int k, int n)
+{
+    if (k == 0)
+        return -1;
+
+    if (k == n)
+        return 1;
+
+    return tanf((float)(2 * k - n) / n * (PI / 4));
+}
+
+// Unit direction of the grid point at 'column' and 'row' of a cube face split in slices x slices quads
+Vector3 GetCubeSphereDirection(int face, int column, int row, int slices)
+{
+    const signed char (*axes)[3] = cubeFaceAxes[face];
+    float a = CubeFaceCoordinate(column, slices);
+    float b = CubeFaceCoordinate(row, slices);
+
+    // Every component is exactly one of 1, a or b, with its sign
+    Vector3 point = {
+        axes[0][0] + axes[1][0] * a + axes[2][0] * b,
+        axes[0][1] + axes[1][1] * a + axes[2][1] * b,
+        axes[0][2] + axes[1][2] * a + axes[2][2] * b,
+    };
+
+    return Vector3Normalize(point);
+}
+
+// North pole, upper ring, lower ring and south pole
+static Vector3 IcosahedronVertex(int index)
+{
+    if (index == 0)
+        return (Vector3){ 0, 0, 1 };
+
+    if (index == 11)
+        return (Vector3){ 0, 0, -1 };
+
+    const float ringLatitude = atanf(0.5f);
+    bool upper = index <= 5;
+    int k = upper ? index - 1 : index - 6;
+    float longitude = (k + (upper ? 0 : 0.5f)) * 2 * PI / 5;
+
+    return (Vector3){
+        cosf(ringLatitude) * cosf(longitude),
+        cosf(ringLatitude) * sinf(longitude),
+        upper ? sinf(ringLatitude) : -sinf(ringLatitude),
+    };
+}
+
+// Corners 00, 10 (along the columns), 01 (along the rows) and 11 of every
+// diamond; the 10-01 diagonal is the icosahedron edge between its triangles
+static const unsigned char icosahedronDiamonds[10][4] = {
+    { 0, 2,  1,  6 }, { 0, 3,  2,  7 }, { 0, 4,  3,  8 }, { 0, 5,  4,  9 }, { 0, 1,  5, 10 },
+    { 2, 7,  6, 11 }, { 3, 8,  7, 11 }, { 4, 9,  8, 11 }, { 5, 10, 9, 11 }, { 1, 6, 10, 11 },
+};
+
+// Point of a diamond grid as integer barycentric weights of its triangle
+// The terms are summed in vertex order, so points on a shared edge come out
+// the same from both sides
+static Vector3 IcosphereDirection(int face, int i, int j, int n)
+{
+    const unsigned char *corners = icosahedronDiamonds[face];
+    int index[3];
+    int weight[3];
+
+    if (i + j <= n) {
+        index[0] = corners[0]; weight[0] = n - i - j;
+        index[1] = corners[1]; weight[1] = j;
+        index[2] = corners[2]; weight[2] = i;
+    }
+    else {
+        index[0] = corners[3]; weight[0] = i + j - n;
+        index[1] = corners[1]; weight[1] = n - i;
+        index[2] = corners[2]; weight[2] = n - j;
+    }
+
+    Vector3 point = Vector3Zero();
+
+    for (int vertex = 0; vertex < 12; vertex++) {
+        for (int k = 0; k < 3; k++) {
+            if (index[k] == vertex && weight[k] != 0)
+                point = Vector3Add(point, Vector3Scale(IcosahedronVertex(vertex), (float)weight[k]));
+        }
+    }
+
+    return Vector3Normalize(point);
+}
+
+typedef struct DirectionsJob {
+    SphereDirections *directions;
+    const float *longitudeCos;  // UV sphere only, of every column
+    const float *longitudeSin;
+} DirectionsJob;
+
+static void ComputeDirectionRows(void *data, int begin, int end)
+{
+    const DirectionsJob *job = data;
+    SphereDirections *directions = job->directions;
+
+    const int columns = directions->faceColumns;
+    const int rows = directions->faceRows;
+
+    const float latitudeStep = PI / rows;
+
+    for (int r = begin; r < end; r++) {
+
+        int face = r / (rows + 1);
+        int i = r % (rows + 1);
+        int v = r * (columns + 1);
+
+        if (directions->topology == PLANET_CUBE_SPHERE) {
+            for (int j = 0; j <= columns; j++, v++) {
+                Vector3 point = GetCubeSphereDirection(face, j, i, columns);
+
+                directions->x[v] = point.x;
+                directions->y[v] = point.y;
+                directions->z[v] = point.z;
+            }
+            continue;
+        }
+
+        if (directions->topology == PLANET_ICOSPHERE) {
+            for (int j = 0; j <= columns; j++, v++) {
+                Vector3 point = IcosphereDirection(face, i, j, columns);
+
+                directions->x[v] = point.x;
+                directions->y[v] = point.y;
+                directions->z[v] = point.z;
+            }
+            continue;
+        }
+
+        float latitudeAngle = PI / 2 - i * latitudeStep;
+        float latitudeCos = cosf(latitudeAngle);
+        float latitudeSin = sinf(latitudeAngle);
+
+        for (int j = 0; j <= columns; j++, v++) {
+            directions->x[v] = latitudeCos * job->longitudeCos[j];
+            directions->y[v] = latitudeCos * job->longitudeSin[j];
+            directions->z[v] = latitudeSin;
+        }
+    }
+}
+
+SphereDirections LoadSphereDirections(WorkerPool *pool, PlanetParams params)
+{
+    SphereDirections directions = { 0 };
+    directions.topology = params.topology;
+    GetPlanetFaceGrid(params, &directions.faceCount, &directions.faceColumns, &directions.faceRows);
+
+    int rows = directions.faceCount * (directions.faceRows + 1);
+    int vertexCount = rows * (directions.faceColumns + 1);
+    directions.x = (float *)RL_MALLOC(vertexCount * 3 * sizeof(float));
+    directions.y = directions.x + vertexCount;
+    directions.z = directions.x + vertexCount * 2;
+
+    // The UV sphere rows are separable: each row scales the same longitude table
+    const int columns = directions.faceColumns;
+    const float longitudeStep = 2 * PI / columns;
+
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *longitudeCos = (float *)ArenaAlloc(arena, (columns + 1) * 2 * sizeof(float));
+    float *longitudeSin = longitudeCos + columns + 1;
+
+    for (int j = 0; params.topology == PLANET_UV_SPHERE && j <= columns; j++) {
+        float longitudeAngle = j * longitudeStep;
+        longitudeCos[j] = cosf(longitudeAngle);
+        longitudeSin[j] = sinf(longitudeAngle);
+    }
+
+    DirectionsJob job = { &directions, longitudeCos, longitudeSin };
+    WorkerPoolFor(pool, rows, 16, ComputeDirectionRows, &job);
+
+    RewindArena(arena, mark);
+
+    return directions;
+}
+
+void UnloadSphereDirections(SphereDirections directions)
+{
+    RL_FREE(directions.x);
+}
+
+// Computes the vertices of the grid rows [begin, end), counted across all faces
+static void GenerateMeshRows(void *data, int begin, int end)
+{
+    const MeshRowsJob *job = data;
+    const SphereDirections *directions = job->directions;
+    ChunkedMesh *chunked = job->chunked;
+
+    const float radius = job->params.radius;
+    const float scale = job->params.scale;
+    const int chunkSlices = chunked->chunkSlices;
+
+    // Whole rows are handed to the batched noise, from the arena of the thread
+    const int rowLength = chunked->faceColumns + 1;
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *rowBuffer = (float *)ArenaAlloc(arena, rowLength * 7 * sizeof(float));
+    float *noiseX = rowBuffer;
+    float *noiseY = rowBuffer + rowLength;
+    float *noiseZ = rowBuffer + rowLength * 2;
+    float *noise = rowBuffer + rowLength * 3;
+    float *gradientX = rowBuffer + rowLength * 4;
+    float *gradientY = rowBuffer + rowLength * 5;
+    float *gradientZ = rowBuffer + rowLength * 6;
+
+    for (int r = begin; r < end; r++) {
+
+        int face = r / (chunked->faceRows + 1);
+        int i = r % (chunked->faceRows + 1);
+
+        const float *directionX = directions->x + r * rowLength;
+        const float *directionY = directions->y + r * rowLength;
+        const float *directionZ = directions->z + r * rowLength;
+
+        for (int j = 0; j < rowLength; j++) {
+            noiseX[j] = radius * directionX[j] / scale;
+            noiseY[j] = radius * directionY[j] / scale;
+            noiseZ[j] = radius * directionZ[j] / scale;
+        }
+
+        GetPlanetNoise(job->params, noiseX, noiseY, noiseZ, noise, gradientX, gradientY, gradientZ, rowLength);
+
+        // The erosion gradient is along the unit sphere, the noise one along radius * direction / scale
+        for (int j = 0; job->erosion != NULL && j < rowLength; j++) {
+            Vector3 direction = { directionX[j], directionY[j], directionZ[j] };
+            Vector3 gradient;
+
+            noise[j] += SampleHeightField(job->erosion, direction, &gradient);
+            gradientX[j] += gradient.x * scale / radius;
+            gradientY[j] += gradient.y * scale / radius;
+            gradientZ[j] += gradient.z * scale / radius;
+        }
+
+        // Rows on a chunk border belong to the chunks on both sides
+        int row = i / chunkSlices;
+        bool rowBorder = i % chunkSlices == 0;
+
+        for (int j = 0; j < rowLength; j++) {
+
+            // Displaced along the sphere direction
+            Vector3 direction = { directionX[j], directionY[j], directionZ[j] };
+            Vector3 gradient = { gradientX[j], gradientY[j], gradientZ[j] };
+            Vector3 position = Vector3Scale(direction, radius + noise[j]);
+            Vector3 normal = GetDisplacedNormal(direction, noise[j], gradient, job->params);
+            Color color = heightToColor(noise[j]);
+
+            int column = j / chunkSlices;
+            bool columnBorder = j % chunkSlices == 0;
+
+            SetChunkVertex(chunked, face, row, column, i, j, position, normal, color);
+
+            if (rowBorder)
+                SetChunkVertex(chunked, face, row - 1, column, i, j, position, normal, color);
+
+            if (columnBorder)
+                SetChunkVertex(chunked, face, row, column - 1, i, j, position, normal, color);
+
+            if (rowBorder && columnBorder)
+                SetChunkVertex(chunked, face, row - 1, column - 1, i, j, position, normal, color);
+        }
+    }
+
+    RewindArena(arena, mark);
+}
+
+// Fills the vertices, normals and colors of the chunks, splitting the rows in bands across the pool
+// Every vertex only depends on its own coordinates, so the result is the same for any thread count
+// The erosion runs first on its own field, with the same result for any thread count too
+void GeneratePlanetVertices(WorkerPool *pool, const SphereDirections *directions, ChunkedMesh *chunked, PlanetParams params)
+{
+    MeshRowsJob job = { directions, chunked, params, NULL };
+    HeightField erosion = { 0 };
+
+    if (IsErosionEnabled(params.erosion)) {
+        erosion = GetPlanetErosion(pool, params);
+        job.erosion = &erosion;
+    }
+
+    // A few bands per thread to even out the cheaper rows near the poles
+    int rows = chunked->faceCount * (chunked->faceRows + 1);
+    int grain = rows / (GetWorkerPoolThreads(pool) * 4);
+
+    WorkerPoolFor(pool, rows, grain, GenerateMeshRows, &job);
+
+    if (job.erosion != NULL)
+        FreeHeightField(erosion);
+}
+
+// Splits the layout in 'params' in chunks and fills their indices, the only array they get
+static ChunkedMesh BuildChunkedMeshIndices(PlanetParams params)
+{
+    ChunkedMesh chunked = { 0 };
+    chunked.topology = params.topology;
+    GetPlanetFaceGrid(params, &chunked.faceCount, &chunked.faceColumns, &chunked.faceRows);
+
+    const int faceColumns = chunked.faceColumns;
+    const int faceRows = chunked.faceRows;
+
+    // Only the UV sphere collapses rows into poles
+    const bool poles = params.topology == PLANET_UV_SPHERE;
+
+    chunked.chunkSlices = Clamp(params.chunkSlices, 1, MAX_CHUNK_SLICES);
+    chunked.chunkColumns = (faceColumns + chunked.chunkSlices - 1) / chunked.chunkSlices;
+    chunked.chunkRows = (faceRows + chunked.chunkSlices - 1) / chunked.chunkSlices;
+    chunked.chunkCount = chunked.faceCount * chunked.chunkColumns * chunked.chunkRows;
+    chunked.chunks = (Mesh *)RL_CALLOC(chunked.chunkCount, sizeof(Mesh));
+
+    for (int face = 0; face < chunked.faceCount; face++) {
+        for (int row = 0; row < chunked.chunkRows; row++) {
+            for (int column = 0; column < chunked.chunkColumns; column++) {
+                Mesh *chunk = &chunked.chunks[(face * chunked.chunkRows + row) * chunked.chunkColumns + column];
+
+                int i0 = row * chunked.chunkSlices;
+                int i1 = fminf(i0 + chunked.chunkSlices, faceRows);
+                int j0 = column * chunked.chunkSlices;
+                int j1 = fminf(j0 + chunked.chunkSlices, faceColumns);
+                int width = j1 - j0;
+
+                // The rows touching the poles only have one triangle per slice
+                int quadRows = i1 - i0;
+                int triangleRows = quadRows * 2;
+                if (poles)
+                    triangleRows -= (i0 == 0) + (i1 == faceRows);
+                if (poles && faceRows == 1)
+                    triangleRows = 0;
+
+                chunk->triangleCount = width * triangleRows;
+                chunk->vertexCount = (width + 1) * (quadRows + 1);
+
+                chunk->indices = (unsigned short *)RL_MALLOC(chunk->triangleCount * 3 * sizeof(unsigned short));
+
+                for (int i = i0, v = 0; i < i1; i++) {
+
+                    int k1 = (i - i0) * (width + 1);
+                    int k2 = k1 + width + 1;
+
+                    for (int j = j0; j < j1; j++, k1++, k2++) {
+
+                        // k1 => k2 => k1+1
+                        if (!poles || i != 0) {
+                            chunk->indices[v++] = k1;
+                            chunk->indices[v++] = k2;
+                            chunk->indices[v++] = k1 + 1;
+                        }
+
+                        // k1+1 => k2 => k2+1
+                        if (!poles || i != faceRows - 1) {
+                            chunk->indices[v++] = k1 + 1;
+                            chunk->indices[v++] = k2;
+                            chunk->indices[v++] = k2 + 1;
+                        }
+                    }
+                }
+
+                chunked.vertexCount += chunk->vertexCount;
+                chunked.triangleCount += chunk->triangleCount;
+            }
+        }
+    }
+
+    return chunked;
+}
+
+// Allocates the CPU buffers of every chunk of 'layout', with a copy of its indices
+// The copy is the mesh's own, so UnloadMesh and FreeChunkedMesh can free it
+ChunkedMesh AllocChunkedMesh(const SphereLayout *layout)
+{
+    ChunkedMesh chunked = layout->indices;
+    chunked.chunks = (Mesh *)RL_CALLOC(chunked.chunkCount, sizeof(Mesh));
+
+    for (int i = 0; i < chunked.chunkCount; i++) {
+        const Mesh *source = &layout->indices.chunks[i];
+        Mesh *chunk = &chunked.chunks[i];
+
+        chunk->vertexCount = source->vertexCount;
+        chunk->triangleCount = source->triangleCount;
+
+        // Allocated like raylib does, so UnloadMesh can free them
+        // No texture coordinates: the shaders never read them, UploadMesh leaves their buffer empty
+        chunk->vertices = (float *)RL_MALLOC(chunk->vertexCount * 3 * sizeof(float));
+        chunk->colors = (unsigned char *)RL_MALLOC(chunk->vertexCount * 4 * sizeof(unsigned char));
+        chunk->indices = (unsigned short *)RL_MALLOC(chunk->triangleCount * 3 * sizeof(unsigned short));
+        chunk->normals = (float *)RL_MALLOC(chunk->vertexCount * 3 * sizeof(float));
+
+        memcpy(chunk->indices, source->indices, chunk->triangleCount * 3 * sizeof(unsigned short));
+    }
+
+    return chunked;
+}
+
+// Frees the CPU buffers of chunks that were never uploaded
+void FreeChunkedMesh(ChunkedMesh chunked)
+{
+    for (int i = 0; i < chunked.chunkCount; i++) {
+        RL_FREE(chunked.chunks[i].vertices);
+        RL_FREE(chunked.chunks[i].colors);
+        RL_FREE(chunked.chunks[i].indices);
+        RL_FREE(chunked.chunks[i].normals);
+    }
+
+    RL_FREE(chunked.chunks);
+}
+
+// Bytes held by the CPU buffers of the chunks
+size_t GetChunkedMeshSize(ChunkedMesh chunked)
+{
+    size_t size = chunked.chunkCount * sizeof(Mesh);
+
+    for (int i = 0; i < chunked.chunkCount; i++) {
+        const Mesh *chunk = &chunked.chunks[i];
+        size += (size_t)chunk->vertexCount * (3 + 3) * sizeof(float);
+        size += (size_t)chunk->vertexCount * 4 * sizeof(unsigned char);
+        size += (size_t)chunk->triangleCount * 3 * sizeof(unsigned short);
+    }
+
+    return size;
+}
+
+bool ChunkedMeshEquals(ChunkedMesh a, ChunkedMesh b)
+{
+    if (a.chunkCount != b.chunkCount)
+        return false;
+
+    for (int i = 0; i < a.chunkCount; i++) {
+        Mesh *ma = &a.chunks[i];
+        Mesh *mb = &b.chunks[i];
+
+        if (ma->vertexCount != mb->vertexCount
+            || memcmp(ma->vertices, mb->vertices, ma->vertexCount * 3 * sizeof(float)) != 0
+            || memcmp(ma->normals, mb->normals, ma->vertexCount * 3 * sizeof(float)) != 0
+            || memcmp(ma->colors, mb->colors, ma->vertexCount * 4 * sizeof(unsigned char)) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+// Exchanges the vertex data of two meshes with the same layout, indices stay in place
+void SwapChunkedMeshVertices(ChunkedMesh *a, ChunkedMesh *b)
+{
+    for (int i = 0; i < a->chunkCount && i < b->chunkCount; i++) {
+        Mesh *ma = &a->chunks[i];
+        Mesh *mb = &b->chunks[i];
+
+        float *vertices = ma->vertices;
+        float *normals = ma->normals;
+        unsigned char *colors = ma->colors;
+
+        ma->vertices = mb->vertices;
+        ma->normals = mb->normals;
+        ma->colors = mb->colors;
+
+        mb->vertices = vertices;
+        mb->normals = normals;
+        mb->colors = colors;
+    }
+}
+
+static pthread_mutex_t sphereLayoutMutex = PTHREAD_MUTEX_INITIALIZER;
+static SphereLayout *sphereLayouts[MAX_SPHERE_LAYOUTS] = { 0 };
+static unsigned long sphereLayoutUses = 0;
+
+static void FreeSphereLayout(SphereLayout *layout)
+{
+    UnloadSphereDirections(layout->directions);
+    FreeChunkedMesh(layout->indices);
+    RL_FREE(layout);
+}
+
+// Takes a reference on the cached layout matching 'key', with the lock held
+static SphereLayout *FindSphereLayout(const SphereLayout *key)
+{
+    for (int i = 0; i < MAX_SPHERE_LAYOUTS; i++) {
+        SphereLayout *layout = sphereLayouts[i];
+
+        if (layout != NULL && layout->topology == key->topology
+            && layout->faceCount == key->faceCount && layout->faceColumns == key->faceColumns
+            && layout->faceRows == key->faceRows && layout->chunkSlices == key->chunkSlices) {
+            layout->references++;
+            layout->lastUse = ++sphereLayoutUses;
+            return layout;
+        }
+    }
+
+    return NULL;
+}
+
+// Returns the layout of 'params', built on the pool the first time and then
+// taken from the cache until evicted by MAX_SPHERE_LAYOUTS newer ones
+// Safe from any thread, each call must be paired with UnloadSphereLayout
+SphereLayout *LoadSphereLayout(WorkerPool *pool, PlanetParams params)
+{
+    SphereLayout key = { 0 };
+    key.topology = params.topology;
+    GetPlanetFaceGrid(params, &key.faceCount, &key.faceColumns, &key.faceRows);
+    key.chunkSlices = Clamp(params.chunkSlices, 1, MAX_CHUNK_SLICES);
+
+    pthread_mutex_lock(&sphereLayoutMutex);
+    SphereLayout *layout = FindSphereLayout(&key);
+    pthread_mutex_unlock(&sphereLayoutMutex);
+
+    if (layout != NULL)
+        return layout;
+
+    // Built without the lock, the pool may run a job loading a layout while this one waits
+    SphereLayout *built = (SphereLayout *)RL_MALLOC(sizeof(SphereLayout));
+    *built = key;
+    built->directions = LoadSphereDirections(pool, params);
+    built->indices = BuildChunkedMeshIndices(params);
+    built->references = 1;
+
+    SphereLayout *evicted = NULL;
+
+    pthread_mutex_lock(&sphereLayoutMutex);
+
+    // Another thread may have built the same layout meanwhile
+    layout = FindSphereLayout(&key);
+
+    if (layout == NULL) {
+        layout = built;
+        layout->lastUse = ++sphereLayoutUses;
+        built = NULL;
+
+        // An empty slot, or else the least recently used layout nobody holds
+        int slot = -1;
+        for (int i = 0; i < MAX_SPHERE_LAYOUTS; i++) {
+            SphereLayout *cached = sphereLayouts[i];
+
+            if (cached == NULL) {
+                slot = i;
+                break;
+            }
+
+            if (cached->references == 0 && (slot < 0 || cached->lastUse < sphereLayouts[slot]->lastUse))
+                slot = i;
+        }
+
+        // With every slot held the layout is not cached, and freed once unloaded
+        if (slot >= 0) {
+            evicted = sphereLayouts[slot];
+            sphereLayouts[slot] = layout;
+            layout->cached = true;
+        }
+    }
+
+    pthread_mutex_unlock(&sphereLayoutMutex);
+
+    if (evicted != NULL)
+        FreeSphereLayout(evicted);
+    if (built != NULL)
+        FreeSphereLayout(built);
+
+    return layout;
+}
+
+// Drops a reference, the layout stays cached for the next planet of the same layout
+void UnloadSphereLayout(SphereLayout *layout)
+{
+    if (layout == NULL)
+        return;
+
+    pthread_mutex_lock(&sphereLayoutMutex);
+    bool release = --layout->references == 0 && !layout->cached;
+    pthread_mutex_unlock(&sphereLayoutMutex);
+
+    if (release)
+        FreeSphereLayout(layout);
+}
+
+// Frees the cached layouts nobody holds
+void UnloadSphereLayoutCache(void)
+{
+    pthread_mutex_lock(&sphereLayoutMutex);
+
+    for (int i = 0; i < MAX_SPHERE_LAYOUTS; i++) {
+        SphereLayout *layout = sphereLayouts[i];
+
+        if (layout != NULL && layout->references == 0) {
+            FreeSphereLayout(layout);
+            sphereLayouts[i] = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&sphereLayoutMutex);
+}
+
+// Regenerations at the same layout only redo the noise, the rest comes from LoadSphereLayout
+ChunkedMesh GeneratePlanetMesh(WorkerPool *pool, PlanetParams params)
+{
+    SphereLayout *layout = LoadSphereLayout(pool, params);
+    ChunkedMesh chunked = AllocChunkedMesh(layout);
+
+    GeneratePlanetVertices(pool, &layout->directions, &chunked, params);
+
+    UnloadSphereLayout(layout);
+
+    return chunked;
+}
+
+// Vertex and triangle counts of a tile: a grid of (tileSlices + 1)^2
+// vertices followed by a skirt of 4 * (tileSlices + 1) vertices hanging below
+// its edges. The skirts cover the cracks left where tiles of different levels meet
+static Mesh GetPlanetTileLayout(int slices)
+{
+    const int side = slices + 1;
+
+    Mesh mesh = { 0 };
+    mesh.vertexCount = side * side + side * 4;
+    mesh.triangleCount = slices * slices * 2 + slices * 8;
+
+    return mesh;
+}
+
+static void FillPlanetTileIndices(Mesh *mesh, int slices)
+{
+    const int side = slices + 1;
+    const int skirt = side * side;
+
+    unsigned short *index = mesh->indices;
+
+    for (int i = 0; i < slices; i++) {
+        for (int j = 0; j < slices; j++) {
+            int k1 = i * side + j;
+            int k2 = k1 + side;
+
+            // Same winding as the chunked grids
+            *index++ = k1;
+            *index++ = k2;
+            *index++ = k1 + 1;
+
+            *index++ = k1 + 1;
+            *index++ = k2;
+            *index++ = k2 + 1;
+        }
+    }
+
+    // Skirt quads, facing away from the tile: top, bottom, left and right edge
+    for (int k = 0; k < slices; k++) {
+        int edges[4][2] = {
+            { k, k + 1 },
+            { slices * side + k, slices * side + k + 1 },
+            { k * side, (k + 1) * side },
+            { k * side + slices, (k + 1) * side + slices },
+        };
+
+        for (int e = 0; e < 4; e++) {
+            int a = edges[e][0];
+            int b = edges[e][1];
+            int sa = skirt + e * side + k;
+            int sb = sa + 1;
+
+            // The bottom and left edges run the other way around the tile
+            bool reversed = e == 1 || e == 2;
+
+            *index++ = a;
+            *index++ = reversed ? sa : b;
+            *index++ = reversed ? b : sa;
+
+            *index++ = b;
+            *index++ = reversed ? sa : sb;
+            *index++ = reversed ? sb : sa;
+        }
+    }
+}
+
+// Allocates a tile, see GetPlanetTileLayout
+Mesh AllocPlanetTileMesh(int tileSlices)
+{
+    const int slices = Clamp(tileSlices, 1, MAX_TILE_SLICES);
+    Mesh mesh = GetPlanetTileLayout(slices);
+
+    // Allocated like raylib does, so UnloadMesh can free them
+    mesh.vertices = (float *)RL_MALLOC(mesh.vertexCount * 3 * sizeof(float));
+    mesh.colors = (unsigned char *)RL_MALLOC(mesh.vertexCount * 4 * sizeof(unsigned char));
+    mesh.indices = (unsigned short *)RL_MALLOC(mesh.triangleCount * 3 * sizeof(unsigned short));
+    mesh.normals = (float *)RL_MALLOC(mesh.vertexCount * 3 * sizeof(float));
+
+    FillPlanetTileIndices(&mesh, slices);
+
+    return mesh;
+}
+
+// Bytes of a tile in a single buffer, for InitPlanetTileMesh
+size_t GetPlanetTileMeshSize(int tileSlices)
+{
+    Mesh mesh = GetPlanetTileLayout(Clamp(tileSlices, 1, MAX_TILE_SLICES));
+
+    return (size_t)mesh.vertexCount * ((3 + 3) * sizeof(float) + 4 * sizeof(unsigned char))
+        + (size_t)mesh.triangleCount * 3 * sizeof(unsigned short);
+}
+
+// Lays a tile out in 'buffer' of GetPlanetTileMeshSize bytes, like a block of
+// a MemoryPool. UnloadMesh must not see its arrays: take them back off the
+// mesh once uploaded and return the buffer to where it came from
+Mesh InitPlanetTileMesh(void *buffer, int tileSlices)
+{
+    const int slices = Clamp(tileSlices, 1, MAX_TILE_SLICES);
+    Mesh mesh = GetPlanetTileLayout(slices);
+
+    // Floats first, so every array stays aligned
+    mesh.vertices = (float *)buffer;
+    mesh.normals = mesh.vertices + mesh.vertexCount * 3;
+    mesh.colors = (unsigned char *)(mesh.normals + mesh.vertexCount * 3);
+    mesh.indices = (unsigned short *)(mesh.colors + mesh.vertexCount * 4);
+
+    FillPlanetTileIndices(&mesh, slices);
+
+    return mesh;
+}
+
+// Frees the CPU buffers of a tile that was never uploaded
+void FreePlanetTileMesh(Mesh mesh)
+{
+    RL_FREE(mesh.vertices);
+    RL_FREE(mesh.colors);
+    RL_FREE(mesh.indices);
+    RL_FREE(mesh.normals);
+}
+
+static void SetTileVertex(Mesh *mesh, int v, Vector3 position, Vector3 normal, Color color)
+{
+    mesh->vertices[v * 3 + 0] = position.x;
+    mesh->vertices[v * 3 + 1] = position.y;
+    mesh->vertices[v * 3 + 2] = position.z;
+
+    mesh->normals[v * 3 + 0] = normal.x;
+    mesh->normals[v * 3 + 1] = normal.y;
+    mesh->normals[v * 3 + 2] = normal.z;
+
+    mesh->colors[v * 4 + 0] = color.r;
+    mesh->colors[v * 4 + 1] = color.g;
+    mesh->colors[v * 4 + 2] = color.b;
+    mesh->colors[v * 4 + 3] = color.a;
+}
+
+// Fills the vertices of a tile allocated with AllocPlanetTileMesh
+// The grid lines are those of the whole face at the tile level, so tiles of
+// any level share their corner and edge vertices bit for bit
+void GeneratePlanetTile(Mesh *mesh, PlanetTile tile, int tileSlices, PlanetParams params)
+{
+    const int slices = Clamp(tileSlices, 1, MAX_TILE_SLICES);
+    const int side = slices + 1;
+    const int faceSlices = slices << tile.level;
+
+    const float radius = params.radius;
+    const float scale = params.scale;
+
+    // Deep enough to hide the gap to a neighbour one level coarser
+    const float skirtDepth = radius * PI / 2 / faceSlices * 4;
+
+    MemoryArena *arena = GetScratchArena();
+    ArenaMark mark = GetArenaMark(arena);
+    float *rowBuffer = (float *)ArenaAlloc(arena, side * 10 * sizeof(float));
+    float *directionX = rowBuffer;
+    float *directionY = rowBuffer + side;
+    float *directionZ = rowBuffer + side * 2;
+    float *noiseX = rowBuffer + side * 3;
+    float *noiseY = rowBuffer + side * 4;
+    float *noiseZ = rowBuffer + side * 5;
+    float *noise = rowBuffer + side * 6;
+    float *gradientX = rowBuffer + side * 7;
+    float *gradientY = rowBuffer + side * 8;
+    float *gradientZ = rowBuffer + side * 9;
+
+    for (int i = 0; i < side; i++) {
+
+        for (int j = 0; j < side; j++) {
+            Vector3 direction = GetCubeSphereDirection(tile.face, tile.x * slices + j, tile.y * slices + i, faceSlices);
+            directionX[j] = direction.x;
+            directionY[j] = direction.y;
+            directionZ[j] = direction.z;
+
+            noiseX[j] = radius * direction.x / scale;
+            noiseY[j] = radius * direction.y / scale;
+            noiseZ[j] = radius * direction.z / scale;
+        }
+
+        GetPlanetNoise(params, noiseX, noiseY, noiseZ, noise, gradientX, gradientY, gradientZ, side);
+
+        for (int j = 0; j < side; j++) {
+            Vector3 direction = { directionX[j], directionY[j], directionZ[j] };
+            Vector3 gradient = { gradientX[j], gradientY[j], gradientZ[j] };
+            Vector3 position = Vector3Scale(direction, radius + noise[j]);
+            Vector3 normal = GetDisplacedNormal(direction, noise[j], gradient, params);
+            Color color = heightToColor(noise[j]);
+
+            SetTileVertex(mesh, i * side + j, position, normal, color);
+
+            Vector3 lowered = Vector3Scale(direction, radius + noise[j] - skirtDepth);
+            int skirt = side * side;
+
+            if (i == 0)
+                SetTileVertex(mesh, skirt + j, lowered, normal, color);
+            if (i == slices)
+                SetTileVertex(mesh, skirt + side + j, lowered, normal, color);
+            if (j == 0)
+                SetTileVertex(mesh, skirt + side * 2 + i, lowered, normal, color);
+            if (j == slices)
+                SetTileVertex(mesh, skirt + side * 3 + i, lowered, normal, color);
+        }
+    }
+
+    RewindArena(arena, mark);
+}
+
+// Only touched from the main thread, but for what the running job reads and
+// writes; the job hands its result over with RunOnMainThread
+struct PlanetGenerator {
+    WorkerPool *pool;
+    PlanetParams layout;
+    SphereLayout *sphere;   // Shared with the other planets of the layout
+    ChunkedMesh staging;
+
+    Job *job;           // Generating 'working' into the staging mesh
+    PlanetParams working;
+    double workingTime;
+
+    // Set by the job once its hand over is queued, so unloading can sleep until then
+    pthread_mutex_t mutex;
+    pthread_cond_t handOver;
+    bool handedOver;
+
+    bool quit;
+    bool pending;       // A request is waiting to be generated
+    bool staged;        // The staging mesh holds a result not taken yet
+
+    PlanetParams requested;
+    PlanetParams generated;
+    double time;
+};
+
+// Runs on the main thread once the job is done with the staging mesh, and
+// again next time until the job returned: waiting on it would run whatever
+// else the pool holds on the main thread, a whole generation or bake included
+static void PublishGeneratedPlanet(void *data)
+{
+    PlanetGenerator *generator = data;
+
+    if (!IsJobFinished(generator->job)) {
+        RunOnMainThread(generator->pool, PublishGeneratedPlanet, generator);
+        return;
+    }
+
+    WaitJob(generator->pool, generator->job);
+    generator->job = NULL;
+    generator->staged = true;
+    generator->generated = generator->working;
+    generator->time = generator->workingTime;
+}
+
+static void GeneratePlanetJob(WorkerPool *pool, Job *job, void *data)
+{
+    (void)job;
+
+    PlanetGenerator *generator = data;
+    double start = GetWallTime();
+
+    // Set up on the first request, so that a planet loaded from a cache never pays for it
+    if (generator->sphere == NULL) {
+        generator->sphere = LoadSphereLayout(pool, generator->layout);
+        generator->staging = AllocChunkedMesh(generator->sphere);
+    }
+
+    GeneratePlanetVertices(pool, &generator->sphere->directions, &generator->staging, generator->working);
+    generator->workingTime = GetWallTime() - start;
+
+    RunOnMainThread(pool, PublishGeneratedPlanet, generator);
+
+    pthread_mutex_lock(&generator->mutex);
+    generator->handedOver = true;
+    pthread_cond_signal(&generator->handOver);
+    pthread_mutex_unlock(&generator->mutex);
+}
+
+// The staging mesh is reused, so a request waits until the last result was taken
+static void StartPlanetGeneration(PlanetGenerator *generator)
+{
+    if (generator->quit || !generator->pending || generator->staged || generator->job != NULL)
+        return;
+
+    generator->working = generator->requested;
+    generator->pending = false;
+    generator->handedOver = false;
+    generator->job = CreateJob(generator->pool, NULL, GeneratePlanetJob, generator);
+    RunJob(generator->pool, generator->job);
+}
+
+// The layout (topology, slices and chunks) is fixed by 'params', later requests only change the noise
+// Generations run as jobs on the pool, their results show up in PollGeneratedPlanet
+// once the main thread ran RunMainThreadJobs
+PlanetGenerator *LoadPlanetGenerator(WorkerPool *pool, PlanetParams params)
+{
+    PlanetGenerator *generator = RL_CALLOC(1, sizeof(PlanetGenerator));
+    generator->pool = pool;
+    generator->layout = params;
+    generator->requested = params;
+
+    pthread_mutex_init(&generator->mutex, NULL);
+    pthread_cond_init(&generator->handOver, NULL);
+
+    return generator;
+}
+
+void UnloadPlanetGenerator(PlanetGenerator *generator)
+{
+    if (generator == NULL)
+        return;
+
+    // Lets the running job publish, without starting another
+    generator->quit = true;
+
+    if (generator->job != NULL) {
+        pthread_mutex_lock(&generator->mutex);
+        while (!generator->handedOver)
+            pthread_cond_wait(&generator->handOver, &generator->mutex);
+        pthread_mutex_unlock(&generator->mutex);
+    }
+
+    // The job is only returning now, its hand over queues itself again until it did
+    while (generator->job != NULL) {
+        RunMainThreadJobs(generator->pool);
+
+        if (generator->job != NULL)
+            sched_yield();
+    }
+
+    pthread_cond_destroy(&generator->handOver);
+    pthread_mutex_destroy(&generator->mutex);
+
+    FreeChunkedMesh(generator->staging);
+    UnloadSphereLayout(generator->sphere);
+    RL_FREE(generator);
+}
+
+// Queues a generation with new noise parameters, replacing any request not started yet
+void RequestPlanetGeneration(PlanetGenerator *generator, PlanetParams params)
+{
+    // Keep the layout the buffers were allocated for
+    params.topology = generator->layout.topology;
+    params.longitudeSlices = generator->layout.longitudeSlices;
+    params.latitudeSlices = generator->layout.latitudeSlices;
+    params.subdivisions = generator->layout.subdivisions;
+    params.chunkSlices = generator->layout.chunkSlices;
+
+    generator->requested = params;
+    generator->pending = true;
+    StartPlanetGeneration(generator);
+}
+
+// Returns the finished mesh, or NULL if there is none yet. It can be read or
+// swapped with SwapChunkedMeshVertices until ReleaseGeneratedPlanet is called
+ChunkedMesh *PollGeneratedPlanet(PlanetGenerator *generator, PlanetParams *params, double *time)
+{
+    if (generator->staged) {
+        if (params != NULL)
+            *params = generator->generated;
+        if (time != NULL)
+            *time = generator->time;
+    }
+
+    return generator->staged ? &generator->staging : NULL;
+}
+
+void ReleaseGeneratedPlanet(PlanetGenerator *generator)
+{
+    generator->staged = false;
+    StartPlanetGeneration(generator);
+}
+
+bool IsPlanetGenerating(PlanetGenerator *generator)
+{
+    return generator->pending || generator->job != NULL;
+}
+
+#endif // PLANET_IMPLEMENTATION
@@ -0,0 +1,433 @@
+// profiler.h - CPU and GPU frame timers with an overlay and a CSV trace
+//
+// to create the implementation,
+//     #define PROFILER_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// parallel.h must be included before this file. Needs the raylib library and
+// rlgl, and like shadow.h the calls must come from the thread that owns the
+// GL context.
+//
+// rlgl has no timer queries, so the GPU timers call the OpenGL 3.3 query
+// functions of the GL library raylib links to. Define PROFILER_NO_GPU_TIMERS
+// on platforms without them, OpenGL ES and the web, and the GPU timers stay
+// empty.
+//
+//
+// Documentation:
+//
+// Profiler *LoadProfiler(const char *tracePath)
+//
+// Keeps the timers of the last PROFILER_HISTORY frames. Unless 'tracePath' is
+// NULL, every frame is also written as a line of milliseconds to that CSV
+// file, with an empty field for the timers that did not run in the frame.
+// Lines go out once the GPU timers of their frame are known, a few frames
+// late.
+//
+// void BeginProfileFrame(Profiler *profiler)
+// void EndProfileFrame(Profiler *profiler)
+//
+// Around everything measured in a frame.
+//
+// void BeginProfileTimer(Profiler *profiler, ProfileTimer timer)
+// void EndProfileTimer(Profiler *profiler, ProfileTimer timer)
+//
+// Around a section of the frame. A CPU timer adds up its sections, a GPU
+// timer must run once at most per frame and not overlap the other one. Both
+// flush the raylib batch before a GPU timer starts and ends, so that it only
+// measures the draws in between.
+//
+// void AddProfileSample(Profiler *profiler, ProfileTimer timer, double seconds)
+//
+// Adds time measured elsewhere to the timer in this frame, like the frame
+// time or a planet generation.
+//
+// ProfileStats GetProfileStats(const Profiler *profiler, ProfileTimer timer)
+//
+// Mean, percentiles and worst of the frames of the history the timer ran in.
+//
+// void DrawProfiler(const Profiler *profiler, int x, int y, int width, int fontSize)
+//
+// Draws the statistics of every timer, then a graph of the history with the
+// CPU sections of each frame stacked, the GPU time and the frame time.
+//
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+
+// Frames kept for the statistics and the graph
+#define PROFILER_HISTORY 240
+
+typedef enum ProfileTimer {
+    PROFILE_UPDATE = 0,     // CPU: input, camera, generation and uniforms
+    PROFILE_SHADOW,         // CPU: submitting the shadow pass
+    PROFILE_MAIN,           // CPU: submitting the main pass
+    PROFILE_UI,             // CPU: the overlay and the menu
+    PROFILE_GPU_SHADOW,     // GPU: the shadow pass
+    PROFILE_GPU_MAIN,       // GPU: the main pass
+    PROFILE_FRAME,          // From one buffer swap to the next
+    PROFILE_GENERATION,     // Planets generated in the background
+    PROFILE_TIMER_COUNT
+} ProfileTimer;
+
+typedef struct ProfileStats {
+    int samples;            // Frames of the history with the timer
+    double last;            // Seconds
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+} ProfileStats;
+
+typedef struct Profiler Profiler;
+
+const char *GetProfileTimerName(ProfileTimer timer);
+
+Profiler *LoadProfiler(const char *tracePath);
+void UnloadProfiler(Profiler *profiler);
+
+void BeginProfileFrame(Profiler *profiler);
+void EndProfileFrame(Profiler *profiler);
+void BeginProfileTimer(Profiler *profiler, ProfileTimer timer);
+void EndProfileTimer(Profiler *profiler, ProfileTimer timer);
+void AddProfileSample(Profiler *profiler, ProfileTimer timer, double seconds);
+
+ProfileStats GetProfileStats(const Profiler *profiler, ProfileTimer timer);
+void DrawProfiler(const Profiler *profiler, int x, int y, int width, int fontSize);
+
+#endif // PROFILER_H
+
+#ifdef PROFILER_IMPLEMENTATION
+
+#include <rlgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Frames a GPU query is given before it is read, so that reading never waits
+#define PROFILER_QUERY_FRAMES 4
+
+#define PROFILER_GPU_TIMERS 2
+
+#ifndef PROFILER_NO_GPU_TIMERS
+#define PROFILER_GL_TIME_ELAPSED 0x88BF
+#define PROFILER_GL_QUERY_RESULT 0x8866
+
+// Core since OpenGL 3.3, which raylib needs on desktop
+void glGenQueries(int n, unsigned int *ids);
+void glDeleteQueries(int n, const unsigned int *ids);
+void glBeginQuery(unsigned int target, unsigned int id);
+void glEndQuery(unsigned int target);
+void glGetQueryObjectui64v(unsigned int id, unsigned int pname, unsigned long long *params);
+#endif
+
+struct Profiler {
+    // Seconds of every timer in the last frames, negative where it did not run
+    double history[PROFILER_HISTORY][PROFILE_TIMER_COUNT];
+    unsigned long frame;    // Frames ended
+    bool inFrame;           // Between BeginProfileFrame and EndProfileFrame
+
+    double started[PROFILE_TIMER_COUNT];
+
+    // Queries of the last frames, one per GPU timer, and whether they were issued
+    unsigned int queries[PROFILER_QUERY_FRAMES][PROFILER_GPU_TIMERS];
+    bool issued[PROFILER_QUERY_FRAMES][PROFILER_GPU_TIMERS];
+    unsigned long pending;  // Oldest frame whose queries are not read yet
+
+    FILE *trace;
+};
+
+static const char *profileTimerNames[PROFILE_TIMER_COUNT] = {
+    "update", "shadow", "main", "ui", "gpu shadow", "gpu main", "frame", "generation",
+};
+
+static bool IsGpuProfileTimer(ProfileTimer timer)
+{
+    return timer == PROFILE_GPU_SHADOW || timer == PROFILE_GPU_MAIN;
+}
+
+const char *GetProfileTimerName(ProfileTimer timer)
+{
+    return profileTimerNames[timer];
+}
+
+Profiler *LoadProfiler(const char *tracePath)
+{
+    Profiler *profiler = (Profiler *)RL_CALLOC(1, sizeof(Profiler));
+
+    for (int i = 0; i < PROFILER_HISTORY; i++) {
+        for (int t = 0; t < PROFILE_TIMER_COUNT; t++)
+            profiler->history[i][t] = -1;
+    }
+
+#ifndef PROFILER_NO_GPU_TIMERS
+    glGenQueries(PROFILER_QUERY_FRAMES * PROFILER_GPU_TIMERS, &profiler->queries[0][0]);
+#endif
+
+    if (tracePath != NULL) {
+        profiler->trace = fopen(tracePath, "w");
+
+        if (profiler->trace == NULL)
+            TRACELOG(LOG_WARNING, "PROFILER: [%s] Failed to open trace file", tracePath);
+        else {
+            fprintf(profiler->trace, "frame");
+            for (int t = 0; t < PROFILE_TIMER_COUNT; t++) {
+                fprintf(profiler->trace, ",");
+
+                // Names in CSV form
+                for (const char *c = profileTimerNames[t]; *c != '\0'; c++)
+                    fputc(*c == ' ' ? '_' : *c, profiler->trace);
+
+                fprintf(profiler->trace, "_ms");
+            }
+            fprintf(profiler->trace, "\n");
+        }
+    }
+
+    return profiler;
+}
+
+// Reads the queries of the oldest pending frame into its history, then writes its trace line
+static void ResolveProfileFrame(Profiler *profiler)
+{
+    unsigned long frame = profiler->pending++;
+    double *values = profiler->history[frame % PROFILER_HISTORY];
+    int slot = frame % PROFILER_QUERY_FRAMES;
+
+    for (int i = 0; i < PROFILER_GPU_TIMERS; i++) {
+        if (!profiler->issued[slot][i])
+            continue;
+
+#ifndef PROFILER_NO_GPU_TIMERS
+        unsigned long long nanoseconds = 0;
+        glGetQueryObjectui64v(profiler->queries[slot][i], PROFILER_GL_QUERY_RESULT, &nanoseconds);
+        values[PROFILE_GPU_SHADOW + i] = nanoseconds * 1e-9;
+#endif
+        profiler->issued[slot][i] = false;
+    }
+
+    if (profiler->trace == NULL)
+        return;
+
+    fprintf(profiler->trace, "%lu", frame);
+
+    for (int t = 0; t < PROFILE_TIMER_COUNT; t++) {
+        if (values[t] >= 0)
+            fprintf(profiler->trace, ",%.4f", values[t] * 1000);
+        else
+            fprintf(profiler->trace, ",");
+    }
+
+    fprintf(profiler->trace, "\n");
+}
+
+void UnloadProfiler(Profiler *profiler)
+{
+    if (profiler == NULL)
+        return;
+
+    while (profiler->pending < profiler->frame)
+        ResolveProfileFrame(profiler);
+
+#ifndef PROFILER_NO_GPU_TIMERS
+    glDeleteQueries(PROFILER_QUERY_FRAMES * PROFILER_GPU_TIMERS, &profiler->queries[0][0]);
+#endif
+
+    if (profiler->trace != NULL)
+        fclose(profiler->trace);
+
+    RL_FREE(profiler);
+}
+
+void BeginProfileFrame(Profiler *profiler)
+{
+    // The query slots of this frame are the ones of PROFILER_QUERY_FRAMES ago
+    while (profiler->frame - profiler->pending >= PROFILER_QUERY_FRAMES)
+        ResolveProfileFrame(profiler);
+
+    double *values = profiler->history[profiler->frame % PROFILER_HISTORY];
+
+    for (int t = 0; t < PROFILE_TIMER_COUNT; t++)
+        values[t] = -1;
+
+    profiler->inFrame = true;
+}
+
+void EndProfileFrame(Profiler *profiler)
+{
+    profiler->frame++;
+    profiler->inFrame = false;
+}
+
+void BeginProfileTimer(Profiler *profiler, ProfileTimer timer)
+{
+    if (IsGpuProfileTimer(timer)) {
+#ifndef PROFILER_NO_GPU_TIMERS
+        int slot = profiler->frame % PROFILER_QUERY_FRAMES;
+
+        rlDrawRenderBatchActive();
+        glBeginQuery(PROFILER_GL_TIME_ELAPSED, profiler->queries[slot][timer - PROFILE_GPU_SHADOW]);
+        profiler->issued[slot][timer - PROFILE_GPU_SHADOW] = true;
+#endif
+        return;
+    }
+
+    profiler->started[timer] = GetWallTime();
+}
+
+void EndProfileTimer(Profiler *profiler, ProfileTimer timer)
+{
+    if (IsGpuProfileTimer(timer)) {
+#ifndef PROFILER_NO_GPU_TIMERS
+        rlDrawRenderBatchActive();
+        glEndQuery(PROFILER_GL_TIME_ELAPSED);
+#endif
+        return;
+    }
+
+    AddProfileSample(profiler, timer, GetWallTime() - profiler->started[timer]);
+}
+
+void AddProfileSample(Profiler *profiler, ProfileTimer timer, double seconds)
+{
+    double *value = &profiler->history[profiler->frame % PROFILER_HISTORY][timer];
+    *value = fmax(*value, 0) + seconds;
+}
+
+static int CompareProfileSamples(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank of the sorted samples
+static double GetProfilePercentile(const double *sorted, int count, double percentile)
+{
+    int rank = (int)ceil(percentile / 100 * count);
+    return sorted[(int)Clamp(rank - 1, 0, count - 1)];
+}
+
+ProfileStats GetProfileStats(const Profiler *profiler, ProfileTimer timer)
+{
+    ProfileStats stats = { 0 };
+    double sorted[PROFILER_HISTORY];
+
+    // Newest first, so that 'last' is the latest frame the timer ran in,
+    // counting the one in progress. The GPU timers of the frames still
+    // pending are not known yet
+    unsigned long newest = IsGpuProfileTimer(timer) ? profiler->pending : profiler->frame + profiler->inFrame;
+    int frames = (int)fmin(newest, PROFILER_HISTORY);
+
+    for (int i = 1; i <= frames; i++) {
+        double value = profiler->history[(newest - i) % PROFILER_HISTORY][timer];
+
+        if (value < 0)
+            continue;
+
+        if (stats.samples == 0)
+            stats.last = value;
+
+        sorted[stats.samples++] = value;
+        stats.mean += value;
+    }
+
+    if (stats.samples == 0)
+        return stats;
+
+    qsort(sorted, stats.samples, sizeof(double), CompareProfileSamples);
+
+    stats.mean /= stats.samples;
+    stats.p50 = GetProfilePercentile(sorted, stats.samples, 50);
+    stats.p95 = GetProfilePercentile(sorted, stats.samples, 95);
+    stats.p99 = GetProfilePercentile(sorted, stats.samples, 99);
+    stats.max = sorted[stats.samples - 1];
+
+    return stats;
+}
+
+void DrawProfiler(const Profiler *profiler, int x, int y, int width, int fontSize)
+{
+    static const Color cpuColors[PROFILE_GPU_SHADOW] = { GRAY, DARKBLUE, DARKGREEN, ORANGE };
+
+    const int lineHeight = fontSize + 2;
+    const int columnWidth = MeasureText("0000.00", fontSize);
+    const int nameWidth = MeasureText("generation", fontSize) + fontSize;
+    const int graphHeight = fontSize * 6;
+    const int height = lineHeight * (PROFILE_TIMER_COUNT + 1) + graphHeight + fontSize * 2;
+
+    DrawRectangle(x, y, width, height, Fade(BLACK, 0.6f));
+
+    x += fontSize / 2;
+    y += fontSize / 2;
+    width -= fontSize;
+
+    const char *columns[] = { "ms", "last", "p50", "p95", "p99", "max" };
+    for (int i = 0; i < 6; i++)
+        DrawText(columns[i], i == 0 ? x : x + nameWidth + (i - 1) * columnWidth, y, fontSize, LIGHTGRAY);
+    y += lineHeight;
+
+    for (int t = 0; t < PROFILE_TIMER_COUNT; t++) {
+        ProfileStats stats = GetProfileStats(profiler, t);
+        Color color = t < PROFILE_GPU_SHADOW ? cpuColors[t] : t == PROFILE_FRAME ? RED : t == PROFILE_GENERATION ? WHITE : PURPLE;
+        double values[5] = { stats.last, stats.p50, stats.p95, stats.p99, stats.max };
+
+        DrawRectangle(x, y + fontSize / 4, fontSize / 2, fontSize / 2, color);
+        DrawText(profileTimerNames[t], x + fontSize, y, fontSize, RAYWHITE);
+
+        for (int i = 0; i < 5; i++) {
+            const char *text = stats.samples > 0 ? TextFormat("%.2f", values[i] * 1000) : "-";
+            DrawText(text, x + nameWidth + i * columnWidth, y, fontSize, RAYWHITE);
+        }
+
+        y += lineHeight;
+    }
+
+    y += fontSize / 2;
+
+    // Scaled to fit the slowest frame, but no less than two 60 Hz frames
+    ProfileStats frameStats = GetProfileStats(profiler, PROFILE_FRAME);
+    double range = fmax(fmax(frameStats.max, GetProfileStats(profiler, PROFILE_GPU_MAIN).max), 2 / 60.0);
+    float pixelsPerSecond = graphHeight / range;
+    int bottom = y + graphHeight;
+
+    DrawLine(x, bottom - (int)(pixelsPerSecond / 60), x + width, bottom - (int)(pixelsPerSecond / 60), Fade(GREEN, 0.6f));
+    DrawLine(x, bottom - (int)(pixelsPerSecond / 30), x + width, bottom - (int)(pixelsPerSecond / 30), Fade(YELLOW, 0.6f));
+    DrawText("60 Hz", x + width - MeasureText("60 Hz", fontSize), bottom - (int)(pixelsPerSecond / 60) - fontSize, fontSize, GREEN);
+
+    // Oldest frame on the left, the GPU times lag a few frames behind
+    int frames = (int)fmin(profiler->frame, PROFILER_HISTORY);
+    float step = (float)width / PROFILER_HISTORY;
+
+    for (int i = 0; i < frames; i++) {
+        const double *values = profiler->history[(profiler->frame - frames + i) % PROFILER_HISTORY];
+        int left = x + (int)((PROFILER_HISTORY - frames + i) * step);
+        int barWidth = (int)fmax(step - 1, 1);
+        float top = bottom;
+
+        for (int t = 0; t < PROFILE_GPU_SHADOW; t++) {
+            if (values[t] <= 0)
+                continue;
+
+            float size = values[t] * pixelsPerSecond;
+            DrawRectangle(left, (int)(top - size), barWidth, (int)ceilf(size), cpuColors[t]);
+            top -= size;
+        }
+
+        double gpu = fmax(values[PROFILE_GPU_SHADOW], 0) + fmax(values[PROFILE_GPU_MAIN], 0);
+        if (gpu > 0)
+            DrawRectangle(left, bottom - (int)(gpu * pixelsPerSecond), barWidth, 2, PURPLE);
+
+        if (values[PROFILE_FRAME] > 0)
+            DrawRectangle(left, bottom - (int)(values[PROFILE_FRAME] * pixelsPerSecond), barWidth, 2, RED);
+
+        if (values[PROFILE_GENERATION] > 0)
+            DrawRectangle(left, y, barWidth, graphHeight, Fade(WHITE, 0.3f));
+    }
+
+    DrawText(TextFormat("%d frames, %.1f ms tall", frames, range * 1000), x, bottom + fontSize / 2, fontSize, LIGHTGRAY);
+}
+
+#endif // PROFILER_IMPLEMENTATION
@@ -0,0 +1,401 @@
+// scene.h - solar system of planets drawn with instancing
+//
+// to create the implementation,
+//     #define SCENE_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// planet.h, terrain.h and cull.h must be included before this file. Needs the
+// raylib library and rlgl, the calls must come from the thread that owns the
+// GL context.
+//
+//
+// Documentation:
+//
+// Scene *LoadScene(WorkerPool *pool, Shader shader)
+//
+// Generates the bare UV spheres of the SCENE_LOD_COUNT levels of detail once,
+// shared by every body, and adds a buffer of per-instance attributes to each:
+// the model matrix, the noise parameters, the seed and the tint. Like
+// --gpu-displace, shadowmap.vs displaces the spheres, which only needs
+// SetTerrainShaderParams to turn the displacement on for the color bands.
+//
+// int AddSceneBody(Scene *scene, SceneBody body)
+//
+// Adds a body, which orbits 'body.parent' or the origin if it is -1. Parents
+// must be added before their moons. Returns the index of the body.
+//
+// void AddSceneSystem(Scene *scene, PlanetParams planet, int count, unsigned int seed)
+//
+// Adds 'count' bodies: 'planet' at the origin, planets around it and moons
+// around those, with noise, sizes and orbits picked from 'seed'.
+//
+// void UpdateScene(Scene *scene, float time, Camera camera, int screenHeight)
+//
+// Moves the bodies along their orbits and picks the level of detail of each
+// from its size on the screen.
+//
+// void DrawScene(Scene *scene, Material material, const ChunkCuller *culler)
+//
+// Draws the bodies the culler keeps, or all of them without one, with one
+// instanced draw per level of detail, using the current rlgl matrices like
+// DrawMesh. Works in the shadow cascades and in the main pass alike.
+//
+// SceneStats GetSceneStats(const Scene *scene)
+//
+// Draw calls, bodies and triangles of the DrawScene calls since the last
+// UpdateScene.
+//
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+
+#define SCENE_LOD_COUNT 3
+
+typedef struct SceneBody {
+    PlanetParams params;    // Radius and noise, the layout is the scene's
+    float seed;             // Offsets the noise, so bodies of the same params differ
+    Color tint;
+
+    int parent;             // Body orbited, -1 for the origin
+    float orbitRadius;
+    float orbitPeriod;      // Seconds per orbit, 0 to stay put
+    float orbitPhase;
+    float orbitTilt;        // Radians off the plane of the parent's orbit
+    float spinPeriod;       // Seconds per turn around its own axis, 0 for none
+
+    Vector3 position;       // Set by UpdateScene
+    Matrix transform;
+    int lod;
+} SceneBody;
+
+typedef struct SceneStats {
+    int bodies;
+    int drawnBodies;        // Summed over the DrawScene calls, like the rest
+    int drawCalls;
+    int triangles;
+    int lodBodies[SCENE_LOD_COUNT];     // Bodies at each level, from the last UpdateScene
+} SceneStats;
+
+typedef struct Scene Scene;
+
+Scene *LoadScene(WorkerPool *pool, Shader shader);
+void UnloadScene(Scene *scene);
+int AddSceneBody(Scene *scene, SceneBody body);
+void AddSceneSystem(Scene *scene, PlanetParams planet, int count, unsigned int seed);
+float GetSceneRadius(const Scene *scene);
+
+void UpdateScene(Scene *scene, float time, Camera camera, int screenHeight);
+void DrawScene(Scene *scene, Material material, const ChunkCuller *culler);
+SceneStats GetSceneStats(const Scene *scene);
+
+#endif // SCENE_H
+
+#ifdef SCENE_IMPLEMENTATION
+
+#include <rlgl.h>
+#include <string.h>
+
+// Longitude and latitude slices of each level, the last one for specks
+static const int sceneLodSlices[SCENE_LOD_COUNT] = { 128, 48, 16 };
+
+// Smallest radius on the screen, in pixels, of the first levels
+static const float sceneLodPixels[SCENE_LOD_COUNT - 1] = { 120, 24 };
+
+// Model matrix, then noise (radius, scale, lacunarity, gain), shape (octaves, seed) and tint
+#define SCENE_INSTANCE_FLOATS 28
+
+typedef struct SceneLod {
+    Mesh mesh;
+    unsigned int buffer;    // Instance attributes, bound to the vertex array of the mesh
+    int capacity;
+    float *instances;
+    int count;
+} SceneLod;
+
+struct Scene {
+    SceneBody *bodies;
+    int bodyCount;
+    int bodyCapacity;
+
+    SceneLod lods[SCENE_LOD_COUNT];
+    SceneStats stats;
+
+    // Attributes and uniforms of the shader
+    int transformLoc;
+    int noiseLoc;
+    int shapeLoc;
+    int tintLoc;
+    int instancedLoc;
+};
+
+// Points the instance attributes of the level at a buffer of 'capacity' instances
+static void ReserveSceneInstances(Scene *scene, SceneLod *lod, int capacity)
+{
+    if (capacity <= lod->capacity)
+        return;
+
+    lod->capacity = capacity > lod->capacity * 2 ? capacity : lod->capacity * 2;
+    lod->instances = RL_REALLOC(lod->instances, lod->capacity * SCENE_INSTANCE_FLOATS * sizeof(float));
+
+    rlEnableVertexArray(lod->mesh.vaoId);
+
+    if (lod->buffer != 0)
+        rlUnloadVertexBuffer(lod->buffer);
+
+    lod->buffer = rlLoadVertexBuffer(NULL, lod->capacity * SCENE_INSTANCE_FLOATS * sizeof(float), true);
+    rlEnableVertexBuffer(lod->buffer);
+
+    const int stride = SCENE_INSTANCE_FLOATS * sizeof(float);
+    int locations[7] = { scene->transformLoc, scene->transformLoc + 1, scene->transformLoc + 2, scene->transformLoc + 3, scene->noiseLoc, scene->shapeLoc, scene->tintLoc };
+
+    // The matrix takes four locations, a column each
+    for (int i = 0; i < 7; i++) {
+        if ((i < 4 ? scene->transformLoc : locations[i]) < 0)
+            continue;
+
+        rlEnableVertexAttribute(locations[i]);
+        rlSetVertexAttribute(locations[i], 4, RL_FLOAT, false, stride, i * 4 * sizeof(float));
+        rlSetVertexAttributeDivisor(locations[i], 1);
+    }
+
+    rlDisableVertexBuffer();
+    rlDisableVertexArray();
+}
+
+Scene *LoadScene(WorkerPool *pool, Shader shader)
+{
+    Scene *scene = RL_CALLOC(1, sizeof(Scene));
+
+    scene->transformLoc = GetShaderLocationAttrib(shader, "instanceTransform");
+    scene->noiseLoc = GetShaderLocationAttrib(shader, "instanceNoise");
+    scene->shapeLoc = GetShaderLocationAttrib(shader, "instanceShape");
+    scene->tintLoc = GetShaderLocationAttrib(shader, "instanceTint");
+    scene->instancedLoc = GetShaderLocation(shader, "instanced");
+
+    for (int i = 0; i < SCENE_LOD_COUNT; i++) {
+        // A single chunk, so a single draw per level
+        PlanetParams layout = {
+            .topology = PLANET_UV_SPHERE,
+            .longitudeSlices = sceneLodSlices[i],
+            .latitudeSlices = sceneLodSlices[i],
+            .chunkSlices = sceneLodSlices[i],
+            .radius = 1,
+        };
+
+        ChunkedMesh sphere = GenerateBaseSphereMesh(pool, layout);
+        scene->lods[i].mesh = sphere.chunks[0];
+        RL_FREE(sphere.chunks);
+
+        UploadMesh(&scene->lods[i].mesh, false);
+        ReserveSceneInstances(scene, &scene->lods[i], 16);
+    }
+
+    return scene;
+}
+
+void UnloadScene(Scene *scene)
+{
+    if (scene == NULL)
+        return;
+
+    for (int i = 0; i < SCENE_LOD_COUNT; i++) {
+        rlUnloadVertexBuffer(scene->lods[i].buffer);
+        UnloadMesh(scene->lods[i].mesh);
+        RL_FREE(scene->lods[i].instances);
+    }
+
+    RL_FREE(scene->bodies);
+    RL_FREE(scene);
+}
+
+int AddSceneBody(Scene *scene, SceneBody body)
+{
+    if (scene->bodyCount == scene->bodyCapacity) {
+        scene->bodyCapacity = scene->bodyCapacity > 0 ? scene->bodyCapacity * 2 : 16;
+        scene->bodies = RL_REALLOC(scene->bodies, scene->bodyCapacity * sizeof(SceneBody));
+    }
+
+    if (body.parent >= scene->bodyCount)
+        body.parent = -1;
+
+    body.transform = MatrixIdentity();
+    scene->bodies[scene->bodyCount] = body;
+
+    return scene->bodyCount++;
+}
+
+static float RandomSceneFloat(unsigned int *state, float low, float high)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return low + (high - low) * (*state >> 8) / (float)(1 << 24);
+}
+
+void AddSceneSystem(Scene *scene, PlanetParams planet, int count, unsigned int seed)
+{
+    unsigned int state = seed * 2654435761u + 1;
+
+    SceneBody center = { .params = planet, .tint = WHITE, .parent = -1, .spinPeriod = 120 };
+    AddSceneBody(scene, center);
+
+    // A planet for every four bodies, the others are moons of the planets
+    int planets = count > 1 ? (count - 1 + 3) / 4 : 0;
+    int first = scene->bodyCount;
+
+    for (int i = 1; i < count; i++) {
+        SceneBody body = { .params = planet, .tint = WHITE };
+        body.seed = RandomSceneFloat(&state, 0, 8);
+        body.params.scale = planet.scale * RandomSceneFloat(&state, 0.5f, 2);
+        body.params.gain = RandomSceneFloat(&state, 0.35f, 0.6f);
+        body.params.octaves = (int)RandomSceneFloat(&state, 3, 7);
+        body.tint = (Color){ RandomSceneFloat(&state, 150, 255), RandomSceneFloat(&state, 150, 255), RandomSceneFloat(&state, 150, 255), 255 };
+        body.orbitPhase = RandomSceneFloat(&state, 0, 2 * PI);
+        body.orbitTilt = RandomSceneFloat(&state, -0.1f, 0.1f);
+        body.spinPeriod = RandomSceneFloat(&state, 20, 90);
+
+        if (i <= planets) {
+            // Spread over a disk rather than rings, so a thousand bodies stay within the far plane
+            body.parent = -1;
+            body.params.radius = planet.radius * RandomSceneFloat(&state, 0.2f, 0.6f);
+            body.orbitRadius = planet.radius * (3 + 2.5f * sqrtf(i));
+        }
+        else {
+            // Moons stay well inside the gap around their planet
+            body.parent = first + (int)RandomSceneFloat(&state, 0, planets);
+            const SceneBody *parent = &scene->bodies[body.parent];
+            body.params.radius = parent->params.radius * RandomSceneFloat(&state, 0.1f, 0.3f);
+            body.orbitRadius = parent->params.radius * RandomSceneFloat(&state, 1.8f, 3.5f);
+        }
+
+        // Kepler's third law, the outer bodies are slower
+        body.orbitPeriod = 20 * powf(body.orbitRadius / planet.radius, 1.5f);
+        AddSceneBody(scene, body);
+    }
+}
+
+// Radius of the sphere around the origin that the orbits stay in
+float GetSceneRadius(const Scene *scene)
+{
+    float radius = 0;
+
+    for (int i = 0; i < scene->bodyCount; i++) {
+        const SceneBody *body = &scene->bodies[i];
+        float reach = body->orbitRadius + body->params.radius + GetPlanetNoiseBound(body->params);
+
+        if (body->parent >= 0)
+            reach += scene->bodies[body->parent].orbitRadius;
+
+        radius = fmaxf(radius, reach);
+    }
+
+    return radius;
+}
+
+void UpdateScene(Scene *scene, float time, Camera camera, int screenHeight)
+{
+    // Pixels per world unit at distance 1
+    float focal = screenHeight * 0.5f / tanf(camera.fovy * DEG2RAD * 0.5f);
+
+    memset(&scene->stats, 0, sizeof(SceneStats));
+    scene->stats.bodies = scene->bodyCount;
+
+    for (int i = 0; i < scene->bodyCount; i++) {
+        SceneBody *body = &scene->bodies[i];
+
+        float angle = body->orbitPhase + (body->orbitPeriod > 0 ? time / body->orbitPeriod * 2 * PI : 0);
+        Vector3 offset = { cosf(angle) * body->orbitRadius, sinf(angle) * sinf(body->orbitTilt) * body->orbitRadius, sinf(angle) * cosf(body->orbitTilt) * body->orbitRadius };
+        Vector3 origin = body->parent >= 0 ? scene->bodies[body->parent].position : Vector3Zero();
+        body->position = Vector3Add(origin, offset);
+
+        float spin = body->spinPeriod > 0 ? time / body->spinPeriod * 2 * PI : 0;
+        body->transform = MatrixMultiply(MatrixRotateY(spin), MatrixTranslate(body->position.x, body->position.y, body->position.z));
+
+        float distance = fmaxf(Vector3Distance(camera.position, body->position), 0.001f);
+        float pixels = body->params.radius * focal / distance;
+
+        body->lod = SCENE_LOD_COUNT - 1;
+        for (int k = SCENE_LOD_COUNT - 2; k >= 0; k--) {
+            if (pixels >= sceneLodPixels[k])
+                body->lod = k;
+        }
+
+        scene->stats.lodBodies[body->lod]++;
+    }
+}
+
+void DrawScene(Scene *scene, Material material, const ChunkCuller *culler)
+{
+    for (int k = 0; k < SCENE_LOD_COUNT; k++) {
+        ReserveSceneInstances(scene, &scene->lods[k], scene->bodyCount);
+        scene->lods[k].count = 0;
+    }
+
+    for (int i = 0; i < scene->bodyCount; i++) {
+        const SceneBody *body = &scene->bodies[i];
+
+        if (culler != NULL) {
+            ChunkBounds bounds = { .center = body->position, .radius = body->params.radius + GetPlanetNoiseBound(body->params) };
+
+            if (GetChunkVisibility(culler, bounds) != CHUNK_VISIBLE)
+                continue;
+        }
+
+        SceneLod *lod = &scene->lods[body->lod];
+
+        float *instance = lod->instances + lod->count++ * SCENE_INSTANCE_FLOATS;
+        float16 transform = MatrixToFloatV(body->transform);
+        Vector4 tint = ColorNormalize(body->tint);
+
+        memcpy(instance, transform.v, 16 * sizeof(float));
+        instance[16] = body->params.radius;
+        instance[17] = body->params.scale;
+        instance[18] = body->params.lacunarity;
+        instance[19] = body->params.gain;
+        instance[20] = body->params.octaves;
+        instance[21] = body->seed;
+        instance[22] = 0;
+        instance[23] = 0;
+        instance[24] = tint.x;
+        instance[25] = tint.y;
+        instance[26] = tint.z;
+        instance[27] = tint.w;
+    }
+
+    // The model matrix comes from the instances, mvp is only the view and projection
+    Matrix viewProjection = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    Vector4 diffuse = ColorNormalize(material.maps[MATERIAL_MAP_DIFFUSE].color);
+    int instanced = 1;
+
+    rlEnableShader(material.shader.id);
+    rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_MVP], viewProjection);
+    rlSetUniform(material.shader.locs[SHADER_LOC_COLOR_DIFFUSE], &diffuse, SHADER_UNIFORM_VEC4, 1);
+    rlSetUniform(scene->instancedLoc, &instanced, SHADER_UNIFORM_INT, 1);
+
+    for (int k = 0; k < SCENE_LOD_COUNT; k++) {
+        SceneLod *lod = &scene->lods[k];
+        if (lod->count == 0)
+            continue;
+
+        rlUpdateVertexBuffer(lod->buffer, lod->instances, lod->count * SCENE_INSTANCE_FLOATS * sizeof(float), 0);
+
+        rlEnableVertexArray(lod->mesh.vaoId);
+        rlDrawVertexArrayElementsInstanced(0, lod->mesh.triangleCount * 3, 0, lod->count);
+        rlDisableVertexArray();
+
+        scene->stats.drawCalls++;
+        scene->stats.drawnBodies += lod->count;
+        scene->stats.triangles += lod->count * lod->mesh.triangleCount;
+    }
+
+    instanced = 0;
+    rlSetUniform(scene->instancedLoc, &instanced, SHADER_UNIFORM_INT, 1);
+    rlDisableShader();
+}
+
+SceneStats GetSceneStats(const Scene *scene)
+{
+    return scene->stats;
+}
+
+#endif // SCENE_IMPLEMENTATION
@@ -0,0 +1,307 @@
+// shadow.h - cascaded shadow maps for a directional light on the planet
+//
+// to create the implementation,
+//     #define SHADOW_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// Needs the raylib library and rlgl, like lod.h the calls must come from the
+// thread that owns the GL context. Define SHADOW_FIT_ONLY with the
+// implementation to only get the fitting of LoadShadowMap and
+// UpdateShadowMap, without a texture or any GL call, like terragen_bench does.
+//
+//
+// Documentation:
+//
+// ShadowMap LoadShadowMap(int cascadeCount, int resolution)
+//
+// Splits the camera view in 'cascadeCount' ranges of depth, each with its own
+// orthographic light projection. rlgl has no texture arrays, so the cascades
+// are tiles side by side in one depth texture; each tile gets
+// resolution / sqrt(cascadeCount) texels per side, so all of them together
+// take no more memory than a single map of 'resolution' squared.
+//
+// bool UpdateShadowMap(ShadowMap *shadow, Camera camera, float aspect, Vector3 lightDir, float innerRadius, float outerRadius)
+//
+// Fits the cascades to the camera frustum, clipped to the planet between
+// 'innerRadius' and 'outerRadius' around the origin. A cascade covers a bit
+// more than its part of the frustum and is only refit once the camera leaves
+// it, so a moving camera does not redraw the map every frame. Returns true
+// when the map must be redrawn.
+//
+// void BeginShadowCascade(ShadowMap *shadow, int cascade)
+// void EndShadowCascades(void)
+//
+// Between BeginTextureMode(shadow.target) and EndTextureMode, set up the
+// viewport and the matrices of one tile before drawing the shadow casters.
+//
+// void SetShadowMapUniforms(ShadowMap *shadow, Shader shader)
+//
+// Sets the cascade uniforms read by shadowmap.fs.
+//
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdbool.h>
+
+#define MAX_SHADOW_CASCADES 4
+
+typedef struct ShadowCascade {
+    Vector3 center;         // Middle of the covered sphere
+    float radius;           // Radius of the covered sphere, padded
+    float texel;            // World size of a texel
+    float depth;            // World depth of the projection
+    Matrix view;
+    Matrix projection;
+    int refits;
+} ShadowCascade;
+
+typedef struct ShadowMap {
+    RenderTexture2D target;
+    int cascadeCount;
+    int resolution;         // Texels along a tile side
+    ShadowCascade cascades[MAX_SHADOW_CASCADES];
+    Vector3 lightDir;       // Light the cascades were fit for
+    int refits;
+} ShadowMap;
+
+ShadowMap LoadShadowMap(int cascadeCount, int resolution);
+void UnloadShadowMap(ShadowMap shadow);
+bool UpdateShadowMap(ShadowMap *shadow, Camera camera, float aspect, Vector3 lightDir, float innerRadius, float outerRadius);
+void BeginShadowCascade(ShadowMap *shadow, int cascade);
+void EndShadowCascades(void);
+void SetShadowMapUniforms(ShadowMap *shadow, Shader shader);
+
+#endif // SHADOW_H
+
+#ifdef SHADOW_IMPLEMENTATION
+
+#include <string.h>
+
+#ifndef SHADOW_FIT_ONLY
+#include <rlgl.h>
+#endif
+
+// Share of logarithmic over even spacing of the cascade splits
+#define SHADOW_SPLIT_LAMBDA 0.75f
+
+// How much larger than needed a cascade is fit, and how much smaller the
+// needed sphere may get before the cascade is fit again
+#define SHADOW_CASCADE_PADDING 1.25f
+#define SHADOW_CASCADE_SHRINK 0.5f
+
+#ifndef SHADOW_FIT_ONLY
+static RenderTexture2D LoadShadowmapTexture(int width, int height)
+{
+    RenderTexture2D target = { 0 };
+
+    target.id = rlLoadFramebuffer(width, height);
+    target.texture.width = width;
+    target.texture.height = height;
+
+    if (target.id > 0) {
+        rlEnableFramebuffer(target.id);
+
+        target.depth.id = rlLoadTextureDepth(width, height, false);
+        target.depth.width = width;
+        target.depth.height = height;
+        target.depth.format = 24;
+        target.depth.mipmaps = 1;
+
+        rlFramebufferAttach(target.id, target.depth.id, RL_ATTACHMENT_DEPTH, RL_ATTACHMENT_TEXTURE2D, 0);
+
+        if (rlFramebufferComplete(target.id))
+            TRACELOG(LOG_INFO, "FBO: [ID %i] Framebuffer object created successfully", target.id);
+
+        rlDisableFramebuffer();
+    }
+    else
+        TRACELOG(LOG_WARNING, "FBO: Framebuffer object can not be created");
+
+    return target;
+}
+#endif
+
+ShadowMap LoadShadowMap(int cascadeCount, int resolution)
+{
+    ShadowMap shadow = { 0 };
+    shadow.cascadeCount = Clamp(cascadeCount, 1, MAX_SHADOW_CASCADES);
+    shadow.resolution = resolution / sqrtf(shadow.cascadeCount);
+#ifndef SHADOW_FIT_ONLY
+    shadow.target = LoadShadowmapTexture(shadow.resolution * shadow.cascadeCount, shadow.resolution);
+#endif
+
+    return shadow;
+}
+
+void UnloadShadowMap(ShadowMap shadow)
+{
+#ifndef SHADOW_FIT_ONLY
+    if (shadow.target.id > 0) {
+        rlUnloadTexture(shadow.target.depth.id);
+        rlUnloadFramebuffer(shadow.target.id);
+    }
+#else
+    (void)shadow;
+#endif
+}
+
+// Smallest sphere around the part of the view frustum between the depths 'near' and 'far'
+static void GetFrustumSphere(Camera camera, float aspect, float near, float far, Vector3 *center, float *radius)
+{
+    Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+    float slope = tanf(camera.fovy * DEG2RAD / 2);
+
+    // Squared distance from the axis to the corners at each end
+    float nearCorner = near * near * slope * slope * (1 + aspect * aspect);
+    float farCorner = far * far * slope * slope * (1 + aspect * aspect);
+
+    // Along the axis, as far from the near corners as from the far ones
+    float middle = (far * far - near * near + farCorner - nearCorner) / (2 * (far - near));
+    middle = fminf(middle, far);
+
+    *center = Vector3Add(camera.position, Vector3Scale(forward, middle));
+    *radius = sqrtf((far - middle) * (far - middle) + farCorner);
+}
+
+// Sphere around the slice of a planet of 'planetRadius' at the origin between
+// the depths 'near' and 'far', which is round around the line through the
+// center along the view
+static void GetPlanetSliceSphere(Camera camera, float near, float far, float planetRadius, Vector3 *center, float *radius)
+{
+    Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+    float depth = -Vector3DotProduct(camera.position, forward);
+
+    float t0 = Clamp(near - depth, -planetRadius, planetRadius);
+    float t1 = Clamp(far - depth, -planetRadius, planetRadius);
+
+    // Centered on the widest disk of the slice, so the sphere reaches both ends
+    float t = Clamp(0, t0, t1);
+
+    *center = Vector3Scale(forward, t);
+    *radius = fmaxf(sqrtf((t - t0) * (t - t0) + planetRadius * planetRadius - t0 * t0),
+                    sqrtf((t1 - t) * (t1 - t) + planetRadius * planetRadius - t1 * t1));
+}
+
+// Light view and projection around the cascade sphere, deep enough for every
+// caster of the planet in front of it
+static void FitShadowCascade(ShadowCascade *cascade, int resolution, Vector3 lightDir, float outerRadius)
+{
+    Vector3 up = fabsf(lightDir.y) < 0.99f ? (Vector3){ 0, 1, 0 } : (Vector3){ 1, 0, 0 };
+    Matrix basis = MatrixLookAt(Vector3Zero(), lightDir, up);
+
+    // Snapped to whole texels across the light, so that shadow edges do not crawl after a refit
+    cascade->texel = cascade->radius * 2 / resolution;
+    Vector3 center = Vector3Transform(cascade->center, basis);
+    center.x = floorf(center.x / cascade->texel) * cascade->texel;
+    center.y = floorf(center.y / cascade->texel) * cascade->texel;
+    cascade->center = Vector3Transform(center, MatrixInvert(basis));
+
+    // The eye is outside the planet, so nothing between it and the cascade is clipped
+    float distance = Vector3Length(cascade->center) + outerRadius;
+    Vector3 eye = Vector3Subtract(cascade->center, Vector3Scale(lightDir, distance));
+
+    cascade->depth = distance + cascade->radius;
+    cascade->view = MatrixLookAt(eye, cascade->center, up);
+    cascade->projection = MatrixOrtho(-cascade->radius, cascade->radius, -cascade->radius, cascade->radius, 0, cascade->depth);
+}
+
+bool UpdateShadowMap(ShadowMap *shadow, Camera camera, float aspect, Vector3 lightDir, float innerRadius, float outerRadius)
+{
+    bool lightChanged = memcmp(&lightDir, &shadow->lightDir, sizeof(Vector3)) != 0;
+    shadow->lightDir = lightDir;
+
+    // Only the planet receives shadows: the view starts where it can first
+    // be hit and ends at the farthest terrain that can peek over the horizon
+    float distance = Vector3Length(camera.position);
+    float horizon = sqrtf(fmaxf(distance * distance - innerRadius * innerRadius, 0));
+    float near = fmaxf(distance - outerRadius, 0.01f);
+    float far = fmaxf(horizon + sqrtf(outerRadius * outerRadius - innerRadius * innerRadius), near * 1.01f);
+
+    bool refit = false;
+
+    for (int i = 0; i < shadow->cascadeCount; i++) {
+        ShadowCascade *cascade = &shadow->cascades[i];
+
+        float splits[2];
+        for (int k = 0; k < 2; k++) {
+            float t = (float)(i + k) / shadow->cascadeCount;
+            float logarithmic = near * powf(far / near, t);
+            float even = near + (far - near) * t;
+            splits[k] = Lerp(even, logarithmic, SHADOW_SPLIT_LAMBDA);
+        }
+
+        // The frustum is much wider than the planet when it is seen from afar
+        Vector3 center, sliceCenter;
+        float radius, sliceRadius;
+        GetFrustumSphere(camera, aspect, splits[0], splits[1], &center, &radius);
+        GetPlanetSliceSphere(camera, splits[0], splits[1], outerRadius, &sliceCenter, &sliceRadius);
+
+        if (sliceRadius < radius) {
+            center = sliceCenter;
+            radius = sliceRadius;
+        }
+
+        radius = fmaxf(radius, outerRadius * 0.01f);
+
+        bool inside = Vector3Distance(center, cascade->center) + radius <= cascade->radius;
+        bool tooLoose = radius < cascade->radius * SHADOW_CASCADE_SHRINK;
+
+        if (!lightChanged && cascade->radius > 0 && inside && !tooLoose)
+            continue;
+
+        // Padded on every cascade, the snapping below moves the center and the
+        // camera must be able to move a bit before the sphere leaves it
+        cascade->center = center;
+        cascade->radius = radius * SHADOW_CASCADE_PADDING;
+        FitShadowCascade(cascade, shadow->resolution, lightDir, outerRadius);
+
+        cascade->refits++;
+        shadow->refits++;
+        refit = true;
+    }
+
+    return refit;
+}
+
+#ifndef SHADOW_FIT_ONLY
+void BeginShadowCascade(ShadowMap *shadow, int cascade)
+{
+    rlDrawRenderBatchActive();
+
+    rlViewport(cascade * shadow->resolution, 0, shadow->resolution, shadow->resolution);
+    rlSetMatrixProjection(shadow->cascades[cascade].projection);
+    rlSetMatrixModelview(shadow->cascades[cascade].view);
+
+    rlEnableDepthTest();
+}
+
+// EndTextureMode restores the viewport and the matrices
+void EndShadowCascades(void)
+{
+    rlDrawRenderBatchActive();
+    rlDisableDepthTest();
+}
+
+void SetShadowMapUniforms(ShadowMap *shadow, Shader shader)
+{
+    float texels[MAX_SHADOW_CASCADES] = { 0 };
+    float depths[MAX_SHADOW_CASCADES] = { 0 };
+
+    for (int i = 0; i < shadow->cascadeCount; i++) {
+        const ShadowCascade *cascade = &shadow->cascades[i];
+        Matrix lightViewProj = MatrixMultiply(cascade->view, cascade->projection);
+        SetShaderValueMatrix(shader, GetShaderLocation(shader, TextFormat("lightVP[%d]", i)), lightViewProj);
+
+        texels[i] = cascade->texel;
+        depths[i] = cascade->depth;
+    }
+
+    SetShaderValue(shader, GetShaderLocation(shader, "cascadeCount"), &shadow->cascadeCount, SHADER_UNIFORM_INT);
+    SetShaderValue(shader, GetShaderLocation(shader, "shadowMapResolution"), &shadow->resolution, SHADER_UNIFORM_INT);
+    SetShaderValueV(shader, GetShaderLocation(shader, "cascadeTexel"), texels, SHADER_UNIFORM_FLOAT, shadow->cascadeCount);
+    SetShaderValueV(shader, GetShaderLocation(shader, "cascadeDepth"), depths, SHADER_UNIFORM_FLOAT, shadow->cascadeCount);
+}
+#endif
+
+#endif // SHADOW_IMPLEMENTATION
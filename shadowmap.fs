@@ -23,10 +23,15 @@ uniform vec4 ambient;
 uniform vec3 viewPos;
 
 // Input shadowmapping values
-uniform mat4 lightVP; // Light source view-projection matrix
+// The cascades are tiles side by side in shadowMap, from the closest to the farthest
+#define MAX_CASCADES 4
+uniform mat4 lightVP[MAX_CASCADES]; // Light source view-projection matrix of each cascade
+uniform float cascadeTexel[MAX_CASCADES]; // World size of a texel of each cascade
+uniform float cascadeDepth[MAX_CASCADES]; // World depth range of each cascade
+uniform int cascadeCount;
 uniform sampler2D shadowMap;
 
-uniform int shadowMapResolution;
+uniform int shadowMapResolution; // Texels along the side of a cascade
 
 void main()
 {
@@ -49,31 +54,48 @@ void main()
     finalColor = (texelColor*((colDiffuse + vec4(specular, 1.0))*vec4(lightDot, 1.0)));
 
     // Shadow calculations
-    vec4 fragPosLightSpace = lightVP * vec4(fragPosition, 1);
-    fragPosLightSpace.xyz /= fragPosLightSpace.w; // Perform the perspective division
-    fragPosLightSpace.xyz = (fragPosLightSpace.xyz + 1.0f) / 2.0f; // Transform from [-1, 1] range to [0, 1] range
-    vec2 sampleCoords = fragPosLightSpace.xy;
-    float curDepth = fragPosLightSpace.z;
-    // Slope-scale depth bias: depth biasing reduces "shadow acne" artifacts, where dark stripes appear all over the scene.
-    // The solution is adding a small bias to the depth
-    // In this case, the bias is proportional to the slope of the surface, relative to the light
-    //float bias = max(0.0002 * (1.0 - dot(normal, l)), 0.00002) + 0.00001;
-    float bias = max(0.002 * (1.0 - dot(normal, l)), 0.002) + 0.001;
+    // Pick the first (sharpest) cascade whose map covers the fragment, with room for the PCF samples
+    vec2 tileTexel = vec2(1.0f / float(shadowMapResolution));
+    int cascade = cascadeCount;
+    vec3 fragPosLightSpace = vec3(0.0);
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        vec4 lightSpace = lightVP[i] * vec4(fragPosition, 1);
+        lightSpace.xyz /= lightSpace.w; // Perform the perspective division
+        lightSpace.xyz = (lightSpace.xyz + 1.0f) / 2.0f; // Transform from [-1, 1] range to [0, 1] range
+        if (all(greaterThanEqual(lightSpace.xy, tileTexel*2.0)) && all(lessThanEqual(lightSpace.xy, 1.0 - tileTexel*2.0)))
+        {
+            cascade = i;
+            fragPosLightSpace = lightSpace.xyz;
+            break;
+        }
+    }
     int shadowCounter = 0;
     const int numSamples = 9;
-    // PCF (percentage-closer filtering) algorithm:
-    // Instead of testing if just one point is closer to the current point,
-    // we test the surrounding points as well.
-    // This blurs shadow edges, hiding aliasing artifacts.
-    vec2 texelSize = vec2(1.0f / float(shadowMapResolution));
-    for (int x = -1; x <= 1; x++)
+    if (cascade < cascadeCount)
     {
-        for (int y = -1; y <= 1; y++)
+        // Into the tile of the cascade
+        vec2 sampleCoords = vec2((fragPosLightSpace.x + float(cascade)) / float(cascadeCount), fragPosLightSpace.y);
+        float curDepth = fragPosLightSpace.z;
+        // Slope-scale depth bias: depth biasing reduces "shadow acne" artifacts, where dark stripes appear all over the scene.
+        // The solution is adding a small bias to the depth
+        // In this case, the bias is proportional to the slope of the surface, relative to the light,
+        // and measured in texels of the cascade, so every cascade gets the same amount
+        float bias = (1.5 + 2.0 * (1.0 - dot(normal, l))) * cascadeTexel[cascade] / cascadeDepth[cascade];
+        // PCF (percentage-closer filtering) algorithm:
+        // Instead of testing if just one point is closer to the current point,
+        // we test the surrounding points as well.
+        // This blurs shadow edges, hiding aliasing artifacts.
+        vec2 texelSize = vec2(1.0f / float(shadowMapResolution * cascadeCount), 1.0f / float(shadowMapResolution));
+        for (int x = -1; x <= 1; x++)
         {
-            float sampleDepth = texture(shadowMap, sampleCoords + texelSize * vec2(x, y)).r;
-            if (curDepth - bias > sampleDepth)
+            for (int y = -1; y <= 1; y++)
             {
-                shadowCounter++;
+                float sampleDepth = texture(shadowMap, sampleCoords + texelSize * vec2(x, y)).r;
+                if (curDepth - bias > sampleDepth)
+                {
+                    shadowCounter++;
+                }
             }
         }
     }
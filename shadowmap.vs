@@ -6,6 +6,13 @@ in vec2 vertexTexCoord;
 in vec3 vertexNormal;
 in vec4 vertexColor;
 
+// Per instance of DrawScene in scene.h: the model matrix, the noise
+// (radius, scale, lacunarity, gain), the octaves and seed, and the tint
+in mat4 instanceTransform;
+in vec4 instanceNoise;
+in vec4 instanceShape;
+in vec4 instanceTint;
+
 // Input uniform values
 uniform mat4 mvp;
 uniform mat4 matModel;
@@ -19,14 +26,195 @@ out vec3 fragNormal;
 
 // NOTE: Add here your custom variables
 
+// Vertices packed by packed.h: the octahedral direction and the height in
+// vertexPosition, the octahedral normal in vertexNormal.xy, and no color
+uniform int packedVertices;
+uniform float heightRange;
+uniform float planetRadius;
+
+// Displacement of a bare sphere mesh by the planet noise, see terrain.h
+#define COLOR_BANDS 6
+uniform int displace;
+uniform sampler2D noiseTable; // stb_perlin permutation in red, gradient index in green
+uniform float noiseScale;
+uniform float lacunarity;
+uniform float gain;
+uniform int octaves;
+uniform float bandHeights[COLOR_BANDS - 1];
+uniform vec4 bandColors[COLOR_BANDS];
+
+// Set while DrawScene draws, mvp is then only the view and projection
+uniform int instanced;
+
+const vec3 basis[12] = vec3[12](
+    vec3( 1, 1, 0), vec3(-1, 1, 0), vec3( 1,-1, 0), vec3(-1,-1, 0),
+    vec3( 1, 0, 1), vec3(-1, 0, 1), vec3( 1, 0,-1), vec3(-1, 0,-1),
+    vec3( 0, 1, 1), vec3( 0,-1, 1), vec3( 0, 1,-1), vec3( 0,-1,-1)
+);
+
+// From [0, 1] back to the folded octahedron of EncodeOctahedral in packed.h
+vec3 OctahedralDecode(vec2 e)
+{
+    vec2 f = e * 2.0 - 1.0;
+    vec3 v = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+
+    if (v.z < 0.0)
+    {
+        vec2 s = vec2(f.x >= 0.0 ? 1.0 : -1.0, f.y >= 0.0 ? 1.0 : -1.0);
+        v.xy = (1.0 - abs(f.yx)) * s;
+    }
+
+    return normalize(v);
+}
+
+// heightToColor in planet.h
+vec4 BandColor(float height)
+{
+    for (int i = 0; i < COLOR_BANDS - 1; i++)
+    {
+        if (height > bandHeights[i]) return bandColors[i];
+    }
+
+    return bandColors[COLOR_BANDS - 1];
+}
+
+int Permute(int i)
+{
+    return int(texelFetch(noiseTable, ivec2(i, 0), 0).r * 255.0 + 0.5);
+}
+
+vec3 Gradient(int i)
+{
+    return basis[int(texelFetch(noiseTable, ivec2(i, 0), 0).g * 255.0 + 0.5)];
+}
+
+// stb_perlin_noise3_deriv_internal without wrapping: the noise in x, its gradient in yzw
+vec4 PerlinNoise(vec3 p, int seed)
+{
+    vec3 cell = floor(p);
+    ivec3 i0 = ivec3(cell) & 255;
+    ivec3 i1 = (ivec3(cell) + 1) & 255;
+
+    vec3 f = p - cell;
+    vec3 e = ((f * 6.0 - 15.0) * f + 10.0) * f * f * f;
+    vec3 de = ((f - 1.0) * f) * ((f - 1.0) * f) * 30.0;
+
+    int r0 = Permute(i0.x + seed);
+    int r1 = Permute(i1.x + seed);
+    int r00 = Permute(r0 + i0.y);
+    int r01 = Permute(r0 + i1.y);
+    int r10 = Permute(r1 + i0.y);
+    int r11 = Permute(r1 + i1.y);
+
+    vec3 g000 = Gradient(r00 + i0.z);
+    vec3 g001 = Gradient(r00 + i1.z);
+    vec3 g010 = Gradient(r01 + i0.z);
+    vec3 g011 = Gradient(r01 + i1.z);
+    vec3 g100 = Gradient(r10 + i0.z);
+    vec3 g101 = Gradient(r10 + i1.z);
+    vec3 g110 = Gradient(r11 + i0.z);
+    vec3 g111 = Gradient(r11 + i1.z);
+
+    float n000 = dot(g000, f);
+    float n001 = dot(g001, f - vec3(0, 0, 1));
+    float n010 = dot(g010, f - vec3(0, 1, 0));
+    float n011 = dot(g011, f - vec3(0, 1, 1));
+    float n100 = dot(g100, f - vec3(1, 0, 0));
+    float n101 = dot(g101, f - vec3(1, 0, 1));
+    float n110 = dot(g110, f - vec3(1, 1, 0));
+    float n111 = dot(g111, f - vec3(1, 1, 1));
+
+    float n00 = mix(n000, n001, e.z);
+    float n01 = mix(n010, n011, e.z);
+    float n10 = mix(n100, n101, e.z);
+    float n11 = mix(n110, n111, e.z);
+
+    float n0 = mix(n00, n01, e.y);
+    float n1 = mix(n10, n11, e.y);
+
+    // The corner gradients interpolated like the values, plus the slope of the weights
+    vec3 d = mix(mix(mix(g000, g001, e.z), mix(g010, g011, e.z), e.y),
+                 mix(mix(g100, g101, e.z), mix(g110, g111, e.z), e.y), e.x);
+    d.x += (n1 - n0) * de.x;
+    d.y += mix(n01 - n00, n11 - n10, e.x) * de.y;
+    d.z += mix(mix(n001 - n000, n011 - n010, e.y), mix(n101 - n100, n111 - n110, e.y), e.x) * de.z;
+
+    return vec4(mix(n0, n1, e.x), d);
+}
+
+// stb_perlin_fbm_noise3_deriv, each octave seeded with its index
+vec4 FbmNoise(vec3 p, float lacunarity, float gain, int octaves)
+{
+    float frequency = 1.0;
+    float amplitude = 1.0;
+    vec4 sum = vec4(0.0);
+
+    for (int i = 0; i < octaves; i++)
+    {
+        vec4 n = PerlinNoise(p * frequency, i);
+        sum += vec4(n.x * amplitude, n.yzw * (amplitude * frequency));
+        frequency *= lacunarity;
+        amplitude *= gain;
+    }
+
+    return sum;
+}
+
 void main()
 {
+    vec3 position = vertexPosition;
+    vec3 normal = vertexNormal;
+    vec4 color = vertexColor;
+
+    if (packedVertices != 0)
+    {
+        vec3 direction = OctahedralDecode(vertexPosition.xy);
+        float height = (vertexPosition.z * 2.0 - 1.0) * heightRange;
+        position = direction * (planetRadius + height);
+        normal = OctahedralDecode(vertexNormal.xy);
+        color = BandColor(height);
+    }
+
+    float radius = planetRadius;
+    float scale = noiseScale;
+    vec4 noiseParams = vec4(lacunarity, gain, float(octaves), 0.0);
+    mat4 model = matModel;
+    mat3 normalMatrix = mat3(matNormal);
+
+    if (instanced != 0)
+    {
+        radius = instanceNoise.x;
+        scale = instanceNoise.y;
+        noiseParams = vec4(instanceNoise.zw, instanceShape.xy);
+        model = instanceTransform;
+        normalMatrix = mat3(instanceTransform);
+    }
+
+    if (displace != 0 || instanced != 0)
+    {
+        // Only the unseeded fBm matches GenerateMeshRows in planet.h: the seed
+        // offset is for the instanced bodies, which have no CPU mesh to match
+        vec3 direction = normalize(position);
+        vec3 offset = vec3(noiseParams.w * 17.0, noiseParams.w * 31.0, noiseParams.w * 47.0);
+        vec4 noise = FbmNoise(direction * radius / scale + offset, noiseParams.x, noiseParams.y, int(noiseParams.z));
+        position = direction * (radius + noise.x);
+
+        vec3 tangent = noise.yzw - direction * dot(noise.yzw, direction);
+        float slope = radius / (scale * (radius + noise.x));
+        normal = normalize(direction - tangent * slope);
+
+        color = BandColor(noise.x);
+    }
+
+    if (instanced != 0)
+        color *= instanceTint;
+
     // Send vertex attributes to fragment shader
-    fragPosition = vec3(matModel*vec4(vertexPosition, 1.0));
+    fragPosition = vec3(model*vec4(position, 1.0));
     fragTexCoord = vertexTexCoord;
-    fragColor = vertexColor;
-    fragNormal = normalize(vec3(matNormal*vec4(vertexNormal, 1.0)));
+    fragColor = color;
+    fragNormal = normalize(normalMatrix*normal);
 
-    // Calculate final vertex position
-    gl_Position = mvp*vec4(vertexPosition, 1.0);
+    // Calculate final vertex position, mvp already has the model but for the instances
+    gl_Position = instanced != 0 ? mvp*(model*vec4(position, 1.0)) : mvp*vec4(position, 1.0);
 }
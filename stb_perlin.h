@@ -68,6 +68,73 @@
 //     offset     =   1.0?  -- used to invert the ridges, may need to be larger, not sure
 //
 //
+// Noise with Derivatives:
+//
+// float stb_perlin_noise3_deriv(float x, float y, float z,
+//                               int x_wrap, int y_wrap, int z_wrap,
+//                               float *dx, float *dy, float *dz)
+//
+// Same value as stb_perlin_noise3, and writes its gradient to dx, dy, dz.
+// The gradient is computed from the same lattice lookups as the value, so
+// it costs a fraction of the 3 or more extra noise3 calls that finite
+// differences need, and it is exact rather than an approximation.
+//
+// float stb_perlin_ridge_noise3_deriv(float x, float y, float z,
+//                                     float lacunarity, float gain, float offset, int octaves,
+//                                     float *dx, float *dy, float *dz)
+//
+// float stb_perlin_fbm_noise3_deriv(float x, float y, float z,
+//                                   float lacunarity, float gain, int octaves,
+//                                   float *dx, float *dy, float *dz)
+//
+// float stb_perlin_turbulence_noise3_deriv(float x, float y, float z,
+//                                          float lacunarity, float gain, int octaves,
+//                                          float *dx, float *dy, float *dz)
+//
+// The fractal noise functions above with their gradient. Ridge and
+// turbulence take the absolute value of the noise, so their gradient jumps
+// where the noise crosses zero.
+//
+//
+// Batched Fractal Noise:
+//
+// void stb_perlin_fbm_noise3_batch(const float *x, const float *y, const float *z, float *out,
+//                                  int count, float lacunarity, float gain, int octaves)
+//
+// Evaluates stb_perlin_fbm_noise3 for 'count' points, writing the results
+// to 'out'. On x86 the points are processed 8 at a time with AVX2 or 4 at
+// a time with SSE2, picked at runtime; elsewhere it falls back to the scalar
+// function. The SIMD paths perform the same operations in the same order, so
+// they match the scalar results (up to floating point contraction settings).
+//
+// void stb_perlin_fbm_noise3_batch_simd(int simd, ...)
+//
+// As above, but uses at most the given STB_PERLIN_SIMD_* level, which is
+// useful to compare the implementations. stb_perlin_simd_support() returns
+// the best level available on the running CPU.
+//
+// void stb_perlin_fbm_noise3_deriv_batch(const float *x, const float *y, const float *z, float *out,
+//                                        float *dx, float *dy, float *dz,
+//                                        int count, float lacunarity, float gain, int octaves)
+//
+// As stb_perlin_fbm_noise3_batch, and also writes the gradient of the noise
+// at every point to 'dx', 'dy' and 'dz'. The gradient comes from the same
+// lattice lookups as the value, which is identical to the one written by
+// stb_perlin_fbm_noise3_batch. stb_perlin_fbm_noise3_deriv_batch_simd(int simd, ...)
+// picks the implementation like stb_perlin_fbm_noise3_batch_simd.
+//
+// Define STB_PERLIN_NO_SIMD to compile only the scalar fallback.
+//
+//
+// Lookup Tables:
+//
+// void stb_perlin_get_tables(unsigned char randtab[512], unsigned char grad_idx[512])
+//
+// Copies the permutation table and the gradient index of each of its
+// entries (into the 12 gradients (+-1,+-1,0), (+-1,0,+-1), (0,+-1,+-1), in
+// that order), to reproduce the noise elsewhere, e.g. in a shader.
+//
+//
 // Contributors:
 //    Jack Mott - additional noise functions
 //    Jordan Peck - seeded noise
@@ -83,6 +150,25 @@ extern float stb_perlin_ridge_noise3(float x, float y, float z, float lacunarity
 extern float stb_perlin_fbm_noise3(float x, float y, float z, float lacunarity, float gain, int octaves);
 extern float stb_perlin_turbulence_noise3(float x, float y, float z, float lacunarity, float gain, int octaves);
 extern float stb_perlin_noise3_wrap_nonpow2(float x, float y, float z, int x_wrap, int y_wrap, int z_wrap, unsigned char seed);
+
+extern float stb_perlin_noise3_deriv(float x, float y, float z, int x_wrap, int y_wrap, int z_wrap, float *dx, float *dy, float *dz);
+extern float stb_perlin_ridge_noise3_deriv(float x, float y, float z, float lacunarity, float gain, float offset, int octaves, float *dx, float *dy, float *dz);
+extern float stb_perlin_fbm_noise3_deriv(float x, float y, float z, float lacunarity, float gain, int octaves, float *dx, float *dy, float *dz);
+extern float stb_perlin_turbulence_noise3_deriv(float x, float y, float z, float lacunarity, float gain, int octaves, float *dx, float *dy, float *dz);
+
+enum
+{
+   STB_PERLIN_SIMD_SCALAR,
+   STB_PERLIN_SIMD_SSE2,
+   STB_PERLIN_SIMD_AVX2
+};
+
+extern int   stb_perlin_simd_support(void);
+extern void  stb_perlin_get_tables(unsigned char randtab[512], unsigned char grad_idx[512]);
+extern void  stb_perlin_fbm_noise3_batch(const float *x, const float *y, const float *z, float *out, int count, float lacunarity, float gain, int octaves);
+extern void  stb_perlin_fbm_noise3_batch_simd(int simd, const float *x, const float *y, const float *z, float *out, int count, float lacunarity, float gain, int octaves);
+extern void  stb_perlin_fbm_noise3_deriv_batch(const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz, int count, float lacunarity, float gain, int octaves);
+extern void  stb_perlin_fbm_noise3_deriv_batch_simd(int simd, const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz, int count, float lacunarity, float gain, int octaves);
 #ifdef __cplusplus
 }
 #endif
@@ -93,7 +179,8 @@ extern float stb_perlin_noise3_wrap_nonpow2(float x, float y, float z, int x_wra
 
 // not same permutation table as Perlin's reference to avoid copyright issues;
 // Perlin's table can be found at http://mrl.nyu.edu/~perlin/noise/
-static unsigned char stb__perlin_randtab[512] =
+// (padded so 32-bit gathers at any index stay inside the table)
+static unsigned char stb__perlin_randtab[512+4] =
 {
    23, 125, 161, 52, 103, 117, 70, 37, 247, 101, 203, 169, 124, 126, 44, 123,
    152, 238, 145, 45, 171, 114, 253, 10, 192, 136, 4, 157, 249, 30, 35, 72,
@@ -138,7 +225,7 @@ static unsigned char stb__perlin_randtab[512] =
 
 // this array is designed to match the previous implementation
 // of gradient hash: indices[stb__perlin_randtab[i]&63]
-static unsigned char stb__perlin_randtab_grad_idx[512] =
+static unsigned char stb__perlin_randtab_grad_idx[512+4] =
 {
     7, 9, 5, 0, 11, 1, 6, 9, 3, 9, 11, 1, 8, 10, 4, 7,
     8, 6, 1, 5, 3, 10, 9, 10, 0, 8, 4, 1, 5, 2, 7, 8,
@@ -188,25 +275,34 @@ static int stb__perlin_fastfloor(float a)
 }
 
 // different grad function from Perlin's, but easy to modify to match reference
+static float stb__perlin_basis[12][4] =
+{
+   {  1, 1, 0 },
+   { -1, 1, 0 },
+   {  1,-1, 0 },
+   { -1,-1, 0 },
+   {  1, 0, 1 },
+   { -1, 0, 1 },
+   {  1, 0,-1 },
+   { -1, 0,-1 },
+   {  0, 1, 1 },
+   {  0,-1, 1 },
+   {  0, 1,-1 },
+   {  0,-1,-1 },
+};
+
+void stb_perlin_get_tables(unsigned char randtab[512], unsigned char grad_idx[512])
+{
+   int i;
+   for (i = 0; i < 512; ++i) {
+      randtab[i] = stb__perlin_randtab[i];
+      grad_idx[i] = stb__perlin_randtab_grad_idx[i];
+   }
+}
+
 static float stb__perlin_grad(int grad_idx, float x, float y, float z)
 {
-   static float basis[12][4] =
-   {
-      {  1, 1, 0 },
-      { -1, 1, 0 },
-      {  1,-1, 0 },
-      { -1,-1, 0 },
-      {  1, 0, 1 },
-      { -1, 0, 1 },
-      {  1, 0,-1 },
-      { -1, 0,-1 },
-      {  0, 1, 1 },
-      {  0,-1, 1 },
-      {  0, 1,-1 },
-      {  0,-1,-1 },
-   };
-
-   float *grad = basis[grad_idx];
+   float *grad = stb__perlin_basis[grad_idx];
    return grad[0]*x + grad[1]*y + grad[2]*z;
 }
 
@@ -323,6 +419,624 @@ float stb_perlin_turbulence_noise3(float x, float y, float z, float lacunarity,
    return sum;
 }
 
+// derivative of stb__perlin_ease
+#define stb__perlin_ease_deriv(a)   (((a-1)*a) * ((a-1)*a) * 30)
+
+// stb_perlin_noise3_internal plus its gradient
+float stb_perlin_noise3_deriv_internal(float x, float y, float z, int x_wrap, int y_wrap, int z_wrap, unsigned char seed, float *dx, float *dy, float *dz)
+{
+   float u,v,w, du,dv,dw;
+   float n000,n001,n010,n011,n100,n101,n110,n111;
+   float n00,n01,n10,n11;
+   float n0,n1;
+   float d[3];
+   float *g[8];
+
+   unsigned int x_mask = (x_wrap-1) & 255;
+   unsigned int y_mask = (y_wrap-1) & 255;
+   unsigned int z_mask = (z_wrap-1) & 255;
+   int px = stb__perlin_fastfloor(x);
+   int py = stb__perlin_fastfloor(y);
+   int pz = stb__perlin_fastfloor(z);
+   int x0 = px & x_mask, x1 = (px+1) & x_mask;
+   int y0 = py & y_mask, y1 = (py+1) & y_mask;
+   int z0 = pz & z_mask, z1 = (pz+1) & z_mask;
+   int r0,r1, r00,r01,r10,r11;
+   int c;
+
+   x -= px; u = stb__perlin_ease(x); du = stb__perlin_ease_deriv(x);
+   y -= py; v = stb__perlin_ease(y); dv = stb__perlin_ease_deriv(y);
+   z -= pz; w = stb__perlin_ease(z); dw = stb__perlin_ease_deriv(z);
+
+   r0 = stb__perlin_randtab[x0+seed];
+   r1 = stb__perlin_randtab[x1+seed];
+
+   r00 = stb__perlin_randtab[r0+y0];
+   r01 = stb__perlin_randtab[r0+y1];
+   r10 = stb__perlin_randtab[r1+y0];
+   r11 = stb__perlin_randtab[r1+y1];
+
+   g[0] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r00+z0]];
+   g[1] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r00+z1]];
+   g[2] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r01+z0]];
+   g[3] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r01+z1]];
+   g[4] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r10+z0]];
+   g[5] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r10+z1]];
+   g[6] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r11+z0]];
+   g[7] = stb__perlin_basis[stb__perlin_randtab_grad_idx[r11+z1]];
+
+   n000 = g[0][0]*x     + g[0][1]*y     + g[0][2]*z;
+   n001 = g[1][0]*x     + g[1][1]*y     + g[1][2]*(z-1);
+   n010 = g[2][0]*x     + g[2][1]*(y-1) + g[2][2]*z;
+   n011 = g[3][0]*x     + g[3][1]*(y-1) + g[3][2]*(z-1);
+   n100 = g[4][0]*(x-1) + g[4][1]*y     + g[4][2]*z;
+   n101 = g[5][0]*(x-1) + g[5][1]*y     + g[5][2]*(z-1);
+   n110 = g[6][0]*(x-1) + g[6][1]*(y-1) + g[6][2]*z;
+   n111 = g[7][0]*(x-1) + g[7][1]*(y-1) + g[7][2]*(z-1);
+
+   n00 = stb__perlin_lerp(n000,n001,w);
+   n01 = stb__perlin_lerp(n010,n011,w);
+   n10 = stb__perlin_lerp(n100,n101,w);
+   n11 = stb__perlin_lerp(n110,n111,w);
+
+   n0 = stb__perlin_lerp(n00,n01,v);
+   n1 = stb__perlin_lerp(n10,n11,v);
+
+   // the corner gradients interpolated like the values, plus the slope of the weights
+   for (c = 0; c < 3; ++c) {
+      float d0 = stb__perlin_lerp(stb__perlin_lerp(g[0][c],g[1][c],w), stb__perlin_lerp(g[2][c],g[3][c],w), v);
+      float d1 = stb__perlin_lerp(stb__perlin_lerp(g[4][c],g[5][c],w), stb__perlin_lerp(g[6][c],g[7][c],w), v);
+      d[c] = stb__perlin_lerp(d0,d1,u);
+   }
+
+   *dx = d[0] + (n1-n0)*du;
+   *dy = d[1] + stb__perlin_lerp(n01-n00, n11-n10, u)*dv;
+   *dz = d[2] + stb__perlin_lerp(stb__perlin_lerp(n001-n000, n011-n010, v), stb__perlin_lerp(n101-n100, n111-n110, v), u)*dw;
+
+   return stb__perlin_lerp(n0,n1,u);
+}
+
+float stb_perlin_noise3_deriv(float x, float y, float z, int x_wrap, int y_wrap, int z_wrap, float *dx, float *dy, float *dz)
+{
+   return stb_perlin_noise3_deriv_internal(x,y,z,x_wrap,y_wrap,z_wrap,0,dx,dy,dz);
+}
+
+float stb_perlin_ridge_noise3_deriv(float x, float y, float z, float lacunarity, float gain, float offset, int octaves, float *dx, float *dy, float *dz)
+{
+   int i, c;
+   float frequency = 1.0f;
+   float prev = 1.0f;
+   float amplitude = 0.5f;
+   float sum = 0.0f;
+   float dprev[3] = { 0, 0, 0 };
+   float dsum[3] = { 0, 0, 0 };
+
+   for (i = 0; i < octaves; i++) {
+      float d[3];
+      float n = stb_perlin_noise3_deriv_internal(x*frequency,y*frequency,z*frequency,0,0,0,(unsigned char)i,&d[0],&d[1],&d[2]);
+      // slope of offset - |n| along the octave's own coordinates
+      float slope = n < 0 ? frequency : -frequency;
+      float r = offset - (float) fabs(n);
+      for (c = 0; c < 3; ++c) {
+         float dr = 2*r*slope*d[c];
+         dsum[c] += (dr*prev + r*r*dprev[c])*amplitude;
+         dprev[c] = dr;
+      }
+      r = r*r;
+      sum += r*amplitude*prev;
+      prev = r;
+      frequency *= lacunarity;
+      amplitude *= gain;
+   }
+   *dx = dsum[0];
+   *dy = dsum[1];
+   *dz = dsum[2];
+   return sum;
+}
+
+float stb_perlin_fbm_noise3_deriv(float x, float y, float z, float lacunarity, float gain, int octaves, float *dx, float *dy, float *dz)
+{
+   int i;
+   float frequency = 1.0f;
+   float amplitude = 1.0f;
+   float sum = 0.0f;
+
+   *dx = *dy = *dz = 0.0f;
+
+   for (i = 0; i < octaves; i++) {
+      float nx,ny,nz;
+      sum += stb_perlin_noise3_deriv_internal(x*frequency,y*frequency,z*frequency,0,0,0,(unsigned char)i,&nx,&ny,&nz)*amplitude;
+      // each octave is sampled at frequency times the point
+      *dx += nx*(amplitude*frequency);
+      *dy += ny*(amplitude*frequency);
+      *dz += nz*(amplitude*frequency);
+      frequency *= lacunarity;
+      amplitude *= gain;
+   }
+   return sum;
+}
+
+float stb_perlin_turbulence_noise3_deriv(float x, float y, float z, float lacunarity, float gain, int octaves, float *dx, float *dy, float *dz)
+{
+   int i;
+   float frequency = 1.0f;
+   float amplitude = 1.0f;
+   float sum = 0.0f;
+
+   *dx = *dy = *dz = 0.0f;
+
+   for (i = 0; i < octaves; i++) {
+      float nx,ny,nz;
+      float r = stb_perlin_noise3_deriv_internal(x*frequency,y*frequency,z*frequency,0,0,0,(unsigned char)i,&nx,&ny,&nz)*amplitude;
+      float slope = r < 0 ? -(amplitude*frequency) : amplitude*frequency;
+      sum += (float) fabs(r);
+      *dx += nx*slope;
+      *dy += ny*slope;
+      *dz += nz*slope;
+      frequency *= lacunarity;
+      amplitude *= gain;
+   }
+   return sum;
+}
+
+#if !defined(STB_PERLIN_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STB__PERLIN_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled per function and picked at runtime, which needs gcc/clang
+#if defined(STB__PERLIN_SSE2) && defined(__GNUC__)
+#define STB__PERLIN_AVX2
+#define STB__PERLIN_AVX2_FUNC __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+#ifdef STB__PERLIN_SSE2
+
+static __m128i stb__perlin_fastfloor_sse2(__m128 a)
+{
+   __m128i ai = _mm_cvttps_epi32(a);
+   // the compare mask is -1 where a < ai
+   return _mm_add_epi32(ai, _mm_castps_si128(_mm_cmplt_ps(a, _mm_cvtepi32_ps(ai))));
+}
+
+static __m128 stb__perlin_ease_sse2(__m128 a)
+{
+   __m128 e = _mm_sub_ps(_mm_mul_ps(a, _mm_set1_ps(6)), _mm_set1_ps(15));
+   e = _mm_add_ps(_mm_mul_ps(e, a), _mm_set1_ps(10));
+   return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(e, a), a), a);
+}
+
+static __m128 stb__perlin_lerp_sse2(__m128 a, __m128 b, __m128 t)
+{
+   return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// same basis as stb__perlin_grad, decoded from the index bits:
+//   x is used for 0..7, y for 0..3 and 8..11, z for 4..11
+//   x takes its sign from bit 0, y from bit 1 below 4 and bit 0 above 7, z from bit 1
+static __m128 stb__perlin_grad_sse2(__m128i g, __m128 x, __m128 y, __m128 z)
+{
+   __m128i lo8  = _mm_cmplt_epi32(g, _mm_set1_epi32(8));
+   __m128i lo4  = _mm_cmplt_epi32(g, _mm_set1_epi32(4));
+   __m128i mid  = _mm_andnot_si128(lo4, lo8);
+   __m128i sign0 = _mm_slli_epi32(g, 31);
+   __m128i sign1 = _mm_slli_epi32(_mm_srli_epi32(g, 1), 31);
+   __m128i signy = _mm_or_si128(_mm_and_si128(lo4, sign1), _mm_andnot_si128(lo4, sign0));
+
+   __m128 gx = _mm_and_ps(_mm_castsi128_ps(lo8), _mm_xor_ps(x, _mm_castsi128_ps(sign0)));
+   __m128 gy = _mm_andnot_ps(_mm_castsi128_ps(mid), _mm_xor_ps(y, _mm_castsi128_ps(signy)));
+   __m128 gz = _mm_andnot_ps(_mm_castsi128_ps(lo4), _mm_xor_ps(z, _mm_castsi128_ps(sign1)));
+
+   return _mm_add_ps(_mm_add_ps(gx, gy), gz);
+}
+
+// the gradient vector itself, decoded like stb__perlin_grad_sse2
+static void stb__perlin_grad_vector_sse2(__m128i g, __m128 *d)
+{
+   __m128 one = _mm_set1_ps(1);
+   __m128i lo8  = _mm_cmplt_epi32(g, _mm_set1_epi32(8));
+   __m128i lo4  = _mm_cmplt_epi32(g, _mm_set1_epi32(4));
+   __m128i mid  = _mm_andnot_si128(lo4, lo8);
+   __m128i sign0 = _mm_slli_epi32(g, 31);
+   __m128i sign1 = _mm_slli_epi32(_mm_srli_epi32(g, 1), 31);
+   __m128i signy = _mm_or_si128(_mm_and_si128(lo4, sign1), _mm_andnot_si128(lo4, sign0));
+
+   d[0] = _mm_and_ps(_mm_castsi128_ps(lo8), _mm_xor_ps(one, _mm_castsi128_ps(sign0)));
+   d[1] = _mm_andnot_ps(_mm_castsi128_ps(mid), _mm_xor_ps(one, _mm_castsi128_ps(signy)));
+   d[2] = _mm_andnot_ps(_mm_castsi128_ps(lo4), _mm_xor_ps(one, _mm_castsi128_ps(sign1)));
+}
+
+static __m128 stb__perlin_ease_deriv_sse2(__m128 a)
+{
+   __m128 e = _mm_mul_ps(_mm_sub_ps(a, _mm_set1_ps(1)), a);
+   return _mm_mul_ps(_mm_mul_ps(e, e), _mm_set1_ps(30));
+}
+
+// also writes the gradient to 'grad' unless it is NULL, see stb_perlin_noise3_deriv_internal
+static __m128 stb__perlin_noise3_sse2(__m128 x, __m128 y, __m128 z, unsigned char seed, __m128 *grad)
+{
+   __m128 u,v,w, x1,y1,z1, one = _mm_set1_ps(1);
+   __m128 n000,n001,n010,n011,n100,n101,n110,n111;
+   __m128 n00,n01,n10,n11;
+   __m128 n0,n1;
+   __m128i mask = _mm_set1_epi32(255);
+   __m128i g[8];
+   int xi[2][4], yi[2][4], zi[2][4], gi[8][4];
+   int lane, c;
+
+   __m128i px = stb__perlin_fastfloor_sse2(x);
+   __m128i py = stb__perlin_fastfloor_sse2(y);
+   __m128i pz = stb__perlin_fastfloor_sse2(z);
+
+   _mm_storeu_si128((__m128i *) xi[0], _mm_and_si128(px, mask));
+   _mm_storeu_si128((__m128i *) xi[1], _mm_and_si128(_mm_add_epi32(px, _mm_set1_epi32(1)), mask));
+   _mm_storeu_si128((__m128i *) yi[0], _mm_and_si128(py, mask));
+   _mm_storeu_si128((__m128i *) yi[1], _mm_and_si128(_mm_add_epi32(py, _mm_set1_epi32(1)), mask));
+   _mm_storeu_si128((__m128i *) zi[0], _mm_and_si128(pz, mask));
+   _mm_storeu_si128((__m128i *) zi[1], _mm_and_si128(_mm_add_epi32(pz, _mm_set1_epi32(1)), mask));
+
+   // SSE2 has no gathers, so the hashing is done lane by lane
+   for (lane = 0; lane < 4; ++lane) {
+      int r0 = stb__perlin_randtab[xi[0][lane]+seed];
+      int r1 = stb__perlin_randtab[xi[1][lane]+seed];
+      int r00 = stb__perlin_randtab[r0+yi[0][lane]];
+      int r01 = stb__perlin_randtab[r0+yi[1][lane]];
+      int r10 = stb__perlin_randtab[r1+yi[0][lane]];
+      int r11 = stb__perlin_randtab[r1+yi[1][lane]];
+      gi[0][lane] = stb__perlin_randtab_grad_idx[r00+zi[0][lane]];
+      gi[1][lane] = stb__perlin_randtab_grad_idx[r00+zi[1][lane]];
+      gi[2][lane] = stb__perlin_randtab_grad_idx[r01+zi[0][lane]];
+      gi[3][lane] = stb__perlin_randtab_grad_idx[r01+zi[1][lane]];
+      gi[4][lane] = stb__perlin_randtab_grad_idx[r10+zi[0][lane]];
+      gi[5][lane] = stb__perlin_randtab_grad_idx[r10+zi[1][lane]];
+      gi[6][lane] = stb__perlin_randtab_grad_idx[r11+zi[0][lane]];
+      gi[7][lane] = stb__perlin_randtab_grad_idx[r11+zi[1][lane]];
+   }
+
+   for (c = 0; c < 8; ++c)
+      g[c] = _mm_loadu_si128((const __m128i *) gi[c]);
+
+   x = _mm_sub_ps(x, _mm_cvtepi32_ps(px)); u = stb__perlin_ease_sse2(x);
+   y = _mm_sub_ps(y, _mm_cvtepi32_ps(py)); v = stb__perlin_ease_sse2(y);
+   z = _mm_sub_ps(z, _mm_cvtepi32_ps(pz)); w = stb__perlin_ease_sse2(z);
+   x1 = _mm_sub_ps(x, one);
+   y1 = _mm_sub_ps(y, one);
+   z1 = _mm_sub_ps(z, one);
+
+   n000 = stb__perlin_grad_sse2(g[0], x , y , z );
+   n001 = stb__perlin_grad_sse2(g[1], x , y , z1);
+   n010 = stb__perlin_grad_sse2(g[2], x , y1, z );
+   n011 = stb__perlin_grad_sse2(g[3], x , y1, z1);
+   n100 = stb__perlin_grad_sse2(g[4], x1, y , z );
+   n101 = stb__perlin_grad_sse2(g[5], x1, y , z1);
+   n110 = stb__perlin_grad_sse2(g[6], x1, y1, z );
+   n111 = stb__perlin_grad_sse2(g[7], x1, y1, z1);
+
+   n00 = stb__perlin_lerp_sse2(n000,n001,w);
+   n01 = stb__perlin_lerp_sse2(n010,n011,w);
+   n10 = stb__perlin_lerp_sse2(n100,n101,w);
+   n11 = stb__perlin_lerp_sse2(n110,n111,w);
+
+   n0 = stb__perlin_lerp_sse2(n00,n01,v);
+   n1 = stb__perlin_lerp_sse2(n10,n11,v);
+
+   if (grad) {
+      __m128 d[8][3];
+      for (c = 0; c < 8; ++c)
+         stb__perlin_grad_vector_sse2(g[c], d[c]);
+
+      for (c = 0; c < 3; ++c) {
+         __m128 d0 = stb__perlin_lerp_sse2(stb__perlin_lerp_sse2(d[0][c],d[1][c],w), stb__perlin_lerp_sse2(d[2][c],d[3][c],w), v);
+         __m128 d1 = stb__perlin_lerp_sse2(stb__perlin_lerp_sse2(d[4][c],d[5][c],w), stb__perlin_lerp_sse2(d[6][c],d[7][c],w), v);
+         grad[c] = stb__perlin_lerp_sse2(d0,d1,u);
+      }
+
+      grad[0] = _mm_add_ps(grad[0], _mm_mul_ps(_mm_sub_ps(n1,n0), stb__perlin_ease_deriv_sse2(x)));
+      grad[1] = _mm_add_ps(grad[1], _mm_mul_ps(stb__perlin_lerp_sse2(_mm_sub_ps(n01,n00), _mm_sub_ps(n11,n10), u), stb__perlin_ease_deriv_sse2(y)));
+      grad[2] = _mm_add_ps(grad[2], _mm_mul_ps(stb__perlin_lerp_sse2(
+         stb__perlin_lerp_sse2(_mm_sub_ps(n001,n000), _mm_sub_ps(n011,n010), v),
+         stb__perlin_lerp_sse2(_mm_sub_ps(n101,n100), _mm_sub_ps(n111,n110), v), u), stb__perlin_ease_deriv_sse2(z)));
+   }
+
+   return stb__perlin_lerp_sse2(n0,n1,u);
+}
+
+// returns how many points were processed, always a multiple of 4
+// the gradient is only computed when 'dx' is not NULL
+static int stb__perlin_fbm_noise3_sse2(const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz, int count, float lacunarity, float gain, int octaves)
+{
+   int i, o;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      __m128 px = _mm_loadu_ps(x + i);
+      __m128 py = _mm_loadu_ps(y + i);
+      __m128 pz = _mm_loadu_ps(z + i);
+      __m128 sum = _mm_setzero_ps();
+      __m128 dsum[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+      float frequency = 1.0f;
+      float amplitude = 1.0f;
+
+      for (o = 0; o < octaves; o++) {
+         __m128 f = _mm_set1_ps(frequency);
+         __m128 d[3];
+         __m128 n = stb__perlin_noise3_sse2(_mm_mul_ps(px, f), _mm_mul_ps(py, f), _mm_mul_ps(pz, f), (unsigned char)o, dx ? d : NULL);
+         sum = _mm_add_ps(sum, _mm_mul_ps(n, _mm_set1_ps(amplitude)));
+         if (dx) {
+            __m128 a = _mm_set1_ps(amplitude*frequency);
+            dsum[0] = _mm_add_ps(dsum[0], _mm_mul_ps(d[0], a));
+            dsum[1] = _mm_add_ps(dsum[1], _mm_mul_ps(d[1], a));
+            dsum[2] = _mm_add_ps(dsum[2], _mm_mul_ps(d[2], a));
+         }
+         frequency *= lacunarity;
+         amplitude *= gain;
+      }
+
+      _mm_storeu_ps(out + i, sum);
+      if (dx) {
+         _mm_storeu_ps(dx + i, dsum[0]);
+         _mm_storeu_ps(dy + i, dsum[1]);
+         _mm_storeu_ps(dz + i, dsum[2]);
+      }
+   }
+   return i;
+}
+
+#endif // STB__PERLIN_SSE2
+
+#ifdef STB__PERLIN_AVX2
+
+STB__PERLIN_AVX2_FUNC static __m256i stb__perlin_fastfloor_avx2(__m256 a)
+{
+   __m256i ai = _mm256_cvttps_epi32(a);
+   return _mm256_add_epi32(ai, _mm256_castps_si256(_mm256_cmp_ps(a, _mm256_cvtepi32_ps(ai), _CMP_LT_OQ)));
+}
+
+STB__PERLIN_AVX2_FUNC static __m256 stb__perlin_ease_avx2(__m256 a)
+{
+   __m256 e = _mm256_sub_ps(_mm256_mul_ps(a, _mm256_set1_ps(6)), _mm256_set1_ps(15));
+   e = _mm256_add_ps(_mm256_mul_ps(e, a), _mm256_set1_ps(10));
+   return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(e, a), a), a);
+}
+
+STB__PERLIN_AVX2_FUNC static __m256 stb__perlin_lerp_avx2(__m256 a, __m256 b, __m256 t)
+{
+   return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+// see stb__perlin_grad_sse2
+STB__PERLIN_AVX2_FUNC static __m256 stb__perlin_grad_avx2(__m256i g, __m256 x, __m256 y, __m256 z)
+{
+   __m256i lo8  = _mm256_cmpgt_epi32(_mm256_set1_epi32(8), g);
+   __m256i lo4  = _mm256_cmpgt_epi32(_mm256_set1_epi32(4), g);
+   __m256i mid  = _mm256_andnot_si256(lo4, lo8);
+   __m256i sign0 = _mm256_slli_epi32(g, 31);
+   __m256i sign1 = _mm256_slli_epi32(_mm256_srli_epi32(g, 1), 31);
+   __m256i signy = _mm256_blendv_epi8(sign0, sign1, lo4);
+
+   __m256 gx = _mm256_and_ps(_mm256_castsi256_ps(lo8), _mm256_xor_ps(x, _mm256_castsi256_ps(sign0)));
+   __m256 gy = _mm256_andnot_ps(_mm256_castsi256_ps(mid), _mm256_xor_ps(y, _mm256_castsi256_ps(signy)));
+   __m256 gz = _mm256_andnot_ps(_mm256_castsi256_ps(lo4), _mm256_xor_ps(z, _mm256_castsi256_ps(sign1)));
+
+   return _mm256_add_ps(_mm256_add_ps(gx, gy), gz);
+}
+
+// see stb__perlin_grad_vector_sse2
+STB__PERLIN_AVX2_FUNC static void stb__perlin_grad_vector_avx2(__m256i g, __m256 *d)
+{
+   __m256 one = _mm256_set1_ps(1);
+   __m256i lo8  = _mm256_cmpgt_epi32(_mm256_set1_epi32(8), g);
+   __m256i lo4  = _mm256_cmpgt_epi32(_mm256_set1_epi32(4), g);
+   __m256i mid  = _mm256_andnot_si256(lo4, lo8);
+   __m256i sign0 = _mm256_slli_epi32(g, 31);
+   __m256i sign1 = _mm256_slli_epi32(_mm256_srli_epi32(g, 1), 31);
+   __m256i signy = _mm256_blendv_epi8(sign0, sign1, lo4);
+
+   d[0] = _mm256_and_ps(_mm256_castsi256_ps(lo8), _mm256_xor_ps(one, _mm256_castsi256_ps(sign0)));
+   d[1] = _mm256_andnot_ps(_mm256_castsi256_ps(mid), _mm256_xor_ps(one, _mm256_castsi256_ps(signy)));
+   d[2] = _mm256_andnot_ps(_mm256_castsi256_ps(lo4), _mm256_xor_ps(one, _mm256_castsi256_ps(sign1)));
+}
+
+STB__PERLIN_AVX2_FUNC static __m256 stb__perlin_ease_deriv_avx2(__m256 a)
+{
+   __m256 e = _mm256_mul_ps(_mm256_sub_ps(a, _mm256_set1_ps(1)), a);
+   return _mm256_mul_ps(_mm256_mul_ps(e, e), _mm256_set1_ps(30));
+}
+
+// byte table lookup through a 32-bit gather, relying on the table padding
+#define stb__perlin_gather_avx2(table, idx) \
+   _mm256_and_si256(_mm256_i32gather_epi32((const int *) (table), (idx), 1), _mm256_set1_epi32(255))
+
+// see stb__perlin_noise3_sse2
+STB__PERLIN_AVX2_FUNC static __m256 stb__perlin_noise3_avx2(__m256 x, __m256 y, __m256 z, unsigned char seed, __m256 *grad)
+{
+   __m256 u,v,w, x1,y1,z1, one = _mm256_set1_ps(1);
+   __m256 n000,n001,n010,n011,n100,n101,n110,n111;
+   __m256 n00,n01,n10,n11;
+   __m256 n0,n1;
+   __m256i mask = _mm256_set1_epi32(255);
+   __m256i ione = _mm256_set1_epi32(1);
+   __m256i r0,r1, r00,r01,r10,r11;
+   __m256i g[8];
+   int c;
+
+   __m256i px = stb__perlin_fastfloor_avx2(x);
+   __m256i py = stb__perlin_fastfloor_avx2(y);
+   __m256i pz = stb__perlin_fastfloor_avx2(z);
+   __m256i x0 = _mm256_and_si256(px, mask), x1i = _mm256_and_si256(_mm256_add_epi32(px, ione), mask);
+   __m256i y0 = _mm256_and_si256(py, mask), y1i = _mm256_and_si256(_mm256_add_epi32(py, ione), mask);
+   __m256i z0 = _mm256_and_si256(pz, mask), z1i = _mm256_and_si256(_mm256_add_epi32(pz, ione), mask);
+   __m256i s = _mm256_set1_epi32(seed);
+
+   r0 = stb__perlin_gather_avx2(stb__perlin_randtab, _mm256_add_epi32(x0, s));
+   r1 = stb__perlin_gather_avx2(stb__perlin_randtab, _mm256_add_epi32(x1i, s));
+
+   r00 = stb__perlin_gather_avx2(stb__perlin_randtab, _mm256_add_epi32(r0, y0));
+   r01 = stb__perlin_gather_avx2(stb__perlin_randtab, _mm256_add_epi32(r0, y1i));
+   r10 = stb__perlin_gather_avx2(stb__perlin_randtab, _mm256_add_epi32(r1, y0));
+   r11 = stb__perlin_gather_avx2(stb__perlin_randtab, _mm256_add_epi32(r1, y1i));
+
+   x = _mm256_sub_ps(x, _mm256_cvtepi32_ps(px)); u = stb__perlin_ease_avx2(x);
+   y = _mm256_sub_ps(y, _mm256_cvtepi32_ps(py)); v = stb__perlin_ease_avx2(y);
+   z = _mm256_sub_ps(z, _mm256_cvtepi32_ps(pz)); w = stb__perlin_ease_avx2(z);
+   x1 = _mm256_sub_ps(x, one);
+   y1 = _mm256_sub_ps(y, one);
+   z1 = _mm256_sub_ps(z, one);
+
+   g[0] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r00, z0 ));
+   g[1] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r00, z1i));
+   g[2] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r01, z0 ));
+   g[3] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r01, z1i));
+   g[4] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r10, z0 ));
+   g[5] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r10, z1i));
+   g[6] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r11, z0 ));
+   g[7] = stb__perlin_gather_avx2(stb__perlin_randtab_grad_idx, _mm256_add_epi32(r11, z1i));
+
+   n000 = stb__perlin_grad_avx2(g[0], x , y , z );
+   n001 = stb__perlin_grad_avx2(g[1], x , y , z1);
+   n010 = stb__perlin_grad_avx2(g[2], x , y1, z );
+   n011 = stb__perlin_grad_avx2(g[3], x , y1, z1);
+   n100 = stb__perlin_grad_avx2(g[4], x1, y , z );
+   n101 = stb__perlin_grad_avx2(g[5], x1, y , z1);
+   n110 = stb__perlin_grad_avx2(g[6], x1, y1, z );
+   n111 = stb__perlin_grad_avx2(g[7], x1, y1, z1);
+
+   n00 = stb__perlin_lerp_avx2(n000,n001,w);
+   n01 = stb__perlin_lerp_avx2(n010,n011,w);
+   n10 = stb__perlin_lerp_avx2(n100,n101,w);
+   n11 = stb__perlin_lerp_avx2(n110,n111,w);
+
+   n0 = stb__perlin_lerp_avx2(n00,n01,v);
+   n1 = stb__perlin_lerp_avx2(n10,n11,v);
+
+   if (grad) {
+      __m256 d[8][3];
+      for (c = 0; c < 8; ++c)
+         stb__perlin_grad_vector_avx2(g[c], d[c]);
+
+      for (c = 0; c < 3; ++c) {
+         __m256 d0 = stb__perlin_lerp_avx2(stb__perlin_lerp_avx2(d[0][c],d[1][c],w), stb__perlin_lerp_avx2(d[2][c],d[3][c],w), v);
+         __m256 d1 = stb__perlin_lerp_avx2(stb__perlin_lerp_avx2(d[4][c],d[5][c],w), stb__perlin_lerp_avx2(d[6][c],d[7][c],w), v);
+         grad[c] = stb__perlin_lerp_avx2(d0,d1,u);
+      }
+
+      grad[0] = _mm256_add_ps(grad[0], _mm256_mul_ps(_mm256_sub_ps(n1,n0), stb__perlin_ease_deriv_avx2(x)));
+      grad[1] = _mm256_add_ps(grad[1], _mm256_mul_ps(stb__perlin_lerp_avx2(_mm256_sub_ps(n01,n00), _mm256_sub_ps(n11,n10), u), stb__perlin_ease_deriv_avx2(y)));
+      grad[2] = _mm256_add_ps(grad[2], _mm256_mul_ps(stb__perlin_lerp_avx2(
+         stb__perlin_lerp_avx2(_mm256_sub_ps(n001,n000), _mm256_sub_ps(n011,n010), v),
+         stb__perlin_lerp_avx2(_mm256_sub_ps(n101,n100), _mm256_sub_ps(n111,n110), v), u), stb__perlin_ease_deriv_avx2(z)));
+   }
+
+   return stb__perlin_lerp_avx2(n0,n1,u);
+}
+
+// returns how many points were processed, always a multiple of 8
+// the gradient is only computed when 'dx' is not NULL
+STB__PERLIN_AVX2_FUNC static int stb__perlin_fbm_noise3_avx2(const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz, int count, float lacunarity, float gain, int octaves)
+{
+   int i, o;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      __m256 px = _mm256_loadu_ps(x + i);
+      __m256 py = _mm256_loadu_ps(y + i);
+      __m256 pz = _mm256_loadu_ps(z + i);
+      __m256 sum = _mm256_setzero_ps();
+      __m256 dsum[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+      float frequency = 1.0f;
+      float amplitude = 1.0f;
+
+      for (o = 0; o < octaves; o++) {
+         __m256 f = _mm256_set1_ps(frequency);
+         __m256 d[3];
+         __m256 n = stb__perlin_noise3_avx2(_mm256_mul_ps(px, f), _mm256_mul_ps(py, f), _mm256_mul_ps(pz, f), (unsigned char)o, dx ? d : NULL);
+         sum = _mm256_add_ps(sum, _mm256_mul_ps(n, _mm256_set1_ps(amplitude)));
+         if (dx) {
+            __m256 a = _mm256_set1_ps(amplitude*frequency);
+            dsum[0] = _mm256_add_ps(dsum[0], _mm256_mul_ps(d[0], a));
+            dsum[1] = _mm256_add_ps(dsum[1], _mm256_mul_ps(d[1], a));
+            dsum[2] = _mm256_add_ps(dsum[2], _mm256_mul_ps(d[2], a));
+         }
+         frequency *= lacunarity;
+         amplitude *= gain;
+      }
+
+      _mm256_storeu_ps(out + i, sum);
+      if (dx) {
+         _mm256_storeu_ps(dx + i, dsum[0]);
+         _mm256_storeu_ps(dy + i, dsum[1]);
+         _mm256_storeu_ps(dz + i, dsum[2]);
+      }
+   }
+   return i;
+}
+
+#endif // STB__PERLIN_AVX2
+
+int stb_perlin_simd_support(void)
+{
+#ifdef STB__PERLIN_AVX2
+   if (__builtin_cpu_supports("avx2"))
+      return STB_PERLIN_SIMD_AVX2;
+#endif
+#ifdef STB__PERLIN_SSE2
+   return STB_PERLIN_SIMD_SSE2;
+#else
+   return STB_PERLIN_SIMD_SCALAR;
+#endif
+}
+
+void stb_perlin_fbm_noise3_batch_simd(int simd, const float *x, const float *y, const float *z, float *out, int count, float lacunarity, float gain, int octaves)
+{
+   int i = 0;
+   int support = stb_perlin_simd_support();
+
+   if (simd > support)
+      simd = support;
+
+#ifdef STB__PERLIN_AVX2
+   if (simd >= STB_PERLIN_SIMD_AVX2)
+      i += stb__perlin_fbm_noise3_avx2(x+i, y+i, z+i, out+i, NULL, NULL, NULL, count-i, lacunarity, gain, octaves);
+#endif
+#ifdef STB__PERLIN_SSE2
+   if (simd >= STB_PERLIN_SIMD_SSE2)
+      i += stb__perlin_fbm_noise3_sse2(x+i, y+i, z+i, out+i, NULL, NULL, NULL, count-i, lacunarity, gain, octaves);
+#endif
+
+   for (; i < count; i++)
+      out[i] = stb_perlin_fbm_noise3(x[i], y[i], z[i], lacunarity, gain, octaves);
+}
+
+void stb_perlin_fbm_noise3_batch(const float *x, const float *y, const float *z, float *out, int count, float lacunarity, float gain, int octaves)
+{
+   stb_perlin_fbm_noise3_batch_simd(STB_PERLIN_SIMD_AVX2, x, y, z, out, count, lacunarity, gain, octaves);
+}
+
+void stb_perlin_fbm_noise3_deriv_batch_simd(int simd, const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz, int count, float lacunarity, float gain, int octaves)
+{
+   int i = 0;
+   int support = stb_perlin_simd_support();
+
+   if (simd > support)
+      simd = support;
+
+#ifdef STB__PERLIN_AVX2
+   if (simd >= STB_PERLIN_SIMD_AVX2)
+      i += stb__perlin_fbm_noise3_avx2(x+i, y+i, z+i, out+i, dx+i, dy+i, dz+i, count-i, lacunarity, gain, octaves);
+#endif
+#ifdef STB__PERLIN_SSE2
+   if (simd >= STB_PERLIN_SIMD_SSE2)
+      i += stb__perlin_fbm_noise3_sse2(x+i, y+i, z+i, out+i, dx+i, dy+i, dz+i, count-i, lacunarity, gain, octaves);
+#endif
+
+   for (; i < count; i++)
+      out[i] = stb_perlin_fbm_noise3_deriv(x[i], y[i], z[i], lacunarity, gain, octaves, &dx[i], &dy[i], &dz[i]);
+}
+
+void stb_perlin_fbm_noise3_deriv_batch(const float *x, const float *y, const float *z, float *out, float *dx, float *dy, float *dz, int count, float lacunarity, float gain, int octaves)
+{
+   stb_perlin_fbm_noise3_deriv_batch_simd(STB_PERLIN_SIMD_AVX2, x, y, z, out, dx, dy, dz, count, lacunarity, gain, octaves);
+}
+
 float stb_perlin_noise3_wrap_nonpow2(float x, float y, float z, int x_wrap, int y_wrap, int z_wrap, unsigned char seed)
 {
    float u,v,w;
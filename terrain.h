@@ -0,0 +1,108 @@
+// terrain.h - displacement of the planet in the vertex shader
+//
+// to create the implementation,
+//     #define TERRAIN_IMPLEMENTATION
+// in *one* C file that includes this file.
+//
+// stb_perlin.h and planet.h must be included before this file. Needs the
+// raylib library, the calls must come from the thread that owns the GL context.
+//
+//
+// Documentation:
+//
+// ChunkedMesh GenerateBaseSphereMesh(WorkerPool *pool, PlanetParams params)
+//
+// Generates the layout of 'params' without noise: a sphere of params.radius
+// that shadowmap.vs displaces. It only changes with the layout, so editing
+// the noise parameters costs a few uniforms instead of a new mesh.
+//
+// Texture2D LoadNoiseTableTexture(void)
+//
+// Uploads the stb_perlin lookup tables as a 512 x 1 texture, read by
+// shadowmap.vs to evaluate the same noise as the CPU.
+//
+// void SetTerrainShaderParams(Shader shader, bool displace, PlanetParams params)
+//
+// Turns the displacement in the shader on or off and sets the noise and
+// color band uniforms. The CPU generated meshes are drawn with it off.
+//
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <stdbool.h>
+
+ChunkedMesh GenerateBaseSphereMesh(WorkerPool *pool, PlanetParams params);
+Texture2D LoadNoiseTableTexture(void);
+void SetTerrainShaderParams(Shader shader, bool displace, PlanetParams params);
+
+#endif // TERRAIN_H
+
+#ifdef TERRAIN_IMPLEMENTATION
+
+ChunkedMesh GenerateBaseSphereMesh(WorkerPool *pool, PlanetParams params)
+{
+    // No octaves leave the directions times the radius, with the directions as normals
+    params.octaves = 0;
+    params.graph = NULL;
+    params.erosion.droplets = 0;
+    params.erosion.thermalIterations = 0;
+
+    return GeneratePlanetMesh(pool, params);
+}
+
+Texture2D LoadNoiseTableTexture(void)
+{
+    unsigned char randtab[512];
+    unsigned char gradIdx[512];
+    stb_perlin_get_tables(randtab, gradIdx);
+
+    Image image = {
+        .data = RL_MALLOC(512 * 4),
+        .width = 512,
+        .height = 1,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    unsigned char *pixels = image.data;
+
+    for (int i = 0; i < 512; i++) {
+        pixels[i * 4 + 0] = randtab[i];
+        pixels[i * 4 + 1] = gradIdx[i];
+        pixels[i * 4 + 2] = 0;
+        pixels[i * 4 + 3] = 255;
+    }
+
+    // Read with texelFetch, so the filter does not matter
+    Texture2D texture = LoadTextureFromImage(image);
+    UnloadImage(image);
+
+    return texture;
+}
+
+void SetTerrainShaderParams(Shader shader, bool displace, PlanetParams params)
+{
+    int enabled = displace;
+    float bandHeights[PLANET_COLOR_BANDS - 1];
+    Vector4 bandColors[PLANET_COLOR_BANDS];
+
+    for (int i = 0; i < PLANET_COLOR_BANDS; i++) {
+        PlanetColorBand band = GetPlanetColorBand(i);
+        bandColors[i] = ColorNormalize(band.color);
+
+        if (i < PLANET_COLOR_BANDS - 1)
+            bandHeights[i] = band.height;
+    }
+
+    SetShaderValue(shader, GetShaderLocation(shader, "displace"), &enabled, SHADER_UNIFORM_INT);
+    SetShaderValue(shader, GetShaderLocation(shader, "planetRadius"), &params.radius, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, GetShaderLocation(shader, "noiseScale"), &params.scale, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, GetShaderLocation(shader, "lacunarity"), &params.lacunarity, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, GetShaderLocation(shader, "gain"), &params.gain, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, GetShaderLocation(shader, "octaves"), &params.octaves, SHADER_UNIFORM_INT);
+    SetShaderValueV(shader, GetShaderLocation(shader, "bandHeights"), bandHeights, SHADER_UNIFORM_FLOAT, PLANET_COLOR_BANDS - 1);
+    SetShaderValueV(shader, GetShaderLocation(shader, "bandColors"), bandColors, SHADER_UNIFORM_VEC4, PLANET_COLOR_BANDS);
+}
+
+#endif // TERRAIN_IMPLEMENTATION